@@ -0,0 +1,17 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT             (1 << 2)
+#define MALLOC_CAP_DMA              (1 << 3)
+#define MALLOC_CAP_INTERNAL         (1 << 11)
+
+// Reports the free heap of a typical ESP32-S3 build, the host heap itself is not limited
+size_t heap_caps_get_free_size(uint32_t caps);
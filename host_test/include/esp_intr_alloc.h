@@ -0,0 +1,9 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#define ESP_INTR_FLAG_LEVEL1        (1 << 1)
@@ -0,0 +1,37 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// ESP-IDF logging for the host tests, written to stderr in the target's format
+// The level starts at HOST_TEST_LOG_LEVEL from the environment (0 none to 5 verbose),
+// INFO if unset.
+
+#pragma once
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Host tests only: fn sees every message that passes the level filter, formatted
+void host_log_set_hook(void (*fn)(esp_log_level_t level, const char *tag, const char *msg));
+
+#define ESP_LOGE(tag, format, ...)  esp_log_write(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  esp_log_write(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  esp_log_write(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)  esp_log_write(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...)  esp_log_write(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+#define ESP_LOG_BUFFER_HEXDUMP(tag, buffer, buff_len, level)  ((void)(buffer), (void)(buff_len))
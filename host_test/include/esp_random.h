@@ -0,0 +1,12 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Pseudo random, seeded from HOST_TEST_SEED so a failing run can be repeated
+uint32_t esp_random(void);
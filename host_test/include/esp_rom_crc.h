@@ -0,0 +1,12 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Same convention as the ROM function and zlib's crc32(): start with 0, chain the result
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
@@ -0,0 +1,12 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Microseconds since the test started, monotonic
+int64_t esp_timer_get_time(void);
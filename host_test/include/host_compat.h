@@ -0,0 +1,17 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Libc calls newlib has and older glibc lacks, included ahead of every source by the Makefile
+
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+#define HOST_NEEDS_STRLCPY  1
+size_t strlcpy(char *dst, const char *src, size_t size);
+#endif
@@ -0,0 +1,49 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// The ROM miniz inflate API for the host tests, implemented on zlib in shim/miniz_zlib.c
+// Unlike tinfl, zlib stops exactly at the end of the deflate data and leaves the rest of
+// the input unconsumed, so m_num_bits is always 0 when TINFL_STATUS_DONE is returned.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE          32768
+#define TINFL_ARENA_SIZE            (48 * 1024)     // zlib state and window, freed with the decompressor
+
+enum {
+    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+    TINFL_FLAG_HAS_MORE_INPUT = 2,
+    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+    TINFL_FLAG_COMPUTE_ADLER32 = 8,
+};
+
+typedef enum {
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+typedef uint64_t tinfl_bit_buf_t;
+
+typedef struct {
+    uint32_t m_state;
+    uint32_t m_num_bits;
+    tinfl_bit_buf_t m_bit_buf;
+    z_stream zs;
+    size_t arena_used;
+    uint8_t arena[TINFL_ARENA_SIZE];
+} tinfl_decompressor;
+
+#define tinfl_init(r)               do { (r)->m_state = 0; (r)->m_num_bits = 0; (r)->m_bit_buf = 0; } while (0)
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size,
+                              uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size,
+                              const uint32_t decomp_flags);
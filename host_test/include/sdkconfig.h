@@ -0,0 +1,20 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Kconfig values the host tests build with, the defaults of main/Kconfig.projbuild
+
+#pragma once
+
+#define CONFIG_LOG_DEFAULT_LEVEL                    3
+#define CONFIG_PRINTER_BRIDGE_SPOOL_BUDGET_KB       64
+#define CONFIG_PRINTER_BRIDGE_MAX_NET_JOBS          4
+#define CONFIG_PRINTER_BRIDGE_RAW_PORT              9100
+#define CONFIG_PRINTER_BRIDGE_LPD_PORT              515
+#define CONFIG_PRINTER_BRIDGE_IPP_PORT              631
+#define CONFIG_PRINTER_BRIDGE_USBIP_PORT            3240
+#define CONFIG_PRINTER_BRIDGE_WIFI_SSID             ""
+#define CONFIG_PRINTER_BRIDGE_WIFI_PASSWORD         ""
+#define CONFIG_USB_HOST_ENABLE_ENUM_FILTER_CALLBACK 1
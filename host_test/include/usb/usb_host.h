@@ -0,0 +1,291 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// USB host library API for the host tests
+// Types and calls mirror ESP-IDF's usb/usb_host.h, so code that only passes USB types
+// around builds unchanged.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef struct usb_device_handle_s *usb_device_handle_t;
+typedef struct usb_host_client_handle_s *usb_host_client_handle_t;
+
+typedef enum {
+    USB_SPEED_LOW = 0,
+    USB_SPEED_FULL,
+    USB_SPEED_HIGH,
+    USB_SPEED_UNKNOWN,
+} usb_speed_t;
+
+typedef enum {
+    USB_TRANSFER_STATUS_COMPLETED,
+    USB_TRANSFER_STATUS_ERROR,
+    USB_TRANSFER_STATUS_TIMED_OUT,
+    USB_TRANSFER_STATUS_CANCELED,
+    USB_TRANSFER_STATUS_STALL,
+    USB_TRANSFER_STATUS_OVERFLOW,
+    USB_TRANSFER_STATUS_SKIPPED,
+    USB_TRANSFER_STATUS_NO_DEVICE,
+} usb_transfer_status_t;
+
+struct usb_transfer_s;
+typedef void (*usb_transfer_cb_t)(struct usb_transfer_s *transfer);
+
+#define USB_TRANSFER_FLAG_ZERO_PACK     0x01
+
+typedef struct usb_transfer_s {
+    uint8_t *const data_buffer;
+    const size_t data_buffer_size;
+    int num_bytes;
+    int actual_num_bytes;
+    uint32_t flags;
+    usb_device_handle_t device_handle;
+    uint8_t bEndpointAddress;
+    usb_transfer_status_t status;
+    uint32_t timeout_ms;
+    usb_transfer_cb_t callback;
+    void *context;
+    const int num_isoc_packets;
+} usb_transfer_t;
+
+// Chapter 9 descriptors and requests
+typedef struct __attribute__((packed)) {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+} usb_standard_desc_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint16_t bcdUSB;
+    uint8_t bDeviceClass;
+    uint8_t bDeviceSubClass;
+    uint8_t bDeviceProtocol;
+    uint8_t bMaxPacketSize0;
+    uint16_t idVendor;
+    uint16_t idProduct;
+    uint16_t bcdDevice;
+    uint8_t iManufacturer;
+    uint8_t iProduct;
+    uint8_t iSerialNumber;
+    uint8_t bNumConfigurations;
+} usb_device_desc_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint16_t wTotalLength;
+    uint8_t bNumInterfaces;
+    uint8_t bConfigurationValue;
+    uint8_t iConfiguration;
+    uint8_t bmAttributes;
+    uint8_t bMaxPower;
+} usb_config_desc_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bInterfaceNumber;
+    uint8_t bAlternateSetting;
+    uint8_t bNumEndpoints;
+    uint8_t bInterfaceClass;
+    uint8_t bInterfaceSubClass;
+    uint8_t bInterfaceProtocol;
+    uint8_t iInterface;
+} usb_intf_desc_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bEndpointAddress;
+    uint8_t bmAttributes;
+    uint16_t wMaxPacketSize;
+    uint8_t bInterval;
+} usb_ep_desc_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint16_t wData[];
+} usb_str_desc_t;
+
+typedef union {
+    struct __attribute__((packed)) {
+        uint8_t bmRequestType;
+        uint8_t bRequest;
+        uint16_t wValue;
+        uint16_t wIndex;
+        uint16_t wLength;
+    };
+    uint8_t val[8];
+} usb_setup_packet_t;
+
+#define USB_SETUP_PACKET_SIZE                   8
+#define USB_BM_REQUEST_TYPE_DIR_OUT             (0 << 7)
+#define USB_BM_REQUEST_TYPE_DIR_IN              (1 << 7)
+#define USB_BM_REQUEST_TYPE_TYPE_STANDARD       (0 << 5)
+#define USB_BM_REQUEST_TYPE_TYPE_CLASS          (1 << 5)
+#define USB_BM_REQUEST_TYPE_TYPE_VENDOR         (2 << 5)
+#define USB_BM_REQUEST_TYPE_RECIP_DEVICE        0
+#define USB_BM_REQUEST_TYPE_RECIP_INTERFACE     1
+#define USB_BM_REQUEST_TYPE_RECIP_ENDPOINT      2
+#define USB_B_REQUEST_GET_STATUS                0x00
+#define USB_B_REQUEST_CLEAR_FEATURE             0x01
+#define USB_B_REQUEST_SET_FEATURE               0x03
+#define USB_B_REQUEST_SET_ADDRESS               0x05
+#define USB_B_REQUEST_GET_DESCRIPTOR            0x06
+#define USB_B_REQUEST_GET_CONFIGURATION         0x08
+#define USB_B_REQUEST_SET_CONFIGURATION         0x09
+#define USB_B_REQUEST_GET_INTERFACE             0x0A
+#define USB_B_REQUEST_SET_INTERFACE             0x0B
+#define USB_W_VALUE_FEATURE_ENDPOINT_HALT       0x0000
+#define USB_B_DESCRIPTOR_TYPE_DEVICE            0x01
+#define USB_B_DESCRIPTOR_TYPE_CONFIGURATION     0x02
+#define USB_B_DESCRIPTOR_TYPE_STRING            0x03
+#define USB_B_DESCRIPTOR_TYPE_INTERFACE         0x04
+#define USB_B_DESCRIPTOR_TYPE_ENDPOINT          0x05
+
+#define USB_SETUP_PACKET_INIT_SET_INTERFACE(setup_pkt_ptr, intf_num, alt_setting_num) ({        \
+        (setup_pkt_ptr)->bmRequestType = USB_BM_REQUEST_TYPE_DIR_OUT | USB_BM_REQUEST_TYPE_TYPE_STANDARD \
+                                         | USB_BM_REQUEST_TYPE_RECIP_INTERFACE;                   \
+        (setup_pkt_ptr)->bRequest = USB_B_REQUEST_SET_INTERFACE;                                 \
+        (setup_pkt_ptr)->wValue = (alt_setting_num);                                            \
+        (setup_pkt_ptr)->wIndex = (intf_num);                                                   \
+        (setup_pkt_ptr)->wLength = 0;                                                           \
+    })
+
+#define USB_CLASS_PER_INTERFACE                 0x00
+#define USB_CLASS_AUDIO                         0x01
+#define USB_CLASS_COMM                          0x02
+#define USB_CLASS_HID                           0x03
+#define USB_CLASS_MASS_STORAGE                  0x08
+#define USB_CLASS_HUB                           0x09
+#define USB_CLASS_MISC                          0xEF
+#define USB_CLASS_APP_SPEC                      0xFE
+#define USB_CLASS_VENDOR_SPEC                   0xFF
+
+#define USB_BM_ATTRIBUTES_XFERTYPE_MASK         0x03
+#define USB_BM_ATTRIBUTES_XFER_CONTROL          0x00
+#define USB_BM_ATTRIBUTES_XFER_ISOC             0x01
+#define USB_BM_ATTRIBUTES_XFER_BULK             0x02
+#define USB_BM_ATTRIBUTES_XFER_INT              0x03
+#define USB_B_ENDPOINT_ADDRESS_EP_NUM_MASK      0x0F
+#define USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK      0x80
+#define USB_EP_DESC_GET_MPS(desc_ptr)           ((desc_ptr)->wMaxPacketSize & 0x7FF)
+#define USB_EP_DESC_GET_EP_DIR(desc_ptr)        (((desc_ptr)->bEndpointAddress & 0x80) ? 1 : 0)
+
+// Host library
+typedef struct {
+    usb_speed_t speed;
+    struct {
+        usb_device_handle_t dev_hdl;
+        uint8_t port_num;
+    } parent;
+    uint8_t dev_addr;
+    uint8_t bMaxPacketSize0;
+    uint8_t bConfigurationValue;
+    const usb_str_desc_t *str_desc_manufacturer;
+    const usb_str_desc_t *str_desc_product;
+    const usb_str_desc_t *str_desc_serial_num;
+} usb_device_info_t;
+
+typedef enum {
+    USB_HOST_CLIENT_EVENT_NEW_DEV = 0,
+    USB_HOST_CLIENT_EVENT_DEV_GONE,
+} usb_host_client_event_t;
+
+typedef struct {
+    usb_host_client_event_t event;
+    union {
+        struct {
+            uint8_t address;
+        } new_dev;
+        struct {
+            usb_device_handle_t dev_hdl;
+        } dev_gone;
+    };
+} usb_host_client_event_msg_t;
+
+typedef void (*usb_host_client_event_cb_t)(const usb_host_client_event_msg_t *event_msg, void *arg);
+
+typedef struct {
+    bool is_synchronous;
+    int max_num_event_msg;
+    union {
+        struct {
+            usb_host_client_event_cb_t client_event_callback;
+            void *callback_arg;
+        } async;
+    };
+} usb_host_client_config_t;
+
+typedef bool (*usb_host_enum_filter_cb_t)(const usb_device_desc_t *dev_desc, uint8_t *bConfigurationValue);
+
+typedef struct {
+    bool skip_phy_setup;
+    bool root_port_unpowered;
+    int intr_flags;
+    usb_host_enum_filter_cb_t enum_filter_cb;
+} usb_host_config_t;
+
+#define USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS     0x01
+#define USB_HOST_LIB_EVENT_FLAGS_ALL_FREE       0x02
+
+esp_err_t usb_host_install(const usb_host_config_t *config);
+esp_err_t usb_host_uninstall(void);
+esp_err_t usb_host_lib_handle_events(TickType_t timeout_ticks, uint32_t *event_flags_ret);
+esp_err_t usb_host_lib_unblock(void);
+esp_err_t usb_host_lib_set_root_port_power(bool enable);
+esp_err_t usb_host_device_free_all(void);
+
+esp_err_t usb_host_client_register(const usb_host_client_config_t *client_config, usb_host_client_handle_t *client_hdl_ret);
+esp_err_t usb_host_client_deregister(usb_host_client_handle_t client_hdl);
+esp_err_t usb_host_client_handle_events(usb_host_client_handle_t client_hdl, TickType_t timeout_ticks);
+esp_err_t usb_host_client_unblock(usb_host_client_handle_t client_hdl);
+
+esp_err_t usb_host_device_open(usb_host_client_handle_t client_hdl, uint8_t dev_addr, usb_device_handle_t *dev_hdl_ret);
+esp_err_t usb_host_device_close(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl);
+esp_err_t usb_host_device_info(usb_device_handle_t dev_hdl, usb_device_info_t *dev_info);
+esp_err_t usb_host_get_device_descriptor(usb_device_handle_t dev_hdl, const usb_device_desc_t **device_desc);
+esp_err_t usb_host_get_active_config_descriptor(usb_device_handle_t dev_hdl, const usb_config_desc_t **config_desc);
+
+esp_err_t usb_host_interface_claim(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                   uint8_t bInterfaceNumber, uint8_t bAlternateSetting);
+esp_err_t usb_host_interface_release(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                     uint8_t bInterfaceNumber);
+esp_err_t usb_host_endpoint_halt(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress);
+esp_err_t usb_host_endpoint_flush(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress);
+esp_err_t usb_host_endpoint_clear(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress);
+
+esp_err_t usb_host_transfer_alloc(size_t data_buffer_size, int num_isoc_packets, usb_transfer_t **transfer);
+esp_err_t usb_host_transfer_free(usb_transfer_t *transfer);
+esp_err_t usb_host_transfer_submit(usb_transfer_t *transfer);
+esp_err_t usb_host_transfer_submit_control(usb_host_client_handle_t client_hdl, usb_transfer_t *transfer);
+
+// Descriptor parsing, as in usb/usb_helpers.h
+const usb_standard_desc_t *usb_parse_next_descriptor(const usb_standard_desc_t *cur_desc, uint16_t wTotalLength,
+                                                     int *offset);
+const usb_standard_desc_t *usb_parse_next_descriptor_of_type(const usb_standard_desc_t *cur_desc, uint16_t wTotalLength,
+                                                             uint8_t bDescriptorType, int *offset);
+int usb_parse_interface_number_of_alternate(const usb_config_desc_t *config_desc, uint8_t bInterfaceNumber);
+const usb_intf_desc_t *usb_parse_interface_descriptor(const usb_config_desc_t *config_desc, uint8_t bInterfaceNumber,
+                                                      uint8_t bAlternateSetting, int *offset);
+const usb_ep_desc_t *usb_parse_endpoint_descriptor_by_index(const usb_intf_desc_t *intf_desc, int index,
+                                                            uint16_t wTotalLength, int *offset);
+const usb_ep_desc_t *usb_parse_endpoint_descriptor_by_address(const usb_config_desc_t *config_desc,
+                                                              uint8_t bInterfaceNumber, uint8_t bAlternateSetting,
+                                                              uint8_t bEndpointAddress, int *offset);
+
+typedef void (*print_class_descriptor_cb)(const usb_standard_desc_t *);
+void usb_print_device_descriptor(const usb_device_desc_t *devc_desc);
+void usb_print_config_descriptor(const usb_config_desc_t *cfg_desc, print_class_descriptor_cb class_specific_cb);
+void usb_print_string_descriptor(const usb_str_desc_t *str_desc);
@@ -0,0 +1,151 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// USB printer on the mock USB host, see mock_printer.h
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "esp_timer.h"
+#include "mock_printer.h"
+#include "test_util.h"
+
+#define PRINTER_REQ_GET_DEVICE_ID       0x00
+#define PRINTER_REQ_GET_PORT_STATUS     0x01
+#define PRINTER_PORT_STATUS_OK          0x18    // Selected, no error
+
+struct mock_printer {
+    mock_printer_config_t config;
+    mock_device_config_t dev_config;
+    usb_device_desc_t dev_desc;
+    uint8_t config_desc[32];
+    mock_device_t *dev;
+    pthread_mutex_t lock;
+    mock_printer_stats_t stats;
+};
+
+static void mock_printer_bulk_out(void *ctx, uint8_t ep, const uint8_t *data, size_t len) {
+    mock_printer_t *printer = ctx;
+    int64_t now = esp_timer_get_time();
+    pthread_mutex_lock(&printer->lock);
+    if (printer->config.check_pattern) {
+        for (size_t i = 0; i < len; i++) {
+            if (data[i] != test_pattern(printer->stats.bytes + i)) {
+                printer->stats.mismatches++;
+            }
+        }
+    }
+    if (printer->stats.first_byte_us == 0 && len > 0) {
+        printer->stats.first_byte_us = now;
+    }
+    if (len > 0) {
+        printer->stats.last_byte_us = now;
+    }
+    printer->stats.bytes += len;
+    pthread_mutex_unlock(&printer->lock);
+}
+
+static int mock_printer_bulk_in(void *ctx, uint8_t ep, uint8_t *data, size_t max_len) {
+    // Nothing to report
+    return -1;
+}
+
+static int mock_printer_control(void *ctx, const usb_setup_packet_t *setup, uint8_t *data) {
+    mock_printer_t *printer = ctx;
+    if ((setup->bmRequestType & 0x60) != USB_BM_REQUEST_TYPE_TYPE_CLASS) {
+        return -1;
+    }
+    switch (setup->bRequest) {
+    case PRINTER_REQ_GET_DEVICE_ID: {
+        const char *id = printer->config.device_id != NULL ? printer->config.device_id : "";
+        size_t len = 2 + strlen(id);
+        data[0] = len >> 8;
+        data[1] = len & 0xFF;
+        if (len > setup->wLength) {
+            len = setup->wLength;
+        }
+        memcpy(&data[2], id, len > 2 ? len - 2 : 0);
+        return len;
+    }
+    case PRINTER_REQ_GET_PORT_STATUS:
+        data[0] = PRINTER_PORT_STATUS_OK;
+        return 1;
+    default:
+        return -1;
+    }
+}
+
+mock_printer_t *mock_printer_attach(const mock_printer_config_t *config) {
+    mock_printer_t *printer = calloc(1, sizeof(mock_printer_t));
+    TEST_ASSERT(printer != NULL);
+    printer->config = *config;
+    pthread_mutex_init(&printer->lock, NULL);
+
+    printer->dev_desc = (usb_device_desc_t) {
+        .bLength = sizeof(usb_device_desc_t),
+        .bDescriptorType = USB_B_DESCRIPTOR_TYPE_DEVICE,
+        .bcdUSB = 0x0200,
+        .bMaxPacketSize0 = 64,
+        .idVendor = config->vid,
+        .idProduct = config->pid,
+        .bcdDevice = 0x0100,
+        .iManufacturer = 1,
+        .iProduct = 2,
+        .iSerialNumber = config->serial != NULL ? 3 : 0,
+        .bNumConfigurations = 1,
+    };
+    const uint8_t config_desc[] = {
+        // Configuration
+        9, USB_B_DESCRIPTOR_TYPE_CONFIGURATION, sizeof(printer->config_desc), 0, 1, 1, 0, 0xC0, 1,
+        // Printer interface
+        9, USB_B_DESCRIPTOR_TYPE_INTERFACE, 0, 0, 2, 0x07, 0x01, config->protocol != 0 ? config->protocol : 0x02, 0,
+        // Bulk OUT and IN, full speed
+        7, USB_B_DESCRIPTOR_TYPE_ENDPOINT, MOCK_PRINTER_EP_OUT, USB_BM_ATTRIBUTES_XFER_BULK, 64, 0, 0,
+        7, USB_B_DESCRIPTOR_TYPE_ENDPOINT, MOCK_PRINTER_EP_IN, USB_BM_ATTRIBUTES_XFER_BULK, 64, 0, 0,
+    };
+    _Static_assert(sizeof(config_desc) == sizeof(printer->config_desc), "config descriptor size");
+    memcpy(printer->config_desc, config_desc, sizeof(config_desc));
+
+    printer->dev_config = (mock_device_config_t) {
+        .dev_desc = &printer->dev_desc,
+        .config_desc = printer->config_desc,
+        .manufacturer = "Mock",
+        .product = "Printer",
+        .serial = config->serial,
+        .port_num = config->port_num,
+        .bulk_out_bytes_per_ms = config->bytes_per_ms,
+        .ops = {
+            .bulk_out = mock_printer_bulk_out,
+            .bulk_in = mock_printer_bulk_in,
+            .control = mock_printer_control,
+            .ctx = printer,
+        },
+    };
+    printer->dev = mock_usb_attach(&printer->dev_config);
+    TEST_ASSERT(printer->dev != NULL);
+    return printer;
+}
+
+// The printer stays allocated, the host side may still hold its handle
+void mock_printer_detach(mock_printer_t *printer) {
+    mock_usb_detach(printer->dev);
+}
+
+void mock_printer_get_stats(mock_printer_t *printer, mock_printer_stats_t *stats) {
+    pthread_mutex_lock(&printer->lock);
+    *stats = printer->stats;
+    pthread_mutex_unlock(&printer->lock);
+}
+
+void mock_printer_reset_stats(mock_printer_t *printer) {
+    pthread_mutex_lock(&printer->lock);
+    memset(&printer->stats, 0, sizeof(printer->stats));
+    pthread_mutex_unlock(&printer->lock);
+}
+
+mock_device_t *mock_printer_device(mock_printer_t *printer) {
+    return printer->dev;
+}
@@ -0,0 +1,45 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// USB printer on the mock USB host
+// One printer class interface with bulk OUT 0x01 and bulk IN 0x81. It takes print data at
+// the configured rate, answers GET_DEVICE_ID and GET_PORT_STATUS and NAKs bulk IN reads.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "mock_usb_host.h"
+
+#define MOCK_PRINTER_EP_OUT         0x01
+#define MOCK_PRINTER_EP_IN          0x81
+
+typedef struct {
+    uint16_t vid;
+    uint16_t pid;
+    const char *serial;                     // NULL for a printer without serial number
+    const char *device_id;                  // IEEE 1284 Device ID
+    uint8_t protocol;                       // Printer interface protocol, bidirectional if 0
+    uint8_t port_num;
+    uint32_t bytes_per_ms;                  // 0 for no limit
+    bool check_pattern;                     // Count bytes that don't follow test_pattern()
+} mock_printer_config_t;
+
+typedef struct {
+    size_t bytes;                           // Bulk OUT data taken
+    size_t mismatches;
+    int64_t first_byte_us;                  // esp_timer time of the first and last data, 0 if none yet
+    int64_t last_byte_us;
+} mock_printer_stats_t;
+
+typedef struct mock_printer mock_printer_t;
+
+mock_printer_t *mock_printer_attach(const mock_printer_config_t *config);
+void mock_printer_detach(mock_printer_t *printer);
+void mock_printer_get_stats(mock_printer_t *printer, mock_printer_stats_t *stats);
+void mock_printer_reset_stats(mock_printer_t *printer);
+mock_device_t *mock_printer_device(mock_printer_t *printer);
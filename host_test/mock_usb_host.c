@@ -0,0 +1,895 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// USB host library on the host, see mock_usb_host.h
+// One lock guards everything. Each endpoint a transfer was submitted to gets a thread that
+// works through its queue, completed transfers go to the client that claimed the interface
+// (or submitted the control transfer) and their callbacks run in its handle_events call.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "freertos/FreeRTOS.h"
+#include "mock_usb_host.h"
+
+#define MOCK_MAX_CLIENTS        4
+#define MOCK_MAX_INTF           8
+#define MOCK_NUM_EPS            32          // Index is the endpoint number, plus 16 for IN
+#define MOCK_EVENT_QUEUE_LEN    64
+#define MOCK_CHUNK_SIZE         512         // Bulk OUT data goes to the device in pieces this big
+#define MOCK_NAK_RETRY_US       1000
+
+typedef struct mock_transfer {
+    usb_transfer_t transfer;                // First, the code under test only sees this
+    struct mock_transfer *next;
+    usb_host_client_handle_t client;        // Gets the callback
+    bool in_flight;
+} mock_transfer_t;
+
+struct usb_host_client_handle_s {
+    usb_host_client_config_t config;
+    usb_host_client_event_msg_t events[MOCK_EVENT_QUEUE_LEN];
+    int event_head;
+    int event_count;
+    mock_transfer_t *done_head;
+    mock_transfer_t *done_tail;
+    bool unblocked;
+    pthread_cond_t cond;
+};
+
+typedef struct {
+    struct usb_device_handle_s *dev;
+    uint8_t address;
+    mock_transfer_t *head;                  // Queue, the head is the one being worked on
+    mock_transfer_t *tail;
+    bool halted;
+    bool busy;                              // Thread works on the head without the lock
+    bool thread_running;
+    pthread_cond_t cond;
+} mock_ep_t;
+
+struct usb_device_handle_s {
+    mock_device_config_t config;
+    uint8_t address;
+    bool gone;
+    bool released;                          // Gone and closed by everyone
+    int open_count[MOCK_MAX_CLIENTS];
+    usb_host_client_handle_t intf_owner[MOCK_MAX_INTF];
+    uint8_t intf_alt[MOCK_MAX_INTF];
+    mock_ep_t ep[MOCK_NUM_EPS];
+    usb_str_desc_t *str[3];                 // Manufacturer, product, serial
+};
+
+static pthread_mutex_t mock_lock = PTHREAD_MUTEX_INITIALIZER;
+static usb_host_client_handle_t clients[MOCK_MAX_CLIENTS];
+static mock_device_t *devices[128];         // By address
+static mock_usb_stats_t stats;
+
+static void mock_misuse(const char *what) {
+    fprintf(stderr, "mock usb: misuse: %s\n", what);
+    stats.misuse++;
+}
+
+static int mock_client_index(usb_host_client_handle_t client) {
+    for (int i = 0; i < MOCK_MAX_CLIENTS; i++) {
+        if (clients[i] == client && client != NULL) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void mock_post_event(usb_host_client_handle_t client, const usb_host_client_event_msg_t *msg) {
+    if (client->event_count == MOCK_EVENT_QUEUE_LEN) {
+        mock_misuse("client event queue overflow");
+        return;
+    }
+    client->events[(client->event_head + client->event_count) % MOCK_EVENT_QUEUE_LEN] = *msg;
+    client->event_count++;
+    pthread_cond_broadcast(&client->cond);
+}
+
+// Hands a transfer back to its client, called with mock_lock held
+static void mock_complete(mock_transfer_t *t, usb_transfer_status_t status) {
+    t->transfer.status = status;
+    t->in_flight = false;
+    t->next = NULL;
+    stats.transfers_in_flight--;
+    usb_host_client_handle_t client = t->client;
+    if (client->done_tail != NULL) {
+        client->done_tail->next = t;
+    } else {
+        client->done_head = t;
+    }
+    client->done_tail = t;
+    pthread_cond_broadcast(&client->cond);
+}
+
+static mock_transfer_t *mock_ep_pop(mock_ep_t *ep) {
+    mock_transfer_t *t = ep->head;
+    ep->head = t->next;
+    if (ep->head == NULL) {
+        ep->tail = NULL;
+    }
+    return t;
+}
+
+static void mock_ep_cancel_all(mock_ep_t *ep, usb_transfer_status_t status) {
+    while (ep->head != NULL) {
+        mock_complete(mock_ep_pop(ep), status);
+    }
+}
+
+static void mock_sleep_us(int64_t us) {
+    struct timespec ts = {
+        .tv_sec = us / 1000000,
+        .tv_nsec = (us % 1000000) * 1000,
+    };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+// Works through the queue of one bulk endpoint until the device goes away
+static void *mock_ep_thread(void *arg) {
+    mock_ep_t *ep = arg;
+    mock_device_t *dev = ep->dev;
+    bool in = ep->address & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK;
+
+    pthread_mutex_lock(&mock_lock);
+    while (1) {
+        while (!dev->gone && (ep->head == NULL || ep->halted)) {
+            pthread_cond_wait(&ep->cond, &mock_lock);
+        }
+        if (dev->gone) {
+            break;
+        }
+        usb_transfer_t *transfer = &ep->head->transfer;
+        ep->busy = true;
+        if (in) {
+            pthread_mutex_unlock(&mock_lock);
+            int len = dev->config.ops.bulk_in != NULL
+                      ? dev->config.ops.bulk_in(dev->config.ops.ctx, ep->address, transfer->data_buffer,
+                                                transfer->num_bytes)
+                      : -1;
+            if (len < 0) {
+                mock_sleep_us(MOCK_NAK_RETRY_US);
+            }
+            pthread_mutex_lock(&mock_lock);
+            if (len >= 0) {
+                transfer->actual_num_bytes = len;
+                mock_complete(mock_ep_pop(ep), USB_TRANSFER_STATUS_COMPLETED);
+            }
+        } else {
+            // A halt stops the transfer between packets, actual_num_bytes tells how far it got
+            transfer->actual_num_bytes = 0;
+            while (transfer->actual_num_bytes < transfer->num_bytes && !ep->halted && !dev->gone) {
+                int chunk = transfer->num_bytes - transfer->actual_num_bytes;
+                if (chunk > MOCK_CHUNK_SIZE) {
+                    chunk = MOCK_CHUNK_SIZE;
+                }
+                uint32_t rate = dev->config.bulk_out_bytes_per_ms;
+                pthread_mutex_unlock(&mock_lock);
+                if (rate != 0) {
+                    mock_sleep_us((int64_t)chunk * 1000 / rate);
+                }
+                if (dev->config.ops.bulk_out != NULL) {
+                    dev->config.ops.bulk_out(dev->config.ops.ctx, ep->address,
+                                             &transfer->data_buffer[transfer->actual_num_bytes], chunk);
+                }
+                pthread_mutex_lock(&mock_lock);
+                transfer->actual_num_bytes += chunk;
+            }
+            if (transfer->actual_num_bytes == transfer->num_bytes) {
+                mock_complete(mock_ep_pop(ep), USB_TRANSFER_STATUS_COMPLETED);
+            }
+        }
+        ep->busy = false;
+        pthread_cond_broadcast(&ep->cond);
+    }
+    mock_ep_cancel_all(ep, USB_TRANSFER_STATUS_NO_DEVICE);
+    ep->thread_running = false;
+    pthread_cond_broadcast(&ep->cond);
+    pthread_mutex_unlock(&mock_lock);
+    return NULL;
+}
+
+// Device lookups, called with mock_lock held
+
+static mock_ep_t *mock_ep_get(mock_device_t *dev, uint8_t address) {
+    return &dev->ep[(address & USB_B_ENDPOINT_ADDRESS_EP_NUM_MASK)
+                    + ((address & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK) ? 16 : 0)];
+}
+
+static const usb_config_desc_t *mock_config(const mock_device_t *dev) {
+    return (const usb_config_desc_t *)dev->config.config_desc;
+}
+
+// Interface the endpoint belongs to in the selected alternate settings, -1 if none
+static int mock_ep_interface(const mock_device_t *dev, uint8_t address) {
+    const usb_config_desc_t *config = mock_config(dev);
+    const uint8_t *p = dev->config.config_desc;
+    const usb_intf_desc_t *intf = NULL;
+    for (int offset = 0; offset + 2 <= config->wTotalLength && p[offset] >= 2; offset += p[offset]) {
+        if (p[offset + 1] == USB_B_DESCRIPTOR_TYPE_INTERFACE) {
+            intf = (const usb_intf_desc_t *)&p[offset];
+        } else if (p[offset + 1] == USB_B_DESCRIPTOR_TYPE_ENDPOINT && intf != NULL
+                   && intf->bInterfaceNumber < MOCK_MAX_INTF
+                   && intf->bAlternateSetting == dev->intf_alt[intf->bInterfaceNumber]
+                   && ((const usb_ep_desc_t *)&p[offset])->bEndpointAddress == address) {
+            return intf->bInterfaceNumber;
+        }
+    }
+    return -1;
+}
+
+static bool mock_device_usable(const mock_device_t *dev) {
+    return dev != NULL && !dev->released;
+}
+
+// Devices
+
+static usb_str_desc_t *mock_str_desc(const char *str) {
+    if (str == NULL) {
+        return NULL;
+    }
+    size_t len = strlen(str);
+    usb_str_desc_t *desc = malloc(2 + 2 * len);
+    desc->bLength = 2 + 2 * len;
+    desc->bDescriptorType = USB_B_DESCRIPTOR_TYPE_STRING;
+    for (size_t i = 0; i < len; i++) {
+        desc->wData[i] = (uint8_t)str[i];
+    }
+    return desc;
+}
+
+mock_device_t *mock_usb_attach(const mock_device_config_t *config) {
+    mock_device_t *dev = calloc(1, sizeof(mock_device_t));
+    dev->config = *config;
+    dev->str[0] = mock_str_desc(config->manufacturer);
+    dev->str[1] = mock_str_desc(config->product);
+    dev->str[2] = mock_str_desc(config->serial);
+    for (int i = 0; i < MOCK_NUM_EPS; i++) {
+        dev->ep[i].dev = dev;
+        dev->ep[i].address = (i & 0x0F) | (i >= 16 ? USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK : 0);
+        pthread_cond_init(&dev->ep[i].cond, NULL);
+    }
+
+    pthread_mutex_lock(&mock_lock);
+    for (int addr = 1; addr < 128 && dev->address == 0; addr++) {
+        if (devices[addr] == NULL) {
+            dev->address = addr;
+            devices[addr] = dev;
+        }
+    }
+    if (dev->address == 0) {
+        pthread_mutex_unlock(&mock_lock);
+        free(dev);
+        return NULL;
+    }
+    stats.devices++;
+    usb_host_client_event_msg_t msg = {
+        .event = USB_HOST_CLIENT_EVENT_NEW_DEV,
+        .new_dev.address = dev->address,
+    };
+    for (int i = 0; i < MOCK_MAX_CLIENTS; i++) {
+        if (clients[i] != NULL) {
+            mock_post_event(clients[i], &msg);
+        }
+    }
+    pthread_mutex_unlock(&mock_lock);
+    return dev;
+}
+
+// Frees the address of a device that is gone and closed, called with mock_lock held
+static void mock_device_check_released(mock_device_t *dev) {
+    for (int i = 0; i < MOCK_MAX_CLIENTS; i++) {
+        if (dev->open_count[i] > 0) {
+            return;
+        }
+    }
+    dev->released = true;
+    devices[dev->address] = NULL;
+    stats.devices--;
+    // The device stays allocated, tests may still look at it
+}
+
+void mock_usb_detach(mock_device_t *dev) {
+    pthread_mutex_lock(&mock_lock);
+    if (dev->gone) {
+        pthread_mutex_unlock(&mock_lock);
+        return;
+    }
+    dev->gone = true;
+    for (int i = 0; i < MOCK_NUM_EPS; i++) {
+        if (!dev->ep[i].thread_running) {
+            mock_ep_cancel_all(&dev->ep[i], USB_TRANSFER_STATUS_NO_DEVICE);
+        }
+        pthread_cond_broadcast(&dev->ep[i].cond);
+    }
+    usb_host_client_event_msg_t msg = {
+        .event = USB_HOST_CLIENT_EVENT_DEV_GONE,
+        .dev_gone.dev_hdl = dev,
+    };
+    for (int i = 0; i < MOCK_MAX_CLIENTS; i++) {
+        if (clients[i] != NULL && dev->open_count[i] > 0) {
+            mock_post_event(clients[i], &msg);
+        }
+    }
+    mock_device_check_released(dev);
+    pthread_mutex_unlock(&mock_lock);
+}
+
+uint8_t mock_usb_address(const mock_device_t *dev) {
+    return dev->address;
+}
+
+void mock_usb_get_stats(mock_usb_stats_t *stats_ret) {
+    pthread_mutex_lock(&mock_lock);
+    *stats_ret = stats;
+    pthread_mutex_unlock(&mock_lock);
+}
+
+// Host library
+
+esp_err_t usb_host_lib_unblock(void) {
+    return ESP_OK;
+}
+
+esp_err_t usb_host_lib_set_root_port_power(bool enable) {
+    // Port power cycles don't reach the mock devices
+    return ESP_OK;
+}
+
+// Clients
+
+esp_err_t usb_host_client_register(const usb_host_client_config_t *client_config, usb_host_client_handle_t *client_hdl_ret) {
+    usb_host_client_handle_t client = calloc(1, sizeof(struct usb_host_client_handle_s));
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    client->config = *client_config;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&client->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_mutex_lock(&mock_lock);
+    int index = -1;
+    for (int i = 0; i < MOCK_MAX_CLIENTS && index < 0; i++) {
+        if (clients[i] == NULL) {
+            index = i;
+        }
+    }
+    if (index < 0) {
+        pthread_mutex_unlock(&mock_lock);
+        free(client);
+        return ESP_ERR_NO_MEM;
+    }
+    clients[index] = client;
+    stats.clients++;
+    pthread_mutex_unlock(&mock_lock);
+    *client_hdl_ret = client;
+    return ESP_OK;
+}
+
+esp_err_t usb_host_client_deregister(usb_host_client_handle_t client_hdl) {
+    pthread_mutex_lock(&mock_lock);
+    int index = mock_client_index(client_hdl);
+    for (int addr = 1; addr < 128 && index >= 0; addr++) {
+        if (devices[addr] != NULL && devices[addr]->open_count[index] > 0) {
+            mock_misuse("client deregistered with devices open");
+            pthread_mutex_unlock(&mock_lock);
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    if (index < 0) {
+        pthread_mutex_unlock(&mock_lock);
+        return ESP_ERR_INVALID_ARG;
+    }
+    clients[index] = NULL;
+    stats.clients--;
+    pthread_mutex_unlock(&mock_lock);
+    return ESP_OK;
+}
+
+esp_err_t usb_host_client_handle_events(usb_host_client_handle_t client_hdl, TickType_t timeout_ticks) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ticks / 1000;
+    deadline.tv_nsec += (long)(timeout_ticks % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&mock_lock);
+    while (!client_hdl->unblocked && client_hdl->event_count == 0 && client_hdl->done_head == NULL) {
+        if (timeout_ticks == portMAX_DELAY) {
+            pthread_cond_wait(&client_hdl->cond, &mock_lock);
+        } else if (timeout_ticks == 0
+                   || pthread_cond_timedwait(&client_hdl->cond, &mock_lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    bool woken = client_hdl->unblocked || client_hdl->event_count > 0 || client_hdl->done_head != NULL;
+    client_hdl->unblocked = false;
+    usb_host_client_event_msg_t events[MOCK_EVENT_QUEUE_LEN];
+    int num_events = client_hdl->event_count;
+    for (int i = 0; i < num_events; i++) {
+        events[i] = client_hdl->events[(client_hdl->event_head + i) % MOCK_EVENT_QUEUE_LEN];
+    }
+    client_hdl->event_head = (client_hdl->event_head + num_events) % MOCK_EVENT_QUEUE_LEN;
+    client_hdl->event_count = 0;
+    mock_transfer_t *done = client_hdl->done_head;
+    client_hdl->done_head = NULL;
+    client_hdl->done_tail = NULL;
+    pthread_mutex_unlock(&mock_lock);
+
+    // Callbacks may submit again, the transfer is off the list before its callback runs
+    for (int i = 0; i < num_events; i++) {
+        client_hdl->config.async.client_event_callback(&events[i], client_hdl->config.async.callback_arg);
+    }
+    while (done != NULL) {
+        mock_transfer_t *next = done->next;
+        done->transfer.callback(&done->transfer);
+        done = next;
+    }
+    return woken ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t usb_host_client_unblock(usb_host_client_handle_t client_hdl) {
+    pthread_mutex_lock(&mock_lock);
+    client_hdl->unblocked = true;
+    pthread_cond_broadcast(&client_hdl->cond);
+    pthread_mutex_unlock(&mock_lock);
+    return ESP_OK;
+}
+
+// Device handles
+
+esp_err_t usb_host_device_open(usb_host_client_handle_t client_hdl, uint8_t dev_addr, usb_device_handle_t *dev_hdl_ret) {
+    pthread_mutex_lock(&mock_lock);
+    int index = mock_client_index(client_hdl);
+    mock_device_t *dev = dev_addr < 128 ? devices[dev_addr] : NULL;
+    if (index < 0 || dev == NULL || dev->gone) {
+        pthread_mutex_unlock(&mock_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    dev->open_count[index]++;
+    stats.open_handles++;
+    pthread_mutex_unlock(&mock_lock);
+    *dev_hdl_ret = dev;
+    return ESP_OK;
+}
+
+esp_err_t usb_host_device_close(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl) {
+    pthread_mutex_lock(&mock_lock);
+    int index = mock_client_index(client_hdl);
+    esp_err_t ret = ESP_OK;
+    if (index < 0 || !mock_device_usable(dev_hdl) || dev_hdl->open_count[index] == 0) {
+        mock_misuse("close of a device the client has not open");
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < MOCK_MAX_INTF && ret == ESP_OK; i++) {
+        if (dev_hdl->intf_owner[i] == client_hdl) {
+            mock_misuse("close with an interface still claimed");
+            ret = ESP_ERR_INVALID_STATE;
+        }
+    }
+    if (ret == ESP_OK) {
+        dev_hdl->open_count[index]--;
+        stats.open_handles--;
+        if (dev_hdl->gone) {
+            mock_device_check_released(dev_hdl);
+        }
+    }
+    pthread_mutex_unlock(&mock_lock);
+    return ret;
+}
+
+esp_err_t usb_host_device_info(usb_device_handle_t dev_hdl, usb_device_info_t *dev_info) {
+    pthread_mutex_lock(&mock_lock);
+    if (!mock_device_usable(dev_hdl)) {
+        mock_misuse("info of a released device");
+        pthread_mutex_unlock(&mock_lock);
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(dev_info, 0, sizeof(usb_device_info_t));
+    dev_info->speed = USB_SPEED_FULL;
+    dev_info->parent.port_num = dev_hdl->config.port_num;
+    dev_info->dev_addr = dev_hdl->address;
+    dev_info->bMaxPacketSize0 = dev_hdl->config.dev_desc->bMaxPacketSize0;
+    dev_info->bConfigurationValue = mock_config(dev_hdl)->bConfigurationValue;
+    dev_info->str_desc_manufacturer = dev_hdl->str[0];
+    dev_info->str_desc_product = dev_hdl->str[1];
+    dev_info->str_desc_serial_num = dev_hdl->str[2];
+    pthread_mutex_unlock(&mock_lock);
+    return ESP_OK;
+}
+
+esp_err_t usb_host_get_device_descriptor(usb_device_handle_t dev_hdl, const usb_device_desc_t **device_desc) {
+    *device_desc = dev_hdl->config.dev_desc;
+    return ESP_OK;
+}
+
+esp_err_t usb_host_get_active_config_descriptor(usb_device_handle_t dev_hdl, const usb_config_desc_t **config_desc) {
+    *config_desc = mock_config(dev_hdl);
+    return ESP_OK;
+}
+
+// Interfaces and endpoints
+
+esp_err_t usb_host_interface_claim(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                   uint8_t bInterfaceNumber, uint8_t bAlternateSetting) {
+    pthread_mutex_lock(&mock_lock);
+    int index = mock_client_index(client_hdl);
+    esp_err_t ret = ESP_OK;
+    if (index < 0 || !mock_device_usable(dev_hdl) || dev_hdl->open_count[index] == 0
+        || bInterfaceNumber >= MOCK_MAX_INTF) {
+        mock_misuse("claim on a device the client has not open");
+        ret = ESP_ERR_INVALID_STATE;
+    } else if (dev_hdl->gone) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else if (dev_hdl->intf_owner[bInterfaceNumber] != NULL) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        dev_hdl->intf_owner[bInterfaceNumber] = client_hdl;
+        dev_hdl->intf_alt[bInterfaceNumber] = bAlternateSetting;
+    }
+    pthread_mutex_unlock(&mock_lock);
+    return ret;
+}
+
+esp_err_t usb_host_interface_release(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                     uint8_t bInterfaceNumber) {
+    pthread_mutex_lock(&mock_lock);
+    esp_err_t ret = ESP_OK;
+    if (!mock_device_usable(dev_hdl) || bInterfaceNumber >= MOCK_MAX_INTF
+        || dev_hdl->intf_owner[bInterfaceNumber] != client_hdl) {
+        mock_misuse("release of an interface the client has not claimed");
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < MOCK_NUM_EPS && ret == ESP_OK; i++) {
+        mock_ep_t *ep = &dev_hdl->ep[i];
+        if ((ep->head != NULL || ep->busy) && mock_ep_interface(dev_hdl, ep->address) == bInterfaceNumber) {
+            mock_misuse("release with transfers in flight");
+            ret = ESP_ERR_INVALID_STATE;
+        }
+    }
+    if (ret == ESP_OK) {
+        dev_hdl->intf_owner[bInterfaceNumber] = NULL;
+    }
+    pthread_mutex_unlock(&mock_lock);
+    return ret;
+}
+
+esp_err_t usb_host_endpoint_halt(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress) {
+    pthread_mutex_lock(&mock_lock);
+    mock_ep_get(dev_hdl, bEndpointAddress)->halted = true;
+    pthread_mutex_unlock(&mock_lock);
+    return ESP_OK;
+}
+
+esp_err_t usb_host_endpoint_flush(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress) {
+    pthread_mutex_lock(&mock_lock);
+    mock_ep_t *ep = mock_ep_get(dev_hdl, bEndpointAddress);
+    if (!ep->halted) {
+        mock_misuse("flush of an endpoint that is not halted");
+        pthread_mutex_unlock(&mock_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    while (ep->busy) {
+        pthread_cond_wait(&ep->cond, &mock_lock);
+    }
+    mock_ep_cancel_all(ep, USB_TRANSFER_STATUS_CANCELED);
+    pthread_mutex_unlock(&mock_lock);
+    return ESP_OK;
+}
+
+esp_err_t usb_host_endpoint_clear(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress) {
+    pthread_mutex_lock(&mock_lock);
+    mock_ep_t *ep = mock_ep_get(dev_hdl, bEndpointAddress);
+    ep->halted = false;
+    pthread_cond_broadcast(&ep->cond);
+    pthread_mutex_unlock(&mock_lock);
+    return ESP_OK;
+}
+
+// Transfers
+
+esp_err_t usb_host_transfer_alloc(size_t data_buffer_size, int num_isoc_packets, usb_transfer_t **transfer) {
+    mock_transfer_t *t = calloc(1, sizeof(mock_transfer_t) + data_buffer_size);
+    if (t == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    usb_transfer_t init = {
+        .data_buffer = (uint8_t *)(t + 1),
+        .data_buffer_size = data_buffer_size,
+        .num_isoc_packets = num_isoc_packets,
+    };
+    memcpy(&t->transfer, &init, sizeof(init));
+    pthread_mutex_lock(&mock_lock);
+    stats.transfers_allocated++;
+    pthread_mutex_unlock(&mock_lock);
+    *transfer = &t->transfer;
+    return ESP_OK;
+}
+
+esp_err_t usb_host_transfer_free(usb_transfer_t *transfer) {
+    if (transfer == NULL) {
+        return ESP_OK;
+    }
+    mock_transfer_t *t = (mock_transfer_t *)transfer;
+    pthread_mutex_lock(&mock_lock);
+    if (t->in_flight) {
+        mock_misuse("free of a transfer in flight");
+        pthread_mutex_unlock(&mock_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    stats.transfers_allocated--;
+    pthread_mutex_unlock(&mock_lock);
+    free(t);
+    return ESP_OK;
+}
+
+esp_err_t usb_host_transfer_submit(usb_transfer_t *transfer) {
+    mock_transfer_t *t = (mock_transfer_t *)transfer;
+    mock_device_t *dev = transfer->device_handle;
+    pthread_mutex_lock(&mock_lock);
+    if (t->in_flight) {
+        mock_misuse("transfer submitted twice");
+        pthread_mutex_unlock(&mock_lock);
+        return ESP_ERR_NOT_FINISHED;
+    }
+    if (!mock_device_usable(dev) || transfer->num_bytes > (int)transfer->data_buffer_size) {
+        mock_misuse("bad bulk transfer");
+        pthread_mutex_unlock(&mock_lock);
+        return ESP_ERR_INVALID_ARG;
+    }
+    int intf = mock_ep_interface(dev, transfer->bEndpointAddress);
+    if (intf < 0 || dev->intf_owner[intf] == NULL) {
+        mock_misuse("bulk transfer on an interface nobody claimed");
+        pthread_mutex_unlock(&mock_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    mock_ep_t *ep = mock_ep_get(dev, transfer->bEndpointAddress);
+    if (dev->gone || ep->halted) {
+        pthread_mutex_unlock(&mock_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    t->client = dev->intf_owner[intf];
+    t->in_flight = true;
+    t->next = NULL;
+    transfer->actual_num_bytes = 0;
+    stats.transfers_in_flight++;
+    if (ep->tail != NULL) {
+        ep->tail->next = t;
+    } else {
+        ep->head = t;
+    }
+    ep->tail = t;
+    if (!ep->thread_running) {
+        pthread_t thread;
+        ep->thread_running = pthread_create(&thread, NULL, mock_ep_thread, ep) == 0;
+        if (ep->thread_running) {
+            pthread_detach(thread);
+        }
+    }
+    pthread_cond_broadcast(&ep->cond);
+    pthread_mutex_unlock(&mock_lock);
+    return ESP_OK;
+}
+
+// Standard requests are answered from the descriptors, the rest goes to the device
+// Returns the data stage length, -1 for a stall
+static int mock_control_request(mock_device_t *dev, const usb_setup_packet_t *setup, uint8_t *data) {
+    if ((setup->bmRequestType & 0x60) != USB_BM_REQUEST_TYPE_TYPE_STANDARD) {
+        return dev->config.ops.control != NULL ? dev->config.ops.control(dev->config.ops.ctx, setup, data) : -1;
+    }
+    const void *desc = NULL;
+    int len = 0;
+    switch (setup->bRequest) {
+    case USB_B_REQUEST_GET_DESCRIPTOR:
+        switch (setup->wValue >> 8) {
+        case USB_B_DESCRIPTOR_TYPE_DEVICE:
+            desc = dev->config.dev_desc;
+            len = sizeof(usb_device_desc_t);
+            break;
+        case USB_B_DESCRIPTOR_TYPE_CONFIGURATION:
+            desc = dev->config.config_desc;
+            len = mock_config(dev)->wTotalLength;
+            break;
+        case USB_B_DESCRIPTOR_TYPE_STRING:
+            if ((setup->wValue & 0xFF) >= 1 && (setup->wValue & 0xFF) <= 3 && dev->str[(setup->wValue & 0xFF) - 1]) {
+                desc = dev->str[(setup->wValue & 0xFF) - 1];
+                len = ((const usb_str_desc_t *)desc)->bLength;
+            }
+            break;
+        }
+        if (desc == NULL) {
+            return -1;
+        }
+        len = len < setup->wLength ? len : setup->wLength;
+        memcpy(data, desc, len);
+        return len;
+    case USB_B_REQUEST_SET_INTERFACE:
+        if (setup->wIndex >= MOCK_MAX_INTF) {
+            return -1;
+        }
+        pthread_mutex_lock(&mock_lock);
+        dev->intf_alt[setup->wIndex] = setup->wValue;
+        pthread_mutex_unlock(&mock_lock);
+        return 0;
+    case USB_B_REQUEST_SET_CONFIGURATION:
+    case USB_B_REQUEST_CLEAR_FEATURE:
+    case USB_B_REQUEST_SET_FEATURE:
+        return 0;
+    case USB_B_REQUEST_GET_STATUS:
+        memset(data, 0, 2);
+        return setup->wLength < 2 ? setup->wLength : 2;
+    default:
+        return -1;
+    }
+}
+
+esp_err_t usb_host_transfer_submit_control(usb_host_client_handle_t client_hdl, usb_transfer_t *transfer) {
+    mock_transfer_t *t = (mock_transfer_t *)transfer;
+    mock_device_t *dev = transfer->device_handle;
+    pthread_mutex_lock(&mock_lock);
+    int index = mock_client_index(client_hdl);
+    if (t->in_flight || index < 0 || !mock_device_usable(dev) || dev->open_count[index] == 0
+        || transfer->num_bytes < USB_SETUP_PACKET_SIZE || transfer->num_bytes > (int)transfer->data_buffer_size) {
+        mock_misuse("bad control transfer");
+        pthread_mutex_unlock(&mock_lock);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (dev->gone) {
+        pthread_mutex_unlock(&mock_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    t->client = client_hdl;
+    t->in_flight = true;
+    stats.transfers_in_flight++;
+    pthread_mutex_unlock(&mock_lock);
+
+    // Answered right away, the callback still only runs in the client's handle_events
+    usb_setup_packet_t setup;
+    memcpy(&setup, transfer->data_buffer, sizeof(setup));
+    int max_len = transfer->num_bytes - USB_SETUP_PACKET_SIZE;
+    if (setup.wLength > max_len) {
+        setup.wLength = max_len;
+    }
+    int len = mock_control_request(dev, &setup, transfer->data_buffer + USB_SETUP_PACKET_SIZE);
+    if (len > setup.wLength) {
+        len = setup.wLength;
+    }
+    transfer->actual_num_bytes = USB_SETUP_PACKET_SIZE + (len > 0 ? len : 0);
+
+    pthread_mutex_lock(&mock_lock);
+    mock_complete(t, dev->gone ? USB_TRANSFER_STATUS_NO_DEVICE
+                  : len < 0 ? USB_TRANSFER_STATUS_STALL : USB_TRANSFER_STATUS_COMPLETED);
+    pthread_mutex_unlock(&mock_lock);
+    return ESP_OK;
+}
+
+// Descriptor parsing, as in ESP-IDF's usb_helpers.c
+
+const usb_standard_desc_t *usb_parse_next_descriptor(const usb_standard_desc_t *cur_desc, uint16_t wTotalLength,
+                                                     int *offset) {
+    if (*offset >= wTotalLength || *offset + cur_desc->bLength >= wTotalLength) {
+        return NULL;
+    }
+    const usb_standard_desc_t *ret = (const usb_standard_desc_t *)((const uint8_t *)cur_desc + cur_desc->bLength);
+    *offset += cur_desc->bLength;
+    return ret;
+}
+
+const usb_standard_desc_t *usb_parse_next_descriptor_of_type(const usb_standard_desc_t *cur_desc, uint16_t wTotalLength,
+                                                             uint8_t bDescriptorType, int *offset) {
+    int offset_temp = *offset;
+    const usb_standard_desc_t *desc = usb_parse_next_descriptor(cur_desc, wTotalLength, &offset_temp);
+    while (desc != NULL && desc->bDescriptorType != bDescriptorType) {
+        desc = usb_parse_next_descriptor(desc, wTotalLength, &offset_temp);
+    }
+    if (desc != NULL) {
+        *offset = offset_temp;
+    }
+    return desc;
+}
+
+int usb_parse_interface_number_of_alternate(const usb_config_desc_t *config_desc, uint8_t bInterfaceNumber) {
+    int offset = 0;
+    int num_alt = -1;
+    const usb_standard_desc_t *desc = (const usb_standard_desc_t *)config_desc;
+    while ((desc = usb_parse_next_descriptor_of_type(desc, config_desc->wTotalLength,
+                                                     USB_B_DESCRIPTOR_TYPE_INTERFACE, &offset)) != NULL) {
+        if (((const usb_intf_desc_t *)desc)->bInterfaceNumber == bInterfaceNumber) {
+            num_alt++;
+        }
+    }
+    return num_alt;
+}
+
+const usb_intf_desc_t *usb_parse_interface_descriptor(const usb_config_desc_t *config_desc, uint8_t bInterfaceNumber,
+                                                      uint8_t bAlternateSetting, int *offset) {
+    if (bInterfaceNumber >= config_desc->bNumInterfaces) {
+        return NULL;
+    }
+    int offset_intf = 0;
+    const usb_standard_desc_t *desc = (const usb_standard_desc_t *)config_desc;
+    while ((desc = usb_parse_next_descriptor_of_type(desc, config_desc->wTotalLength,
+                                                     USB_B_DESCRIPTOR_TYPE_INTERFACE, &offset_intf)) != NULL) {
+        const usb_intf_desc_t *intf_desc = (const usb_intf_desc_t *)desc;
+        if (intf_desc->bInterfaceNumber == bInterfaceNumber && intf_desc->bAlternateSetting == bAlternateSetting) {
+            if (offset != NULL) {
+                *offset = offset_intf;
+            }
+            return intf_desc;
+        }
+    }
+    return NULL;
+}
+
+const usb_ep_desc_t *usb_parse_endpoint_descriptor_by_index(const usb_intf_desc_t *intf_desc, int index,
+                                                            uint16_t wTotalLength, int *offset) {
+    if (index >= intf_desc->bNumEndpoints) {
+        return NULL;
+    }
+    int offset_temp = *offset;
+    const usb_standard_desc_t *desc = (const usb_standard_desc_t *)intf_desc;
+    for (int i = 0; i <= index && desc != NULL; i++) {
+        desc = usb_parse_next_descriptor_of_type(desc, wTotalLength, USB_B_DESCRIPTOR_TYPE_ENDPOINT, &offset_temp);
+    }
+    if (desc != NULL) {
+        *offset = offset_temp;
+    }
+    return (const usb_ep_desc_t *)desc;
+}
+
+const usb_ep_desc_t *usb_parse_endpoint_descriptor_by_address(const usb_config_desc_t *config_desc,
+                                                              uint8_t bInterfaceNumber, uint8_t bAlternateSetting,
+                                                              uint8_t bEndpointAddress, int *offset) {
+    int offset_intf = 0;
+    const usb_intf_desc_t *intf_desc = usb_parse_interface_descriptor(config_desc, bInterfaceNumber,
+                                                                      bAlternateSetting, &offset_intf);
+    for (int i = 0; intf_desc != NULL && i < intf_desc->bNumEndpoints; i++) {
+        int offset_ep = offset_intf;
+        const usb_ep_desc_t *ep_desc = usb_parse_endpoint_descriptor_by_index(intf_desc, i, config_desc->wTotalLength,
+                                                                              &offset_ep);
+        if (ep_desc != NULL && ep_desc->bEndpointAddress == bEndpointAddress) {
+            if (offset != NULL) {
+                *offset = offset_ep;
+            }
+            return ep_desc;
+        }
+    }
+    return NULL;
+}
+
+// Descriptor printing, short forms of ESP-IDF's usb_print_*()
+
+void usb_print_device_descriptor(const usb_device_desc_t *devc_desc) {
+    printf("*** Device descriptor: %04x:%04x class 0x%02x, %d configurations\n", devc_desc->idVendor,
+           devc_desc->idProduct, devc_desc->bDeviceClass, devc_desc->bNumConfigurations);
+}
+
+void usb_print_config_descriptor(const usb_config_desc_t *cfg_desc, print_class_descriptor_cb class_specific_cb) {
+    printf("*** Configuration descriptor: %d bytes, %d interfaces\n", cfg_desc->wTotalLength,
+           cfg_desc->bNumInterfaces);
+}
+
+void usb_print_string_descriptor(const usb_str_desc_t *str_desc) {
+    printf("*** String descriptor: ");
+    for (int i = 0; i < (str_desc->bLength - 2) / 2; i++) {
+        putchar(str_desc->wData[i] < 0x80 ? (char)str_desc->wData[i] : '?');
+    }
+    putchar('\n');
+}
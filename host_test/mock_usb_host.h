@@ -0,0 +1,64 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// USB host library on the host, with mock devices plugged in by the tests
+// Implements the usb/usb_host.h calls of the sources in main/ with the rules of the real
+// library: client and transfer callbacks only run inside usb_host_client_handle_events(),
+// bulk endpoints need their interface claimed, a halted endpoint takes no transfers and
+// flushing it hands them back as cancelled, an interface with transfers in flight can't be
+// released and a device with claimed interfaces can't be closed. Calls the real library
+// would refuse are counted as misuse, tests expect none.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "usb/usb_host.h"
+
+typedef struct usb_device_handle_s mock_device_t;
+
+// Device side, called from the mock's endpoint threads
+typedef struct {
+    // Data the host sent to bulk OUT endpoint ep
+    void (*bulk_out)(void *ctx, uint8_t ep, const uint8_t *data, size_t len);
+    // Data for bulk IN endpoint ep, returns its length, or -1 to NAK and be asked again later
+    int (*bulk_in)(void *ctx, uint8_t ep, uint8_t *data, size_t max_len);
+    // Class and vendor control requests, returns the data stage length or -1 to stall
+    int (*control)(void *ctx, const usb_setup_packet_t *setup, uint8_t *data);
+    void *ctx;
+} mock_device_ops_t;
+
+typedef struct {
+    const usb_device_desc_t *dev_desc;
+    const uint8_t *config_desc;             // wTotalLength bytes
+    const char *manufacturer;               // String descriptors, NULL if the device has none
+    const char *product;
+    const char *serial;
+    uint8_t port_num;                       // Root port the device is plugged into
+    uint32_t bulk_out_bytes_per_ms;         // How fast bulk OUT data is taken, 0 for no limit
+    mock_device_ops_t ops;
+} mock_device_config_t;
+
+typedef struct {
+    int clients;
+    int devices;                            // Attached, or unplugged and still open
+    int open_handles;
+    int transfers_allocated;
+    int transfers_in_flight;
+    int misuse;
+} mock_usb_stats_t;
+
+// Plugs in a device, every registered client gets NEW_DEV
+// The config and what it points to must stay valid while the device exists
+mock_device_t *mock_usb_attach(const mock_device_config_t *config);
+
+// Unplugs a device. Its transfers end with USB_TRANSFER_STATUS_NO_DEVICE and the clients that
+// have it open get DEV_GONE, the address is free again once the last one closed it.
+void mock_usb_detach(mock_device_t *dev);
+
+uint8_t mock_usb_address(const mock_device_t *dev);
+
+void mock_usb_get_stats(mock_usb_stats_t *stats);
@@ -0,0 +1,178 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// ESP-IDF system calls for the host tests: errors, logging, time, heap and random
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+
+#define HOST_LOG_MAX_TAGS           32
+#define HOST_FREE_HEAP              (300 * 1024)    // Free heap of the bridge after boot
+
+static const struct {
+    esp_err_t code;
+    const char *name;
+} err_names[] = {
+    {ESP_OK, "ESP_OK"},
+    {ESP_FAIL, "ESP_FAIL"},
+    {ESP_ERR_NO_MEM, "ESP_ERR_NO_MEM"},
+    {ESP_ERR_INVALID_ARG, "ESP_ERR_INVALID_ARG"},
+    {ESP_ERR_INVALID_STATE, "ESP_ERR_INVALID_STATE"},
+    {ESP_ERR_INVALID_SIZE, "ESP_ERR_INVALID_SIZE"},
+    {ESP_ERR_NOT_FOUND, "ESP_ERR_NOT_FOUND"},
+    {ESP_ERR_NOT_SUPPORTED, "ESP_ERR_NOT_SUPPORTED"},
+    {ESP_ERR_TIMEOUT, "ESP_ERR_TIMEOUT"},
+    {ESP_ERR_INVALID_RESPONSE, "ESP_ERR_INVALID_RESPONSE"},
+    {ESP_ERR_INVALID_CRC, "ESP_ERR_INVALID_CRC"},
+    {ESP_ERR_INVALID_VERSION, "ESP_ERR_INVALID_VERSION"},
+    {ESP_ERR_INVALID_MAC, "ESP_ERR_INVALID_MAC"},
+    {ESP_ERR_NOT_FINISHED, "ESP_ERR_NOT_FINISHED"},
+    {ESP_ERR_NOT_ALLOWED, "ESP_ERR_NOT_ALLOWED"},
+};
+
+const char *esp_err_to_name(esp_err_t code) {
+    for (size_t i = 0; i < sizeof(err_names) / sizeof(err_names[0]); i++) {
+        if (err_names[i].code == code) {
+            return err_names[i].name;
+        }
+    }
+    return "UNKNOWN ERROR";
+}
+
+// Logging
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static int log_default_level = -1;
+static struct {
+    const char *tag;
+    esp_log_level_t level;
+} log_tags[HOST_LOG_MAX_TAGS];
+static int log_num_tags;
+static void (*log_hook)(esp_log_level_t level, const char *tag, const char *msg);
+
+// Called with log_lock held
+static esp_log_level_t host_log_level(const char *tag) {
+    if (log_default_level < 0) {
+        const char *env = getenv("HOST_TEST_LOG_LEVEL");
+        log_default_level = env != NULL ? atoi(env) : CONFIG_LOG_DEFAULT_LEVEL;
+    }
+    for (int i = 0; i < log_num_tags; i++) {
+        if (strcmp(log_tags[i].tag, tag) == 0) {
+            return log_tags[i].level;
+        }
+    }
+    return (esp_log_level_t)log_default_level;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    pthread_mutex_lock(&log_lock);
+    if (strcmp(tag, "*") == 0) {
+        log_default_level = level;
+        log_num_tags = 0;
+    } else {
+        int i = 0;
+        while (i < log_num_tags && strcmp(log_tags[i].tag, tag) != 0) {
+            i++;
+        }
+        if (i < HOST_LOG_MAX_TAGS) {
+            log_tags[i].tag = tag;
+            log_tags[i].level = level;
+            if (i == log_num_tags) {
+                log_num_tags++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&log_lock);
+}
+
+void host_log_set_hook(void (*fn)(esp_log_level_t level, const char *tag, const char *msg)) {
+    pthread_mutex_lock(&log_lock);
+    log_hook = fn;
+    pthread_mutex_unlock(&log_lock);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    static const char letters[] = "NEWIDV";
+    char msg[512];
+    pthread_mutex_lock(&log_lock);
+    if (level <= host_log_level(tag)) {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(msg, sizeof(msg), format, args);
+        va_end(args);
+        fprintf(stderr, "%c (%lld) %s: %s\n", letters[level], (long long)(esp_timer_get_time() / 1000), tag, msg);
+        if (log_hook != NULL) {
+            log_hook(level, tag, msg);
+        }
+    }
+    pthread_mutex_unlock(&log_lock);
+}
+
+// Time, heap and random
+
+static struct timespec timer_start;
+static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+
+static void timer_init(void) {
+    clock_gettime(CLOCK_MONOTONIC, &timer_start);
+}
+
+int64_t esp_timer_get_time(void) {
+    pthread_once(&timer_once, timer_init);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(now.tv_sec - timer_start.tv_sec) * 1000000 + (now.tv_nsec - timer_start.tv_nsec) / 1000;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return HOST_FREE_HEAP;
+}
+
+uint32_t esp_random(void) {
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static uint64_t state;
+    pthread_mutex_lock(&lock);
+    if (state == 0) {
+        const char *env = getenv("HOST_TEST_SEED");
+        state = env != NULL ? strtoull(env, NULL, 0) : (uint64_t)time(NULL);
+        state = state * 2 + 1;
+        fprintf(stderr, "Random seed %llu, repeat with HOST_TEST_SEED\n", (unsigned long long)(state / 2));
+    }
+    // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    uint32_t value = (uint32_t)((state * 0x2545F4914F6CDD1DULL) >> 32);
+    pthread_mutex_unlock(&lock);
+    return value;
+}
+
+#ifdef HOST_NEEDS_STRLCPY
+size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#endif
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    return (uint32_t)crc32(crc, buf, len);
+}
@@ -0,0 +1,64 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// tinfl_decompress() on zlib, see include/miniz.h
+
+#include <string.h>
+#include "miniz.h"
+
+// zlib allocates its state and window once per stream, they come out of the decompressor
+// itself so nothing outlives it
+static voidpf arena_alloc(voidpf opaque, uInt items, uInt size) {
+    tinfl_decompressor *r = opaque;
+    size_t len = ((size_t)items * size + 15) & ~(size_t)15;
+    if (r->arena_used + len > sizeof(r->arena)) {
+        return Z_NULL;
+    }
+    voidpf p = &r->arena[r->arena_used];
+    r->arena_used += len;
+    return p;
+}
+
+static void arena_free(voidpf opaque, voidpf address) {
+}
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size,
+                              uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size,
+                              const uint32_t decomp_flags) {
+    if (r->m_state == 0) {
+        memset(&r->zs, 0, sizeof(r->zs));
+        r->arena_used = 0;
+        r->zs.zalloc = arena_alloc;
+        r->zs.zfree = arena_free;
+        r->zs.opaque = r;
+        int window_bits = (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? 15 : -15;
+        if (inflateInit2(&r->zs, window_bits) != Z_OK) {
+            return TINFL_STATUS_FAILED;
+        }
+        r->m_state = 1;
+    } else if (r->m_state == 2) {
+        *pIn_buf_size = 0;
+        *pOut_buf_size = 0;
+        return TINFL_STATUS_DONE;
+    }
+
+    r->zs.next_in = (Bytef *)pIn_buf_next;
+    r->zs.avail_in = (uInt)*pIn_buf_size;
+    r->zs.next_out = pOut_buf_next;
+    r->zs.avail_out = (uInt)*pOut_buf_size;
+    int ret = inflate(&r->zs, Z_NO_FLUSH);
+    *pIn_buf_size -= r->zs.avail_in;
+    *pOut_buf_size -= r->zs.avail_out;
+
+    if (ret == Z_STREAM_END) {
+        r->m_state = 2;
+        return TINFL_STATUS_DONE;
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        return TINFL_STATUS_FAILED;
+    }
+    return r->zs.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
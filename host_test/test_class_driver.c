@@ -0,0 +1,206 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Class driver and printer handler on the mock USB host
+// Mock printers are plugged in and out under the class driver task. The mock counts every
+// call the real host library would refuse, tests expect none.
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "printer_handler.h"
+#include "mock_usb_host.h"
+#include "mock_printer.h"
+#include "test_util.h"
+
+#define WAIT_TIMEOUT_US             (5 * 1000 * 1000)
+#define SLOW_JOB_SIZE               (256 * 1024)
+#define ATTACH_RUNS                 10
+#define ATTACH_JOB_SIZE             4096
+
+void class_driver_task(void *arg);
+void class_driver_client_deregister(void);
+
+static uint8_t slow_job[SLOW_JOB_SIZE];     // Parked on shutdown, so it has to outlive the test
+
+static int printers_listed(void) {
+    printer_info_t list[PRINTER_MAX_COUNT];
+    return printer_handler_list(list, PRINTER_MAX_COUNT);
+}
+
+// arg is an optional semaphore given when the job ends
+static void job_done(void *arg, esp_err_t result) {
+    if (arg != NULL) {
+        xSemaphoreGive((SemaphoreHandle_t)arg);
+    }
+}
+
+// Latencies the printer handler logs, in us after the attach event
+static struct {
+    SemaphoreHandle_t lock;
+    int64_t ready_us;
+    int64_t first_byte_us;
+} logged;
+
+static void log_hook(esp_log_level_t level, const char *tag, const char *msg) {
+    const char *after = strstr(msg, " us after attach");
+    if (strcmp(tag, "Printer handler") != 0 || after == NULL) {
+        return;
+    }
+    const char *num = after;
+    while (num > msg && num[-1] >= '0' && num[-1] <= '9') {
+        num--;
+    }
+    xSemaphoreTake(logged.lock, portMAX_DELAY);
+    if (strstr(msg, "ready for use") != NULL) {
+        logged.ready_us = strtoll(num, NULL, 10);
+    } else if (strstr(msg, "first byte") != NULL) {
+        logged.first_byte_us = strtoll(num, NULL, 10);
+    }
+    xSemaphoreGive(logged.lock);
+}
+
+static int compare_us(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_latency(const char *what, int64_t *samples) {
+    qsort(samples, ATTACH_RUNS, sizeof(int64_t), compare_us);
+    printf("\t%-40s min %6lld  median %6lld  max %6lld us\n", what, (long long)samples[0],
+           (long long)samples[ATTACH_RUNS / 2], (long long)samples[ATTACH_RUNS - 1]);
+}
+
+static mock_printer_t *attach_printer(const mock_printer_config_t *config) {
+    int listed = printers_listed();
+    mock_printer_t *printer = mock_printer_attach(config);
+    for (int64_t start_us = test_now_us(); printers_listed() == listed && test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    TEST_ASSERT_EQUAL(listed + 1, printers_listed());
+    return printer;
+}
+
+// Plugs a printer in, submits a job the moment it is listed and measures until the printer
+// takes the first byte. The mock answers control transfers without bus timing, so this is
+// the class driver's and printer handler's own share of the attach latency.
+static void test_attach_to_first_byte(void) {
+    static uint8_t job[ATTACH_JOB_SIZE];
+    mock_printer_config_t config = {
+        .vid = 0x04B8,
+        .pid = 0x0005,
+        .serial = "ATTACH01",
+        .device_id = "MFG:Mock;MDL:Attach;CMD:PCL;",
+        .port_num = 1,
+    };
+    int64_t listed_us[ATTACH_RUNS], first_byte_us[ATTACH_RUNS];
+    int64_t logged_ready_us[ATTACH_RUNS], logged_first_byte_us[ATTACH_RUNS];
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+
+    for (int run = 0; run < ATTACH_RUNS; run++) {
+        xSemaphoreTake(logged.lock, portMAX_DELAY);
+        logged.ready_us = -1;
+        logged.first_byte_us = -1;
+        xSemaphoreGive(logged.lock);
+
+        int64_t attach_us = esp_timer_get_time();
+        mock_printer_t *printer = mock_printer_attach(&config);
+        while (printers_listed() == 0) {
+            TEST_ASSERT(esp_timer_get_time() - attach_us < WAIT_TIMEOUT_US);
+        }
+        listed_us[run] = esp_timer_get_time() - attach_us;
+        TEST_ASSERT_EQUAL(ESP_OK, printer_handler_submit(NULL, job, ATTACH_JOB_SIZE, job_done, done));
+        TEST_ASSERT(xSemaphoreTake(done, pdMS_TO_TICKS(WAIT_TIMEOUT_US / 1000)) == pdTRUE);
+        mock_printer_stats_t stats;
+        mock_printer_get_stats(printer, &stats);
+        TEST_ASSERT_EQUAL(ATTACH_JOB_SIZE, stats.bytes);
+        first_byte_us[run] = stats.first_byte_us - attach_us;
+
+        // The handler's own figures start at the attach event, a little after the plug-in.
+        // Its first byte counts once the first transfer completed.
+        xSemaphoreTake(logged.lock, portMAX_DELAY);
+        logged_ready_us[run] = logged.ready_us;
+        logged_first_byte_us[run] = logged.first_byte_us;
+        xSemaphoreGive(logged.lock);
+        TEST_ASSERT(logged_ready_us[run] >= 0 && logged_ready_us[run] <= listed_us[run]);
+        TEST_ASSERT(logged_first_byte_us[run] >= logged_ready_us[run]);
+
+        mock_printer_detach(printer);
+        for (int64_t start_us = test_now_us(); printers_listed() > 0 && test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+        TEST_ASSERT_EQUAL(0, printers_listed());
+    }
+    vSemaphoreDelete(done);
+
+    print_latency("Plug-in to listed:", listed_us);
+    print_latency("Plug-in to first byte on USB:", first_byte_us);
+    print_latency("Attach to ready (handler log):", logged_ready_us);
+    print_latency("Attach to first transfer (handler log):", logged_first_byte_us);
+    mock_usb_stats_t usb;
+    mock_usb_get_stats(&usb);
+    TEST_ASSERT_EQUAL(0, usb.misuse);
+}
+
+// Runs last, the class driver is gone afterwards
+// A printer with transfers in flight has to be closed before the client deregisters
+static void test_shutdown_closes_printers_first(void) {
+    mock_printer_config_t config = {
+        .vid = 0x04B8,
+        .pid = 0x0005,
+        .serial = "SHUTDOWN01",
+        .device_id = "MFG:Mock;MDL:Shutdown;CMD:PCL;",
+        .port_num = 1,
+        .bytes_per_ms = 64,
+    };
+    mock_printer_t *printer = attach_printer(&config);
+    TEST_ASSERT_EQUAL(ESP_OK, printer_handler_submit(NULL, slow_job, SLOW_JOB_SIZE, job_done, NULL));
+    mock_printer_stats_t stats;
+    do {
+        vTaskDelay(pdMS_TO_TICKS(1));
+        mock_printer_get_stats(printer, &stats);
+    } while (stats.bytes == 0);
+
+    class_driver_client_deregister();
+    mock_usb_stats_t usb;
+    for (int64_t start_us = test_now_us(); test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+        mock_usb_get_stats(&usb);
+        if (usb.clients == 0) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    TEST_ASSERT_EQUAL(0, usb.clients);
+    TEST_ASSERT_EQUAL(0, usb.open_handles);
+    TEST_ASSERT_EQUAL(0, usb.transfers_allocated);
+    TEST_ASSERT_EQUAL(0, usb.misuse);
+    TEST_ASSERT_EQUAL(0, printers_listed());
+    mock_printer_detach(printer);
+}
+
+int main(void) {
+    logged.lock = xSemaphoreCreateMutex();
+    host_log_set_hook(log_hook);
+    xTaskCreate(class_driver_task, "class", 4096, NULL, 5, NULL);
+    mock_usb_stats_t usb;
+    for (int64_t start_us = test_now_us(); test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+        mock_usb_get_stats(&usb);
+        if (usb.clients == 1) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    TEST_ASSERT_EQUAL(1, usb.clients);
+    RUN_TEST(test_attach_to_first_byte);
+    RUN_TEST(test_shutdown_closes_printers_first);
+    return 0;
+}
@@ -0,0 +1,427 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// DOT4 transport against an emulated peer
+// The peer sits on the other end of a dot4_link_t made of two packet queues. It answers the
+// transaction channel, counts print data per socket and hands out credit the way the test
+// tells it to, so one channel can be starved while another keeps flowing. Any packet the
+// host sends without credit is counted as a violation, tests expect none.
+
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "dot4.h"
+#include "test_util.h"
+
+#define LINK_PACKET_SIZE            512     // One bulk transfer
+#define LINK_QUEUE_LEN              64
+#define PEER_SOCKETS                8
+#define PEER_CREDIT                 2       // Per grant, for sockets that grant at all
+#define PEER_POLL_TICKS             pdMS_TO_TICKS(5)
+
+#define PRINT_SOCKET                0x02
+#define SCAN_SOCKET                 0x03
+#define FLOW_SIZE                   (64 * 1024)
+#define STARVED_SIZE                (4 * 1024)
+#define PEER_SEND_SIZE              (16 * 1024)
+
+// One direction of the link, a bulk pipe that delivers whole transfers
+typedef struct {
+    uint8_t data[LINK_PACKET_SIZE];
+    size_t len;
+} link_transfer_t;
+
+typedef struct {
+    QueueHandle_t queue;
+    link_transfer_t partial;                // Rest of a transfer the reader had no room for
+    size_t partial_pos;
+} link_pipe_t;
+
+static esp_err_t pipe_write(link_pipe_t *pipe, const uint8_t *data, size_t len, TickType_t timeout) {
+    while (len > 0) {
+        link_transfer_t transfer;
+        transfer.len = len < LINK_PACKET_SIZE ? len : LINK_PACKET_SIZE;
+        memcpy(transfer.data, data, transfer.len);
+        if (xQueueSend(pipe->queue, &transfer, timeout) != pdTRUE) {
+            return ESP_ERR_TIMEOUT;
+        }
+        data += transfer.len;
+        len -= transfer.len;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t pipe_read(link_pipe_t *pipe, uint8_t *data, size_t max_len, size_t *actual_len, TickType_t timeout) {
+    if (pipe->partial_pos >= pipe->partial.len) {
+        if (xQueueReceive(pipe->queue, &pipe->partial, timeout) != pdTRUE) {
+            return ESP_ERR_TIMEOUT;
+        }
+        pipe->partial_pos = 0;
+    }
+    size_t len = pipe->partial.len - pipe->partial_pos;
+    if (len > max_len) {
+        len = max_len;
+    }
+    memcpy(data, &pipe->partial.data[pipe->partial_pos], len);
+    pipe->partial_pos += len;
+    *actual_len = len;
+    return ESP_OK;
+}
+
+// Emulated DOT4 peer
+static struct {
+    link_pipe_t to_peer;
+    link_pipe_t to_host;
+    SemaphoreHandle_t lock;
+    volatile bool stop;
+    SemaphoreHandle_t stopped;
+    uint8_t rx_buf[LINK_PACKET_SIZE * 2];
+    size_t rx_len;
+    // Per socket, under lock
+    bool grants[PEER_SOCKETS];              // Answers credit requests and opens with credit
+    bool open[PEER_SOCKETS];
+    int host_credit[PEER_SOCKETS];          // Packets the host may still send us
+    int peer_credit[PEER_SOCKETS];          // Packets we may still send the host
+    size_t bytes[PEER_SOCKETS];
+    size_t mismatches[PEER_SOCKETS];
+    int credit_requests[PEER_SOCKETS];
+    size_t to_send[PEER_SOCKETS];           // test_pattern() bytes still to send the host
+    size_t sent[PEER_SOCKETS];
+    int violations;
+} peer;
+
+static esp_err_t host_link_write(void *ctx, const uint8_t *data, size_t len, TickType_t timeout) {
+    return pipe_write(&peer.to_peer, data, len, timeout);
+}
+
+static esp_err_t host_link_read(void *ctx, uint8_t *data, size_t max_len, size_t *actual_len, TickType_t timeout) {
+    return pipe_read(&peer.to_host, data, max_len, actual_len, timeout);
+}
+
+static const dot4_link_t host_link = {
+    .write = host_link_write,
+    .read = host_link_read,
+};
+
+static void put_be16(uint8_t *p, uint16_t val) {
+    p[0] = val >> 8;
+    p[1] = val & 0xFF;
+}
+
+static uint16_t get_be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void peer_send(uint8_t socket_id, const uint8_t *payload, size_t len) {
+    uint8_t pkt[LINK_PACKET_SIZE];
+    TEST_ASSERT(len + 6 <= sizeof(pkt));
+    pkt[0] = socket_id;
+    pkt[1] = socket_id;
+    put_be16(&pkt[2], len + 6);
+    pkt[4] = 0;
+    pkt[5] = 0;
+    memcpy(&pkt[6], payload, len);
+    TEST_ASSERT_EQUAL(ESP_OK, pipe_write(&peer.to_host, pkt, len + 6, portMAX_DELAY));
+}
+
+// Commands from the host on the transaction channel, answered like a printer would
+static void peer_handle_command(const uint8_t *cmd, size_t len) {
+    uint8_t reply[16] = {cmd[0] | 0x80, 0x00};
+    size_t reply_len = 2;
+    uint8_t socket_id = len > 1 ? cmd[1] % PEER_SOCKETS : 0;
+
+    xSemaphoreTake(peer.lock, portMAX_DELAY);
+    switch (cmd[0]) {
+    case 0x00:  // Init
+        reply[2] = 0x20;
+        reply_len = 3;
+        break;
+    case 0x09:  // GetSocketID
+        reply[2] = len == 6 && memcmp(&cmd[1], "PRINT", 5) == 0 ? PRINT_SOCKET : SCAN_SOCKET;
+        reply_len = 3;
+        break;
+    case 0x01:  // OpenChannel
+        peer.open[socket_id] = true;
+        peer.host_credit[socket_id] = peer.grants[socket_id] ? PEER_CREDIT : 0;
+        peer.peer_credit[socket_id] = 0;
+        memcpy(&reply[2], &cmd[1], 6);      // Sockets and packet sizes as requested
+        put_be16(&reply[8], 8);             // Max outstanding credit
+        put_be16(&reply[10], peer.host_credit[socket_id]);
+        reply_len = 12;
+        break;
+    case 0x02:  // CloseChannel
+        peer.open[socket_id] = false;
+        reply[2] = cmd[1];
+        reply[3] = cmd[2];
+        reply_len = 4;
+        break;
+    case 0x03:  // Credit, the host has room for more of our packets
+        peer.peer_credit[socket_id] += get_be16(&cmd[3]);
+        reply[2] = cmd[1];
+        reply[3] = cmd[2];
+        reply_len = 4;
+        break;
+    case 0x04: {  // CreditRequest
+        uint16_t grant = peer.grants[socket_id] ? PEER_CREDIT : 0;
+        peer.credit_requests[socket_id]++;
+        peer.host_credit[socket_id] += grant;
+        reply[2] = cmd[1];
+        reply[3] = cmd[2];
+        put_be16(&reply[4], grant);
+        reply_len = 6;
+        break;
+    }
+    case 0x08:  // Exit
+        break;
+    default:
+        reply[1] = 0x01;
+        break;
+    }
+    xSemaphoreGive(peer.lock);
+
+    peer_send(0x00, reply, reply_len);
+}
+
+static void peer_dispatch(const uint8_t *pkt, size_t len) {
+    uint8_t socket_id = pkt[1];
+    const uint8_t *payload = &pkt[6];
+    size_t payload_len = len - 6;
+
+    if (socket_id == 0x00) {
+        // Replies to our own Credit commands need no action
+        if (payload_len > 0 && !(payload[0] & 0x80)) {
+            peer_handle_command(payload, payload_len);
+        }
+        return;
+    }
+
+    xSemaphoreTake(peer.lock, portMAX_DELAY);
+    socket_id %= PEER_SOCKETS;
+    if (!peer.open[socket_id] || --peer.host_credit[socket_id] < 0) {
+        peer.violations++;
+    }
+    for (size_t i = 0; i < payload_len; i++) {
+        if (payload[i] != test_pattern(peer.bytes[socket_id] + i)) {
+            peer.mismatches[socket_id]++;
+        }
+    }
+    peer.bytes[socket_id] += payload_len;
+    xSemaphoreGive(peer.lock);
+}
+
+// Sends pattern data on every socket that has some queued and credit from the host
+static void peer_send_data(void) {
+    for (int socket_id = 1; socket_id < PEER_SOCKETS; socket_id++) {
+        while (1) {
+            uint8_t payload[LINK_PACKET_SIZE - 6];
+            xSemaphoreTake(peer.lock, portMAX_DELAY);
+            size_t len = 0;
+            if (peer.open[socket_id] && peer.peer_credit[socket_id] > 0 && peer.to_send[socket_id] > 0) {
+                len = peer.to_send[socket_id] < sizeof(payload) ? peer.to_send[socket_id] : sizeof(payload);
+                for (size_t i = 0; i < len; i++) {
+                    payload[i] = test_pattern(peer.sent[socket_id] + i);
+                }
+                peer.peer_credit[socket_id]--;
+                peer.to_send[socket_id] -= len;
+                peer.sent[socket_id] += len;
+            }
+            xSemaphoreGive(peer.lock);
+            if (len == 0) {
+                break;
+            }
+            peer_send(socket_id, payload, len);
+        }
+    }
+}
+
+static void peer_task(void *arg) {
+    while (!peer.stop) {
+        size_t received = 0;
+        if (pipe_read(&peer.to_peer, &peer.rx_buf[peer.rx_len], sizeof(peer.rx_buf) - peer.rx_len,
+                      &received, PEER_POLL_TICKS) == ESP_OK) {
+            peer.rx_len += received;
+            while (peer.rx_len >= 6) {
+                size_t pkt_len = get_be16(&peer.rx_buf[2]);
+                TEST_ASSERT(pkt_len >= 6 && pkt_len <= sizeof(peer.rx_buf));
+                if (peer.rx_len < pkt_len) {
+                    break;
+                }
+                peer_dispatch(peer.rx_buf, pkt_len);
+                peer.rx_len -= pkt_len;
+                memmove(peer.rx_buf, &peer.rx_buf[pkt_len], peer.rx_len);
+            }
+        }
+        peer_send_data();
+    }
+    xSemaphoreGive(peer.stopped);
+    vTaskDelete(NULL);
+}
+
+// Tells the host it may send credit more packets on socket_id
+static void peer_grant_credit(uint8_t socket_id, uint16_t credit) {
+    xSemaphoreTake(peer.lock, portMAX_DELAY);
+    peer.grants[socket_id] = true;
+    peer.host_credit[socket_id] += credit;
+    xSemaphoreGive(peer.lock);
+    uint8_t cmd[5] = {0x03, socket_id, socket_id};
+    put_be16(&cmd[3], credit);
+    peer_send(0x00, cmd, sizeof(cmd));
+}
+
+static void peer_start(void) {
+    memset(&peer, 0, sizeof(peer));
+    peer.to_peer.queue = xQueueCreate(LINK_QUEUE_LEN, sizeof(link_transfer_t));
+    peer.to_host.queue = xQueueCreate(LINK_QUEUE_LEN, sizeof(link_transfer_t));
+    peer.lock = xSemaphoreCreateMutex();
+    peer.stopped = xSemaphoreCreateBinary();
+    TEST_ASSERT(xTaskCreate(peer_task, "dot4_peer", 4096, NULL, 3, NULL) == pdTRUE);
+}
+
+static void peer_stop(void) {
+    peer.stop = true;
+    xSemaphoreTake(peer.stopped, portMAX_DELAY);
+    vQueueDelete(peer.to_peer.queue);
+    vQueueDelete(peer.to_host.queue);
+    vSemaphoreDelete(peer.lock);
+    vSemaphoreDelete(peer.stopped);
+}
+
+// Writer on its own task, the way a print job and a status poll run side by side
+typedef struct {
+    dot4_channel_t *channel;
+    const uint8_t *data;
+    size_t len;
+    TickType_t timeout;
+    esp_err_t result;
+    SemaphoreHandle_t done;
+} writer_t;
+
+static void writer_task(void *arg) {
+    writer_t *writer = arg;
+    writer->result = dot4_channel_write(writer->channel, writer->data, writer->len, writer->timeout);
+    xSemaphoreGive(writer->done);
+    vTaskDelete(NULL);
+}
+
+static uint8_t *pattern_buf(size_t len) {
+    uint8_t *buf = malloc(len);
+    TEST_ASSERT(buf != NULL);
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = test_pattern(i);
+    }
+    return buf;
+}
+
+static void open_channels(dot4_t **dot4, dot4_channel_t **print, dot4_channel_t **scan) {
+    TEST_ASSERT_EQUAL(ESP_OK, dot4_open(&host_link, dot4));
+    uint8_t print_socket, scan_socket;
+    TEST_ASSERT_EQUAL(ESP_OK, dot4_get_socket(*dot4, "PRINT", &print_socket));
+    TEST_ASSERT_EQUAL(ESP_OK, dot4_get_socket(*dot4, "SCAN", &scan_socket));
+    TEST_ASSERT_EQUAL(PRINT_SOCKET, print_socket);
+    TEST_ASSERT_EQUAL(SCAN_SOCKET, scan_socket);
+    TEST_ASSERT_EQUAL(ESP_OK, dot4_channel_open(*dot4, print_socket, print));
+    TEST_ASSERT_EQUAL(ESP_OK, dot4_channel_open(*dot4, scan_socket, scan));
+}
+
+// The peer never gives the print channel credit. Its writer waits for the whole timeout,
+// while the scan channel moves data both ways as if the print channel weren't there.
+static void test_starved_channel_does_not_block_others(void) {
+    peer_start();
+    peer.grants[SCAN_SOCKET] = true;
+    peer.to_send[SCAN_SOCKET] = PEER_SEND_SIZE;
+    dot4_t *dot4;
+    dot4_channel_t *print, *scan;
+    open_channels(&dot4, &print, &scan);
+
+    uint8_t *starved_data = pattern_buf(STARVED_SIZE);
+    writer_t starved = {
+        .channel = print,
+        .data = starved_data,
+        .len = STARVED_SIZE,
+        .timeout = pdMS_TO_TICKS(2000),
+        .done = xSemaphoreCreateBinary(),
+    };
+    int64_t start_us = test_now_us();
+    TEST_ASSERT(xTaskCreate(writer_task, "starved", 4096, &starved, 2, NULL) == pdTRUE);
+
+    uint8_t *flow_data = pattern_buf(FLOW_SIZE);
+    TEST_ASSERT_EQUAL(ESP_OK, dot4_channel_write(scan, flow_data, FLOW_SIZE, pdMS_TO_TICKS(1000)));
+    uint8_t *received = malloc(PEER_SEND_SIZE);
+    TEST_ASSERT(received != NULL);
+    for (size_t total = 0; total < PEER_SEND_SIZE;) {
+        size_t len;
+        TEST_ASSERT_EQUAL(ESP_OK, dot4_channel_read(scan, &received[total], PEER_SEND_SIZE - total, &len,
+                                                    pdMS_TO_TICKS(1000)));
+        total += len;
+    }
+    int64_t flow_us = test_now_us() - start_us;
+    for (size_t i = 0; i < PEER_SEND_SIZE; i++) {
+        TEST_ASSERT_EQUAL(test_pattern(i), received[i]);
+    }
+    // The scan channel finished while the print writer is still waiting for credit
+    TEST_ASSERT(xSemaphoreTake(starved.done, 0) != pdTRUE);
+    printf("\t%d KB out and %d KB in on the scan channel in %lld ms, print channel starved\n",
+           FLOW_SIZE / 1024, PEER_SEND_SIZE / 1024, (long long)(flow_us / 1000));
+
+    TEST_ASSERT(xSemaphoreTake(starved.done, pdMS_TO_TICKS(5000)) == pdTRUE);
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, starved.result);
+    TEST_ASSERT(test_now_us() - start_us >= 2000 * 1000);
+
+    dot4_close(dot4);
+    peer_stop();
+    TEST_ASSERT_EQUAL(0, peer.bytes[PRINT_SOCKET]);
+    TEST_ASSERT(peer.credit_requests[PRINT_SOCKET] > 0);
+    TEST_ASSERT_EQUAL(FLOW_SIZE, peer.bytes[SCAN_SOCKET]);
+    TEST_ASSERT_EQUAL(0, peer.mismatches[SCAN_SOCKET]);
+    TEST_ASSERT_EQUAL(0, peer.violations);
+    vSemaphoreDelete(starved.done);
+    free(starved_data);
+    free(flow_data);
+    free(received);
+}
+
+// A starved writer picks up where it stopped once the peer sends a Credit command
+static void test_starved_channel_resumes_on_credit(void) {
+    peer_start();
+    dot4_t *dot4;
+    dot4_channel_t *print, *scan;
+    open_channels(&dot4, &print, &scan);
+
+    uint8_t *data = pattern_buf(STARVED_SIZE);
+    writer_t writer = {
+        .channel = print,
+        .data = data,
+        .len = STARVED_SIZE,
+        .timeout = pdMS_TO_TICKS(3000),
+        .done = xSemaphoreCreateBinary(),
+    };
+    TEST_ASSERT(xTaskCreate(writer_task, "starved", 4096, &writer, 2, NULL) == pdTRUE);
+    vTaskDelay(pdMS_TO_TICKS(300));
+    TEST_ASSERT(xSemaphoreTake(writer.done, 0) != pdTRUE);
+    TEST_ASSERT_EQUAL(0, peer.bytes[PRINT_SOCKET]);
+
+    peer_grant_credit(PRINT_SOCKET, PEER_CREDIT);
+    TEST_ASSERT(xSemaphoreTake(writer.done, pdMS_TO_TICKS(3000)) == pdTRUE);
+    TEST_ASSERT_EQUAL(ESP_OK, writer.result);
+
+    dot4_close(dot4);
+    peer_stop();
+    TEST_ASSERT_EQUAL(STARVED_SIZE, peer.bytes[PRINT_SOCKET]);
+    TEST_ASSERT_EQUAL(0, peer.mismatches[PRINT_SOCKET]);
+    TEST_ASSERT_EQUAL(0, peer.violations);
+    vSemaphoreDelete(writer.done);
+    free(data);
+}
+
+int main(void) {
+    RUN_TEST(test_starved_channel_does_not_block_others);
+    RUN_TEST(test_starved_channel_resumes_on_credit);
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Hotplug storm against the class driver on the mock USB host
+// A real mock printer stays plugged in and prints a job while the storm attaches and
+// unplugs its own devices, stand-in printers with jobs in flight among them. The storm
+// reports leaked slots, pending entries, parked jobs and handles, all of which must be zero,
+// and the USB host must not have seen a single call the real library would refuse.
+
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "printer_handler.h"
+#include "mock_usb_host.h"
+#include "mock_printer.h"
+#include "test_util.h"
+
+#define JOB_SIZE                    (256 * 1024)
+#define STORM_TIMEOUT_US            (120 * 1000 * 1000)
+#define WAIT_TIMEOUT_US             (5 * 1000 * 1000)
+
+void class_driver_task(void *arg);
+void class_driver_storm_task(void *arg);
+
+// What the storm reported, filled in from the class driver's log
+static struct {
+    SemaphoreHandle_t lock;
+    bool reporting;                         // Past "Hotplug storm done"
+    bool leak_free;
+    bool done;                              // class_driver_print_stats() after the report
+    int errors;
+} report;
+
+static void log_hook(esp_log_level_t level, const char *tag, const char *msg) {
+    if (strcmp(tag, "CLASS") != 0) {
+        return;
+    }
+    xSemaphoreTake(report.lock, portMAX_DELAY);
+    if (strstr(msg, "Hotplug storm done") != NULL) {
+        report.reporting = true;
+    }
+    if (report.reporting) {
+        if (level == ESP_LOG_ERROR) {
+            report.errors++;
+        }
+        if (strstr(msg, "Leaked: none") != NULL) {
+            report.leak_free = true;
+        }
+        if (strstr(msg, "Wakeups:") != NULL) {
+            report.done = true;
+        }
+    }
+    xSemaphoreGive(report.lock);
+}
+
+static bool report_done(void) {
+    xSemaphoreTake(report.lock, portMAX_DELAY);
+    bool done = report.done;
+    xSemaphoreGive(report.lock);
+    return done;
+}
+
+static int printers_listed(void) {
+    printer_info_t list[PRINTER_MAX_COUNT];
+    return printer_handler_list(list, PRINTER_MAX_COUNT);
+}
+
+typedef struct {
+    SemaphoreHandle_t done;
+    esp_err_t result;
+} job_state_t;
+
+static void job_done(void *arg, esp_err_t result) {
+    job_state_t *state = arg;
+    state->result = result;
+    xSemaphoreGive(state->done);
+}
+
+static void test_storm_leaves_nothing_behind(void) {
+    mock_usb_stats_t usb;
+    int64_t start_us = test_now_us();
+    do {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        mock_usb_get_stats(&usb);
+    } while (usb.clients == 0 && test_now_us() - start_us < WAIT_TIMEOUT_US);
+    TEST_ASSERT_EQUAL(1, usb.clients);
+
+    mock_printer_config_t config = {
+        .vid = 0x04B8,
+        .pid = 0x0005,
+        .serial = "STORM0001",
+        .device_id = "MFG:Mock;MDL:Storm;CMD:PCL;",
+        .port_num = 1,
+        .bytes_per_ms = 1024,
+        .check_pattern = true,
+    };
+    mock_printer_t *printer = mock_printer_attach(&config);
+    for (start_us = test_now_us(); printers_listed() == 0 && test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL(1, printers_listed());
+
+    uint8_t *job = malloc(JOB_SIZE);
+    TEST_ASSERT(job != NULL);
+    for (size_t i = 0; i < JOB_SIZE; i++) {
+        job[i] = test_pattern(i);
+    }
+    xTaskCreate(class_driver_storm_task, "storm", 4096, NULL, 4, NULL);
+    // Without a printer ID the real printer prints it, never a stand-in
+    job_state_t state = { .done = xSemaphoreCreateBinary() };
+    TEST_ASSERT_EQUAL(ESP_OK, printer_handler_submit(NULL, job, JOB_SIZE, job_done, &state));
+
+    for (start_us = test_now_us(); !report_done() && test_now_us() - start_us < STORM_TIMEOUT_US;) {
+        vTaskDelay(pdMS_TO_TICKS(50));
+    }
+    TEST_ASSERT(report_done());
+    TEST_ASSERT_EQUAL(0, report.errors);
+    TEST_ASSERT(report.leak_free);
+
+    TEST_ASSERT(xSemaphoreTake(state.done, pdMS_TO_TICKS(WAIT_TIMEOUT_US / 1000)) == pdTRUE);
+    TEST_ASSERT_EQUAL(ESP_OK, state.result);
+    mock_printer_stats_t stats;
+    mock_printer_get_stats(printer, &stats);
+    TEST_ASSERT_EQUAL(JOB_SIZE, stats.bytes);
+    TEST_ASSERT_EQUAL(0, stats.mismatches);
+
+    // Only the real printer is left open, and it goes away cleanly too
+    mock_usb_get_stats(&usb);
+    TEST_ASSERT_EQUAL(0, usb.misuse);
+    TEST_ASSERT_EQUAL(1, usb.open_handles);
+    TEST_ASSERT_EQUAL(1, printers_listed());
+    mock_printer_detach(printer);
+    for (start_us = test_now_us(); test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+        mock_usb_get_stats(&usb);
+        if (usb.devices == 0 && printers_listed() == 0) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL(0, usb.devices);
+    TEST_ASSERT_EQUAL(0, usb.open_handles);
+    TEST_ASSERT_EQUAL(0, usb.transfers_allocated);
+    TEST_ASSERT_EQUAL(0, usb.misuse);
+    TEST_ASSERT_EQUAL(0, printers_listed());
+    vSemaphoreDelete(state.done);
+    free(job);
+}
+
+int main(void) {
+    report.lock = xSemaphoreCreateMutex();
+    host_log_set_hook(log_hook);
+    xTaskCreate(class_driver_task, "class", 4096, NULL, 5, NULL);
+    RUN_TEST(test_storm_leaves_nothing_behind);
+    return 0;
+}
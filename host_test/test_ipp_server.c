@@ -0,0 +1,490 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// IPP server over loopback
+// Runs the server on a free port and checks its responses the way ipptool's stock
+// get-printer-attributes and print-job tests do, and what POST /print reports, then times
+// requests on a kept-alive connection to show the per-request overhead.
+
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "ipp.h"
+#include "ipp_server.h"
+#include "http_util.h"
+#include "net_admission.h"
+#include "descriptor_log.h"
+#include "printer_handler.h"
+#include "test_util.h"
+
+#define TEST_PRINTER_ID             "04b8-0005-TEST01"
+#define RESPONSE_MAX                4096
+#define RESPONSE_ATTRS_MAX          48
+#define BENCH_REQUESTS              2000
+#define BENCH_JOB_SIZE              1024
+#define BENCH_MEDIAN_MAX_US         10000
+
+// Attached printers as printer_handler_list() reports them
+static int num_printers;
+static portMUX_TYPE printed_lock = portMUX_INITIALIZER_UNLOCKED;
+static size_t printed_bytes;
+static size_t printed_mismatches;
+static size_t printer_ack_limit = SIZE_MAX;  // The mock printer fails after acknowledging this much
+
+int printer_handler_list(printer_info_t *list, int max_count) {
+    if (num_printers > 0 && max_count > 0) {
+        memset(&list[0], 0, sizeof(list[0]));
+        strcpy(list[0].id, TEST_PRINTER_ID);
+        list[0].vid = 0x04b8;
+        list[0].pid = 0x0005;
+        list[0].num_interfaces = 1;
+    }
+    return num_printers < max_count ? num_printers : max_count;
+}
+
+size_t descriptor_log_format(char *buf, size_t size) {
+    buf[0] = '\0';
+    return 0;
+}
+
+// Mock printer that takes the document as fast as it comes
+typedef struct {
+    print_stream_t *stream;
+    printer_job_done_cb_t done;
+    void *done_arg;
+} mock_job_t;
+
+static void mock_printer_task(void *arg) {
+    mock_job_t *job = (mock_job_t *)arg;
+    uint8_t buf[2048];
+    size_t pos = 0;
+    esp_err_t ret;
+    while (1) {
+        size_t len;
+        ret = print_stream_read(job->stream, buf, sizeof(buf), &len, pdMS_TO_TICKS(5000));
+        if (ret != ESP_OK || len == 0) {
+            break;
+        }
+        size_t mismatches = 0;
+        for (size_t i = 0; i < len; i++) {
+            mismatches += buf[i] != test_pattern(pos + i);
+        }
+        pos += len;
+        portENTER_CRITICAL(&printed_lock);
+        printed_bytes += len;
+        printed_mismatches += mismatches;
+        portEXIT_CRITICAL(&printed_lock);
+    }
+    size_t acked = pos;
+    if (ret == ESP_OK && pos > printer_ack_limit) {
+        // Read all of it, but the last transfers never came back
+        acked = printer_ack_limit;
+        ret = ESP_FAIL;
+        print_stream_abort(job->stream);
+    }
+    print_stream_set_acked(job->stream, acked);
+    job->done(job->done_arg, ret);
+    free(job);
+    vTaskDelete(NULL);
+}
+
+esp_err_t printer_handler_submit_stream(const char *printer_id, print_stream_t *stream,
+                                        printer_job_done_cb_t done, void *done_arg) {
+    if (num_printers == 0 || (printer_id != NULL && strcmp(printer_id, TEST_PRINTER_ID) != 0)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    mock_job_t *job = malloc(sizeof(mock_job_t));
+    TEST_ASSERT(job != NULL);
+    job->stream = stream;
+    job->done = done;
+    job->done_arg = done_arg;
+    TEST_ASSERT(xTaskCreate(mock_printer_task, "mock_printer", 4096, job, 2, NULL) == pdTRUE);
+    return ESP_OK;
+}
+
+// IPP response, each attribute value with the name it came with
+typedef struct {
+    uint8_t group;
+    uint8_t value_tag;
+    char name[IPP_PARSER_NAME_MAX];
+    char value[IPP_PARSER_VALUE_MAX + 1];
+    uint16_t value_len;
+} response_attr_t;
+
+typedef struct {
+    int http_status;
+    uint16_t status;
+    uint32_t request_id;
+    int num_attrs;
+    response_attr_t attrs[RESPONSE_ATTRS_MAX];
+} response_t;
+
+static void response_attr(void *arg, uint8_t group, uint8_t value_tag, const char *name,
+                          const uint8_t *value, uint16_t value_len) {
+    response_t *resp = (response_t *)arg;
+    TEST_ASSERT(resp->num_attrs < RESPONSE_ATTRS_MAX);
+    response_attr_t *attr = &resp->attrs[resp->num_attrs++];
+    attr->group = group;
+    attr->value_tag = value_tag;
+    strcpy(attr->name, name);
+    memcpy(attr->value, value, value_len);
+    attr->value[value_len] = '\0';
+    attr->value_len = value_len;
+}
+
+// Finds the n-th value of an attribute, NULL if there are fewer
+static const response_attr_t *response_find(const response_t *resp, const char *name, int n) {
+    for (int i = 0; i < resp->num_attrs; i++) {
+        if (strcmp(resp->attrs[i].name, name) == 0 && n-- == 0) {
+            return &resp->attrs[i];
+        }
+    }
+    return NULL;
+}
+
+static int32_t attr_integer(const response_attr_t *attr) {
+    TEST_ASSERT(attr != NULL && attr->value_len == 4);
+    const uint8_t *v = (const uint8_t *)attr->value;
+    return (int32_t)((uint32_t)v[0] << 24 | (uint32_t)v[1] << 16 | (uint32_t)v[2] << 8 | v[3]);
+}
+
+// EXPECT name OF-TYPE tag WITH-VALUE value, for string values
+static void expect_string(const response_t *resp, uint8_t group, const char *name, uint8_t value_tag,
+                          const char *value) {
+    const response_attr_t *attr = response_find(resp, name, 0);
+    if (attr == NULL) {
+        fprintf(stderr, "Missing %s\n", name);
+        abort();
+    }
+    TEST_ASSERT_EQUAL(group, attr->group);
+    TEST_ASSERT_EQUAL(value_tag, attr->value_tag);
+    if (value != NULL && strcmp(attr->value, value) != 0) {
+        fprintf(stderr, "%s is \"%s\", expected \"%s\"\n", name, attr->value, value);
+        abort();
+    }
+}
+
+// Sends an IPP request and reads the whole response
+// With host NULL the request carries no Host header
+static void ipp_request(int sock, const char *path, const char *host, const uint8_t *msg, size_t msg_len,
+                        const uint8_t *doc, size_t doc_len, response_t *resp) {
+    char head[256];
+    int head_len = snprintf(head, sizeof(head),
+                            "POST %s HTTP/1.1\r\n%s%s%sContent-Type: application/ipp\r\nContent-Length: %zu\r\n\r\n",
+                            path, host ? "Host: " : "", host ? host : "", host ? "\r\n" : "", msg_len + doc_len);
+    TEST_ASSERT(test_send_all(sock, head, head_len));
+    TEST_ASSERT(test_send_all(sock, msg, msg_len));
+    if (doc_len > 0) {
+        TEST_ASSERT(test_send_all(sock, doc, doc_len));
+    }
+
+    static __thread uint8_t buf[RESPONSE_MAX];
+    size_t len = 0;
+    size_t header_end;
+    while ((header_end = http_header_end((const char *)buf, len)) == 0) {
+        TEST_ASSERT(len < sizeof(buf));
+        ssize_t n = recv(sock, &buf[len], sizeof(buf) - len, 0);
+        TEST_ASSERT(n > 0);
+        len += n;
+    }
+    char value[16];
+    TEST_ASSERT(http_get_header((const char *)buf, header_end, "Content-Length", value, sizeof(value)));
+    size_t body_len = strtoul(value, NULL, 10);
+    TEST_ASSERT(header_end + body_len <= sizeof(buf));
+    while (len < header_end + body_len) {
+        ssize_t n = recv(sock, &buf[len], sizeof(buf) - len, 0);
+        TEST_ASSERT(n > 0);
+        len += n;
+    }
+    TEST_ASSERT_EQUAL(header_end + body_len, len);
+
+    memset(resp, 0, sizeof(*resp));
+    TEST_ASSERT(sscanf((const char *)buf, "HTTP/1.1 %d", &resp->http_status) == 1);
+    if (body_len == 0) {
+        return;
+    }
+    ipp_parser_t parser;
+    size_t consumed;
+    ipp_parser_init(&parser, response_attr, resp);
+    TEST_ASSERT_EQUAL(ESP_OK, ipp_parser_feed(&parser, &buf[header_end], body_len, &consumed));
+    TEST_ASSERT(parser.done);
+    TEST_ASSERT_EQUAL(body_len, consumed);
+    resp->status = parser.op_or_status;
+    resp->request_id = parser.request_id;
+}
+
+static size_t ipp_build_request(uint8_t *buf, size_t size, uint16_t op, uint32_t request_id, const char *printer_uri) {
+    ipp_writer_t w;
+    ipp_writer_init(&w, buf, size);
+    ipp_put_header(&w, op, request_id);
+    ipp_put_tag(&w, IPP_TAG_OPERATION);
+    ipp_put_string(&w, IPP_TAG_CHARSET, "attributes-charset", "utf-8");
+    ipp_put_string(&w, IPP_TAG_LANGUAGE, "attributes-natural-language", "en");
+    ipp_put_string(&w, IPP_TAG_URI, "printer-uri", printer_uri);
+    ipp_put_string(&w, IPP_TAG_NAME, "requesting-user-name", "host_test");
+    if (op != IPP_OP_GET_PRINTER_ATTRIBUTES) {
+        ipp_put_string(&w, IPP_TAG_NAME, "job-name", "loopback");
+        ipp_put_string(&w, IPP_TAG_MIME_TYPE, "document-format", "application/octet-stream");
+    }
+    ipp_put_tag(&w, IPP_TAG_END);
+    TEST_ASSERT(!w.overflow);
+    return w.len;
+}
+
+static uint16_t server_port;
+static char server_host[32];
+
+// Connects like ipptool does, without Nagle delaying the pieces of a request
+static int ipp_connect(void) {
+    int sock = test_tcp_connect(server_port);
+    int opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    return sock;
+}
+
+static void start_server(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, net_admission_init());
+    int sock = test_tcp_listen(&server_port);
+    close(sock);
+    snprintf(server_host, sizeof(server_host), "127.0.0.1:%d", server_port);
+    TEST_ASSERT_EQUAL(ESP_OK, ipp_server_start(server_port));
+    close(test_tcp_connect(server_port));
+}
+
+// The operation attributes every response starts with
+static void expect_response_header(const response_t *resp, uint16_t status, uint32_t request_id) {
+    TEST_ASSERT_EQUAL(200, resp->http_status);
+    TEST_ASSERT_EQUAL(status, resp->status);
+    TEST_ASSERT_EQUAL(request_id, resp->request_id);
+    TEST_ASSERT_EQUAL(IPP_TAG_CHARSET, resp->attrs[0].value_tag);
+    TEST_ASSERT(strcmp(resp->attrs[0].name, "attributes-charset") == 0);
+    TEST_ASSERT_EQUAL(IPP_TAG_LANGUAGE, resp->attrs[1].value_tag);
+    TEST_ASSERT(strcmp(resp->attrs[1].name, "attributes-natural-language") == 0);
+}
+
+// get-printer-attributes.test: the required printer description attributes
+static void test_get_printer_attributes(void) {
+    num_printers = 1;
+    char uri[96];
+    snprintf(uri, sizeof(uri), "ipp://%s/ipp/print", server_host);
+    uint8_t msg[256];
+    size_t msg_len = ipp_build_request(msg, sizeof(msg), IPP_OP_GET_PRINTER_ATTRIBUTES, 7, uri);
+    response_t resp;
+    int sock = ipp_connect();
+    ipp_request(sock, "/ipp/print", server_host, msg, msg_len, NULL, 0, &resp);
+
+    expect_response_header(&resp, IPP_STATUS_OK, 7);
+    expect_string(&resp, IPP_TAG_PRINTER, "printer-uri-supported", IPP_TAG_URI, uri);
+    expect_string(&resp, IPP_TAG_PRINTER, "uri-security-supported", IPP_TAG_KEYWORD, "none");
+    expect_string(&resp, IPP_TAG_PRINTER, "uri-authentication-supported", IPP_TAG_KEYWORD, "none");
+    expect_string(&resp, IPP_TAG_PRINTER, "printer-name", IPP_TAG_NAME, TEST_PRINTER_ID);
+    expect_string(&resp, IPP_TAG_PRINTER, "charset-configured", IPP_TAG_CHARSET, NULL);
+    expect_string(&resp, IPP_TAG_PRINTER, "charset-supported", IPP_TAG_CHARSET, "utf-8");
+    expect_string(&resp, IPP_TAG_PRINTER, "natural-language-configured", IPP_TAG_LANGUAGE, NULL);
+    expect_string(&resp, IPP_TAG_PRINTER, "generated-natural-language-supported", IPP_TAG_LANGUAGE, "en");
+    expect_string(&resp, IPP_TAG_PRINTER, "document-format-default", IPP_TAG_MIME_TYPE, NULL);
+    expect_string(&resp, IPP_TAG_PRINTER, "document-format-supported", IPP_TAG_MIME_TYPE, NULL);
+    expect_string(&resp, IPP_TAG_PRINTER, "ipp-versions-supported", IPP_TAG_KEYWORD, "1.1");
+    expect_string(&resp, IPP_TAG_PRINTER, "pdl-override-supported", IPP_TAG_KEYWORD, NULL);
+    expect_string(&resp, IPP_TAG_PRINTER, "compression-supported", IPP_TAG_KEYWORD, "none");
+    TEST_ASSERT_EQUAL(IPP_PRINTER_STATE_IDLE, attr_integer(response_find(&resp, "printer-state", 0)));
+    TEST_ASSERT(attr_integer(response_find(&resp, "printer-up-time", 0)) > 0);
+    TEST_ASSERT(attr_integer(response_find(&resp, "queued-job-count", 0)) >= 0);
+    const response_attr_t *accepting = response_find(&resp, "printer-is-accepting-jobs", 0);
+    TEST_ASSERT(accepting != NULL);
+    TEST_ASSERT_EQUAL(IPP_TAG_BOOLEAN, accepting->value_tag);
+    TEST_ASSERT_EQUAL(1, accepting->value_len);
+    TEST_ASSERT_EQUAL(1, accepting->value[0]);
+    int ops[3] = {0};
+    for (int i = 0; i < 3; i++) {
+        const response_attr_t *op = response_find(&resp, "operations-supported", i);
+        TEST_ASSERT(op != NULL && op->value_tag == IPP_TAG_ENUM);
+        ops[i] = attr_integer(op);
+    }
+    TEST_ASSERT(ops[0] == IPP_OP_PRINT_JOB && ops[1] == IPP_OP_VALIDATE_JOB && ops[2] == IPP_OP_GET_PRINTER_ATTRIBUTES);
+
+    // Without a Host header the URIs name the address the connection came in on
+    ipp_request(sock, "/ipp/print/" TEST_PRINTER_ID, NULL, msg, msg_len, NULL, 0, &resp);
+    expect_response_header(&resp, IPP_STATUS_OK, 7);
+    snprintf(uri, sizeof(uri), "ipp://%s/ipp/print/%s", server_host, TEST_PRINTER_ID);
+    expect_string(&resp, IPP_TAG_PRINTER, "printer-uri-supported", IPP_TAG_URI, uri);
+
+    // An unknown printer is not found, none attached is a stopped printer refusing jobs
+    ipp_request(sock, "/ipp/print/nonexistent", server_host, msg, msg_len, NULL, 0, &resp);
+    expect_response_header(&resp, IPP_STATUS_CLIENT_ERROR_NOT_FOUND, 7);
+    num_printers = 0;
+    ipp_request(sock, "/ipp/print", server_host, msg, msg_len, NULL, 0, &resp);
+    expect_response_header(&resp, IPP_STATUS_OK, 7);
+    TEST_ASSERT_EQUAL(IPP_PRINTER_STATE_STOPPED, attr_integer(response_find(&resp, "printer-state", 0)));
+    TEST_ASSERT_EQUAL(0, response_find(&resp, "printer-is-accepting-jobs", 0)->value[0]);
+    close(sock);
+}
+
+// print-job.test: job-id, job-uri and job-state come back, the document reaches the printer
+static void test_print_job(void) {
+    num_printers = 1;
+    char uri[96];
+    snprintf(uri, sizeof(uri), "ipp://%s/ipp/print", server_host);
+    uint8_t msg[256];
+    size_t msg_len = ipp_build_request(msg, sizeof(msg), IPP_OP_PRINT_JOB, 42, uri);
+    static uint8_t doc[64 * 1024];
+    for (size_t i = 0; i < sizeof(doc); i++) {
+        doc[i] = test_pattern(i);
+    }
+    printed_bytes = 0;
+    printed_mismatches = 0;
+
+    response_t resp;
+    int sock = ipp_connect();
+    ipp_request(sock, "/ipp/print", server_host, msg, msg_len, doc, sizeof(doc), &resp);
+    expect_response_header(&resp, IPP_STATUS_OK, 42);
+    const response_attr_t *job_id = response_find(&resp, "job-id", 0);
+    TEST_ASSERT(job_id != NULL && job_id->group == IPP_TAG_JOB && job_id->value_tag == IPP_TAG_INTEGER);
+    int32_t first_id = attr_integer(job_id);
+    TEST_ASSERT(first_id > 0);
+    char job_uri[96];
+    snprintf(job_uri, sizeof(job_uri), "ipp://%s/ipp/job/%" PRId32, server_host, first_id);
+    expect_string(&resp, IPP_TAG_JOB, "job-uri", IPP_TAG_URI, job_uri);
+    TEST_ASSERT_EQUAL(IPP_JOB_STATE_COMPLETED, attr_integer(response_find(&resp, "job-state", 0)));
+    expect_string(&resp, IPP_TAG_JOB, "job-state-reasons", IPP_TAG_KEYWORD, "job-completed-successfully");
+    TEST_ASSERT_EQUAL(sizeof(doc), printed_bytes);
+    TEST_ASSERT_EQUAL(0, printed_mismatches);
+
+    // validate-job answers for the printer but creates no job
+    msg_len = ipp_build_request(msg, sizeof(msg), IPP_OP_VALIDATE_JOB, 43, uri);
+    ipp_request(sock, "/ipp/print", server_host, msg, msg_len, NULL, 0, &resp);
+    expect_response_header(&resp, IPP_STATUS_OK, 43);
+    TEST_ASSERT(response_find(&resp, "job-id", 0) == NULL);
+
+    // A second job on the same connection gets the next ID
+    msg_len = ipp_build_request(msg, sizeof(msg), IPP_OP_PRINT_JOB, 44, uri);
+    ipp_request(sock, "/ipp/print", server_host, msg, msg_len, doc, 100, &resp);
+    expect_response_header(&resp, IPP_STATUS_OK, 44);
+    TEST_ASSERT_EQUAL(first_id + 1, attr_integer(response_find(&resp, "job-id", 0)));
+    close(sock);
+}
+
+// POST /print with the document as the body, returns the HTTP status and the JSON reply
+static int http_post_print(int sock, const uint8_t *doc, size_t doc_len, char *body, size_t body_size) {
+    char head[128];
+    int head_len = snprintf(head, sizeof(head), "POST /print HTTP/1.1\r\nContent-Length: %zu\r\n\r\n", doc_len);
+    TEST_ASSERT(test_send_all(sock, head, head_len));
+    TEST_ASSERT(test_send_all(sock, doc, doc_len));
+
+    char buf[1024];
+    size_t len = 0;
+    size_t header_end;
+    while ((header_end = http_header_end(buf, len)) == 0) {
+        TEST_ASSERT(len < sizeof(buf));
+        ssize_t n = recv(sock, &buf[len], sizeof(buf) - len, 0);
+        TEST_ASSERT(n > 0);
+        len += n;
+    }
+    char value[16];
+    TEST_ASSERT(http_get_header(buf, header_end, "Content-Length", value, sizeof(value)));
+    size_t body_len = strtoul(value, NULL, 10);
+    TEST_ASSERT(header_end + body_len < sizeof(buf) && body_len < body_size);
+    while (len < header_end + body_len) {
+        ssize_t n = recv(sock, &buf[len], sizeof(buf) - len, 0);
+        TEST_ASSERT(n > 0);
+        len += n;
+    }
+    memcpy(body, &buf[header_end], body_len);
+    body[body_len] = '\0';
+    int status = 0;
+    TEST_ASSERT(sscanf(buf, "HTTP/1.1 %d", &status) == 1);
+    return status;
+}
+
+// "delivered" counts what the printer acknowledged, not what was read for it
+static void test_upload_reports_acked_bytes(void) {
+    num_printers = 1;
+    static uint8_t doc[32 * 1024];
+    for (size_t i = 0; i < sizeof(doc); i++) {
+        doc[i] = test_pattern(i);
+    }
+    char body[256];
+    size_t received;
+    size_t delivered;
+    int sock = ipp_connect();
+    TEST_ASSERT_EQUAL(200, http_post_print(sock, doc, sizeof(doc), body, sizeof(body)));
+    TEST_ASSERT(sscanf(strstr(body, "\"received\""), "\"received\":%zu,\"delivered\":%zu", &received, &delivered) == 2);
+    TEST_ASSERT_EQUAL(sizeof(doc), received);
+    TEST_ASSERT_EQUAL(sizeof(doc), delivered);
+
+    printer_ack_limit = 10000;
+    TEST_ASSERT_EQUAL(502, http_post_print(sock, doc, sizeof(doc), body, sizeof(body)));
+    printer_ack_limit = SIZE_MAX;
+    TEST_ASSERT(sscanf(strstr(body, "\"received\""), "\"received\":%zu,\"delivered\":%zu", &received, &delivered) == 2);
+    TEST_ASSERT_EQUAL(sizeof(doc), received);
+    TEST_ASSERT_EQUAL(10000, delivered);
+    close(sock);
+}
+
+static int compare_us(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Round trips of one request type on a kept-alive connection
+static void bench_requests(const char *name, uint16_t op, size_t doc_len) {
+    char uri[96];
+    snprintf(uri, sizeof(uri), "ipp://%s/ipp/print", server_host);
+    uint8_t msg[256];
+    size_t msg_len = ipp_build_request(msg, sizeof(msg), op, 1, uri);
+    uint8_t doc[BENCH_JOB_SIZE];
+    for (size_t i = 0; i < sizeof(doc); i++) {
+        doc[i] = test_pattern(i);
+    }
+    static int64_t times[BENCH_REQUESTS];
+    static response_t resp;
+    int sock = ipp_connect();
+    for (int i = 0; i < BENCH_REQUESTS; i++) {
+        int64_t start = test_now_us();
+        ipp_request(sock, "/ipp/print", server_host, msg, msg_len, doc, doc_len, &resp);
+        times[i] = test_now_us() - start;
+        TEST_ASSERT_EQUAL(IPP_STATUS_OK, resp.status);
+    }
+    close(sock);
+
+    qsort(times, BENCH_REQUESTS, sizeof(times[0]), compare_us);
+    int64_t total = 0;
+    for (int i = 0; i < BENCH_REQUESTS; i++) {
+        total += times[i];
+    }
+    printf("  %s: %d requests, mean %" PRId64 " us, median %" PRId64 " us, p99 %" PRId64 " us\n",
+           name, BENCH_REQUESTS, total / BENCH_REQUESTS, times[BENCH_REQUESTS / 2], times[BENCH_REQUESTS * 99 / 100]);
+    // A response split over two segments waits for the client's delayed ACK, 40 ms on Linux
+    TEST_ASSERT(times[BENCH_REQUESTS / 2] < BENCH_MEDIAN_MAX_US);
+}
+
+// Per-request overhead of the server, the mock printer takes documents at once
+static void test_request_overhead(void) {
+    num_printers = 1;
+    esp_log_level_set("*", ESP_LOG_WARN);
+    bench_requests("Get-Printer-Attributes", IPP_OP_GET_PRINTER_ATTRIBUTES, 0);
+    bench_requests("Validate-Job", IPP_OP_VALIDATE_JOB, 0);
+    bench_requests("Print-Job 1 KB", IPP_OP_PRINT_JOB, BENCH_JOB_SIZE);
+    esp_log_level_set("*", CONFIG_LOG_DEFAULT_LEVEL);
+}
+
+int main(void) {
+    start_server();
+    RUN_TEST(test_get_printer_attributes);
+    RUN_TEST(test_print_job);
+    RUN_TEST(test_upload_reports_acked_bytes);
+    RUN_TEST(test_request_overhead);
+    return 0;
+}
@@ -0,0 +1,384 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// IPP-USB transport on the mock USB host
+// The mock device has two IPP-USB interfaces, each with its own bulk pair and its own HTTP
+// server behind it. Bulk OUT data is taken at a fixed rate per endpoint, so two jobs that
+// really run side by side take as long as one, and two that queue behind each other take twice
+// as long. The device also records how many of its interfaces had a request in progress at
+// once.
+
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+#include "ipp_usb.h"
+#include "ipp.h"
+#include "http_util.h"
+#include "mock_usb_host.h"
+#include "test_util.h"
+
+#define CHANNELS                    2
+#define BYTES_PER_MS                256     // Per bulk OUT endpoint
+#define JOB_SIZE                    (128 * 1024)
+#define LONG_JOB_SIZE               (512 * 1024)
+#define WAIT_TIMEOUT_US             (5 * 1000 * 1000)
+#define RESPONSE_SIZE               256
+
+// One IPP-USB interface of the device: an HTTP server that answers every request when its
+// chunked body is complete
+typedef struct {
+    char head[512];
+    size_t head_len;
+    bool in_body;
+    http_chunked_decoder_t dec;
+    uint8_t ipp_header[IPP_HEADER_SIZE];    // Start of the body, operation and request ID
+    size_t body_len;
+    uint8_t response[RESPONSE_SIZE];
+    size_t response_len;
+    size_t response_pos;
+    bool active;                            // From the first request byte to the last response byte
+    size_t requests;
+    size_t body_bytes;
+} ipp_interface_t;
+
+static struct {
+    pthread_mutex_t lock;
+    ipp_interface_t intf[CHANNELS];
+    int active;
+    int max_active;
+    usb_device_desc_t dev_desc;
+    uint8_t config_desc[9 + CHANNELS * (9 + 2 * 7)];
+    mock_device_config_t config;
+    mock_device_t *dev;
+} device = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static usb_host_client_handle_t client_hdl;
+static usb_device_handle_t dev_hdl;
+static ipp_usb_t *ipp;
+static SemaphoreHandle_t released;
+static volatile bool pump_stop;
+static SemaphoreHandle_t pump_stopped;
+
+// The transport's hooks into the printer handler and class driver
+esp_err_t printer_claim_interface(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                  uint8_t interface_num, uint8_t alt_setting) {
+    return usb_host_interface_claim(client_hdl, dev_hdl, interface_num, alt_setting);
+}
+
+void class_driver_device_released(usb_device_handle_t dev_hdl) {
+    xSemaphoreGive(released);
+}
+
+static void ipp_interface_respond(ipp_interface_t *intf) {
+    uint16_t op = (intf->ipp_header[2] << 8) | intf->ipp_header[3];
+    uint32_t request_id = ((uint32_t)intf->ipp_header[4] << 24) | (intf->ipp_header[5] << 16)
+                          | (intf->ipp_header[6] << 8) | intf->ipp_header[7];
+    uint8_t body[128];
+    ipp_writer_t w;
+    ipp_writer_init(&w, body, sizeof(body));
+    ipp_put_header(&w, IPP_STATUS_OK, request_id);
+    ipp_put_tag(&w, IPP_TAG_OPERATION);
+    ipp_put_string(&w, IPP_TAG_CHARSET, "attributes-charset", "utf-8");
+    ipp_put_string(&w, IPP_TAG_LANGUAGE, "attributes-natural-language", "en");
+    if (op == IPP_OP_GET_PRINTER_ATTRIBUTES) {
+        // Processing while another interface takes a document
+        bool printing = false;
+        for (int i = 0; i < CHANNELS; i++) {
+            printing |= &device.intf[i] != intf && device.intf[i].active;
+        }
+        ipp_put_tag(&w, IPP_TAG_PRINTER);
+        ipp_put_integer(&w, IPP_TAG_ENUM, "printer-state",
+                        printing ? IPP_PRINTER_STATE_PROCESSING : IPP_PRINTER_STATE_IDLE);
+    }
+    ipp_put_tag(&w, IPP_TAG_END);
+    TEST_ASSERT(!w.overflow);
+
+    int head_len = snprintf((char *)intf->response, RESPONSE_SIZE,
+                            "HTTP/1.1 200 OK\r\nContent-Type: application/ipp\r\nContent-Length: %zu\r\n\r\n", w.len);
+    TEST_ASSERT(head_len + w.len <= RESPONSE_SIZE);
+    memcpy(&intf->response[head_len], body, w.len);
+    intf->response_len = head_len + w.len;
+    intf->response_pos = 0;
+}
+
+static void ipp_interface_out(ipp_interface_t *intf, const uint8_t *data, size_t len) {
+    if (!intf->active) {
+        intf->active = true;
+        if (++device.active > device.max_active) {
+            device.max_active = device.active;
+        }
+    }
+    while (len > 0) {
+        if (!intf->in_body) {
+            TEST_ASSERT(intf->head_len < sizeof(intf->head));
+            intf->head[intf->head_len++] = *data++;
+            len--;
+            if (http_header_end(intf->head, intf->head_len) != 0) {
+                intf->in_body = true;
+                intf->body_len = 0;
+                http_chunked_init(&intf->dec);
+            }
+            continue;
+        }
+
+        uint8_t buf[1024];
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        memcpy(buf, data, n);
+        size_t consumed, payload;
+        TEST_ASSERT_EQUAL(ESP_OK, http_chunked_decode(&intf->dec, buf, n, &consumed, &payload));
+        for (size_t i = 0; i < payload && intf->body_len + i < IPP_HEADER_SIZE; i++) {
+            intf->ipp_header[intf->body_len + i] = buf[i];
+        }
+        intf->body_len += payload;
+        intf->body_bytes += payload;
+        data += consumed;
+        len -= consumed;
+        if (intf->dec.done) {
+            TEST_ASSERT_EQUAL(0, len);
+            intf->requests++;
+            intf->in_body = false;
+            intf->head_len = 0;
+            ipp_interface_respond(intf);
+        }
+    }
+}
+
+static void device_bulk_out(void *ctx, uint8_t ep, const uint8_t *data, size_t len) {
+    pthread_mutex_lock(&device.lock);
+    ipp_interface_out(&device.intf[ep - 1], data, len);
+    pthread_mutex_unlock(&device.lock);
+}
+
+static int device_bulk_in(void *ctx, uint8_t ep, uint8_t *data, size_t max_len) {
+    pthread_mutex_lock(&device.lock);
+    ipp_interface_t *intf = &device.intf[(ep & 0x0F) - 1];
+    int len = -1;
+    if (intf->response_pos < intf->response_len) {
+        len = intf->response_len - intf->response_pos;
+        if ((size_t)len > max_len) {
+            len = max_len;
+        }
+        memcpy(data, &intf->response[intf->response_pos], len);
+        intf->response_pos += len;
+        if (intf->response_pos == intf->response_len) {
+            intf->active = false;
+            device.active--;
+        }
+    }
+    pthread_mutex_unlock(&device.lock);
+    return len;
+}
+
+static void device_attach(void) {
+    device.dev_desc = (usb_device_desc_t) {
+        .bLength = sizeof(usb_device_desc_t),
+        .bDescriptorType = USB_B_DESCRIPTOR_TYPE_DEVICE,
+        .bcdUSB = 0x0200,
+        .bMaxPacketSize0 = 64,
+        .idVendor = 0x03F0,
+        .idProduct = 0x0001,
+        .bNumConfigurations = 1,
+    };
+    uint8_t *p = device.config_desc;
+    const uint8_t config[] = {9, USB_B_DESCRIPTOR_TYPE_CONFIGURATION, sizeof(device.config_desc), 0, CHANNELS, 1, 0, 0xC0, 1};
+    memcpy(p, config, sizeof(config));
+    p += sizeof(config);
+    for (int i = 0; i < CHANNELS; i++) {
+        // IPP-USB interface with bulk OUT i+1 and IN 0x80|i+1, high speed
+        const uint8_t intf[] = {
+            9, USB_B_DESCRIPTOR_TYPE_INTERFACE, i, 0, 2, 0x07, 0x01, 0x04, 0,
+            7, USB_B_DESCRIPTOR_TYPE_ENDPOINT, i + 1, USB_BM_ATTRIBUTES_XFER_BULK, 0x00, 0x02, 0,
+            7, USB_B_DESCRIPTOR_TYPE_ENDPOINT, 0x80 | (i + 1), USB_BM_ATTRIBUTES_XFER_BULK, 0x00, 0x02, 0,
+        };
+        memcpy(p, intf, sizeof(intf));
+        p += sizeof(intf);
+    }
+    TEST_ASSERT(p == device.config_desc + sizeof(device.config_desc));
+
+    device.config = (mock_device_config_t) {
+        .dev_desc = &device.dev_desc,
+        .config_desc = device.config_desc,
+        .port_num = 1,
+        .bulk_out_bytes_per_ms = BYTES_PER_MS,
+        .ops = {
+            .bulk_out = device_bulk_out,
+            .bulk_in = device_bulk_in,
+        },
+    };
+    device.dev = mock_usb_attach(&device.config);
+    TEST_ASSERT(device.dev != NULL);
+}
+
+static void device_reset_stats(void) {
+    pthread_mutex_lock(&device.lock);
+    for (int i = 0; i < CHANNELS; i++) {
+        device.intf[i].requests = 0;
+        device.intf[i].body_bytes = 0;
+    }
+    device.max_active = device.active;
+    pthread_mutex_unlock(&device.lock);
+}
+
+static void client_event(const usb_host_client_event_msg_t *msg, void *arg) {
+}
+
+// Transfer callbacks only run in here, as with the class driver task
+static void pump_task(void *arg) {
+    while (!pump_stop) {
+        usb_host_client_handle_events(client_hdl, pdMS_TO_TICKS(10));
+    }
+    xSemaphoreGive(pump_stopped);
+    vTaskDelete(NULL);
+}
+
+typedef struct {
+    size_t size;
+    esp_err_t result;
+    int64_t end_us;
+    SemaphoreHandle_t done;
+} job_t;
+
+static void job_done(void *arg, esp_err_t result) {
+    job_t *job = arg;
+    job->result = result;
+    job->end_us = test_now_us();
+    xSemaphoreGive(job->done);
+}
+
+static void print_job_task(void *arg) {
+    static uint8_t data[JOB_SIZE];
+    job_t *job = arg;
+    job_done(job, ipp_usb_print_job(ipp, data, job->size, pdMS_TO_TICKS(5000)));
+    vTaskDelete(NULL);
+}
+
+// One job queued to the transport's task, another sent from a task of its own, the way a
+// network job and a test page can meet. Each interface takes JOB_SIZE at BYTES_PER_MS.
+static void test_two_jobs_print_in_parallel(void) {
+    static uint8_t data[JOB_SIZE];
+    device_reset_stats();
+    job_t queued = { .size = JOB_SIZE, .done = xSemaphoreCreateBinary() };
+    job_t direct = { .size = JOB_SIZE, .done = xSemaphoreCreateBinary() };
+
+    int64_t start_us = test_now_us();
+    TEST_ASSERT_EQUAL(ESP_OK, ipp_usb_queue_job(ipp, data, JOB_SIZE, job_done, &queued));
+    TEST_ASSERT(xTaskCreate(print_job_task, "print_job", 4096, &direct, 3, NULL) == pdTRUE);
+    TEST_ASSERT(xSemaphoreTake(queued.done, pdMS_TO_TICKS(WAIT_TIMEOUT_US / 1000)) == pdTRUE);
+    TEST_ASSERT(xSemaphoreTake(direct.done, pdMS_TO_TICKS(WAIT_TIMEOUT_US / 1000)) == pdTRUE);
+    TEST_ASSERT_EQUAL(ESP_OK, queued.result);
+    TEST_ASSERT_EQUAL(ESP_OK, direct.result);
+
+    int64_t end_us = queued.end_us > direct.end_us ? queued.end_us : direct.end_us;
+    int64_t one_job_us = (int64_t)JOB_SIZE * 1000 / BYTES_PER_MS;
+    printf("\tTwo %d KB jobs in %lld ms, one alone takes at least %lld ms\n",
+           JOB_SIZE / 1024, (long long)((end_us - start_us) / 1000), (long long)(one_job_us / 1000));
+    pthread_mutex_lock(&device.lock);
+    TEST_ASSERT_EQUAL(CHANNELS, device.max_active);
+    TEST_ASSERT_EQUAL(1, device.intf[0].requests);
+    TEST_ASSERT_EQUAL(1, device.intf[1].requests);
+    TEST_ASSERT(device.intf[0].body_bytes > JOB_SIZE);
+    TEST_ASSERT(device.intf[1].body_bytes > JOB_SIZE);
+    pthread_mutex_unlock(&device.lock);
+    // Back to back they would take twice as long
+    TEST_ASSERT(end_us - start_us < one_job_us * 3 / 2);
+
+    vSemaphoreDelete(queued.done);
+    vSemaphoreDelete(direct.done);
+}
+
+// A status query goes out on the second interface while the first is busy with a long job
+static void test_status_answers_during_job(void) {
+    static uint8_t data[LONG_JOB_SIZE];
+    device_reset_stats();
+    job_t job = { .size = LONG_JOB_SIZE, .done = xSemaphoreCreateBinary() };
+    TEST_ASSERT_EQUAL(ESP_OK, ipp_usb_queue_job(ipp, data, LONG_JOB_SIZE, job_done, &job));
+    for (int64_t start_us = test_now_us(); test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+        pthread_mutex_lock(&device.lock);
+        bool started = device.intf[0].body_bytes + device.intf[1].body_bytes > 0;
+        pthread_mutex_unlock(&device.lock);
+        if (started) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    uint8_t request[192];
+    ipp_writer_t w;
+    ipp_writer_init(&w, request, sizeof(request));
+    ipp_put_header(&w, IPP_OP_GET_PRINTER_ATTRIBUTES, 1);
+    ipp_put_tag(&w, IPP_TAG_OPERATION);
+    ipp_put_string(&w, IPP_TAG_CHARSET, "attributes-charset", "utf-8");
+    ipp_put_string(&w, IPP_TAG_LANGUAGE, "attributes-natural-language", "en");
+    ipp_put_string(&w, IPP_TAG_URI, "printer-uri", "ipp://localhost/ipp/print");
+    ipp_put_tag(&w, IPP_TAG_END);
+    uint8_t response[RESPONSE_SIZE];
+    size_t response_len;
+    int64_t start_us = test_now_us();
+    TEST_ASSERT_EQUAL(ESP_OK, ipp_usb_request(ipp, request, w.len, response, sizeof(response), &response_len,
+                                              pdMS_TO_TICKS(1000)));
+    int64_t status_us = test_now_us() - start_us;
+    TEST_ASSERT(xSemaphoreTake(job.done, 0) != pdTRUE);
+
+    uint8_t tag;
+    uint16_t len;
+    const uint8_t *value = ipp_find_attribute(response, response_len, "printer-state", &tag, &len);
+    TEST_ASSERT(value != NULL && len == 4);
+    TEST_ASSERT_EQUAL(IPP_PRINTER_STATE_PROCESSING, value[3]);
+    printf("\tprinter-state answered in %lld us while a %d KB job prints\n",
+           (long long)status_us, LONG_JOB_SIZE / 1024);
+    // A request behind the job would wait for all of it, about 2 s
+    TEST_ASSERT(status_us < 200 * 1000);
+
+    TEST_ASSERT(xSemaphoreTake(job.done, pdMS_TO_TICKS(WAIT_TIMEOUT_US / 1000)) == pdTRUE);
+    TEST_ASSERT_EQUAL(ESP_OK, job.result);
+    vSemaphoreDelete(job.done);
+}
+
+int main(void) {
+    released = xSemaphoreCreateBinary();
+    pump_stopped = xSemaphoreCreateBinary();
+    usb_host_client_config_t client_config = {
+        .is_synchronous = false,
+        .max_num_event_msg = 5,
+        .async = {
+            .client_event_callback = client_event,
+        },
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, usb_host_client_register(&client_config, &client_hdl));
+    TEST_ASSERT(xTaskCreate(pump_task, "pump", 4096, NULL, 5, NULL) == pdTRUE);
+    device_attach();
+    TEST_ASSERT_EQUAL(ESP_OK, usb_host_device_open(client_hdl, mock_usb_address(device.dev), &dev_hdl));
+    TEST_ASSERT_EQUAL(ESP_OK, ipp_usb_open(dev_hdl, client_hdl, &ipp));
+    // The status task's first poll says the transport is up
+    for (int64_t start_us = test_now_us(); ipp_usb_printer_state(ipp) == 0 && test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    TEST_ASSERT_EQUAL(IPP_PRINTER_STATE_IDLE, ipp_usb_printer_state(ipp));
+
+    RUN_TEST(test_two_jobs_print_in_parallel);
+    RUN_TEST(test_status_answers_during_job);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FINISHED, ipp_usb_close(ipp));
+    TEST_ASSERT(xSemaphoreTake(released, pdMS_TO_TICKS(WAIT_TIMEOUT_US / 1000)) == pdTRUE);
+    TEST_ASSERT_EQUAL(ESP_OK, ipp_usb_close(ipp));
+    TEST_ASSERT_EQUAL(ESP_OK, usb_host_device_close(client_hdl, dev_hdl));
+    pump_stop = true;
+    xSemaphoreTake(pump_stopped, portMAX_DELAY);
+    TEST_ASSERT_EQUAL(ESP_OK, usb_host_client_deregister(client_hdl));
+    mock_usb_detach(device.dev);
+    mock_usb_stats_t usb;
+    mock_usb_get_stats(&usb);
+    TEST_ASSERT_EQUAL(0, usb.transfers_allocated);
+    TEST_ASSERT_EQUAL(0, usb.misuse);
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Network print servers end to end, from a loopback client to a mock printer
+// A client sends a job the way a print spooler does and the printer on the mock USB host
+// checks every byte. Reports sustained MB/s and the time from connect to the first byte on
+// USB. The mock printer takes data without a rate limit, so the numbers are the pipeline's
+// own cost on this machine, not what a full-speed printer on the ESP32 gets.
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "raw_server.h"
+#include "lpd_server.h"
+#include "net_admission.h"
+#include "printer_handler.h"
+#include "mock_usb_host.h"
+#include "mock_printer.h"
+#include "test_util.h"
+
+#define WAIT_TIMEOUT_US             (10 * 1000 * 1000)
+#define JOB_SIZE                    (8 * 1024 * 1024)
+#define SEND_SIZE                   (16 * 1024)
+#define RUNS                        3
+
+void class_driver_task(void *arg);
+
+static mock_printer_t *printer;
+static uint8_t job_data[JOB_SIZE];
+
+typedef struct {
+    int64_t first_byte_us;                  // Connect to the first byte on USB
+    int64_t total_us;                       // Connect to the last byte on USB
+} ingest_result_t;
+
+static ingest_result_t raw_best;            // Fastest RAW run, LPD is measured against it
+
+static int printers_listed(void) {
+    printer_info_t list[PRINTER_MAX_COUNT];
+    return printer_handler_list(list, PRINTER_MAX_COUNT);
+}
+
+static uint16_t start_server(esp_err_t (*start)(uint16_t port)) {
+    uint16_t port;
+    close(test_tcp_listen(&port));
+    TEST_ASSERT_EQUAL(ESP_OK, start(port));
+    close(test_tcp_connect(port));
+    return port;
+}
+
+// Waits until the printer has taken size bytes, all of them in order
+static void wait_printed(size_t size, int64_t start_us, ingest_result_t *result) {
+    mock_printer_stats_t stats;
+    for (int64_t wait_us = test_now_us(); test_now_us() - wait_us < WAIT_TIMEOUT_US;) {
+        mock_printer_get_stats(printer, &stats);
+        if (stats.bytes >= size) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    TEST_ASSERT_EQUAL(size, stats.bytes);
+    TEST_ASSERT_EQUAL(0, stats.mismatches);
+    result->first_byte_us = stats.first_byte_us - start_us;
+    result->total_us = stats.last_byte_us - start_us;
+}
+
+static void print_result(const char *what, const ingest_result_t *result) {
+    printf("\t%s: %.1f MB/s, first USB byte after %lld us\n", what,
+           (double)JOB_SIZE / result->total_us, (long long)result->first_byte_us);
+}
+
+// One connection is one job, it ends when the client closes
+static void raw_send_job(uint16_t port, ingest_result_t *result) {
+    mock_printer_reset_stats(printer);
+    int64_t start_us = esp_timer_get_time();
+    int sock = test_tcp_connect(port);
+    for (size_t pos = 0; pos < JOB_SIZE; pos += SEND_SIZE) {
+        TEST_ASSERT(test_send_all(sock, &job_data[pos], SEND_SIZE));
+    }
+    close(sock);
+    wait_printed(JOB_SIZE, start_us, result);
+}
+
+static void lpd_expect_ack(int sock) {
+    uint8_t ack = 0xFF;
+    TEST_ASSERT_EQUAL(1, recv(sock, &ack, 1, MSG_WAITALL));
+    TEST_ASSERT_EQUAL(0, ack);
+}
+
+static void lpd_send_line(int sock, const char *line) {
+    TEST_ASSERT(test_send_all(sock, line, strlen(line)));
+    lpd_expect_ack(sock);
+}
+
+// Receive job with a control file and one data file of known size, the way lpr sends it
+static void lpd_send_job(uint16_t port, ingest_result_t *result) {
+    static const char control[] = "Htest\nPbench\nJbenchmark\nldfA001test\n";
+    char line[64];
+    mock_printer_reset_stats(printer);
+    int64_t start_us = esp_timer_get_time();
+    int sock = test_tcp_connect(port);
+    lpd_send_line(sock, "\x02lp\n");
+    snprintf(line, sizeof(line), "\x02%zu cfA001test\n", sizeof(control) - 1);
+    lpd_send_line(sock, line);
+    TEST_ASSERT(test_send_all(sock, control, sizeof(control)));     // With its trailing zero byte
+    lpd_expect_ack(sock);
+    snprintf(line, sizeof(line), "\x03%d dfA001test\n", JOB_SIZE);
+    lpd_send_line(sock, line);
+    for (size_t pos = 0; pos < JOB_SIZE; pos += SEND_SIZE) {
+        TEST_ASSERT(test_send_all(sock, &job_data[pos], SEND_SIZE));
+    }
+    TEST_ASSERT(test_send_all(sock, "", 1));
+    // Acknowledged once the printer has the whole file
+    lpd_expect_ack(sock);
+    close(sock);
+    wait_printed(JOB_SIZE, start_us, result);
+}
+
+static void test_raw_throughput(void) {
+    uint16_t port = start_server(raw_server_start);
+    for (int run = 0; run < RUNS; run++) {
+        ingest_result_t result;
+        raw_send_job(port, &result);
+        print_result("RAW 9100", &result);
+        TEST_ASSERT(result.first_byte_us < WAIT_TIMEOUT_US);
+        if (run == 0 || result.total_us < raw_best.total_us) {
+            raw_best = result;
+        }
+    }
+}
+
+// Both servers receive straight into the job's stream, so LPD has to keep up with RAW. A data
+// file buffered before printing would also hold back its first USB byte until the end.
+static void test_lpd_against_raw(void) {
+    uint16_t port = start_server(lpd_server_start);
+    ingest_result_t best = {0};
+    for (int run = 0; run < RUNS; run++) {
+        ingest_result_t result;
+        lpd_send_job(port, &result);
+        print_result("LPD 515", &result);
+        if (run == 0 || result.total_us < best.total_us) {
+            best = result;
+        }
+    }
+    printf("\tBest runs: LPD %.1f MB/s, RAW %.1f MB/s\n",
+           (double)JOB_SIZE / best.total_us, (double)JOB_SIZE / raw_best.total_us);
+    TEST_ASSERT(best.total_us < raw_best.total_us * 2);
+    TEST_ASSERT(best.first_byte_us < best.total_us / 2);
+}
+
+int main(void) {
+    for (size_t i = 0; i < JOB_SIZE; i++) {
+        job_data[i] = test_pattern(i);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, net_admission_init());
+    xTaskCreate(class_driver_task, "class", 4096, NULL, 5, NULL);
+    mock_usb_stats_t usb;
+    for (int64_t start_us = test_now_us(); test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+        mock_usb_get_stats(&usb);
+        if (usb.clients == 1) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    TEST_ASSERT_EQUAL(1, usb.clients);
+    mock_printer_config_t config = {
+        .vid = 0x04B8,
+        .pid = 0x0005,
+        .serial = "INGEST01",
+        .device_id = "MFG:Mock;MDL:Ingest;CMD:PCL;",
+        .port_num = 1,
+        .check_pattern = true,
+    };
+    printer = mock_printer_attach(&config);
+    for (int64_t start_us = test_now_us(); printers_listed() == 0 && test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    TEST_ASSERT_EQUAL(1, printers_listed());
+
+    RUN_TEST(test_raw_throughput);
+    RUN_TEST(test_lpd_against_raw);
+    return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Print stream and network job back-pressure
+// A client sends multi-MB documents over a loopback TCP connection into a net_job, and a
+// slow mock printer drains the stream the way a printer worker does. However large the
+// job, the bridge must never hold more than the stream's ring for it.
+
+#include <string.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+#include "print_stream.h"
+#include "net_job.h"
+#include "printer_handler.h"
+#include "test_util.h"
+
+#define MOCK_PRINTER_READ_SIZE      4096    // One bulk OUT transfer
+#define MOCK_PRINTER_DELAY_US       1000    // Per transfer, about 4 MB/s
+#define HEAP_SAMPLE_EVERY           64      // Reads between heap samples
+
+// Slow mock printer, stands in for the printer worker behind printer_handler_submit_stream()
+typedef struct {
+    print_stream_t *stream;
+    printer_job_done_cb_t done;
+    void *done_arg;
+} mock_job_t;
+
+static struct {
+    size_t bytes;
+    size_t mismatches;
+    size_t heap_base;                       // Heap in use when the job was submitted
+    size_t heap_peak;                       // Most heap in use while it printed
+    esp_err_t result;
+} mock_printer;
+
+static size_t heap_in_use(void) {
+    return mallinfo2().uordblks;
+}
+
+static void mock_printer_task(void *arg) {
+    mock_job_t *job = (mock_job_t *)arg;
+    uint8_t *buf = malloc(MOCK_PRINTER_READ_SIZE);
+    TEST_ASSERT(buf != NULL);
+    esp_err_t ret;
+    for (uint32_t reads = 0;; reads++) {
+        size_t len;
+        ret = print_stream_read(job->stream, buf, MOCK_PRINTER_READ_SIZE, &len, pdMS_TO_TICKS(5000));
+        if (ret != ESP_OK || len == 0) {
+            break;
+        }
+        for (size_t i = 0; i < len; i++) {
+            if (buf[i] != test_pattern(mock_printer.bytes + i)) {
+                mock_printer.mismatches++;
+            }
+        }
+        mock_printer.bytes += len;
+        if (reads % HEAP_SAMPLE_EVERY == 0) {
+            size_t heap = heap_in_use();
+            if (heap > mock_printer.heap_peak) {
+                mock_printer.heap_peak = heap;
+            }
+        }
+        usleep(MOCK_PRINTER_DELAY_US);
+    }
+    free(buf);
+    mock_printer.result = ret;
+    job->done(job->done_arg, ret);
+    free(job);
+    vTaskDelete(NULL);
+}
+
+esp_err_t printer_handler_submit_stream(const char *printer_id, print_stream_t *stream,
+                                        printer_job_done_cb_t done, void *done_arg) {
+    mock_job_t *job = malloc(sizeof(mock_job_t));
+    TEST_ASSERT(job != NULL);
+    job->stream = stream;
+    job->done = done;
+    job->done_arg = done_arg;
+    memset(&mock_printer, 0, sizeof(mock_printer));
+    mock_printer.heap_base = heap_in_use();
+    mock_printer.heap_peak = mock_printer.heap_base;
+    TEST_ASSERT(xTaskCreate(mock_printer_task, "mock_printer", 4096, job, 2, NULL) == pdTRUE);
+    return ESP_OK;
+}
+
+// Loopback client sending a test document
+typedef struct {
+    int sock;
+    size_t size;
+} client_arg_t;
+
+static void client_task(void *arg) {
+    client_arg_t *client = (client_arg_t *)arg;
+    uint8_t chunk[1460];
+    for (size_t sent = 0; sent < client->size;) {
+        size_t n = client->size - sent < sizeof(chunk) ? client->size - sent : sizeof(chunk);
+        for (size_t i = 0; i < n; i++) {
+            chunk[i] = test_pattern(sent + i);
+        }
+        TEST_ASSERT(test_send_all(client->sock, chunk, n));
+        sent += n;
+    }
+    shutdown(client->sock, SHUT_WR);
+    vTaskDelete(NULL);
+}
+
+typedef struct {
+    print_stream_stats_t stats;
+    size_t heap_growth;
+} loopback_result_t;
+
+// Receives a document of size bytes the way the RAW server does
+static loopback_result_t run_loopback_job(size_t size) {
+    int client_sock, server_sock;
+    test_tcp_pair(&client_sock, &server_sock);
+    client_arg_t client = {
+        .sock = client_sock,
+        .size = size,
+    };
+
+    net_job_t job;
+    TEST_ASSERT_EQUAL(ESP_OK, net_job_start(&job, NULL));
+    TEST_ASSERT(xTaskCreate(client_task, "client", 4096, &client, 2, NULL) == pdTRUE);
+    while (1) {
+        int len;
+        TEST_ASSERT_EQUAL(ESP_OK, net_job_recv(&job, server_sock, SIZE_MAX, &len));
+        TEST_ASSERT(len >= 0);
+        if (len == 0) {
+            break;
+        }
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, net_job_finish(&job, true));
+
+    loopback_result_t result = {
+        .heap_growth = mock_printer.heap_peak - mock_printer.heap_base,
+    };
+    net_job_get_stats(&job, &result.stats);
+    net_job_free(&job, "test", "127.0.0.1");
+    close(client_sock);
+    close(server_sock);
+
+    TEST_ASSERT_EQUAL(ESP_OK, mock_printer.result);
+    TEST_ASSERT_EQUAL(size, mock_printer.bytes);
+    TEST_ASSERT_EQUAL(0, mock_printer.mismatches);
+    TEST_ASSERT_EQUAL(size, result.stats.bytes);
+    printf("  %zu KB job: peak fill %zu of %d bytes, %" PRIu32 " pauses for %lld ms, heap growth %zu bytes\n",
+           size / 1024, result.stats.peak_count, NET_JOB_STREAM_SIZE, result.stats.pauses,
+           (long long)result.stats.paused_us / 1000, result.heap_growth);
+    return result;
+}
+
+// A slow printer holds the job's memory at the ring size, whatever the job size
+static void test_loopback_memory_bounded(void) {
+    loopback_result_t small = run_loopback_job(1024 * 1024);
+    loopback_result_t large = run_loopback_job(8 * 1024 * 1024);
+
+    TEST_ASSERT(small.stats.peak_count <= NET_JOB_STREAM_SIZE);
+    TEST_ASSERT(large.stats.peak_count <= NET_JOB_STREAM_SIZE);
+    // The printer is the bottleneck, so the writer must have been held back
+    TEST_ASSERT(small.stats.pauses > 0);
+    TEST_ASSERT(large.stats.pauses > small.stats.pauses);
+    // Everything was received in place, nothing went through a copy
+    TEST_ASSERT_EQUAL(0, large.stats.copied);
+    TEST_ASSERT_EQUAL(8 * 1024 * 1024, large.stats.forwarded);
+    // Eight times the data must not need more memory on the bridge side
+    TEST_ASSERT(large.heap_growth <= small.heap_growth + NET_JOB_STREAM_SIZE);
+}
+
+// Writer task that blocks on a paused stream
+typedef struct {
+    print_stream_t *stream;
+    size_t len;
+    volatile bool done;
+    esp_err_t result;
+} writer_arg_t;
+
+static void writer_task(void *arg) {
+    writer_arg_t *writer = (writer_arg_t *)arg;
+    uint8_t data[64] = {0};
+    writer->result = print_stream_write(writer->stream, data, writer->len);
+    writer->done = true;
+    vTaskDelete(NULL);
+}
+
+static bool wait_done(volatile bool *done, int timeout_ms) {
+    for (int waited = 0; !*done && waited < timeout_ms; waited += 5) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    return *done;
+}
+
+// A full ring takes writes again only once drained to the low watermark
+static void test_low_watermark_hysteresis(void) {
+    print_stream_t *stream = print_stream_create(1024, 256);
+    TEST_ASSERT(stream != NULL);
+    uint8_t buf[1024] = {0};
+    TEST_ASSERT_EQUAL(ESP_OK, print_stream_write(stream, buf, sizeof(buf)));
+
+    writer_arg_t writer = {
+        .stream = stream,
+        .len = 1,
+    };
+    TEST_ASSERT(xTaskCreate(writer_task, "writer", 4096, &writer, 2, NULL) == pdTRUE);
+
+    // 324 bytes left, above the watermark, the writer stays paused
+    size_t len;
+    TEST_ASSERT_EQUAL(ESP_OK, print_stream_read(stream, buf, 700, &len, 0));
+    TEST_ASSERT_EQUAL(700, len);
+    TEST_ASSERT(!wait_done(&writer.done, 200));
+
+    // Down to the watermark, the writer goes on
+    TEST_ASSERT_EQUAL(ESP_OK, print_stream_read(stream, buf, 68, &len, 0));
+    TEST_ASSERT(wait_done(&writer.done, 1000));
+    TEST_ASSERT_EQUAL(ESP_OK, writer.result);
+
+    print_stream_stats_t stats;
+    print_stream_get_stats(stream, &stats);
+    TEST_ASSERT_EQUAL(1, stats.pauses);
+    TEST_ASSERT_EQUAL(1024, stats.peak_count);
+    TEST_ASSERT(stats.paused_us >= 150000);
+    print_stream_delete(stream);
+}
+
+// A printer that gives up releases a writer blocked on the full ring
+static void test_reader_abort_releases_writer(void) {
+    print_stream_t *stream = print_stream_create(256, 64);
+    TEST_ASSERT(stream != NULL);
+    writer_arg_t writer = {
+        .stream = stream,
+        .len = 512,
+    };
+    TEST_ASSERT(xTaskCreate(writer_task, "writer", 4096, &writer, 2, NULL) == pdTRUE);
+    TEST_ASSERT(!wait_done(&writer.done, 100));
+
+    print_stream_abort(stream);
+    TEST_ASSERT(wait_done(&writer.done, 1000));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, writer.result);
+    print_stream_delete(stream);
+}
+
+// The reader tells a complete job from one whose client went away
+static void test_finish_complete_and_truncated(void) {
+    uint8_t buf[16];
+    size_t len;
+    print_stream_t *stream = print_stream_create(64, 16);
+    TEST_ASSERT_EQUAL(ESP_OK, print_stream_write(stream, (const uint8_t *)"abc", 3));
+    print_stream_finish(stream, true);
+    TEST_ASSERT_EQUAL(ESP_OK, print_stream_read(stream, buf, sizeof(buf), &len, 0));
+    TEST_ASSERT_EQUAL(3, len);
+    TEST_ASSERT_EQUAL(ESP_OK, print_stream_read(stream, buf, sizeof(buf), &len, 0));
+    TEST_ASSERT_EQUAL(0, len);
+    print_stream_delete(stream);
+
+    stream = print_stream_create(64, 16);
+    print_stream_finish(stream, false);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, print_stream_read(stream, buf, sizeof(buf), &len, 0));
+    print_stream_delete(stream);
+}
+
+int main(void) {
+    RUN_TEST(test_finish_complete_and_truncated);
+    RUN_TEST(test_low_watermark_hysteresis);
+    RUN_TEST(test_reader_abort_releases_writer);
+    RUN_TEST(test_loopback_memory_bounded);
+    return 0;
+}
@@ -0,0 +1,304 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// USB/IP server over loopback, with a mock printer on the mock USB host
+// A test client imports the printer and runs CMD_SUBMIT and CMD_UNLINK against it the way
+// the Linux vhci driver does, and checks every RET_SUBMIT and RET_UNLINK. While the printer
+// is imported, other hosts still get the device list.
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "usbip_server.h"
+#include "net_admission.h"
+#include "printer_handler.h"
+#include "mock_usb_host.h"
+#include "mock_printer.h"
+#include "test_util.h"
+
+#define WAIT_TIMEOUT_US             (5 * 1000 * 1000)
+#define TEST_DEVICE_ID              "MFG:Mock;MDL:USBIP;CMD:PCL;"
+#define OUT_URB_SIZE                4000
+
+// Protocol, as in usbip_server.c
+#define USBIP_VERSION               0x0111
+#define USBIP_OP_REQ_DEVLIST        0x8005
+#define USBIP_OP_REP_DEVLIST        0x0005
+#define USBIP_OP_REQ_IMPORT         0x8003
+#define USBIP_OP_REP_IMPORT         0x0003
+#define USBIP_DEVICE_SIZE           312
+#define USBIP_INTERFACE_SIZE        4
+#define USBIP_HEADER_SIZE           48
+#define USBIP_CMD_SUBMIT            1
+#define USBIP_CMD_UNLINK            2
+#define USBIP_RET_SUBMIT            3
+#define USBIP_RET_UNLINK            4
+#define USBIP_DIR_OUT               0
+#define USBIP_DIR_IN                1
+#define USBIP_ECONNRESET            104
+
+void class_driver_task(void *arg);
+
+static uint16_t server_port;
+static char printer_id[PRINTER_ID_LEN];
+
+typedef struct {
+    uint32_t command;
+    uint32_t seqnum;
+    int32_t status;
+    uint32_t actual;
+    uint8_t data[256];
+} usbip_reply_t;
+
+static void put_u16(uint8_t *p, uint16_t val) {
+    p[0] = val >> 8;
+    p[1] = val & 0xFF;
+}
+
+static void put_u32(uint8_t *p, uint32_t val) {
+    put_u16(p, val >> 16);
+    put_u16(&p[2], val & 0xFFFF);
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return ((uint32_t)get_u16(p) << 16) | get_u16(&p[2]);
+}
+
+static void recv_all(int sock, void *buf, size_t len) {
+    for (uint8_t *p = buf; len > 0;) {
+        ssize_t n = recv(sock, p, len, 0);
+        TEST_ASSERT(n > 0);
+        p += n;
+        len -= n;
+    }
+}
+
+// Connects with a receive timeout, so a server that never answers fails the test
+static int usbip_connect(void) {
+    int sock = test_tcp_connect(server_port);
+    int opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    struct timeval timeout = {
+        .tv_sec = WAIT_TIMEOUT_US / 1000000,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return sock;
+}
+
+static void send_op(int sock, uint16_t code) {
+    uint8_t op[8] = {0};
+    put_u16(&op[0], USBIP_VERSION);
+    put_u16(&op[2], code);
+    TEST_ASSERT(test_send_all(sock, op, sizeof(op)));
+}
+
+// Reads an op reply header and checks its code, returns its status
+static uint32_t recv_op(int sock, uint16_t code) {
+    uint8_t op[8];
+    recv_all(sock, op, sizeof(op));
+    TEST_ASSERT_EQUAL(USBIP_VERSION, get_u16(&op[0]));
+    TEST_ASSERT_EQUAL(code, get_u16(&op[2]));
+    return get_u32(&op[4]);
+}
+
+// Checks the devlist lists the mock printer, on a connection of its own
+static void expect_devlist(void) {
+    int sock = usbip_connect();
+    send_op(sock, USBIP_OP_REQ_DEVLIST);
+    TEST_ASSERT_EQUAL(0, recv_op(sock, USBIP_OP_REP_DEVLIST));
+    uint8_t count[4];
+    recv_all(sock, count, sizeof(count));
+    TEST_ASSERT_EQUAL(1, get_u32(count));
+    uint8_t device[USBIP_DEVICE_SIZE + USBIP_INTERFACE_SIZE];
+    recv_all(sock, device, sizeof(device));
+    TEST_ASSERT(strncmp((const char *)&device[256], printer_id, 31) == 0);
+    TEST_ASSERT_EQUAL(0x04B8, get_u16(&device[300]));
+    TEST_ASSERT_EQUAL(1, device[311]);
+    TEST_ASSERT_EQUAL(0x07, device[USBIP_DEVICE_SIZE]);
+    close(sock);
+}
+
+static void send_submit(int sock, uint32_t seqnum, uint32_t dir, uint8_t ep, const uint8_t *setup,
+                        const uint8_t *data, uint32_t len) {
+    uint8_t hdr[USBIP_HEADER_SIZE] = {0};
+    put_u32(&hdr[0], USBIP_CMD_SUBMIT);
+    put_u32(&hdr[4], seqnum);
+    put_u32(&hdr[8], 1 << 16 | 1);
+    put_u32(&hdr[12], dir);
+    put_u32(&hdr[16], ep);
+    put_u32(&hdr[24], len);
+    put_u32(&hdr[32], UINT32_MAX);          // Not isochronous
+    if (setup != NULL) {
+        memcpy(&hdr[40], setup, 8);
+    }
+    TEST_ASSERT(test_send_all(sock, hdr, sizeof(hdr)));
+    if (dir == USBIP_DIR_OUT && len > 0) {
+        TEST_ASSERT(test_send_all(sock, data, len));
+    }
+}
+
+static void send_unlink(int sock, uint32_t seqnum, uint32_t target) {
+    uint8_t hdr[USBIP_HEADER_SIZE] = {0};
+    put_u32(&hdr[0], USBIP_CMD_UNLINK);
+    put_u32(&hdr[4], seqnum);
+    put_u32(&hdr[20], target);
+    TEST_ASSERT(test_send_all(sock, hdr, sizeof(hdr)));
+}
+
+// Reads a RET_SUBMIT or RET_UNLINK, with the IN data of a RET_SUBMIT
+static void recv_reply(int sock, bool in, usbip_reply_t *reply) {
+    uint8_t hdr[USBIP_HEADER_SIZE];
+    recv_all(sock, hdr, sizeof(hdr));
+    reply->command = get_u32(&hdr[0]);
+    reply->seqnum = get_u32(&hdr[4]);
+    reply->status = (int32_t)get_u32(&hdr[20]);
+    reply->actual = get_u32(&hdr[24]);
+    if (reply->command == USBIP_RET_SUBMIT && in && reply->actual > 0) {
+        TEST_ASSERT(reply->actual <= sizeof(reply->data));
+        recv_all(sock, reply->data, reply->actual);
+    }
+}
+
+static void test_devlist(void) {
+    expect_devlist();
+}
+
+static void test_import_round_trips(void) {
+    int sock = usbip_connect();
+    send_op(sock, USBIP_OP_REQ_IMPORT);
+    char busid[32] = {0};
+    strlcpy(busid, printer_id, sizeof(busid));
+    TEST_ASSERT(test_send_all(sock, busid, sizeof(busid)));
+    TEST_ASSERT_EQUAL(0, recv_op(sock, USBIP_OP_REP_IMPORT));
+    uint8_t device[USBIP_DEVICE_SIZE];
+    recv_all(sock, device, sizeof(device));
+    TEST_ASSERT(strcmp((const char *)&device[256], busid) == 0);
+
+    // The import holds its connection, other hosts are still served meanwhile
+    expect_devlist();
+    // And the printer takes no local jobs while exported
+    static const uint8_t local_job[16];
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, printer_handler_submit(printer_id, local_job, sizeof(local_job), NULL, NULL));
+
+    // Bulk OUT
+    static uint8_t data[OUT_URB_SIZE];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = test_pattern(i);
+    }
+    usbip_reply_t reply;
+    send_submit(sock, 1, USBIP_DIR_OUT, MOCK_PRINTER_EP_OUT, NULL, data, sizeof(data));
+    recv_reply(sock, false, &reply);
+    TEST_ASSERT_EQUAL(USBIP_RET_SUBMIT, reply.command);
+    TEST_ASSERT_EQUAL(1, reply.seqnum);
+    TEST_ASSERT_EQUAL(0, reply.status);
+    TEST_ASSERT_EQUAL(sizeof(data), reply.actual);
+
+    // Class request on the control endpoint, GET_DEVICE_ID
+    const uint8_t get_device_id[8] = { 0xA1, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x00 };
+    send_submit(sock, 2, USBIP_DIR_IN, 0, get_device_id, NULL, 255);
+    recv_reply(sock, true, &reply);
+    TEST_ASSERT_EQUAL(USBIP_RET_SUBMIT, reply.command);
+    TEST_ASSERT_EQUAL(2, reply.seqnum);
+    TEST_ASSERT_EQUAL(0, reply.status);
+    TEST_ASSERT_EQUAL(2 + strlen(TEST_DEVICE_ID), reply.actual);
+    TEST_ASSERT_EQUAL(reply.actual, get_u16(reply.data));
+    TEST_ASSERT(memcmp(&reply.data[2], TEST_DEVICE_ID, strlen(TEST_DEVICE_ID)) == 0);
+
+    // Bulk IN the printer NAKs stays in flight until unlinked, and then never completes
+    send_submit(sock, 3, USBIP_DIR_IN, MOCK_PRINTER_EP_IN & 0x0F, NULL, NULL, 64);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    send_unlink(sock, 4, 3);
+    recv_reply(sock, false, &reply);
+    TEST_ASSERT_EQUAL(USBIP_RET_UNLINK, reply.command);
+    TEST_ASSERT_EQUAL(4, reply.seqnum);
+    TEST_ASSERT_EQUAL(-USBIP_ECONNRESET, reply.status);
+
+    // Unlinking what is already done finds nothing
+    send_unlink(sock, 5, 1);
+    recv_reply(sock, false, &reply);
+    TEST_ASSERT_EQUAL(USBIP_RET_UNLINK, reply.command);
+    TEST_ASSERT_EQUAL(5, reply.seqnum);
+    TEST_ASSERT_EQUAL(0, reply.status);
+
+    // The endpoint works again after the flush, and the next reply is this one, not seqnum 3
+    send_submit(sock, 6, USBIP_DIR_OUT, MOCK_PRINTER_EP_OUT, NULL, data, 100);
+    recv_reply(sock, false, &reply);
+    TEST_ASSERT_EQUAL(USBIP_RET_SUBMIT, reply.command);
+    TEST_ASSERT_EQUAL(6, reply.seqnum);
+    TEST_ASSERT_EQUAL(0, reply.status);
+    TEST_ASSERT_EQUAL(100, reply.actual);
+
+    // Detaching gives the printer back to local jobs
+    close(sock);
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+    for (int64_t start_us = test_now_us(); ret == ESP_ERR_INVALID_STATE && test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        ret = printer_handler_submit(printer_id, local_job, sizeof(local_job), NULL, NULL);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, ret);
+}
+
+int main(void) {
+    xTaskCreate(class_driver_task, "class", 4096, NULL, 5, NULL);
+    mock_printer_config_t config = {
+        .vid = 0x04B8,
+        .pid = 0x0005,
+        .serial = "USBIP01",
+        .device_id = TEST_DEVICE_ID,
+        .port_num = 1,
+    };
+    mock_usb_stats_t usb;
+    for (int64_t start_us = test_now_us(); test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+        mock_usb_get_stats(&usb);
+        if (usb.clients == 1) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    TEST_ASSERT_EQUAL(1, usb.clients);
+    mock_printer_t *printer = mock_printer_attach(&config);
+    printer_info_t list[PRINTER_MAX_COUNT];
+    int listed = 0;
+    for (int64_t start_us = test_now_us(); listed == 0 && test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+        listed = printer_handler_list(list, PRINTER_MAX_COUNT);
+    }
+    TEST_ASSERT_EQUAL(1, listed);
+    strcpy(printer_id, list[0].id);
+
+    TEST_ASSERT_EQUAL(ESP_OK, net_admission_init());
+    int sock = test_tcp_listen(&server_port);
+    close(sock);
+    TEST_ASSERT_EQUAL(ESP_OK, usbip_server_start(server_port));
+    close(test_tcp_connect(server_port));
+
+    RUN_TEST(test_devlist);
+    RUN_TEST(test_import_round_trips);
+
+    // Both URBs and the local job after the export reached the printer
+    mock_printer_stats_t stats;
+    for (int64_t start_us = test_now_us(); test_now_us() - start_us < WAIT_TIMEOUT_US;) {
+        mock_printer_get_stats(printer, &stats);
+        if (stats.bytes >= OUT_URB_SIZE + 100 + 16) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    TEST_ASSERT_EQUAL(OUT_URB_SIZE + 100 + 16, stats.bytes);
+    mock_usb_get_stats(&usb);
+    TEST_ASSERT_EQUAL(0, usb.misuse);
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "test_util.h"
+
+int test_tcp_listen(uint16_t *port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT(sock >= 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    TEST_ASSERT(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    TEST_ASSERT(listen(sock, 4) == 0);
+    socklen_t len = sizeof(addr);
+    TEST_ASSERT(getsockname(sock, (struct sockaddr *)&addr, &len) == 0);
+    *port = ntohs(addr.sin_port);
+    return sock;
+}
+
+int test_tcp_connect(uint16_t port) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    for (int attempt = 0; attempt < 200; attempt++) {
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        TEST_ASSERT(sock >= 0);
+        if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            return sock;
+        }
+        close(sock);
+        usleep(10000);
+    }
+    fprintf(stderr, "Could not connect to port %d\n", port);
+    abort();
+}
+
+void test_tcp_pair(int *client, int *server) {
+    uint16_t port;
+    int listen_sock = test_tcp_listen(&port);
+    *client = test_tcp_connect(port);
+    *server = accept(listen_sock, NULL, NULL);
+    TEST_ASSERT(*server >= 0);
+    close(listen_sock);
+}
+
+int test_send_all(int sock, const void *data, size_t len) {
+    const uint8_t *p = data;
+    while (len > 0) {
+        ssize_t n = send(sock, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+int64_t test_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,58 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Assertions and loopback helpers shared by the host tests
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define TEST_ASSERT(cond) do {                                                          \
+        if (!(cond)) {                                                                  \
+            fprintf(stderr, "%s:%d: assertion failed: %s\n", __FILE__, __LINE__, #cond); \
+            abort();                                                                    \
+        }                                                                               \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL(expected, actual) do {                                        \
+        long long expected_ = (long long)(expected);                                    \
+        long long actual_ = (long long)(actual);                                        \
+        if (expected_ != actual_) {                                                     \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__,   \
+                    #actual, actual_, expected_);                                       \
+            abort();                                                                    \
+        }                                                                               \
+    } while (0)
+
+#define RUN_TEST(fn) do {                                                               \
+        printf("%s\n", #fn);                                                            \
+        fflush(stdout);                                                                 \
+        fn();                                                                           \
+        printf("%s: ok\n", #fn);                                                        \
+    } while (0)
+
+// Connected TCP sockets over 127.0.0.1
+void test_tcp_pair(int *client, int *server);
+
+// Listening socket on 127.0.0.1 with a free port, port returns the port
+int test_tcp_listen(uint16_t *port);
+
+// Connects to 127.0.0.1:port, retrying while the server is still starting
+int test_tcp_connect(uint16_t port);
+
+// Writes all of len bytes, false on error
+int test_send_all(int sock, const void *data, size_t len);
+
+// Byte at offset pos of the test documents, so receivers can check order and content
+static inline uint8_t test_pattern(size_t pos) {
+    return (uint8_t)((pos >> 8) ^ (pos * 7));
+}
+
+// Microseconds of the monotonic clock
+int64_t test_now_us(void);
@@ -0,0 +1,143 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include "esp_log.h"
+
+#include "bulk_pipe.h"
+
+static const char *TAG = "Bulk pipe";
+
+static void bulk_pipe_transfer_callback(usb_transfer_t *transfer) {
+    xSemaphoreGive((SemaphoreHandle_t)transfer->context);
+}
+
+static void bulk_pipe_abort_ep(bulk_pipe_t *pipe, uint8_t ep) {
+    usb_host_endpoint_halt(pipe->dev_hdl, ep);
+    usb_host_endpoint_flush(pipe->dev_hdl, ep);
+    usb_host_endpoint_clear(pipe->dev_hdl, ep);
+}
+
+esp_err_t bulk_pipe_init(bulk_pipe_t *pipe, usb_device_handle_t dev_hdl, uint8_t out_ep,
+                         uint8_t in_ep, uint16_t in_mps, size_t buf_size) {
+    memset(pipe, 0, sizeof(bulk_pipe_t));
+    pipe->dev_hdl = dev_hdl;
+    pipe->out_ep = out_ep;
+    pipe->in_ep = in_ep;
+    pipe->in_mps = in_mps;
+    pipe->buf_size = buf_size;
+
+    pipe->out_done_sem = xSemaphoreCreateBinary();
+    pipe->in_done_sem = xSemaphoreCreateBinary();
+    if (pipe->out_done_sem == NULL || pipe->in_done_sem == NULL
+        || usb_host_transfer_alloc(buf_size, 0, &pipe->out_xfer) != ESP_OK
+        || usb_host_transfer_alloc(buf_size, 0, &pipe->in_xfer) != ESP_OK) {
+        bulk_pipe_deinit(pipe);
+        return ESP_ERR_NO_MEM;
+    }
+
+    pipe->out_xfer->device_handle = dev_hdl;
+    pipe->out_xfer->bEndpointAddress = out_ep;
+    pipe->out_xfer->callback = bulk_pipe_transfer_callback;
+    pipe->out_xfer->context = pipe->out_done_sem;
+    pipe->in_xfer->device_handle = dev_hdl;
+    pipe->in_xfer->bEndpointAddress = in_ep;
+    pipe->in_xfer->callback = bulk_pipe_transfer_callback;
+    pipe->in_xfer->context = pipe->in_done_sem;
+    return ESP_OK;
+}
+
+void bulk_pipe_deinit(bulk_pipe_t *pipe) {
+    if (pipe->in_pending) {
+        bulk_pipe_abort_ep(pipe, pipe->in_ep);
+        xSemaphoreTake(pipe->in_done_sem, portMAX_DELAY);
+        pipe->in_pending = false;
+    }
+    if (pipe->out_xfer) {
+        usb_host_transfer_free(pipe->out_xfer);
+    }
+    if (pipe->in_xfer) {
+        usb_host_transfer_free(pipe->in_xfer);
+    }
+    if (pipe->out_done_sem) {
+        vSemaphoreDelete(pipe->out_done_sem);
+    }
+    if (pipe->in_done_sem) {
+        vSemaphoreDelete(pipe->in_done_sem);
+    }
+    memset(pipe, 0, sizeof(bulk_pipe_t));
+}
+
+esp_err_t bulk_pipe_write(bulk_pipe_t *pipe, const uint8_t *data, size_t len, TickType_t timeout) {
+    while (len > 0) {
+        size_t chunk = len < pipe->buf_size ? len : pipe->buf_size;
+        memcpy(pipe->out_xfer->data_buffer, data, chunk);
+        pipe->out_xfer->num_bytes = chunk;
+
+        esp_err_t ret = usb_host_transfer_submit(pipe->out_xfer);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        if (xSemaphoreTake(pipe->out_done_sem, timeout) != pdTRUE) {
+            // Cancel the stuck transfer so it can be reused
+            bulk_pipe_abort_ep(pipe, pipe->out_ep);
+            xSemaphoreTake(pipe->out_done_sem, portMAX_DELAY);
+            return ESP_ERR_TIMEOUT;
+        }
+        if (pipe->out_xfer->status != USB_TRANSFER_STATUS_COMPLETED) {
+            ESP_LOGE(TAG, "Bulk OUT failed with status: %d", pipe->out_xfer->status);
+            return ESP_FAIL;
+        }
+        data += chunk;
+        len -= chunk;
+    }
+    return ESP_OK;
+}
+
+esp_err_t bulk_pipe_read(bulk_pipe_t *pipe, uint8_t *data, size_t max_len, size_t *actual_len, TickType_t timeout) {
+    while (1) {
+        // Hand out anything left over from the last completed transfer first
+        if (pipe->in_offset < pipe->in_avail) {
+            size_t len = pipe->in_avail - pipe->in_offset;
+            len = len < max_len ? len : max_len;
+            memcpy(data, &pipe->in_xfer->data_buffer[pipe->in_offset], len);
+            pipe->in_offset += len;
+            *actual_len = len;
+            return ESP_OK;
+        }
+
+        // IN transfers must be a multiple of the MPS
+        if (!pipe->in_pending) {
+            pipe->in_xfer->num_bytes = pipe->buf_size - (pipe->buf_size % pipe->in_mps);
+            esp_err_t ret = usb_host_transfer_submit(pipe->in_xfer);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            pipe->in_pending = true;
+        }
+        if (xSemaphoreTake(pipe->in_done_sem, timeout) != pdTRUE) {
+            return ESP_ERR_TIMEOUT;
+        }
+        pipe->in_pending = false;
+        if (pipe->in_xfer->status != USB_TRANSFER_STATUS_COMPLETED) {
+            ESP_LOGE(TAG, "Bulk IN failed with status: %d", pipe->in_xfer->status);
+            return ESP_FAIL;
+        }
+
+        pipe->in_offset = 0;
+        pipe->in_avail = pipe->in_xfer->actual_num_bytes;
+        if (pipe->in_avail == 0) {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+}
+
+void bulk_pipe_cancel(bulk_pipe_t *pipe) {
+    bulk_pipe_abort_ep(pipe, pipe->out_ep);
+    if (pipe->in_pending) {
+        bulk_pipe_abort_ep(pipe, pipe->in_ep);
+    }
+}
@@ -0,0 +1,47 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Blocking byte pipe over a bulk OUT/IN endpoint pair
+// The interface must already be claimed. Calls block on transfer completion,
+// so they must not be made from the class driver task, which runs the callbacks.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "usb/usb_host.h"
+
+typedef struct {
+    usb_device_handle_t dev_hdl;
+    uint8_t out_ep;
+    uint8_t in_ep;
+    uint16_t in_mps;
+    size_t buf_size;
+    usb_transfer_t *out_xfer;
+    usb_transfer_t *in_xfer;
+    SemaphoreHandle_t out_done_sem;
+    SemaphoreHandle_t in_done_sem;
+    bool in_pending;                        // IN transfer submitted but not yet collected
+    size_t in_offset;                       // Bytes of the completed IN transfer already handed out
+    size_t in_avail;
+} bulk_pipe_t;
+
+esp_err_t bulk_pipe_init(bulk_pipe_t *pipe, usb_device_handle_t dev_hdl, uint8_t out_ep,
+                         uint8_t in_ep, uint16_t in_mps, size_t buf_size);
+void bulk_pipe_deinit(bulk_pipe_t *pipe);
+
+esp_err_t bulk_pipe_write(bulk_pipe_t *pipe, const uint8_t *data, size_t len, TickType_t timeout);
+
+// Returns what has arrived (at least 1 byte), or ESP_ERR_TIMEOUT
+// An IN transfer that times out stays pending and is collected by the next call, so no data is lost
+esp_err_t bulk_pipe_read(bulk_pipe_t *pipe, uint8_t *data, size_t max_len, size_t *actual_len, TickType_t timeout);
+
+// Cancels whatever is in flight so blocked calls return, used when the device goes away
+void bulk_pipe_cancel(bulk_pipe_t *pipe);
@@ -4,14 +4,19 @@
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/event_groups.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
 #include "usb/usb_host.h"
-
-bool check_device_for_printer_interfaces(usb_device_handle_t dev_hdl, usb_host_client_handle_t client_hdl);
-esp_err_t send_print_job(void);
+#include "printer_handler.h"
+#include "descriptor_log.h"
 
 #define CLIENT_NUM_EVENT_MSG        5
 
@@ -25,67 +30,276 @@ typedef enum {
     ACTION_CLOSE_DEV        = (1 << 6),
 } action_t;
 
-#define DEV_MAX_COUNT           128
+#define DEV_TABLE_INITIAL_SIZE  4       // Device slots allocated up front, the table doubles when full
+#define DEV_TABLE_MAX_SIZE      32
+#define DEV_HASH_SIZE           64      // Power of two, at least twice DEV_TABLE_MAX_SIZE
+#define DEV_SLOT_NONE           0xFF
+
+// Reasons for the class driver task to wake up, besides USB client events
+#define CLASS_WAKE_DEVICES      (1 << 0)    // Devices on the pending list
+#define CLASS_WAKE_SHUTDOWN     (1 << 1)    // class_driver_client_deregister() was called
+#define CLASS_WAKE_ALL          (CLASS_WAKE_DEVICES | CLASS_WAKE_SHUTDOWN)
 
 typedef struct {
+    bool in_use;
+    bool pending;                       /**< Slot is on the pending list */
     usb_host_client_handle_t client_hdl;
     uint8_t dev_addr;
     usb_device_handle_t dev_hdl;
     action_t actions;
+    int64_t event_time_us;              /**< When the last hotplug event for this device arrived, 0 once handled */
+    int64_t attach_time_us;             /**< When the device was announced */
 } usb_device_t;
 
+typedef struct {
+    uint32_t new_dev_events;
+    uint32_t dev_gone_events;
+    uint32_t unknown_events;            /**< Events this driver doesn't know, ignored */
+    uint32_t dropped_devices;           /**< NEW_DEV without a free slot */
+    uint32_t open_failures;             /**< Device gone before it could be opened */
+    uint32_t close_failures;            /**< usb_host_device_close() failed, the handle leaked */
+    uint32_t handled_events;
+    int64_t total_latency_us;
+    int64_t worst_latency_us;
+    int32_t open_handles;
+    uint32_t wakeups;                   /**< Wakeups with work to do, from any source */
+    int64_t total_wake_latency_us;      /**< From the first wake request to the task picking it up */
+    int64_t worst_wake_latency_us;
+} class_driver_stats_t;
+
 typedef struct {
     struct {
-        union {
-            struct {
-                uint8_t unhandled_devices: 1;   /**< Device has unhandled devices */
-                uint8_t shutdown: 1;            /**<  */
-                uint8_t reserved6: 6;           /**< Reserved */
-            };
-            uint8_t val;                        /**< Class drivers' flags value */
-        } flags;                                /**< Class drivers' flags */
-        usb_device_t device[DEV_MAX_COUNT];     /**< Class drivers' static array of devices */
+        int64_t wake_time_us;                   /**< Oldest wake request not yet picked up, 0 if none */
+        usb_device_t *device;                   /**< Compact device table, grows up to DEV_TABLE_MAX_SIZE */
+        uint8_t device_table_size;              /**< Number of slots in device */
+        struct {
+            usb_device_handle_t dev_hdl;
+            uint8_t slot;
+        } hdl_index[DEV_HASH_SIZE];             /**< Open addressing hash from device handle to slot */
+        uint8_t pending[DEV_TABLE_MAX_SIZE];    /**< FIFO of slots with unhandled actions */
+        uint8_t pending_head;
+        uint8_t pending_count;
+        bool shutdown;                          /**< class_driver_client_deregister() was called, devices only close */
+        class_driver_stats_t stats;             /**< Hotplug statistics, see class_driver_print_stats() */
     } mux_protected;                            /**< Mutex protected members. Must be protected by the Class mux_lock when accessed */
 
     struct {
         usb_host_client_handle_t client_hdl;
         SemaphoreHandle_t mux_lock;         /**< Mutex for protected members */
+        EventGroupHandle_t wake_events;     /**< CLASS_WAKE_* bits */
+        TaskHandle_t task;                  /**< Class driver task */
     } constant;                                 /**< Constant members. Do not change after installation thus do not require a critical section or mutex */
 } class_driver_t;
 
 static const char *TAG = "CLASS";
 static class_driver_t *s_driver_obj;
 
+#ifdef CONFIG_PRINTER_BRIDGE_HOTPLUG_STORM
+static esp_err_t storm_device_open(usb_host_client_handle_t client_hdl, uint8_t dev_addr, usb_device_handle_t *dev_hdl);
+static esp_err_t storm_device_close(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl);
+static bool storm_device_is_fake(usb_device_handle_t dev_hdl);
+static bool storm_device_attach(usb_device_t *device_obj);
+#endif
+
+// Device table helpers, all called with mux_lock held
+
+static uint32_t device_hdl_hash(usb_device_handle_t dev_hdl)
+{
+    uintptr_t key = (uintptr_t)dev_hdl;
+    return (uint32_t)((key >> 2) * 2654435761u) & (DEV_HASH_SIZE - 1);
+}
+
+static uint8_t device_index_find(class_driver_t *driver_obj, usb_device_handle_t dev_hdl)
+{
+    for (uint32_t i = device_hdl_hash(dev_hdl), n = 0; n < DEV_HASH_SIZE; i = (i + 1) & (DEV_HASH_SIZE - 1), n++) {
+        if (driver_obj->mux_protected.hdl_index[i].dev_hdl == NULL) {
+            break;
+        }
+        if (driver_obj->mux_protected.hdl_index[i].dev_hdl == dev_hdl) {
+            return driver_obj->mux_protected.hdl_index[i].slot;
+        }
+    }
+    return DEV_SLOT_NONE;
+}
+
+static void device_index_add(class_driver_t *driver_obj, usb_device_handle_t dev_hdl, uint8_t slot)
+{
+    uint32_t i = device_hdl_hash(dev_hdl);
+    while (driver_obj->mux_protected.hdl_index[i].dev_hdl != NULL) {
+        i = (i + 1) & (DEV_HASH_SIZE - 1);
+    }
+    driver_obj->mux_protected.hdl_index[i].dev_hdl = dev_hdl;
+    driver_obj->mux_protected.hdl_index[i].slot = slot;
+}
+
+static void device_index_remove(class_driver_t *driver_obj, usb_device_handle_t dev_hdl)
+{
+    uint32_t i = device_hdl_hash(dev_hdl);
+    while (driver_obj->mux_protected.hdl_index[i].dev_hdl != dev_hdl) {
+        if (driver_obj->mux_protected.hdl_index[i].dev_hdl == NULL) {
+            return;
+        }
+        i = (i + 1) & (DEV_HASH_SIZE - 1);
+    }
+    // Shift later entries of the probe chain back so lookups never stop at the hole
+    uint32_t hole = i;
+    for (uint32_t j = (i + 1) & (DEV_HASH_SIZE - 1); driver_obj->mux_protected.hdl_index[j].dev_hdl != NULL;
+         j = (j + 1) & (DEV_HASH_SIZE - 1)) {
+        uint32_t home = device_hdl_hash(driver_obj->mux_protected.hdl_index[j].dev_hdl);
+        if (((j - home) & (DEV_HASH_SIZE - 1)) >= ((j - hole) & (DEV_HASH_SIZE - 1))) {
+            driver_obj->mux_protected.hdl_index[hole] = driver_obj->mux_protected.hdl_index[j];
+            hole = j;
+        }
+    }
+    driver_obj->mux_protected.hdl_index[hole].dev_hdl = NULL;
+}
+
+static uint8_t device_slot_alloc(class_driver_t *driver_obj, uint8_t dev_addr)
+{
+    uint8_t size = driver_obj->mux_protected.device_table_size;
+    uint8_t slot = DEV_SLOT_NONE;
+    for (uint8_t i = 0; i < size; i++) {
+        if (!driver_obj->mux_protected.device[i].in_use) {
+            slot = i;
+            break;
+        }
+    }
+
+    // Table full, double it
+    if (slot == DEV_SLOT_NONE) {
+        if (size == DEV_TABLE_MAX_SIZE) {
+            return DEV_SLOT_NONE;
+        }
+        uint8_t new_size = size == 0 ? DEV_TABLE_INITIAL_SIZE : size * 2;
+        if (new_size > DEV_TABLE_MAX_SIZE) {
+            new_size = DEV_TABLE_MAX_SIZE;
+        }
+        usb_device_t *device = realloc(driver_obj->mux_protected.device, new_size * sizeof(usb_device_t));
+        if (device == NULL) {
+            return DEV_SLOT_NONE;
+        }
+        memset(&device[size], 0, (new_size - size) * sizeof(usb_device_t));
+        driver_obj->mux_protected.device = device;
+        driver_obj->mux_protected.device_table_size = new_size;
+        slot = size;
+    }
+
+    usb_device_t *device_obj = &driver_obj->mux_protected.device[slot];
+    memset(device_obj, 0, sizeof(usb_device_t));
+    device_obj->in_use = true;
+    device_obj->client_hdl = driver_obj->constant.client_hdl;
+    device_obj->dev_addr = dev_addr;
+    return slot;
+}
+
+static void device_slot_free(class_driver_t *driver_obj, uint8_t slot, usb_device_handle_t dev_hdl)
+{
+    if (dev_hdl != NULL) {
+        device_index_remove(driver_obj, dev_hdl);
+    }
+    // A DEV_GONE or release that came in while the device was closing queued the slot again.
+    // Its entry must go too, or the stale close runs on the freed slot, or on the next
+    // device to get it.
+    if (driver_obj->mux_protected.device[slot].pending) {
+        uint8_t head = driver_obj->mux_protected.pending_head;
+        uint8_t kept = 0;
+        for (uint8_t i = 0; i < driver_obj->mux_protected.pending_count; i++) {
+            uint8_t entry = driver_obj->mux_protected.pending[(head + i) % DEV_TABLE_MAX_SIZE];
+            if (entry != slot) {
+                driver_obj->mux_protected.pending[(head + kept) % DEV_TABLE_MAX_SIZE] = entry;
+                kept++;
+            }
+        }
+        driver_obj->mux_protected.pending_count = kept;
+    }
+    memset(&driver_obj->mux_protected.device[slot], 0, sizeof(usb_device_t));
+}
+
+static uint8_t device_slots_in_use(class_driver_t *driver_obj)
+{
+    uint8_t slots = 0;
+    for (uint8_t i = 0; i < driver_obj->mux_protected.device_table_size; i++) {
+        if (driver_obj->mux_protected.device[i].in_use) {
+            slots++;
+        }
+    }
+    return slots;
+}
+
+// Wakes the class driver task, from any task
+// The task sleeps in usb_host_client_handle_events(), so other tasks also unblock the client.
+// Inside the task (client event callback) the bits are enough, they are checked on return.
+static void class_driver_wake(class_driver_t *driver_obj, EventBits_t bits)
+{
+    if (driver_obj->mux_protected.wake_time_us == 0) {
+        driver_obj->mux_protected.wake_time_us = esp_timer_get_time();
+    }
+    xEventGroupSetBits(driver_obj->constant.wake_events, bits);
+    if (xTaskGetCurrentTaskHandle() != driver_obj->constant.task) {
+        usb_host_client_unblock(driver_obj->constant.client_hdl);
+    }
+}
+
+// Adds actions to a device and queues it for the class driver task
+static void device_add_actions(class_driver_t *driver_obj, uint8_t slot, action_t actions)
+{
+    usb_device_t *device_obj = &driver_obj->mux_protected.device[slot];
+    device_obj->actions |= actions;
+    if (!device_obj->pending) {
+        uint8_t tail = (driver_obj->mux_protected.pending_head + driver_obj->mux_protected.pending_count) % DEV_TABLE_MAX_SIZE;
+        driver_obj->mux_protected.pending[tail] = slot;
+        driver_obj->mux_protected.pending_count++;
+        device_obj->pending = true;
+    }
+    class_driver_wake(driver_obj, CLASS_WAKE_DEVICES);
+}
+
 static void client_event_cb(const usb_host_client_event_msg_t *event_msg, void *arg)
 {
     class_driver_t *driver_obj = (class_driver_t *)arg;
     switch (event_msg->event) {
-    case USB_HOST_CLIENT_EVENT_NEW_DEV:
-        // Save the device address
+    case USB_HOST_CLIENT_EVENT_NEW_DEV: {
+        // Save the device address in a free slot
         xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
-        driver_obj->mux_protected.device[event_msg->new_dev.address].dev_addr = event_msg->new_dev.address;
-        driver_obj->mux_protected.device[event_msg->new_dev.address].dev_hdl = NULL;
-        // Open the device next
-        driver_obj->mux_protected.device[event_msg->new_dev.address].actions |= ACTION_OPEN_DEV;
-        // Set flag
-        driver_obj->mux_protected.flags.unhandled_devices = 1;
+        driver_obj->mux_protected.stats.new_dev_events++;
+        if (driver_obj->mux_protected.shutdown) {
+            // Not opened, so there is nothing to close before deregistering
+            xSemaphoreGive(driver_obj->constant.mux_lock);
+            break;
+        }
+        uint8_t slot = device_slot_alloc(driver_obj, event_msg->new_dev.address);
+        if (slot == DEV_SLOT_NONE) {
+            driver_obj->mux_protected.stats.dropped_devices++;
+            ESP_LOGE(TAG, "No free device slot for address %d", event_msg->new_dev.address);
+        } else {
+            driver_obj->mux_protected.device[slot].event_time_us = esp_timer_get_time();
+            driver_obj->mux_protected.device[slot].attach_time_us = driver_obj->mux_protected.device[slot].event_time_us;
+            // Open the device next
+            device_add_actions(driver_obj, slot, ACTION_OPEN_DEV);
+        }
         xSemaphoreGive(driver_obj->constant.mux_lock);
         break;
-    case USB_HOST_CLIENT_EVENT_DEV_GONE:
+    }
+    case USB_HOST_CLIENT_EVENT_DEV_GONE: {
         // Cancel any other actions and close the device next
         xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
-        for (uint8_t i = 0; i < DEV_MAX_COUNT; i++) {
-            if (driver_obj->mux_protected.device[i].dev_hdl == event_msg->dev_gone.dev_hdl) {
-                driver_obj->mux_protected.device[i].actions = ACTION_CLOSE_DEV;
-                // Set flag
-                driver_obj->mux_protected.flags.unhandled_devices = 1;
-            }
+        driver_obj->mux_protected.stats.dev_gone_events++;
+        uint8_t slot = device_index_find(driver_obj, event_msg->dev_gone.dev_hdl);
+        if (slot != DEV_SLOT_NONE) {
+            driver_obj->mux_protected.device[slot].actions = 0;
+            driver_obj->mux_protected.device[slot].event_time_us = esp_timer_get_time();
+            device_add_actions(driver_obj, slot, ACTION_CLOSE_DEV);
         }
         xSemaphoreGive(driver_obj->constant.mux_lock);
         break;
+    }
     default:
-        // Should never occur
-        abort();
+        // Newer host library versions may add events, don't take the whole bridge down
+        xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+        driver_obj->mux_protected.stats.unknown_events++;
+        xSemaphoreGive(driver_obj->constant.mux_lock);
+        ESP_LOGW(TAG, "Ignoring unknown client event %d", event_msg->event);
+        break;
     }
 }
 
@@ -93,9 +307,43 @@ static void action_open_dev(usb_device_t *device_obj)
 {
     assert(device_obj->dev_addr != 0);
     ESP_LOGI(TAG, "Opening device at address %d", device_obj->dev_addr);
-    ESP_ERROR_CHECK(usb_host_device_open(device_obj->client_hdl, device_obj->dev_addr, &device_obj->dev_hdl));
-    // Get the device's information next
-    device_obj->actions |= ACTION_GET_DEV_INFO;
+#ifdef CONFIG_PRINTER_BRIDGE_HOTPLUG_STORM
+    esp_err_t ret = storm_device_open(device_obj->client_hdl, device_obj->dev_addr, &device_obj->dev_hdl);
+#else
+    esp_err_t ret = usb_host_device_open(device_obj->client_hdl, device_obj->dev_addr, &device_obj->dev_hdl);
+#endif
+    if (ret != ESP_OK) {
+        // Flaky cables: the device can be gone again before we get to open it
+        ESP_LOGW(TAG, "Failed to open device at address %d: %s", device_obj->dev_addr, esp_err_to_name(ret));
+        xSemaphoreTake(s_driver_obj->constant.mux_lock, portMAX_DELAY);
+        s_driver_obj->mux_protected.stats.open_failures++;
+        xSemaphoreGive(s_driver_obj->constant.mux_lock);
+        device_obj->dev_hdl = NULL;
+        device_obj->dev_addr = 0;
+        device_obj->actions = 0;
+        return;
+    }
+    xSemaphoreTake(s_driver_obj->constant.mux_lock, portMAX_DELAY);
+    s_driver_obj->mux_protected.stats.open_handles++;
+    xSemaphoreGive(s_driver_obj->constant.mux_lock);
+#ifdef CONFIG_PRINTER_BRIDGE_HOTPLUG_STORM
+    // Storm devices have no descriptors
+    if (storm_device_is_fake(device_obj->dev_hdl)) {
+        device_obj->actions |= ACTION_HANDLE_PRINTER;
+        return;
+    }
+#endif
+    // Descriptors are only recorded here, descriptor_log_print() formats them on demand
+    descriptor_log_record(device_obj->dev_hdl);
+#ifdef CONFIG_PRINTER_BRIDGE_DUMP_DESCRIPTORS
+    // Known printers skip the descriptor dump
+    if (!printer_handler_is_known(device_obj->dev_hdl)) {
+        // Get the device's information next
+        device_obj->actions |= ACTION_GET_DEV_INFO;
+        return;
+    }
+#endif
+    device_obj->actions |= ACTION_HANDLE_PRINTER;
 }
 
 static void action_get_info(usb_device_t *device_obj)
@@ -170,20 +418,49 @@ static void action_get_str_desc(usb_device_t *device_obj)
 // Uses functions from printer_handler.c
 static void action_handle_printer(usb_device_t *device_obj)
 {
+#ifdef CONFIG_PRINTER_BRIDGE_HOTPLUG_STORM
+    if (storm_device_is_fake(device_obj->dev_hdl)) {
+        if (!storm_device_attach(device_obj)) {
+            device_obj->actions |= ACTION_CLOSE_DEV;
+        }
+        return;
+    }
+#endif
     // Check if the connected USB device is a printer
-    bool ret = check_device_for_printer_interfaces(device_obj->dev_hdl, device_obj->client_hdl);
+    bool ret = check_device_for_printer_interfaces(device_obj->dev_hdl, device_obj->client_hdl,
+                                                   device_obj->attach_time_us);
 
-    // If it is a printer, start handling print jobs (WIP)
-    if (ret) {
-        send_print_job();
-    } else {
+    if (!ret) {
         device_obj->actions |= ACTION_CLOSE_DEV;
+        return;
     }
+    // Jobs come from the network servers, the test page only prints if asked for
+#ifdef CONFIG_PRINTER_BRIDGE_TEST_PAGE_ON_ATTACH
+    send_print_job(device_obj->dev_hdl);
+#endif
 }
 
 static void action_close_dev(usb_device_t *device_obj)
 {
-    ESP_ERROR_CHECK(usb_host_device_close(device_obj->client_hdl, device_obj->dev_hdl));
+    // Printer transfers are still in flight, class_driver_device_released() brings us back here
+    if (printer_handler_release_device(device_obj->dev_hdl) == ESP_ERR_NOT_FINISHED) {
+        return;
+    }
+#ifdef CONFIG_PRINTER_BRIDGE_HOTPLUG_STORM
+    esp_err_t ret = storm_device_close(device_obj->client_hdl, device_obj->dev_hdl);
+#else
+    esp_err_t ret = usb_host_device_close(device_obj->client_hdl, device_obj->dev_hdl);
+#endif
+    xSemaphoreTake(s_driver_obj->constant.mux_lock, portMAX_DELAY);
+    if (ret == ESP_OK) {
+        s_driver_obj->mux_protected.stats.open_handles--;
+    } else {
+        s_driver_obj->mux_protected.stats.close_failures++;
+    }
+    xSemaphoreGive(s_driver_obj->constant.mux_lock);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to close device: %s", esp_err_to_name(ret));
+    }
     device_obj->dev_hdl = NULL;
     device_obj->dev_addr = 0;
 }
@@ -224,57 +501,127 @@ static void class_driver_device_handle(usb_device_t *device_obj)
 
 void class_driver_task(void *arg)
 {
-    class_driver_t driver_obj = {0};
     usb_host_client_handle_t class_driver_client_hdl = NULL;
 
     ESP_LOGI(TAG, "Registering Client");
 
+    // Driver object lives on the heap, the class task's stack stays small
+    class_driver_t *driver_obj = calloc(1, sizeof(class_driver_t));
     SemaphoreHandle_t mux_lock = xSemaphoreCreateMutex();
-    if (mux_lock == NULL) {
-        ESP_LOGE(TAG, "Unable to create class driver mutex");
+    EventGroupHandle_t wake_events = xEventGroupCreate();
+    if (driver_obj == NULL || mux_lock == NULL || wake_events == NULL) {
+        ESP_LOGE(TAG, "Unable to create class driver object");
         vTaskSuspend(NULL);
         return;
     }
+    printer_handler_init();
 
     usb_host_client_config_t client_config = {
         .is_synchronous = false,    //Synchronous clients currently not supported. Set this to false
         .max_num_event_msg = CLIENT_NUM_EVENT_MSG,
         .async = {
             .client_event_callback = client_event_cb,
-            .callback_arg = (void *) &driver_obj,
+            .callback_arg = (void *) driver_obj,
         },
     };
     ESP_ERROR_CHECK(usb_host_client_register(&client_config, &class_driver_client_hdl));
 
-    driver_obj.constant.mux_lock = mux_lock;
-    driver_obj.constant.client_hdl = class_driver_client_hdl;
-
-    for (uint8_t i = 0; i < DEV_MAX_COUNT; i++) {
-        driver_obj.mux_protected.device[i].client_hdl = class_driver_client_hdl;
-    }
+    driver_obj->constant.mux_lock = mux_lock;
+    driver_obj->constant.client_hdl = class_driver_client_hdl;
+    driver_obj->constant.wake_events = wake_events;
+    driver_obj->constant.task = xTaskGetCurrentTaskHandle();
 
-    s_driver_obj = &driver_obj;
+    s_driver_obj = driver_obj;
 
     while (1) {
-        // Driver has unhandled devices, handle all devices first
-        if (driver_obj.mux_protected.flags.unhandled_devices) {
-            xSemaphoreTake(driver_obj.constant.mux_lock, portMAX_DELAY);
-            for (uint8_t i = 0; i < DEV_MAX_COUNT; i++) {
-                if (driver_obj.mux_protected.device[i].actions) {
-                    class_driver_device_handle(&driver_obj.mux_protected.device[i]);
-                }
+        // Sleep until a USB client event or a wake request from any task
+        EventBits_t bits = xEventGroupClearBits(wake_events, CLASS_WAKE_ALL);
+        if (bits == 0) {
+            usb_host_client_handle_events(class_driver_client_hdl, portMAX_DELAY);
+            continue;
+        }
+
+        xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+        if (driver_obj->mux_protected.wake_time_us != 0) {
+            int64_t latency_us = esp_timer_get_time() - driver_obj->mux_protected.wake_time_us;
+            driver_obj->mux_protected.wake_time_us = 0;
+            driver_obj->mux_protected.stats.wakeups++;
+            driver_obj->mux_protected.stats.total_wake_latency_us += latency_us;
+            if (latency_us > driver_obj->mux_protected.stats.worst_wake_latency_us) {
+                driver_obj->mux_protected.stats.worst_wake_latency_us = latency_us;
             }
-            driver_obj.mux_protected.flags.unhandled_devices = 0;
-            xSemaphoreGive(driver_obj.constant.mux_lock);
-        } else {
-            // Driver is active, handle client events
-            if (driver_obj.mux_protected.flags.shutdown == 0) {
-                usb_host_client_handle_events(class_driver_client_hdl, portMAX_DELAY);
-            } else {
-                // Shutdown the driver
-                break;
+        }
+        xSemaphoreGive(driver_obj->constant.mux_lock);
+
+        if (bits & CLASS_WAKE_DEVICES) {
+            // Only the devices on the pending list are touched. Actions run on a copy of
+            // the device without holding mux_lock, so printer workers and transports can
+            // flag devices while a slow action runs.
+            while (1) {
+                xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+                if (driver_obj->mux_protected.pending_count == 0) {
+                    xSemaphoreGive(driver_obj->constant.mux_lock);
+                    break;
+                }
+                uint8_t slot = driver_obj->mux_protected.pending[driver_obj->mux_protected.pending_head];
+                driver_obj->mux_protected.pending_head = (driver_obj->mux_protected.pending_head + 1) % DEV_TABLE_MAX_SIZE;
+                driver_obj->mux_protected.pending_count--;
+                usb_device_t device_obj = driver_obj->mux_protected.device[slot];
+                driver_obj->mux_protected.device[slot].pending = false;
+                driver_obj->mux_protected.device[slot].actions = 0;
+                driver_obj->mux_protected.device[slot].event_time_us = 0;
+                if (driver_obj->mux_protected.shutdown) {
+                    // Devices not opened yet are dropped, open ones only close
+                    if (device_obj.dev_hdl == NULL) {
+                        device_obj.dev_addr = 0;
+                        device_obj.actions = 0;
+                    } else {
+                        device_obj.actions = ACTION_CLOSE_DEV;
+                    }
+                }
+                xSemaphoreGive(driver_obj->constant.mux_lock);
+
+                if (device_obj.event_time_us != 0) {
+                    int64_t latency_us = esp_timer_get_time() - device_obj.event_time_us;
+                    ESP_LOGI(TAG, "Hotplug event for address %d handled after %" PRId64 " us",
+                             device_obj.dev_addr, latency_us);
+                    xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+                    driver_obj->mux_protected.stats.handled_events++;
+                    driver_obj->mux_protected.stats.total_latency_us += latency_us;
+                    if (latency_us > driver_obj->mux_protected.stats.worst_latency_us) {
+                        driver_obj->mux_protected.stats.worst_latency_us = latency_us;
+                    }
+                    xSemaphoreGive(driver_obj->constant.mux_lock);
+                }
+                usb_device_handle_t old_dev_hdl = device_obj.dev_hdl;
+                class_driver_device_handle(&device_obj);
+
+                xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+                if (device_obj.dev_hdl != old_dev_hdl && device_obj.dev_hdl != NULL) {
+                    // Device opened
+                    device_index_add(driver_obj, device_obj.dev_hdl, slot);
+                }
+                if (device_obj.dev_addr == 0) {
+                    // Device closed
+                    device_slot_free(driver_obj, slot, old_dev_hdl);
+                } else {
+                    driver_obj->mux_protected.device[slot].dev_hdl = device_obj.dev_hdl;
+                }
+                xSemaphoreGive(driver_obj->constant.mux_lock);
             }
         }
+        // Printers still returning transfers close later, through class_driver_device_released().
+        // Their transfer callbacks only run in usb_host_client_handle_events(), so the loop
+        // keeps going until every slot is free.
+        xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+        bool closed = driver_obj->mux_protected.shutdown && device_slots_in_use(driver_obj) == 0;
+        if (closed) {
+            s_driver_obj = NULL;
+        }
+        xSemaphoreGive(driver_obj->constant.mux_lock);
+        if (closed) {
+            break;
+        }
     }
 
     ESP_LOGI(TAG, "Deregistering Class Client");
@@ -282,24 +629,423 @@ void class_driver_task(void *arg)
     if (mux_lock != NULL) {
         vSemaphoreDelete(mux_lock);
     }
+    vEventGroupDelete(wake_events);
+    free(driver_obj->mux_protected.device);
+    free(driver_obj);
     vTaskSuspend(NULL);
 }
 
+// Called by the printer handler once a closing device has no transfers in flight
+void class_driver_device_released(usb_device_handle_t dev_hdl)
+{
+    xSemaphoreTake(s_driver_obj->constant.mux_lock, portMAX_DELAY);
+    uint8_t slot = device_index_find(s_driver_obj, dev_hdl);
+    if (slot != DEV_SLOT_NONE) {
+        // Close the device next, this also wakes the class driver task
+        device_add_actions(s_driver_obj, slot, ACTION_CLOSE_DEV);
+    }
+    xSemaphoreGive(s_driver_obj->constant.mux_lock);
+}
+
 void class_driver_client_deregister(void)
 {
-    // Mark all opened devices
+    // Mark all devices, one being opened right now included. The task drops the ones
+    // not opened yet and closes the others.
     xSemaphoreTake(s_driver_obj->constant.mux_lock, portMAX_DELAY);
-    for (uint8_t i = 0; i < DEV_MAX_COUNT; i++) {
-        if (s_driver_obj->mux_protected.device[i].dev_hdl != NULL) {
+    s_driver_obj->mux_protected.shutdown = true;
+    for (uint8_t i = 0; i < s_driver_obj->mux_protected.device_table_size; i++) {
+        if (s_driver_obj->mux_protected.device[i].in_use) {
             // Mark device to close
-            s_driver_obj->mux_protected.device[i].actions |= ACTION_CLOSE_DEV;
-            // Set flag
-            s_driver_obj->mux_protected.flags.unhandled_devices = 1;
+            device_add_actions(s_driver_obj, i, ACTION_CLOSE_DEV);
         }
     }
-    s_driver_obj->mux_protected.flags.shutdown = 1;
+    // Exit the loop and proceed to deregister client
+    class_driver_wake(s_driver_obj, CLASS_WAKE_SHUTDOWN);
     xSemaphoreGive(s_driver_obj->constant.mux_lock);
+}
+
+void class_driver_print_stats(void)
+{
+    if (s_driver_obj == NULL) {
+        return;
+    }
+    xSemaphoreTake(s_driver_obj->constant.mux_lock, portMAX_DELAY);
+    class_driver_stats_t stats = s_driver_obj->mux_protected.stats;
+    xSemaphoreGive(s_driver_obj->constant.mux_lock);
+
+    ESP_LOGI(TAG, "Hotplug stats:");
+    ESP_LOGI(TAG, "\tEvents: %" PRIu32 " new, %" PRIu32 " gone, %" PRIu32 " unknown",
+             stats.new_dev_events, stats.dev_gone_events, stats.unknown_events);
+    ESP_LOGI(TAG, "\tHandled: %" PRIu32 ", avg latency %" PRId64 " us, worst %" PRId64 " us",
+             stats.handled_events, stats.handled_events ? stats.total_latency_us / stats.handled_events : 0,
+             stats.worst_latency_us);
+    ESP_LOGI(TAG, "\tDropped: %" PRIu32 ", open failures: %" PRIu32 ", close failures: %" PRIu32,
+             stats.dropped_devices, stats.open_failures, stats.close_failures);
+    ESP_LOGI(TAG, "\tOpen handles: %" PRId32, stats.open_handles);
+    ESP_LOGI(TAG, "\tWakeups: %" PRIu32 ", avg wake latency %" PRId64 " us, worst %" PRId64 " us",
+             stats.wakeups, stats.wakeups ? stats.total_wake_latency_us / stats.wakeups : 0,
+             stats.worst_wake_latency_us);
+}
+
+#ifdef CONFIG_PRINTER_BRIDGE_HOTPLUG_STORM
+// Hotplug storm, a stress run of the event path on the target
+// Synthesized NEW_DEV and DEV_GONE events go through client_event_cb() like real ones, in
+// random bursts. The NEW_DEV addresses are above anything the host library hands out on a
+// small hub tree. The first STORM_NUM_DEVICES of them open to fake handles with no device
+// behind them, and the first STORM_NUM_PRINTERS of those attach as stand-in printers that
+// take jobs (see printer_handler_storm_attach()). Opens of the other addresses fail like a
+// device that left before it could be opened. DEV_GONE goes to the handles the storm opened,
+// printers with jobs in flight included, and now and then to a handle that was never opened.
+// Attached printers are never touched and keep working during the run.
+#define STORM_FIRST_ADDR        100
+#define STORM_NUM_ADDRS         28                      // Addresses 100 to 127
+#define STORM_NUM_DEVICES       8                       // Addresses 100 to 107 open
+#define STORM_NUM_PRINTERS      2                       // Addresses 100 and 101 are printers
+#define STORM_MAX_BURST         8                       // Events sent back to back before the storm yields
+#define STORM_JOB_SIZE          512
+#define STORM_DRAIN_TIMEOUT_US  (10 * 1000 * 1000)      // Storm state left after this has leaked
+
+static uint32_t storm_handles[STORM_NUM_DEVICES];       // Fake device handles, never dereferenced
+static uint8_t storm_job_data[STORM_JOB_SIZE];
+static portMUX_TYPE storm_lock = portMUX_INITIALIZER_UNLOCKED;
+static struct {
+    uint32_t sent_new;
+    uint32_t sent_gone;
+    uint32_t opened;                    /**< NEW_DEV that got a fake handle */
+    uint32_t jobs_submitted;
+    uint32_t jobs_done;                 /**< Under storm_lock, counted from the printer workers */
+    uint32_t jobs_failed;               /**< Under storm_lock */
+} storm_stats;
+
+static bool storm_device_is_fake(usb_device_handle_t dev_hdl)
+{
+    uintptr_t hdl = (uintptr_t)dev_hdl;
+    return hdl >= (uintptr_t)&storm_handles[0] && hdl < (uintptr_t)&storm_handles[STORM_NUM_DEVICES];
+}
+
+static esp_err_t storm_device_open(usb_host_client_handle_t client_hdl, uint8_t dev_addr, usb_device_handle_t *dev_hdl)
+{
+    if (dev_addr < STORM_FIRST_ADDR || dev_addr >= STORM_FIRST_ADDR + STORM_NUM_DEVICES) {
+        return usb_host_device_open(client_hdl, dev_addr, dev_hdl);
+    }
+    *dev_hdl = (usb_device_handle_t)&storm_handles[dev_addr - STORM_FIRST_ADDR];
+    storm_stats.opened++;
+    return ESP_OK;
+}
+
+static esp_err_t storm_device_close(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl)
+{
+    if (storm_device_is_fake(dev_hdl)) {
+        return ESP_OK;
+    }
+    return usb_host_device_close(client_hdl, dev_hdl);
+}
+
+static void storm_printer_id(int printer, char *id)
+{
+    snprintf(id, PRINTER_ID_LEN, "storm-%d", STORM_FIRST_ADDR + printer);
+}
+
+static bool storm_device_attach(usb_device_t *device_obj)
+{
+    int index = (uint32_t *)device_obj->dev_hdl - storm_handles;
+    if (index >= STORM_NUM_PRINTERS) {
+        return false;
+    }
+    char id[PRINTER_ID_LEN];
+    storm_printer_id(index, id);
+    return printer_handler_storm_attach(device_obj->dev_hdl, device_obj->client_hdl, id);
+}
+
+static void storm_job_done(void *arg, esp_err_t result)
+{
+    portENTER_CRITICAL(&storm_lock);
+    storm_stats.jobs_done++;
+    if (result != ESP_OK) {
+        storm_stats.jobs_failed++;
+    }
+    portEXIT_CRITICAL(&storm_lock);
+}
+
+static esp_err_t storm_submit_job(int printer)
+{
+    char id[PRINTER_ID_LEN];
+    storm_printer_id(printer, id);
+    portENTER_CRITICAL(&storm_lock);
+    storm_stats.jobs_submitted++;
+    portEXIT_CRITICAL(&storm_lock);
+    esp_err_t ret = printer_handler_submit(id, storm_job_data, sizeof(storm_job_data), storm_job_done, NULL);
+    if (ret != ESP_OK) {
+        portENTER_CRITICAL(&storm_lock);
+        storm_stats.jobs_submitted--;
+        portEXIT_CRITICAL(&storm_lock);
+    }
+    return ret;
+}
+
+// Slots taken by storm addresses, called with mux_lock held
+static uint32_t storm_slots_in_use(class_driver_t *driver_obj)
+{
+    uint32_t slots = 0;
+    for (uint8_t i = 0; i < driver_obj->mux_protected.device_table_size; i++) {
+        if (driver_obj->mux_protected.device[i].in_use && driver_obj->mux_protected.device[i].dev_addr >= STORM_FIRST_ADDR) {
+            slots++;
+        }
+    }
+    return slots;
+}
 
-    // Unblock, exit the loop and proceed to deregister client
-    ESP_ERROR_CHECK(usb_host_client_unblock(s_driver_obj->constant.client_hdl));
+// Slots on the pending list, counted both ways, called with mux_lock held
+static uint32_t storm_pending(class_driver_t *driver_obj)
+{
+    uint32_t pending = driver_obj->mux_protected.pending_count;
+    for (uint8_t i = 0; i < driver_obj->mux_protected.device_table_size; i++) {
+        if (driver_obj->mux_protected.device[i].pending) {
+            pending++;
+        }
+    }
+    return pending;
+}
+
+static bool storm_addr_in_use(class_driver_t *driver_obj, uint8_t dev_addr)
+{
+    bool in_use = false;
+    xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+    for (uint8_t i = 0; i < driver_obj->mux_protected.device_table_size; i++) {
+        if (driver_obj->mux_protected.device[i].in_use && driver_obj->mux_protected.device[i].dev_addr == dev_addr) {
+            in_use = true;
+        }
+    }
+    xSemaphoreGive(driver_obj->constant.mux_lock);
+    return in_use;
+}
+
+// Sends NEW_DEV for an address, a storm device is only announced again once its slot is free
+static void storm_send_new_dev(class_driver_t *driver_obj, uint8_t dev_addr)
+{
+    if (dev_addr < STORM_FIRST_ADDR + STORM_NUM_DEVICES && storm_addr_in_use(driver_obj, dev_addr)) {
+        return;
+    }
+    usb_host_client_event_msg_t event_msg = {
+        .event = USB_HOST_CLIENT_EVENT_NEW_DEV,
+        .new_dev.address = dev_addr,
+    };
+    client_event_cb(&event_msg, driver_obj);
+    storm_stats.sent_new++;
+}
+
+// Sends DEV_GONE for a random device the storm opened, or all of them
+// Without one the handle is one that was never opened, which must be ignored.
+static void storm_send_gone(class_driver_t *driver_obj, bool all)
+{
+    usb_device_handle_t dev_hdl[STORM_NUM_DEVICES];
+    int num_devices = 0;
+    xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+    for (uint8_t i = 0; i < driver_obj->mux_protected.device_table_size; i++) {
+        usb_device_t *device_obj = &driver_obj->mux_protected.device[i];
+        if (device_obj->in_use && storm_device_is_fake(device_obj->dev_hdl)) {
+            dev_hdl[num_devices++] = device_obj->dev_hdl;
+        }
+    }
+    xSemaphoreGive(driver_obj->constant.mux_lock);
+
+    usb_host_client_event_msg_t event_msg = {
+        .event = USB_HOST_CLIENT_EVENT_DEV_GONE,
+    };
+    if (num_devices == 0) {
+        if (all) {
+            return;
+        }
+        // Odd, no heap allocated handle can have it
+        event_msg.dev_gone.dev_hdl = (usb_device_handle_t)(uintptr_t)(esp_random() | 1);
+        client_event_cb(&event_msg, driver_obj);
+        storm_stats.sent_gone++;
+        return;
+    }
+    for (int i = all ? 0 : esp_random() % num_devices; i < num_devices; i++) {
+        // The slot may have been freed since, the event is stale then and ignored
+        event_msg.dev_gone.dev_hdl = dev_hdl[i];
+        client_event_cb(&event_msg, driver_obj);
+        storm_stats.sent_gone++;
+        if (!all) {
+            break;
+        }
+    }
+}
+
+// Brings the storm printers back until every job is over and nothing is parked
+static bool storm_settle_jobs(class_driver_t *driver_obj, int parked_before)
+{
+    for (int64_t start_us = esp_timer_get_time(); esp_timer_get_time() - start_us < STORM_DRAIN_TIMEOUT_US;) {
+        for (int i = 0; i < STORM_NUM_PRINTERS; i++) {
+            storm_send_new_dev(driver_obj, STORM_FIRST_ADDR + i);
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+        portENTER_CRITICAL(&storm_lock);
+        bool jobs_over = storm_stats.jobs_done == storm_stats.jobs_submitted;
+        portEXIT_CRITICAL(&storm_lock);
+        if (jobs_over && printer_handler_parked_count() == parked_before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Unplugs the first storm printer with one job printing and one queued
+// Whatever had not finished by then has to be parked.
+static bool storm_unplug_mid_job(class_driver_t *driver_obj, int parked_before)
+{
+    portENTER_CRITICAL(&storm_lock);
+    uint32_t done_before = storm_stats.jobs_done;
+    portEXIT_CRITICAL(&storm_lock);
+    bool submitted = false;
+    for (int64_t start_us = esp_timer_get_time(); !submitted && esp_timer_get_time() - start_us < STORM_DRAIN_TIMEOUT_US;) {
+        storm_send_new_dev(driver_obj, STORM_FIRST_ADDR);
+        submitted = storm_submit_job(0) == ESP_OK;
+        if (!submitted) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+    if (!submitted || storm_submit_job(0) != ESP_OK) {
+        return false;
+    }
+    usb_host_client_event_msg_t event_msg = {
+        .event = USB_HOST_CLIENT_EVENT_DEV_GONE,
+        .dev_gone.dev_hdl = (usb_device_handle_t) &storm_handles[0],
+    };
+    client_event_cb(&event_msg, driver_obj);
+    storm_stats.sent_gone++;
+
+    for (int64_t start_us = esp_timer_get_time(); esp_timer_get_time() - start_us < STORM_DRAIN_TIMEOUT_US;) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        if (!storm_addr_in_use(driver_obj, STORM_FIRST_ADDR)) {
+            int parked = printer_handler_parked_count() - parked_before;
+            portENTER_CRITICAL(&storm_lock);
+            int done = storm_stats.jobs_done - done_before;
+            portEXIT_CRITICAL(&storm_lock);
+            return parked > 0 && parked + done == 2;
+        }
+    }
+    return false;
+}
+
+void class_driver_storm_task(void *arg)
+{
+    // Wait for the class driver to register its client
+    while (s_driver_obj == NULL) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    class_driver_t *driver_obj = s_driver_obj;
+    const uint32_t num_events = CONFIG_PRINTER_BRIDGE_HOTPLUG_STORM_EVENTS;
+    ESP_LOGI(TAG, "Hotplug storm: %" PRIu32 " events", num_events);
+
+    // Per event logs would measure the console, not the class driver
+    esp_log_level_set(TAG, ESP_LOG_NONE);
+
+    // Worst case latencies are restarted for the storm, the earlier ones are merged back at the end
+    xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+    class_driver_stats_t before = driver_obj->mux_protected.stats;
+    driver_obj->mux_protected.stats.worst_latency_us = 0;
+    driver_obj->mux_protected.stats.worst_wake_latency_us = 0;
+    xSemaphoreGive(driver_obj->constant.mux_lock);
+    int parked_before = printer_handler_parked_count();
+
+    int64_t start_us = esp_timer_get_time();
+    while (storm_stats.sent_new + storm_stats.sent_gone < num_events) {
+        uint32_t burst = 1 + esp_random() % STORM_MAX_BURST;
+        for (; burst > 0 && storm_stats.sent_new + storm_stats.sent_gone < num_events; burst--) {
+            switch (esp_random() % 8) {
+            case 0:
+            case 1:
+                storm_send_gone(driver_obj, false);
+                break;
+            case 2:
+                // Not attached right now is fine, the job is just refused
+                storm_submit_job(esp_random() % STORM_NUM_PRINTERS);
+                break;
+            default:
+                storm_send_new_dev(driver_obj, STORM_FIRST_ADDR + esp_random() % STORM_NUM_ADDRS);
+                break;
+            }
+        }
+        // Sometimes the class driver task gets to drain the pending list, sometimes it piles up
+        vTaskDelay(esp_random() % 3);
+    }
+
+    // Parked jobs resume on the printers' return, a printer unplugged mid-job parks its jobs
+    // again, then everything the storm opened goes away
+    bool jobs_settled = storm_settle_jobs(driver_obj, parked_before);
+    bool mid_job_parked = storm_unplug_mid_job(driver_obj, parked_before);
+    jobs_settled = storm_settle_jobs(driver_obj, parked_before) && jobs_settled;
+    uint32_t leaked_slots;
+    uint32_t leaked_pending;
+    int64_t drain_start_us = esp_timer_get_time();
+    while (1) {
+        storm_send_gone(driver_obj, true);
+        vTaskDelay(pdMS_TO_TICKS(10));
+        xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+        leaked_slots = storm_slots_in_use(driver_obj);
+        leaked_pending = storm_pending(driver_obj);
+        xSemaphoreGive(driver_obj->constant.mux_lock);
+        if ((leaked_slots == 0 && leaked_pending == 0) || esp_timer_get_time() - drain_start_us > STORM_DRAIN_TIMEOUT_US) {
+            break;
+        }
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+    xSemaphoreTake(driver_obj->constant.mux_lock, portMAX_DELAY);
+    class_driver_stats_t after = driver_obj->mux_protected.stats;
+    if (before.worst_latency_us > driver_obj->mux_protected.stats.worst_latency_us) {
+        driver_obj->mux_protected.stats.worst_latency_us = before.worst_latency_us;
+    }
+    if (before.worst_wake_latency_us > driver_obj->mux_protected.stats.worst_wake_latency_us) {
+        driver_obj->mux_protected.stats.worst_wake_latency_us = before.worst_wake_latency_us;
+    }
+    xSemaphoreGive(driver_obj->constant.mux_lock);
+    esp_log_level_set(TAG, (esp_log_level_t)CONFIG_LOG_DEFAULT_LEVEL);
+
+    // Each storm NEW_DEV ends dropped for lack of a slot, as a failed open or opened
+    uint32_t sent_new = storm_stats.sent_new;
+    uint32_t sent_gone = storm_stats.sent_gone;
+    uint32_t handled = after.handled_events - before.handled_events;
+    uint32_t dropped = after.dropped_devices - before.dropped_devices;
+    uint32_t open_failures = after.open_failures - before.open_failures;
+    int32_t leaked_handles = after.open_handles - before.open_handles;
+    int32_t lost = (int32_t)sent_new - (int32_t)(dropped + open_failures + storm_stats.opened);
+    int leaked_parked = printer_handler_parked_count() - parked_before;
+    portENTER_CRITICAL(&storm_lock);
+    uint32_t jobs_submitted = storm_stats.jobs_submitted;
+    uint32_t jobs_failed = storm_stats.jobs_failed;
+    int32_t leaked_jobs = (int32_t)(storm_stats.jobs_submitted - storm_stats.jobs_done);
+    portEXIT_CRITICAL(&storm_lock);
+    if (elapsed_us == 0) {
+        elapsed_us = 1;
+    }
+
+    ESP_LOGI(TAG, "Hotplug storm done: %" PRIu32 " new, %" PRIu32 " gone in %" PRId64 " ms",
+             sent_new, sent_gone, elapsed_us / 1000);
+    ESP_LOGI(TAG, "\tThroughput: %" PRId64 " events/s fed, %" PRId64 " devices/s handled",
+             (int64_t)(sent_new + sent_gone) * 1000000 / elapsed_us, (int64_t)handled * 1000000 / elapsed_us);
+    ESP_LOGI(TAG, "\tWorst latency: %" PRId64 " us handling, %" PRId64 " us wake",
+             after.worst_latency_us, after.worst_wake_latency_us);
+    ESP_LOGI(TAG, "\tOpened: %" PRIu32 ", dropped: %" PRIu32 ", open failures: %" PRIu32,
+             storm_stats.opened, dropped, open_failures);
+    ESP_LOGI(TAG, "\tJobs: %" PRIu32 " submitted, %" PRIu32 " failed", jobs_submitted, jobs_failed);
+    if (!mid_job_parked) {
+        ESP_LOGE(TAG, "\tPrinter unplugged mid-job did not park its jobs");
+    }
+    if (!jobs_settled) {
+        ESP_LOGE(TAG, "\tJobs did not finish once the printers were back");
+    }
+    if (leaked_handles != 0 || leaked_slots != 0 || leaked_pending != 0 || leaked_parked != 0
+        || leaked_jobs != 0 || lost != 0) {
+        ESP_LOGE(TAG, "\tLeaked: %" PRId32 " handles, %" PRIu32 " slots, %" PRIu32 " pending, %d parked, %" PRId32
+                 " jobs, %" PRId32 " events lost",
+                 leaked_handles, leaked_slots, leaked_pending, leaked_parked, leaked_jobs, lost);
+    } else {
+        ESP_LOGI(TAG, "\tLeaked: none");
+    }
+    class_driver_print_stats();
+    vTaskDelete(NULL);
 }
+#endif
@@ -0,0 +1,196 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+#include "descriptor_log.h"
+
+static const char *TAG = "Descriptor log";
+
+#define DESCRIPTOR_LOG_NUM_STR      3       // Manufacturer, product, serial number
+
+typedef struct {
+    bool valid;
+    uint32_t seq;
+    uint8_t dev_addr;
+    usb_speed_t speed;
+    uint8_t parent_addr;                    // 0 if attached to the root port
+    uint8_t port_num;
+    usb_device_desc_t dev_desc;
+    uint16_t config_len;                    // Bytes kept in config, may be less than wTotalLength
+    uint8_t config[DESCRIPTOR_LOG_CONFIG_MAX];
+    uint8_t str[DESCRIPTOR_LOG_NUM_STR][DESCRIPTOR_LOG_STR_MAX];
+} descriptor_log_entry_t;
+
+static descriptor_log_entry_t entries[DESCRIPTOR_LOG_SIZE];
+static uint32_t log_seq;
+static portMUX_TYPE log_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const str_names[DESCRIPTOR_LOG_NUM_STR] = { "Manufacturer", "Product", "Serial" };
+
+static void descriptor_log_copy_str(uint8_t *dst, const usb_str_desc_t *str_desc) {
+    if (str_desc == NULL) {
+        dst[0] = 0;
+        return;
+    }
+    size_t len = str_desc->bLength < DESCRIPTOR_LOG_STR_MAX ? str_desc->bLength : DESCRIPTOR_LOG_STR_MAX & ~1;
+    memcpy(dst, str_desc, len);
+    dst[0] = len;
+}
+
+void descriptor_log_record(usb_device_handle_t dev_hdl) {
+    usb_device_info_t dev_info;
+    const usb_device_desc_t *dev_desc;
+    const usb_config_desc_t *config_desc;
+    if (usb_host_device_info(dev_hdl, &dev_info) != ESP_OK
+        || usb_host_get_device_descriptor(dev_hdl, &dev_desc) != ESP_OK
+        || usb_host_get_active_config_descriptor(dev_hdl, &config_desc) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to read descriptors");
+        return;
+    }
+    uint8_t parent_addr = 0;
+    if (dev_info.parent.dev_hdl) {
+        usb_device_info_t parent_dev_info;
+        if (usb_host_device_info(dev_info.parent.dev_hdl, &parent_dev_info) == ESP_OK) {
+            parent_addr = parent_dev_info.dev_addr;
+        }
+    }
+
+    portENTER_CRITICAL(&log_lock);
+    // Reuse the oldest entry
+    descriptor_log_entry_t *entry = &entries[0];
+    for (int i = 0; i < DESCRIPTOR_LOG_SIZE; i++) {
+        if (!entries[i].valid) {
+            entry = &entries[i];
+            break;
+        }
+        if (entries[i].seq < entry->seq) {
+            entry = &entries[i];
+        }
+    }
+    entry->valid = true;
+    entry->seq = ++log_seq;
+    entry->dev_addr = dev_info.dev_addr;
+    entry->speed = dev_info.speed;
+    entry->parent_addr = parent_addr;
+    entry->port_num = dev_info.parent.port_num;
+    entry->dev_desc = *dev_desc;
+    entry->config_len = config_desc->wTotalLength < DESCRIPTOR_LOG_CONFIG_MAX ? config_desc->wTotalLength
+                        : DESCRIPTOR_LOG_CONFIG_MAX;
+    memcpy(entry->config, config_desc, entry->config_len);
+    descriptor_log_copy_str(entry->str[0], dev_info.str_desc_manufacturer);
+    descriptor_log_copy_str(entry->str[1], dev_info.str_desc_product);
+    descriptor_log_copy_str(entry->str[2], dev_info.str_desc_serial_num);
+    portEXIT_CRITICAL(&log_lock);
+}
+
+// Copies the index-th entry in attach order, returns 0 past the last one
+static int descriptor_log_snapshot(descriptor_log_entry_t *entry, int index) {
+    int count = 0;
+    portENTER_CRITICAL(&log_lock);
+    // Entries in attach order: find the index-th smallest sequence number
+    uint32_t last = 0;
+    for (int n = 0; n <= index; n++) {
+        const descriptor_log_entry_t *next = NULL;
+        for (int i = 0; i < DESCRIPTOR_LOG_SIZE; i++) {
+            if (entries[i].valid && entries[i].seq > last && (next == NULL || entries[i].seq < next->seq)) {
+                next = &entries[i];
+            }
+        }
+        if (next == NULL) {
+            break;
+        }
+        last = next->seq;
+        if (n == index) {
+            *entry = *next;
+            count = 1;
+        }
+    }
+    portEXIT_CRITICAL(&log_lock);
+    return count;
+}
+
+void descriptor_log_print(void) {
+    static descriptor_log_entry_t entry;    // Kept off the caller's stack, callers don't overlap
+    for (int i = 0; descriptor_log_snapshot(&entry, i); i++) {
+        ESP_LOGI(TAG, "Device at address %d (%s speed, %s port %d)", entry.dev_addr,
+                 (char *[]) { "Low", "Full", "High" }[entry.speed],
+                 entry.parent_addr ? "hub" : "root", entry.port_num);
+        usb_print_device_descriptor(&entry.dev_desc);
+        if (entry.config_len == ((const usb_config_desc_t *)entry.config)->wTotalLength) {
+            usb_print_config_descriptor((const usb_config_desc_t *)entry.config, NULL);
+        } else {
+            ESP_LOGI(TAG, "Config descriptor truncated to %d bytes", entry.config_len);
+        }
+        for (int s = 0; s < DESCRIPTOR_LOG_NUM_STR; s++) {
+            if (entry.str[s][0] >= 2) {
+                usb_print_string_descriptor((const usb_str_desc_t *)entry.str[s]);
+            }
+        }
+    }
+}
+
+static size_t descriptor_log_append(char *buf, size_t size, size_t len, const char *fmt, ...) {
+    if (len >= size) {
+        return len;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(&buf[len], size - len, fmt, args);
+    va_end(args);
+    if (n < 0) {
+        return len;
+    }
+    return len + n < size ? len + n : size - 1;
+}
+
+size_t descriptor_log_format(char *buf, size_t size) {
+    static descriptor_log_entry_t entry;
+    size_t len = 0;
+    if (size == 0) {
+        return 0;
+    }
+    buf[0] = '\0';
+
+    for (int i = 0; descriptor_log_snapshot(&entry, i); i++) {
+        const usb_device_desc_t *d = &entry.dev_desc;
+        len = descriptor_log_append(buf, size, len, "Device %d: %04x:%04x bcdDevice %04x class %02x/%02x/%02x\n",
+                                    entry.dev_addr, d->idVendor, d->idProduct, d->bcdDevice,
+                                    d->bDeviceClass, d->bDeviceSubClass, d->bDeviceProtocol);
+        for (int s = 0; s < DESCRIPTOR_LOG_NUM_STR; s++) {
+            const usb_str_desc_t *str_desc = (const usb_str_desc_t *)entry.str[s];
+            if (entry.str[s][0] < 2) {
+                continue;
+            }
+            len = descriptor_log_append(buf, size, len, "  %s: ", str_names[s]);
+            for (int c = 0; c < (str_desc->bLength - 2) / 2; c++) {
+                uint16_t ch = str_desc->wData[c];
+                len = descriptor_log_append(buf, size, len, "%c", (ch >= 0x20 && ch < 0x7F) ? ch : '?');
+            }
+            len = descriptor_log_append(buf, size, len, "\n");
+        }
+
+        // Interfaces and endpoints, straight from the raw config descriptor
+        for (int pos = 0; pos + 2 <= entry.config_len && entry.config[pos] >= 2; pos += entry.config[pos]) {
+            const uint8_t *desc = &entry.config[pos];
+            if (pos + desc[0] > entry.config_len) {
+                break;
+            }
+            if (desc[1] == USB_B_DESCRIPTOR_TYPE_INTERFACE && desc[0] >= 9) {
+                len = descriptor_log_append(buf, size, len, "  Interface %d alt %d: class %02x/%02x/%02x\n",
+                                            desc[2], desc[3], desc[5], desc[6], desc[7]);
+            } else if (desc[1] == USB_B_DESCRIPTOR_TYPE_ENDPOINT && desc[0] >= 7) {
+                len = descriptor_log_append(buf, size, len, "    Endpoint 0x%02x: attr %02x mps %d\n",
+                                            desc[2], desc[3], desc[4] | ((desc[5] & 0x07) << 8));
+            }
+        }
+    }
+    return len;
+}
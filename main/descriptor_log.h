@@ -0,0 +1,27 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Deferred descriptor dumps
+// Attach only copies a device's descriptors into a small ring. Formatting happens when
+// someone asks for it, so a slow console never sits in the enumeration path.
+
+#pragma once
+
+#include <stddef.h>
+#include "usb/usb_host.h"
+
+#define DESCRIPTOR_LOG_SIZE         4       // Most recently attached devices kept
+#define DESCRIPTOR_LOG_CONFIG_MAX   512     // Longer config descriptors are truncated
+#define DESCRIPTOR_LOG_STR_MAX      64      // Raw string descriptor bytes kept
+
+// Copies the descriptors of an open device, no bus traffic
+void descriptor_log_record(usb_device_handle_t dev_hdl);
+
+// Prints all recorded devices to the console with the USB host library's printers
+void descriptor_log_print(void);
+
+// Formats all recorded devices as text, returns the length written (always NUL terminated)
+size_t descriptor_log_format(char *buf, size_t size);
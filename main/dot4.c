@@ -0,0 +1,597 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// IEEE 1284.4 (DOT4) transport
+// There is no reader task: whichever caller is waiting for something (a reply, credit
+// or channel data) pumps the IN pipe and dispatches packets to their channels.
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "dot4.h"
+
+static const char *TAG = "DOT4";
+
+#define DOT4_HEADER_SIZE            6
+#define DOT4_TRANSACTION_SOCKET     0x00
+#define DOT4_REVISION               0x20
+#define DOT4_MAX_PACKET_SIZE        512     // Requested for both directions, header included
+#define DOT4_MAX_CREDIT             8
+#define DOT4_RX_BUF_SIZE            (DOT4_MAX_PACKET_SIZE * 2)
+#define DOT4_CHANNEL_RX_SIZE        (DOT4_MAX_PACKET_SIZE * 2)
+#define DOT4_POLL_TICKS             pdMS_TO_TICKS(20)
+#define DOT4_TRANSACTION_TIMEOUT    pdMS_TO_TICKS(3000)
+#define DOT4_CREDIT_RETRY_TICKS     pdMS_TO_TICKS(100)
+
+// Transaction channel commands (replies have bit 7 set)
+#define DOT4_CMD_INIT               0x00
+#define DOT4_CMD_OPEN_CHANNEL       0x01
+#define DOT4_CMD_CLOSE_CHANNEL      0x02
+#define DOT4_CMD_CREDIT             0x03
+#define DOT4_CMD_CREDIT_REQUEST     0x04
+#define DOT4_CMD_EXIT               0x08
+#define DOT4_CMD_GET_SOCKET_ID      0x09
+#define DOT4_CMD_ERROR              0x7F
+#define DOT4_REPLY                  0x80
+
+struct dot4_channel {
+    dot4_t *dot4;
+    uint8_t socket_id;
+    bool open;
+    uint16_t max_tx_payload;    // Largest payload we may put in one packet
+    uint16_t max_rx_payload;    // Largest payload the peer may send us
+    uint16_t tx_credit;         // Packets we are allowed to send
+    uint16_t rx_credit;         // Packets the peer is allowed to send us
+    uint8_t rx_data[DOT4_CHANNEL_RX_SIZE];
+    size_t rx_head;
+    size_t rx_len;
+};
+
+struct dot4 {
+    dot4_link_t link;
+    SemaphoreHandle_t tx_lock;          // Serialises packets on the OUT pipe
+    SemaphoreHandle_t rx_lock;          // Only one task pumps the IN pipe at a time
+    SemaphoreHandle_t state_lock;       // Protects channel state and the reply slot
+    SemaphoreHandle_t transaction_lock; // One transaction channel command in flight
+    uint8_t tx_buf[DOT4_MAX_PACKET_SIZE];
+    uint8_t rx_buf[DOT4_RX_BUF_SIZE];
+    size_t rx_buf_len;
+    uint8_t reply[16];
+    size_t reply_len;
+    bool reply_ready;
+    dot4_channel_t channels[DOT4_MAX_CHANNELS];
+};
+
+static inline uint16_t get_be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline void put_be16(uint8_t *p, uint16_t val) {
+    p[0] = val >> 8;
+    p[1] = val & 0xFF;
+}
+
+static bool deadline_passed(TickType_t start, TickType_t timeout) {
+    return timeout != portMAX_DELAY && (xTaskGetTickCount() - start) >= timeout;
+}
+
+static esp_err_t dot4_send_packet(dot4_t *dot4, uint8_t socket_id, uint8_t credit,
+                                  const uint8_t *payload, size_t len) {
+    if (len > DOT4_MAX_PACKET_SIZE - DOT4_HEADER_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(dot4->tx_lock, portMAX_DELAY);
+    uint8_t *pkt = dot4->tx_buf;
+    pkt[0] = socket_id;     // Primary socket
+    pkt[1] = socket_id;     // Secondary socket
+    put_be16(&pkt[2], len + DOT4_HEADER_SIZE);
+    pkt[4] = credit;        // Piggybacked credit
+    pkt[5] = 0;             // Control
+    memcpy(&pkt[DOT4_HEADER_SIZE], payload, len);
+    esp_err_t ret = dot4->link.write(dot4->link.ctx, pkt, len + DOT4_HEADER_SIZE, DOT4_TRANSACTION_TIMEOUT);
+    xSemaphoreGive(dot4->tx_lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send packet on socket %d: %s", socket_id, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+static dot4_channel_t *dot4_find_channel(dot4_t *dot4, uint8_t socket_id) {
+    for (int i = 0; i < DOT4_MAX_CHANNELS; i++) {
+        if (dot4->channels[i].open && dot4->channels[i].socket_id == socket_id) {
+            return &dot4->channels[i];
+        }
+    }
+    return NULL;
+}
+
+// How many more packets the channel's receive buffer can take than the peer already has credit for
+// Must be called with state_lock held
+static uint16_t dot4_channel_grantable(const dot4_channel_t *channel) {
+    size_t packets = (DOT4_CHANNEL_RX_SIZE - channel->rx_len) / channel->max_rx_payload;
+    if (packets > DOT4_MAX_CREDIT) {
+        packets = DOT4_MAX_CREDIT;
+    }
+    return packets > channel->rx_credit ? packets - channel->rx_credit : 0;
+}
+
+// Commands initiated by the peer on the transaction channel
+static void dot4_handle_command(dot4_t *dot4, const uint8_t *cmd, size_t len) {
+    uint8_t reply[8] = {cmd[0] | DOT4_REPLY, 0x00};
+    size_t reply_len = 2;
+
+    switch (cmd[0]) {
+    case DOT4_CMD_CREDIT: {
+        if (len < 5) {
+            return;
+        }
+        xSemaphoreTake(dot4->state_lock, portMAX_DELAY);
+        dot4_channel_t *channel = dot4_find_channel(dot4, cmd[1]);
+        if (channel != NULL) {
+            channel->tx_credit += get_be16(&cmd[3]);
+        }
+        xSemaphoreGive(dot4->state_lock);
+        reply[2] = cmd[1];
+        reply[3] = cmd[2];
+        reply_len = 4;
+        break;
+    }
+    case DOT4_CMD_CREDIT_REQUEST: {
+        if (len < 5) {
+            return;
+        }
+        uint16_t grant = 0;
+        xSemaphoreTake(dot4->state_lock, portMAX_DELAY);
+        dot4_channel_t *channel = dot4_find_channel(dot4, cmd[1]);
+        if (channel != NULL) {
+            grant = dot4_channel_grantable(channel);
+            channel->rx_credit += grant;
+        }
+        xSemaphoreGive(dot4->state_lock);
+        reply[2] = cmd[1];
+        reply[3] = cmd[2];
+        put_be16(&reply[4], grant);
+        reply_len = 6;
+        break;
+    }
+    case DOT4_CMD_ERROR:
+        ESP_LOGE(TAG, "Peer reported error 0x%02x", len > 3 ? cmd[3] : 0);
+        return;
+    default:
+        ESP_LOGW(TAG, "Ignoring unsupported peer command 0x%02x", cmd[0]);
+        return;
+    }
+
+    dot4_send_packet(dot4, DOT4_TRANSACTION_SOCKET, 1, reply, reply_len);
+}
+
+static void dot4_dispatch(dot4_t *dot4, const uint8_t *pkt, size_t len) {
+    uint8_t socket_id = pkt[1];
+    uint8_t credit = pkt[4];
+    const uint8_t *payload = &pkt[DOT4_HEADER_SIZE];
+    size_t payload_len = len - DOT4_HEADER_SIZE;
+
+    if (socket_id == DOT4_TRANSACTION_SOCKET) {
+        if (payload_len == 0) {
+            return;
+        }
+        if (payload[0] & DOT4_REPLY) {
+            xSemaphoreTake(dot4->state_lock, portMAX_DELAY);
+            dot4->reply_len = payload_len < sizeof(dot4->reply) ? payload_len : sizeof(dot4->reply);
+            memcpy(dot4->reply, payload, dot4->reply_len);
+            dot4->reply_ready = true;
+            xSemaphoreGive(dot4->state_lock);
+        } else {
+            dot4_handle_command(dot4, payload, payload_len);
+        }
+        return;
+    }
+
+    xSemaphoreTake(dot4->state_lock, portMAX_DELAY);
+    dot4_channel_t *channel = dot4_find_channel(dot4, socket_id);
+    if (channel == NULL) {
+        xSemaphoreGive(dot4->state_lock);
+        ESP_LOGW(TAG, "Dropping %zu bytes for closed socket %d", payload_len, socket_id);
+        return;
+    }
+    channel->tx_credit += credit;
+    if (payload_len > 0) {
+        if (channel->rx_credit > 0) {
+            channel->rx_credit--;
+        }
+        if (payload_len > DOT4_CHANNEL_RX_SIZE - channel->rx_len) {
+            // Only happens if the peer ignores our credit
+            ESP_LOGW(TAG, "Socket %d overrun, dropping %zu bytes", socket_id, payload_len);
+        } else {
+            for (size_t i = 0; i < payload_len; i++) {
+                channel->rx_data[(channel->rx_head + channel->rx_len + i) % DOT4_CHANNEL_RX_SIZE] = payload[i];
+            }
+            channel->rx_len += payload_len;
+        }
+    }
+    xSemaphoreGive(dot4->state_lock);
+}
+
+// Reads once from the link and dispatches every complete packet
+// Returns ESP_ERR_TIMEOUT if another task is pumping or nothing arrived
+static esp_err_t dot4_pump(dot4_t *dot4, TickType_t timeout) {
+    if (xSemaphoreTake(dot4->rx_lock, timeout) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    size_t received = 0;
+    esp_err_t ret = dot4->link.read(dot4->link.ctx, &dot4->rx_buf[dot4->rx_buf_len],
+                                    DOT4_RX_BUF_SIZE - dot4->rx_buf_len, &received, timeout);
+    if (ret == ESP_OK) {
+        dot4->rx_buf_len += received;
+        while (dot4->rx_buf_len >= DOT4_HEADER_SIZE) {
+            size_t pkt_len = get_be16(&dot4->rx_buf[2]);
+            if (pkt_len < DOT4_HEADER_SIZE || pkt_len > DOT4_RX_BUF_SIZE) {
+                ESP_LOGE(TAG, "Bad packet length %zu, resynchronising", pkt_len);
+                dot4->rx_buf_len = 0;
+                break;
+            }
+            if (dot4->rx_buf_len < pkt_len) {
+                break;
+            }
+            dot4_dispatch(dot4, dot4->rx_buf, pkt_len);
+            dot4->rx_buf_len -= pkt_len;
+            memmove(dot4->rx_buf, &dot4->rx_buf[pkt_len], dot4->rx_buf_len);
+        }
+    }
+
+    xSemaphoreGive(dot4->rx_lock);
+    return ret;
+}
+
+// Sends a command on the transaction channel and waits for its reply
+static esp_err_t dot4_transact(dot4_t *dot4, const uint8_t *cmd, size_t cmd_len,
+                               uint8_t *reply, size_t reply_size, size_t *reply_len) {
+    xSemaphoreTake(dot4->transaction_lock, portMAX_DELAY);
+
+    xSemaphoreTake(dot4->state_lock, portMAX_DELAY);
+    dot4->reply_ready = false;
+    xSemaphoreGive(dot4->state_lock);
+
+    esp_err_t ret = dot4_send_packet(dot4, DOT4_TRANSACTION_SOCKET, 1, cmd, cmd_len);
+    TickType_t start = xTaskGetTickCount();
+    while (ret == ESP_OK) {
+        xSemaphoreTake(dot4->state_lock, portMAX_DELAY);
+        bool ready = dot4->reply_ready;
+        if (ready) {
+            size_t len = dot4->reply_len < reply_size ? dot4->reply_len : reply_size;
+            memcpy(reply, dot4->reply, len);
+            *reply_len = len;
+            dot4->reply_ready = false;
+        }
+        xSemaphoreGive(dot4->state_lock);
+
+        if (ready) {
+            break;
+        }
+        if (deadline_passed(start, DOT4_TRANSACTION_TIMEOUT)) {
+            ESP_LOGE(TAG, "No reply to command 0x%02x", cmd[0]);
+            ret = ESP_ERR_TIMEOUT;
+            break;
+        }
+        dot4_pump(dot4, DOT4_POLL_TICKS);
+    }
+
+    xSemaphoreGive(dot4->transaction_lock);
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (*reply_len < 2 || reply[0] != (cmd[0] | DOT4_REPLY)) {
+        ESP_LOGE(TAG, "Unexpected reply 0x%02x to command 0x%02x", reply[0], cmd[0]);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (reply[1] != 0x00) {
+        ESP_LOGE(TAG, "Command 0x%02x failed with result 0x%02x", cmd[0], reply[1]);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Gives the peer credit for whatever space is free in the channel's receive buffer
+static esp_err_t dot4_channel_grant(dot4_channel_t *channel) {
+    dot4_t *dot4 = channel->dot4;
+
+    // Counted before the command goes out: the peer may use the credit right away, and
+    // another task pumping the IN pipe can dispatch its data before our reply arrives
+    xSemaphoreTake(dot4->state_lock, portMAX_DELAY);
+    uint16_t grant = dot4_channel_grantable(channel);
+    channel->rx_credit += grant;
+    xSemaphoreGive(dot4->state_lock);
+    if (grant == 0) {
+        return ESP_OK;
+    }
+
+    uint8_t cmd[5] = {DOT4_CMD_CREDIT, channel->socket_id, channel->socket_id};
+    put_be16(&cmd[3], grant);
+    uint8_t reply[4];
+    size_t reply_len;
+    esp_err_t ret = dot4_transact(dot4, cmd, sizeof(cmd), reply, sizeof(reply), &reply_len);
+    if (ret != ESP_OK) {
+        xSemaphoreTake(dot4->state_lock, portMAX_DELAY);
+        channel->rx_credit = channel->rx_credit > grant ? channel->rx_credit - grant : 0;
+        xSemaphoreGive(dot4->state_lock);
+    }
+    return ret;
+}
+
+// Asks the peer for more credit on the channel, returns how much was granted
+static uint16_t dot4_channel_request_credit(dot4_channel_t *channel) {
+    uint8_t cmd[5] = {DOT4_CMD_CREDIT_REQUEST, channel->socket_id, channel->socket_id};
+    put_be16(&cmd[3], DOT4_MAX_CREDIT);
+    uint8_t reply[6];
+    size_t reply_len;
+    if (dot4_transact(channel->dot4, cmd, sizeof(cmd), reply, sizeof(reply), &reply_len) != ESP_OK
+        || reply_len < 6) {
+        return 0;
+    }
+
+    uint16_t credit = get_be16(&reply[4]);
+    xSemaphoreTake(channel->dot4->state_lock, portMAX_DELAY);
+    channel->tx_credit += credit;
+    xSemaphoreGive(channel->dot4->state_lock);
+    return credit;
+}
+
+esp_err_t dot4_open(const dot4_link_t *link, dot4_t **dot4_ret) {
+    if (link == NULL || link->write == NULL || link->read == NULL || dot4_ret == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    dot4_t *dot4 = calloc(1, sizeof(dot4_t));
+    if (dot4 == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    dot4->link = *link;
+    dot4->tx_lock = xSemaphoreCreateMutex();
+    dot4->rx_lock = xSemaphoreCreateMutex();
+    dot4->state_lock = xSemaphoreCreateMutex();
+    dot4->transaction_lock = xSemaphoreCreateMutex();
+    if (!dot4->tx_lock || !dot4->rx_lock || !dot4->state_lock || !dot4->transaction_lock) {
+        ESP_LOGE(TAG, "Failed to create DOT4 locks");
+        dot4_close(dot4);
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < DOT4_MAX_CHANNELS; i++) {
+        dot4->channels[i].dot4 = dot4;
+    }
+
+    uint8_t cmd[2] = {DOT4_CMD_INIT, DOT4_REVISION};
+    uint8_t reply[3];
+    size_t reply_len;
+    esp_err_t ret = dot4_transact(dot4, cmd, sizeof(cmd), reply, sizeof(reply), &reply_len);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "DOT4 Init failed: %s", esp_err_to_name(ret));
+        vSemaphoreDelete(dot4->tx_lock);
+        vSemaphoreDelete(dot4->rx_lock);
+        vSemaphoreDelete(dot4->state_lock);
+        vSemaphoreDelete(dot4->transaction_lock);
+        free(dot4);
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "DOT4 session open, peer revision 0x%02x", reply_len > 2 ? reply[2] : 0);
+    *dot4_ret = dot4;
+    return ESP_OK;
+}
+
+void dot4_close(dot4_t *dot4) {
+    if (dot4 == NULL) {
+        return;
+    }
+
+    if (dot4->tx_lock && dot4->rx_lock && dot4->state_lock && dot4->transaction_lock) {
+        for (int i = 0; i < DOT4_MAX_CHANNELS; i++) {
+            if (dot4->channels[i].open) {
+                dot4_channel_close(&dot4->channels[i]);
+            }
+        }
+        uint8_t cmd[1] = {DOT4_CMD_EXIT};
+        uint8_t reply[2];
+        size_t reply_len;
+        dot4_transact(dot4, cmd, sizeof(cmd), reply, sizeof(reply), &reply_len);
+    }
+
+    if (dot4->tx_lock) {
+        vSemaphoreDelete(dot4->tx_lock);
+    }
+    if (dot4->rx_lock) {
+        vSemaphoreDelete(dot4->rx_lock);
+    }
+    if (dot4->state_lock) {
+        vSemaphoreDelete(dot4->state_lock);
+    }
+    if (dot4->transaction_lock) {
+        vSemaphoreDelete(dot4->transaction_lock);
+    }
+    free(dot4);
+}
+
+esp_err_t dot4_get_socket(dot4_t *dot4, const char *service_name, uint8_t *socket_id) {
+    uint8_t cmd[1 + 40] = {DOT4_CMD_GET_SOCKET_ID};
+    size_t name_len = strlen(service_name);
+    if (name_len > sizeof(cmd) - 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&cmd[1], service_name, name_len);
+
+    uint8_t reply[3];
+    size_t reply_len;
+    esp_err_t ret = dot4_transact(dot4, cmd, name_len + 1, reply, sizeof(reply), &reply_len);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (reply_len < 3) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    *socket_id = reply[2];
+    return ESP_OK;
+}
+
+esp_err_t dot4_channel_open(dot4_t *dot4, uint8_t socket_id, dot4_channel_t **channel_ret) {
+    dot4_channel_t *channel = NULL;
+
+    xSemaphoreTake(dot4->state_lock, portMAX_DELAY);
+    if (dot4_find_channel(dot4, socket_id) != NULL) {
+        xSemaphoreGive(dot4->state_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < DOT4_MAX_CHANNELS; i++) {
+        if (!dot4->channels[i].open) {
+            channel = &dot4->channels[i];
+            break;
+        }
+    }
+    xSemaphoreGive(dot4->state_lock);
+    if (channel == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint8_t cmd[9] = {DOT4_CMD_OPEN_CHANNEL, socket_id, socket_id};
+    put_be16(&cmd[3], DOT4_MAX_PACKET_SIZE);    // Primary to secondary
+    put_be16(&cmd[5], DOT4_MAX_PACKET_SIZE);    // Secondary to primary
+    put_be16(&cmd[7], DOT4_MAX_CREDIT);
+    // Reply: cmd, result, PSID, SSID, MaxP2S, MaxS2P, MaxOutstandingCredit, Credit
+    uint8_t reply[12];
+    size_t reply_len;
+    esp_err_t ret = dot4_transact(dot4, cmd, sizeof(cmd), reply, sizeof(reply), &reply_len);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open channel to socket %d", socket_id);
+        return ret;
+    }
+    if (reply_len < 12) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    uint16_t max_tx = get_be16(&reply[4]);
+    uint16_t max_rx = get_be16(&reply[6]);
+    if (max_tx <= DOT4_HEADER_SIZE || max_tx > DOT4_MAX_PACKET_SIZE) {
+        max_tx = DOT4_MAX_PACKET_SIZE;
+    }
+    if (max_rx <= DOT4_HEADER_SIZE || max_rx > DOT4_MAX_PACKET_SIZE) {
+        max_rx = DOT4_MAX_PACKET_SIZE;
+    }
+
+    xSemaphoreTake(dot4->state_lock, portMAX_DELAY);
+    channel->socket_id = socket_id;
+    channel->max_tx_payload = max_tx - DOT4_HEADER_SIZE;
+    channel->max_rx_payload = max_rx - DOT4_HEADER_SIZE;
+    channel->tx_credit = get_be16(&reply[10]);
+    channel->rx_credit = 0;
+    channel->rx_head = 0;
+    channel->rx_len = 0;
+    channel->open = true;
+    xSemaphoreGive(dot4->state_lock);
+
+    ESP_LOGI(TAG, "Channel %d open: tx %d, rx %d bytes per packet, %d initial credit",
+             socket_id, channel->max_tx_payload, channel->max_rx_payload, channel->tx_credit);
+
+    // Let the peer start sending to us right away
+    dot4_channel_grant(channel);
+
+    *channel_ret = channel;
+    return ESP_OK;
+}
+
+esp_err_t dot4_channel_close(dot4_channel_t *channel) {
+    dot4_t *dot4 = channel->dot4;
+    if (!channel->open) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint8_t cmd[4] = {DOT4_CMD_CLOSE_CHANNEL, channel->socket_id, channel->socket_id, 0x00};  // Control 0
+    uint8_t reply[4];
+    size_t reply_len;
+    esp_err_t ret = dot4_transact(dot4, cmd, sizeof(cmd), reply, sizeof(reply), &reply_len);
+
+    xSemaphoreTake(dot4->state_lock, portMAX_DELAY);
+    channel->open = false;
+    xSemaphoreGive(dot4->state_lock);
+
+    return ret;
+}
+
+esp_err_t dot4_channel_write(dot4_channel_t *channel, const uint8_t *data, size_t len, TickType_t timeout) {
+    dot4_t *dot4 = channel->dot4;
+    TickType_t start = xTaskGetTickCount();
+
+    while (len > 0) {
+        // Wait for credit on this channel only
+        bool have_credit = false;
+        while (!have_credit) {
+            xSemaphoreTake(dot4->state_lock, portMAX_DELAY);
+            if (channel->tx_credit > 0) {
+                channel->tx_credit--;
+                have_credit = true;
+            }
+            xSemaphoreGive(dot4->state_lock);
+            if (have_credit) {
+                break;
+            }
+            if (deadline_passed(start, timeout)) {
+                ESP_LOGE(TAG, "Timed out waiting for credit on socket %d", channel->socket_id);
+                return ESP_ERR_TIMEOUT;
+            }
+            if (dot4_channel_request_credit(channel) == 0) {
+                // The peer will send a Credit command once it has room
+                dot4_pump(dot4, DOT4_CREDIT_RETRY_TICKS);
+            }
+        }
+
+        size_t chunk = len < channel->max_tx_payload ? len : channel->max_tx_payload;
+        esp_err_t ret = dot4_send_packet(dot4, channel->socket_id, 0, data, chunk);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        data += chunk;
+        len -= chunk;
+        // The timeout is for one credit wait, a long job keeps going while the peer grants credit
+        start = xTaskGetTickCount();
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t dot4_channel_read(dot4_channel_t *channel, uint8_t *data, size_t max_len, size_t *actual_len,
+                            TickType_t timeout) {
+    dot4_t *dot4 = channel->dot4;
+    TickType_t start = xTaskGetTickCount();
+    size_t copied = 0;
+
+    while (1) {
+        xSemaphoreTake(dot4->state_lock, portMAX_DELAY);
+        while (copied < max_len && channel->rx_len > 0) {
+            data[copied++] = channel->rx_data[channel->rx_head];
+            channel->rx_head = (channel->rx_head + 1) % DOT4_CHANNEL_RX_SIZE;
+            channel->rx_len--;
+        }
+        xSemaphoreGive(dot4->state_lock);
+
+        if (copied > 0) {
+            break;
+        }
+        if (deadline_passed(start, timeout)) {
+            return ESP_ERR_TIMEOUT;
+        }
+        dot4_pump(dot4, DOT4_POLL_TICKS);
+    }
+
+    *actual_len = copied;
+    // Space was freed, top up the peer's credit
+    dot4_channel_grant(channel);
+    return ESP_OK;
+}
@@ -0,0 +1,52 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// IEEE 1284.4 (DOT4) transport
+// Multiplexes several logical channels (print, scan, status...) over one bulk IN/OUT pair.
+// Every channel has its own credit-based flow control, so a stalled print channel
+// never blocks status traffic on another channel.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#define DOT4_MAX_CHANNELS           4
+#define DOT4_PRINT_SOCKET_DEFAULT   0x02    // Used if the peer doesn't answer GetSocketID
+
+// Byte pipe the transport runs over (a bulk pair, or anything else that behaves like one)
+typedef struct {
+    esp_err_t (*write)(void *ctx, const uint8_t *data, size_t len, TickType_t timeout);
+    // Returns ESP_ERR_TIMEOUT if nothing arrived within timeout
+    esp_err_t (*read)(void *ctx, uint8_t *data, size_t max_len, size_t *actual_len, TickType_t timeout);
+    void *ctx;
+} dot4_link_t;
+
+typedef struct dot4 dot4_t;
+typedef struct dot4_channel dot4_channel_t;
+
+// Opens a DOT4 session over link (sends Init and waits for the reply)
+esp_err_t dot4_open(const dot4_link_t *link, dot4_t **dot4_ret);
+
+// Closes all channels, sends Exit and frees the session
+void dot4_close(dot4_t *dot4);
+
+// Resolves a service name (e.g. "PRINT") into a socket ID
+esp_err_t dot4_get_socket(dot4_t *dot4, const char *service_name, uint8_t *socket_id);
+
+// Opens a channel to socket_id. Channels can be used from different tasks concurrently.
+esp_err_t dot4_channel_open(dot4_t *dot4, uint8_t socket_id, dot4_channel_t **channel_ret);
+esp_err_t dot4_channel_close(dot4_channel_t *channel);
+
+// Blocks only while this channel has no credit; other channels keep flowing
+// ESP_ERR_TIMEOUT if no credit came for timeout, however long the whole write takes
+esp_err_t dot4_channel_write(dot4_channel_t *channel, const uint8_t *data, size_t len, TickType_t timeout);
+
+// Returns whatever is buffered for this channel (at least 1 byte), or ESP_ERR_TIMEOUT
+esp_err_t dot4_channel_read(dot4_channel_t *channel, uint8_t *data, size_t max_len, size_t *actual_len,
+                            TickType_t timeout);
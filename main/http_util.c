@@ -0,0 +1,162 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "http_util.h"
+
+enum {
+    CHUNK_SIZE,             // Hex chunk size
+    CHUNK_EXT,              // Chunk extension, skipped up to the line end
+    CHUNK_SIZE_LF,
+    CHUNK_DATA,
+    CHUNK_DATA_CR,
+    CHUNK_DATA_LF,
+    CHUNK_TRAILER,          // Start of a trailer line, an empty one ends the body
+    CHUNK_TRAILER_LINE,
+    CHUNK_TRAILER_LF,
+};
+
+size_t http_header_end(const char *buf, size_t len) {
+    for (size_t i = 3; i < len; i++) {
+        if (buf[i - 3] == '\r' && buf[i - 2] == '\n' && buf[i - 1] == '\r' && buf[i] == '\n') {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+bool http_get_header(const char *head, size_t head_len, const char *name, char *value, size_t value_size) {
+    size_t name_len = strlen(name);
+    const char *end = head + head_len;
+
+    // Skip the request or status line
+    const char *line = memchr(head, '\n', head_len);
+    while (line != NULL && ++line < end) {
+        const char *line_end = memchr(line, '\n', end - line);
+        if (line_end == NULL) {
+            line_end = end;
+        }
+        if ((size_t)(line_end - line) > name_len && line[name_len] == ':'
+            && strncasecmp(line, name, name_len) == 0) {
+            const char *val = line + name_len + 1;
+            while (val < line_end && (*val == ' ' || *val == '\t')) {
+                val++;
+            }
+            const char *val_end = line_end;
+            while (val_end > val && isspace((unsigned char)val_end[-1])) {
+                val_end--;
+            }
+            size_t len = val_end - val;
+            if (len >= value_size) {
+                len = value_size - 1;
+            }
+            memcpy(value, val, len);
+            value[len] = '\0';
+            return true;
+        }
+        line = line_end;
+    }
+    return false;
+}
+
+void http_chunked_init(http_chunked_decoder_t *dec) {
+    memset(dec, 0, sizeof(http_chunked_decoder_t));
+    dec->state = CHUNK_SIZE;
+}
+
+esp_err_t http_chunked_decode(http_chunked_decoder_t *dec, uint8_t *buf, size_t len,
+                              size_t *consumed, size_t *payload_len) {
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < len && !dec->done) {
+        uint8_t c = buf[in];
+        switch (dec->state) {
+        case CHUNK_SIZE:
+            if (isxdigit(c)) {
+                if (dec->remaining > (SIZE_MAX >> 4)) {
+                    return ESP_ERR_INVALID_SIZE;
+                }
+                dec->remaining = (dec->remaining << 4) | (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+            } else if (c == ';' || c == ' ' || c == '\t') {
+                dec->state = CHUNK_EXT;
+            } else if (c == '\r') {
+                dec->state = CHUNK_SIZE_LF;
+            } else {
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            in++;
+            break;
+        case CHUNK_EXT:
+            if (c == '\r') {
+                dec->state = CHUNK_SIZE_LF;
+            }
+            in++;
+            break;
+        case CHUNK_SIZE_LF:
+            if (c != '\n') {
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            dec->state = dec->remaining > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+            in++;
+            break;
+        case CHUNK_DATA: {
+            size_t n = len - in;
+            if (n > dec->remaining) {
+                n = dec->remaining;
+            }
+            memmove(&buf[out], &buf[in], n);
+            in += n;
+            out += n;
+            dec->remaining -= n;
+            if (dec->remaining == 0) {
+                dec->state = CHUNK_DATA_CR;
+            }
+            break;
+        }
+        case CHUNK_DATA_CR:
+            if (c != '\r') {
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            dec->state = CHUNK_DATA_LF;
+            in++;
+            break;
+        case CHUNK_DATA_LF:
+            if (c != '\n') {
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            dec->state = CHUNK_SIZE;
+            in++;
+            break;
+        case CHUNK_TRAILER:
+            dec->state = c == '\r' ? CHUNK_TRAILER_LF : CHUNK_TRAILER_LINE;
+            in++;
+            break;
+        case CHUNK_TRAILER_LINE:
+            if (c == '\n') {
+                dec->state = CHUNK_TRAILER;
+            }
+            in++;
+            break;
+        case CHUNK_TRAILER_LF:
+            if (c != '\n') {
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            dec->done = true;
+            in++;
+            break;
+        default:
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    *consumed = in;
+    *payload_len = out;
+    return ESP_OK;
+}
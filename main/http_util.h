@@ -0,0 +1,36 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Minimal HTTP/1.1 helpers shared by the IPP-USB client and the network servers
+// Everything works on caller-provided buffers, nothing is allocated.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Returns the length of the header block including the blank line, or 0 if it is not complete yet
+size_t http_header_end(const char *buf, size_t len);
+
+// Copies the value of header name (case-insensitive) into value
+// Returns false if the header is not present in head
+bool http_get_header(const char *head, size_t head_len, const char *name, char *value, size_t value_size);
+
+// Chunked transfer-coding decoder, keeps its state between calls so data can arrive in any split
+typedef struct {
+    uint8_t state;
+    size_t remaining;       // Bytes left in the current chunk
+    bool done;              // Last chunk and trailer seen
+} http_chunked_decoder_t;
+
+void http_chunked_init(http_chunked_decoder_t *dec);
+
+// Decodes len bytes of chunked data in place, the payload is moved to the start of buf
+// Bytes after the end of the body are left untouched and not counted in consumed
+esp_err_t http_chunked_decode(http_chunked_decoder_t *dec, uint8_t *buf, size_t len,
+                              size_t *consumed, size_t *payload_len);
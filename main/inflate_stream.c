@@ -0,0 +1,233 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "miniz.h"
+
+#include "inflate_stream.h"
+
+// gzip header flags
+#define GZIP_FHCRC          0x02
+#define GZIP_FEXTRA         0x04
+#define GZIP_FNAME          0x08
+#define GZIP_FCOMMENT       0x10
+
+#define GZIP_HEADER_SIZE    10
+#define GZIP_TRAILER_SIZE   8
+
+static const char *TAG = "Inflate";
+
+enum {
+    INFLATE_GZIP_HEADER,
+    INFLATE_GZIP_EXTRA_LEN,
+    INFLATE_GZIP_EXTRA,
+    INFLATE_GZIP_NAME,
+    INFLATE_GZIP_COMMENT,
+    INFLATE_GZIP_HCRC,
+    INFLATE_DATA,
+    INFLATE_GZIP_TRAILER,
+    INFLATE_DONE,
+};
+
+struct inflate_stream {
+    tinfl_decompressor decomp;
+    uint8_t window[TINFL_LZ_DICT_SIZE];     // Inflated data is written to the printer from here
+    size_t window_pos;
+    bool more_output;                       // The decompressor has output left without new input
+    bool gzip;
+    uint8_t state;
+    uint8_t flags;                          // gzip header flags
+    uint8_t field[GZIP_HEADER_SIZE];        // Fixed gzip header, FEXTRA length or trailer
+    size_t field_pos;
+    size_t skip;                            // FEXTRA bytes left
+    uint32_t crc;
+    inflate_stream_stats_t stats;
+};
+
+inflate_stream_t *inflate_stream_create(inflate_format_t format) {
+    if (format == INFLATE_FORMAT_NONE) {
+        return NULL;
+    }
+    inflate_stream_t *inf = calloc(1, sizeof(inflate_stream_t));
+    if (inf == NULL) {
+        return NULL;
+    }
+    tinfl_init(&inf->decomp);
+    inf->gzip = format == INFLATE_FORMAT_GZIP;
+    inf->state = inf->gzip ? INFLATE_GZIP_HEADER : INFLATE_DATA;
+    return inf;
+}
+
+void inflate_stream_delete(inflate_stream_t *inf) {
+    free(inf);
+}
+
+size_t inflate_stream_size(void) {
+    return sizeof(inflate_stream_t);
+}
+
+// Moves past the gzip header field just read to the next one present
+static void inflate_gzip_next(inflate_stream_t *inf) {
+    inf->field_pos = 0;
+    switch (inf->state) {
+    case INFLATE_GZIP_HEADER:
+        if (inf->flags & GZIP_FEXTRA) {
+            inf->state = INFLATE_GZIP_EXTRA_LEN;
+            return;
+        }
+        // Fall through
+    case INFLATE_GZIP_EXTRA_LEN:
+    case INFLATE_GZIP_EXTRA:
+        if (inf->flags & GZIP_FNAME) {
+            inf->state = INFLATE_GZIP_NAME;
+            return;
+        }
+        // Fall through
+    case INFLATE_GZIP_NAME:
+        if (inf->flags & GZIP_FCOMMENT) {
+            inf->state = INFLATE_GZIP_COMMENT;
+            return;
+        }
+        // Fall through
+    case INFLATE_GZIP_COMMENT:
+        if (inf->flags & GZIP_FHCRC) {
+            inf->state = INFLATE_GZIP_HCRC;
+            return;
+        }
+        // Fall through
+    default:
+        inf->state = INFLATE_DATA;
+        break;
+    }
+}
+
+static esp_err_t inflate_gzip_check(inflate_stream_t *inf) {
+    const uint8_t *t = inf->field;
+    uint32_t crc = t[0] | (t[1] << 8) | (t[2] << 16) | ((uint32_t)t[3] << 24);
+    uint32_t size = t[4] | (t[5] << 8) | (t[6] << 16) | ((uint32_t)t[7] << 24);
+    if (crc != inf->crc || size != (uint32_t)inf->stats.out_bytes) {
+        ESP_LOGE(TAG, "gzip trailer mismatch, data is corrupt");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    inf->state = INFLATE_DONE;
+    return ESP_OK;
+}
+
+// Runs the decompressor on the input, len returns the bytes it consumed
+static esp_err_t inflate_data(inflate_stream_t *inf, const uint8_t *data, size_t *len, print_stream_t *out) {
+    size_t out_len = TINFL_LZ_DICT_SIZE - inf->window_pos;
+    int64_t start_us = esp_timer_get_time();
+    tinfl_status status = tinfl_decompress(&inf->decomp, data, len, inf->window, &inf->window[inf->window_pos],
+                                           &out_len, TINFL_FLAG_HAS_MORE_INPUT);
+    inf->stats.cpu_us += esp_timer_get_time() - start_us;
+    if (status < TINFL_STATUS_DONE) {
+        ESP_LOGE(TAG, "Corrupt deflate data after %zu bytes", inf->stats.in_bytes);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    inf->more_output = status == TINFL_STATUS_HAS_MORE_OUTPUT;
+
+    const uint8_t *inflated = &inf->window[inf->window_pos];
+    if (inf->gzip) {
+        inf->crc = esp_rom_crc32_le(inf->crc, inflated, out_len);
+    }
+    inf->stats.out_bytes += out_len;
+    inf->window_pos = (inf->window_pos + out_len) & (TINFL_LZ_DICT_SIZE - 1);
+
+    if (status == TINFL_STATUS_DONE && !inf->gzip) {
+        inf->state = INFLATE_DONE;
+    } else if (status == TINFL_STATUS_DONE) {
+        // The decompressor reads ahead, whole bytes left in its bit buffer start the trailer
+        inf->state = INFLATE_GZIP_TRAILER;
+        uint64_t bits = inf->decomp.m_bit_buf >> (inf->decomp.m_num_bits & 7);
+        for (uint32_t n = inf->decomp.m_num_bits / 8; n > 0 && inf->field_pos < GZIP_TRAILER_SIZE; n--) {
+            inf->field[inf->field_pos++] = bits & 0xFF;
+            bits >>= 8;
+        }
+        if (inf->field_pos == GZIP_TRAILER_SIZE && inflate_gzip_check(inf) != ESP_OK) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+    return out_len > 0 ? print_stream_write(out, inflated, out_len) : ESP_OK;
+}
+
+esp_err_t inflate_stream_write(inflate_stream_t *inf, const uint8_t *data, size_t len, print_stream_t *out) {
+    size_t pos = 0;
+    inf->stats.in_bytes += len;
+
+    while (inf->state != INFLATE_DONE && (pos < len || (inf->state == INFLATE_DATA && inf->more_output))) {
+        if (inf->state == INFLATE_DATA) {
+            size_t in_len = len - pos;
+            esp_err_t ret = inflate_data(inf, &data[pos], &in_len, out);
+            pos += in_len;
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            continue;
+        }
+
+        uint8_t c = data[pos++];
+        switch (inf->state) {
+        case INFLATE_GZIP_HEADER:
+            inf->field[inf->field_pos++] = c;
+            if (inf->field_pos == GZIP_HEADER_SIZE) {
+                if (inf->field[0] != 0x1F || inf->field[1] != 0x8B || inf->field[2] != 8) {
+                    ESP_LOGE(TAG, "Not a gzip deflate stream");
+                    return ESP_ERR_INVALID_RESPONSE;
+                }
+                inf->flags = inf->field[3];
+                inflate_gzip_next(inf);
+            }
+            break;
+        case INFLATE_GZIP_EXTRA_LEN:
+            inf->field[inf->field_pos++] = c;
+            if (inf->field_pos == 2) {
+                inf->skip = inf->field[0] | (inf->field[1] << 8);
+                inf->state = INFLATE_GZIP_EXTRA;
+                if (inf->skip == 0) {
+                    inflate_gzip_next(inf);
+                }
+            }
+            break;
+        case INFLATE_GZIP_EXTRA:
+            if (--inf->skip == 0) {
+                inflate_gzip_next(inf);
+            }
+            break;
+        case INFLATE_GZIP_NAME:
+        case INFLATE_GZIP_COMMENT:
+            if (c == '\0') {
+                inflate_gzip_next(inf);
+            }
+            break;
+        case INFLATE_GZIP_HCRC:
+            if (++inf->field_pos == 2) {
+                inflate_gzip_next(inf);
+            }
+            break;
+        case INFLATE_GZIP_TRAILER:
+            inf->field[inf->field_pos++] = c;
+            if (inf->field_pos == GZIP_TRAILER_SIZE && inflate_gzip_check(inf) != ESP_OK) {
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            break;
+        default:
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    return ESP_OK;
+}
+
+bool inflate_stream_done(const inflate_stream_t *inf) {
+    return inf->state == INFLATE_DONE;
+}
+
+void inflate_stream_get_stats(const inflate_stream_t *inf, inflate_stream_stats_t *stats) {
+    *stats = inf->stats;
+}
@@ -0,0 +1,47 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Streaming decompression of compressed documents
+// Deflate and gzip data is inflated with the ROM miniz as it arrives and written into a
+// print stream. The only buffer is the 32 KB deflate window, the output is written
+// straight out of it.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "print_stream.h"
+
+typedef enum {
+    INFLATE_FORMAT_NONE,
+    INFLATE_FORMAT_DEFLATE,                 // Raw deflate (RFC 1951)
+    INFLATE_FORMAT_GZIP,                    // gzip member (RFC 1952), CRC and length are checked
+} inflate_format_t;
+
+typedef struct inflate_stream inflate_stream_t;
+
+typedef struct {
+    size_t in_bytes;                        // Compressed bytes written
+    size_t out_bytes;                       // Bytes inflated into the print stream
+    int64_t cpu_us;                         // Time spent in the decompressor
+} inflate_stream_stats_t;
+
+inflate_stream_t *inflate_stream_create(inflate_format_t format);
+void inflate_stream_delete(inflate_stream_t *inf);
+
+// Memory one stream allocates, for the spool budget
+size_t inflate_stream_size(void);
+
+// Inflates len bytes into out, blocks while out is full
+// Returns ESP_ERR_INVALID_RESPONSE on corrupt data, or the error of print_stream_write
+esp_err_t inflate_stream_write(inflate_stream_t *inf, const uint8_t *data, size_t len, print_stream_t *out);
+
+// True once the end of the compressed data was reached
+bool inflate_stream_done(const inflate_stream_t *inf);
+
+void inflate_stream_get_stats(const inflate_stream_t *inf, inflate_stream_stats_t *stats);
@@ -0,0 +1,230 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include "ipp.h"
+
+enum {
+    IPP_PARSE_HEADER,
+    IPP_PARSE_TAG,
+    IPP_PARSE_NAME_LEN_HI,
+    IPP_PARSE_NAME_LEN_LO,
+    IPP_PARSE_NAME,
+    IPP_PARSE_VALUE_LEN_HI,
+    IPP_PARSE_VALUE_LEN_LO,
+    IPP_PARSE_VALUE,
+};
+
+static void ipp_put_bytes(ipp_writer_t *w, const void *data, size_t len) {
+    if (w->overflow || len > w->size - w->len) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(&w->buf[w->len], data, len);
+    w->len += len;
+}
+
+static void ipp_put_u16(ipp_writer_t *w, uint16_t val) {
+    uint8_t b[2] = {val >> 8, val & 0xFF};
+    ipp_put_bytes(w, b, sizeof(b));
+}
+
+static void ipp_put_u32(ipp_writer_t *w, uint32_t val) {
+    uint8_t b[4] = {val >> 24, (val >> 16) & 0xFF, (val >> 8) & 0xFF, val & 0xFF};
+    ipp_put_bytes(w, b, sizeof(b));
+}
+
+void ipp_writer_init(ipp_writer_t *w, uint8_t *buf, size_t size) {
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->overflow = false;
+}
+
+void ipp_put_header(ipp_writer_t *w, uint16_t op_or_status, uint32_t request_id) {
+    uint8_t version[2] = {1, 1};
+    ipp_put_bytes(w, version, sizeof(version));
+    ipp_put_u16(w, op_or_status);
+    ipp_put_u32(w, request_id);
+}
+
+void ipp_put_tag(ipp_writer_t *w, uint8_t tag) {
+    ipp_put_bytes(w, &tag, 1);
+}
+
+void ipp_put_string(ipp_writer_t *w, uint8_t value_tag, const char *name, const char *value) {
+    size_t name_len = strlen(name);
+    size_t value_len = strlen(value);
+    ipp_put_tag(w, value_tag);
+    ipp_put_u16(w, name_len);
+    ipp_put_bytes(w, name, name_len);
+    ipp_put_u16(w, value_len);
+    ipp_put_bytes(w, value, value_len);
+}
+
+void ipp_put_integer(ipp_writer_t *w, uint8_t value_tag, const char *name, int32_t value) {
+    size_t name_len = strlen(name);
+    ipp_put_tag(w, value_tag);
+    ipp_put_u16(w, name_len);
+    ipp_put_bytes(w, name, name_len);
+    ipp_put_u16(w, 4);
+    ipp_put_u32(w, (uint32_t)value);
+}
+
+void ipp_put_boolean(ipp_writer_t *w, const char *name, bool value) {
+    size_t name_len = strlen(name);
+    uint8_t b = value ? 1 : 0;
+    ipp_put_tag(w, IPP_TAG_BOOLEAN);
+    ipp_put_u16(w, name_len);
+    ipp_put_bytes(w, name, name_len);
+    ipp_put_u16(w, 1);
+    ipp_put_bytes(w, &b, 1);
+}
+
+const uint8_t *ipp_find_attribute(const uint8_t *msg, size_t len, const char *name,
+                                  uint8_t *value_tag, uint16_t *value_len) {
+    size_t name_len = strlen(name);
+    size_t pos = IPP_HEADER_SIZE;
+
+    while (pos < len) {
+        uint8_t tag = msg[pos++];
+        if (tag == IPP_TAG_END) {
+            break;
+        }
+        if (tag < 0x10) {
+            continue;   // Group delimiter
+        }
+        if (pos + 2 > len) {
+            break;
+        }
+        uint16_t n_len = (msg[pos] << 8) | msg[pos + 1];
+        pos += 2;
+        const uint8_t *n = &msg[pos];
+        pos += n_len;
+        if (pos + 2 > len) {
+            break;
+        }
+        uint16_t v_len = (msg[pos] << 8) | msg[pos + 1];
+        pos += 2;
+        if (pos + v_len > len) {
+            break;
+        }
+        if (n_len == name_len && memcmp(n, name, name_len) == 0) {
+            *value_tag = tag;
+            *value_len = v_len;
+            return &msg[pos];
+        }
+        pos += v_len;
+    }
+    return NULL;
+}
+
+void ipp_parser_init(ipp_parser_t *p, ipp_attribute_cb_t cb, void *cb_arg) {
+    memset(p, 0, sizeof(ipp_parser_t));
+    p->state = IPP_PARSE_HEADER;
+    p->cb = cb;
+    p->cb_arg = cb_arg;
+}
+
+// Copies the part of a name or value that fits, the rest is skipped
+static size_t ipp_parser_copy(ipp_parser_t *p, uint8_t *dst, size_t dst_size, const uint8_t *data, size_t len) {
+    size_t n = p->field_len - p->field_pos;
+    if (n > len) {
+        n = len;
+    }
+    if (p->field_pos < dst_size) {
+        size_t fit = dst_size - p->field_pos;
+        memcpy(&dst[p->field_pos], data, n < fit ? n : fit);
+    }
+    p->field_pos += n;
+    return n;
+}
+
+static void ipp_parser_emit(ipp_parser_t *p) {
+    uint16_t value_len = p->field_len < IPP_PARSER_VALUE_MAX ? p->field_len : IPP_PARSER_VALUE_MAX;
+    if (p->cb != NULL) {
+        p->cb(p->cb_arg, p->group, p->value_tag, p->name, p->value, value_len);
+    }
+    p->state = IPP_PARSE_TAG;
+}
+
+esp_err_t ipp_parser_feed(ipp_parser_t *p, const uint8_t *data, size_t len, size_t *consumed) {
+    size_t pos = 0;
+
+    while (pos < len && !p->done) {
+        uint8_t c = data[pos];
+        switch (p->state) {
+        case IPP_PARSE_HEADER:
+            p->header[p->field_pos++] = c;
+            pos++;
+            if (p->field_pos == IPP_HEADER_SIZE) {
+                p->version_major = p->header[0];
+                p->op_or_status = (p->header[2] << 8) | p->header[3];
+                p->request_id = ((uint32_t)p->header[4] << 24) | (p->header[5] << 16) | (p->header[6] << 8) | p->header[7];
+                p->state = IPP_PARSE_TAG;
+            }
+            break;
+        case IPP_PARSE_TAG:
+            pos++;
+            if (c == IPP_TAG_END) {
+                p->done = true;
+            } else if (c < 0x10) {
+                p->group = c;   // Group delimiter
+            } else {
+                p->value_tag = c;
+                p->state = IPP_PARSE_NAME_LEN_HI;
+            }
+            break;
+        case IPP_PARSE_NAME_LEN_HI:
+        case IPP_PARSE_VALUE_LEN_HI:
+            p->field_len = c << 8;
+            p->state++;
+            pos++;
+            break;
+        case IPP_PARSE_NAME_LEN_LO:
+            p->field_len |= c;
+            p->field_pos = 0;
+            pos++;
+            if (p->field_len > 0) {
+                p->state = IPP_PARSE_NAME;
+            } else if (p->name[0] != '\0') {
+                p->state = IPP_PARSE_VALUE_LEN_HI;  // Additional value, keeps the name
+            } else {
+                return ESP_ERR_INVALID_ARG;
+            }
+            break;
+        case IPP_PARSE_NAME:
+            pos += ipp_parser_copy(p, (uint8_t *)p->name, IPP_PARSER_NAME_MAX - 1, &data[pos], len - pos);
+            if (p->field_pos == p->field_len) {
+                p->name[p->field_len < IPP_PARSER_NAME_MAX - 1 ? p->field_len : IPP_PARSER_NAME_MAX - 1] = '\0';
+                p->state = IPP_PARSE_VALUE_LEN_HI;
+            }
+            break;
+        case IPP_PARSE_VALUE_LEN_LO:
+            p->field_len |= c;
+            p->field_pos = 0;
+            pos++;
+            if (p->field_len > 0) {
+                p->state = IPP_PARSE_VALUE;
+            } else {
+                ipp_parser_emit(p);
+            }
+            break;
+        case IPP_PARSE_VALUE:
+            pos += ipp_parser_copy(p, p->value, IPP_PARSER_VALUE_MAX, &data[pos], len - pos);
+            if (p->field_pos == p->field_len) {
+                ipp_parser_emit(p);
+            }
+            break;
+        default:
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    *consumed = pos;
+    return ESP_OK;
+}
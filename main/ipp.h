@@ -0,0 +1,112 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// IPP/1.1 message encoding helpers (RFC 8010)
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define IPP_HEADER_SIZE                 8
+#define IPP_PARSER_NAME_MAX             64      // Longer attribute names are truncated
+#define IPP_PARSER_VALUE_MAX            128     // Longer values are truncated
+
+// Operations
+#define IPP_OP_PRINT_JOB                0x0002
+#define IPP_OP_VALIDATE_JOB             0x0004
+#define IPP_OP_GET_PRINTER_ATTRIBUTES   0x000B
+
+// Status codes
+#define IPP_STATUS_OK                           0x0000
+#define IPP_STATUS_CLIENT_ERROR_BAD_REQUEST     0x0400
+#define IPP_STATUS_CLIENT_ERROR_NOT_FOUND       0x0406
+#define IPP_STATUS_CLIENT_ERROR_COMPRESSION_NOT_SUPPORTED 0x040F
+#define IPP_STATUS_SERVER_ERROR_INTERNAL        0x0500
+#define IPP_STATUS_SERVER_ERROR_OP_NOT_SUPPORTED 0x0501
+#define IPP_STATUS_SERVER_ERROR_SERVICE_UNAVAILABLE 0x0502
+#define IPP_STATUS_SERVER_ERROR_BUSY            0x0507
+
+// Delimiter tags
+#define IPP_TAG_OPERATION               0x01
+#define IPP_TAG_JOB                     0x02
+#define IPP_TAG_END                     0x03
+#define IPP_TAG_PRINTER                 0x04
+#define IPP_TAG_UNSUPPORTED_GROUP       0x05
+
+// Value tags
+#define IPP_TAG_INTEGER                 0x21
+#define IPP_TAG_BOOLEAN                 0x22
+#define IPP_TAG_ENUM                    0x23
+#define IPP_TAG_TEXT                    0x41
+#define IPP_TAG_NAME                    0x42
+#define IPP_TAG_KEYWORD                 0x44
+#define IPP_TAG_URI                     0x45
+#define IPP_TAG_CHARSET                 0x47
+#define IPP_TAG_LANGUAGE                0x48
+#define IPP_TAG_MIME_TYPE               0x49
+
+// printer-state values
+#define IPP_PRINTER_STATE_IDLE          3
+#define IPP_PRINTER_STATE_PROCESSING    4
+#define IPP_PRINTER_STATE_STOPPED       5
+
+// job-state values
+#define IPP_JOB_STATE_ABORTED           8
+#define IPP_JOB_STATE_COMPLETED         9
+
+// Writes an IPP message into a fixed buffer, overflow is sticky and checked once at the end
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+} ipp_writer_t;
+
+void ipp_writer_init(ipp_writer_t *w, uint8_t *buf, size_t size);
+
+// Version 1.1 header, op_or_status is the operation for requests and the status for responses
+void ipp_put_header(ipp_writer_t *w, uint16_t op_or_status, uint32_t request_id);
+void ipp_put_tag(ipp_writer_t *w, uint8_t tag);
+void ipp_put_string(ipp_writer_t *w, uint8_t value_tag, const char *name, const char *value);
+void ipp_put_integer(ipp_writer_t *w, uint8_t value_tag, const char *name, int32_t value);
+void ipp_put_boolean(ipp_writer_t *w, const char *name, bool value);
+
+// Looks up the first value of an attribute in a complete message
+// Returns a pointer to the value, or NULL if the attribute is not there
+const uint8_t *ipp_find_attribute(const uint8_t *msg, size_t len, const char *name,
+                                  uint8_t *value_tag, uint16_t *value_len);
+
+// Incremental message parser, bytes can arrive in any split
+// Each attribute value is handed to the callback as soon as it is complete. Additional
+// values of a multi-valued attribute come with the attribute's name again.
+typedef void (*ipp_attribute_cb_t)(void *arg, uint8_t group, uint8_t value_tag, const char *name,
+                                   const uint8_t *value, uint16_t value_len);
+
+typedef struct {
+    uint8_t state;
+    uint8_t header[IPP_HEADER_SIZE];
+    uint8_t version_major;
+    uint16_t op_or_status;
+    uint32_t request_id;
+    uint8_t group;                          // Current delimiter tag
+    uint8_t value_tag;
+    uint16_t field_len;                     // Length of the name or value being read
+    uint16_t field_pos;
+    char name[IPP_PARSER_NAME_MAX];
+    uint8_t value[IPP_PARSER_VALUE_MAX];
+    bool done;                              // End of attributes seen
+    ipp_attribute_cb_t cb;
+    void *cb_arg;
+} ipp_parser_t;
+
+void ipp_parser_init(ipp_parser_t *p, ipp_attribute_cb_t cb, void *cb_arg);
+
+// Parses len bytes of a message, stops after the end-of-attributes tag
+// consumed excludes the document data that follows the attributes
+esp_err_t ipp_parser_feed(ipp_parser_t *p, const uint8_t *data, size_t len, size_t *consumed);
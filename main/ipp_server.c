@@ -0,0 +1,670 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "ipp_server.h"
+#include "ipp.h"
+#include "http_util.h"
+#include "net_job.h"
+#include "net_admission.h"
+#include "printer_handler.h"
+#include "descriptor_log.h"
+
+#define IPP_SERVER_TASK_STACK       6144
+#define IPP_SERVER_TASK_PRIORITY    2
+#define IPP_SERVER_BUF_SIZE         4096    // Headers must fit, with the job's stream this is all a connection holds
+#define IPP_SERVER_IDLE_TIMEOUT_S   30
+#define IPP_SERVER_RESPONSE_SIZE    1024
+#define IPP_SERVER_URI_SIZE         128
+#define IPP_SERVER_TEXT_SIZE        4096    // GET /descriptors output
+#define IPP_SERVER_PRINT_PATH       "/ipp/print"
+#define IPP_SERVER_UPLOAD_PATH      "/print"
+#define IPP_SERVER_JOB_PATH         "/ipp/job"
+
+static const char *TAG = "IPP server";
+
+typedef struct {
+    int sock;
+    char peer[INET_ADDRSTRLEN];
+    bool keep_alive;
+    int64_t request_us;                     // Request headers complete
+    char host[64];                          // Host the client reached the server by, for URIs
+    // Body of the current request
+    bool chunked;
+    bool body_done;
+    size_t remaining;                       // Content-Length left
+    http_chunked_decoder_t chunk;
+    // Received bytes not handled yet are buf[pos, len)
+    size_t pos;
+    size_t len;
+    uint8_t buf[IPP_SERVER_BUF_SIZE];
+} ipp_conn_t;
+
+// Spool budget of a connection: a job's stream, the connection and its task
+#define IPP_CONN_COST               (NET_JOB_STREAM_SIZE + sizeof(ipp_conn_t) + IPP_SERVER_TASK_STACK)
+
+// Operation attributes of a request that the server cares about
+typedef struct {
+    char job_name[64];
+    char user[32];
+    char format[48];
+    char compression[16];
+} ipp_request_attrs_t;
+
+static uint32_t next_job_id = 1;
+static portMUX_TYPE job_id_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Connections run concurrently, job IDs are handed out under a lock
+static uint32_t ipp_next_job_id(void) {
+    portENTER_CRITICAL(&job_id_lock);
+    uint32_t job_id = next_job_id++;
+    portEXIT_CRITICAL(&job_id_lock);
+    return job_id;
+}
+
+// Reads up to the end of the request headers, bytes after them stay in the buffer
+static esp_err_t ipp_conn_read_head(ipp_conn_t *conn, size_t *head_len) {
+    // A pipelined request may already be in the buffer
+    memmove(conn->buf, &conn->buf[conn->pos], conn->len - conn->pos);
+    conn->len -= conn->pos;
+    conn->pos = 0;
+
+    while ((*head_len = http_header_end((const char *)conn->buf, conn->len)) == 0) {
+        if (conn->len == sizeof(conn->buf)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        int len = recv(conn->sock, &conn->buf[conn->len], sizeof(conn->buf) - conn->len, 0);
+        if (len <= 0) {
+            return ESP_FAIL;
+        }
+        conn->len += len;
+    }
+    conn->pos = *head_len;
+    conn->request_us = esp_timer_get_time();
+    return ESP_OK;
+}
+
+// Returns the next piece of the request body in place, len 0 at its end
+static esp_err_t ipp_conn_read_body(ipp_conn_t *conn, uint8_t **data, size_t *len) {
+    *len = 0;
+    while (!conn->body_done) {
+        if (conn->pos == conn->len) {
+            int recv_len = recv(conn->sock, conn->buf, sizeof(conn->buf), 0);
+            if (recv_len <= 0) {
+                return ESP_FAIL;
+            }
+            conn->pos = 0;
+            conn->len = recv_len;
+        }
+        uint8_t *piece = &conn->buf[conn->pos];
+        size_t avail = conn->len - conn->pos;
+        if (!conn->chunked) {
+            size_t n = avail < conn->remaining ? avail : conn->remaining;
+            conn->pos += n;
+            conn->remaining -= n;
+            conn->body_done = conn->remaining == 0;
+            *data = piece;
+            *len = n;
+            return ESP_OK;
+        }
+        size_t consumed;
+        size_t payload_len;
+        esp_err_t ret = http_chunked_decode(&conn->chunk, piece, avail, &consumed, &payload_len);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        conn->pos += consumed;
+        conn->body_done = conn->chunk.done;
+        if (payload_len > 0) {
+            *data = piece;
+            *len = payload_len;
+            return ESP_OK;
+        }
+    }
+    return ESP_OK;
+}
+
+// Skips the rest of the request body so the connection can take the next request
+static void ipp_conn_drain_body(ipp_conn_t *conn) {
+    uint8_t *data;
+    size_t len;
+    while (!conn->body_done) {
+        if (ipp_conn_read_body(conn, &data, &len) != ESP_OK) {
+            conn->keep_alive = false;
+            return;
+        }
+    }
+}
+
+static void ipp_conn_send(ipp_conn_t *conn, const char *status, const char *type, const void *body, size_t len) {
+    char head[160];
+    int head_len = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s\r\n",
+                            status, type, len, conn->keep_alive ? "" : "Connection: close\r\n");
+    // One segment for both, a separate body would wait for the client's delayed ACK
+    send(conn->sock, head, head_len, len > 0 ? MSG_MORE : 0);
+    if (len > 0) {
+        send(conn->sock, body, len, 0);
+    }
+}
+
+static void ipp_response_begin(ipp_writer_t *w, uint8_t *buf, uint16_t status, uint32_t request_id) {
+    ipp_writer_init(w, buf, IPP_SERVER_RESPONSE_SIZE);
+    ipp_put_header(w, status, request_id);
+    ipp_put_tag(w, IPP_TAG_OPERATION);
+    ipp_put_string(w, IPP_TAG_CHARSET, "attributes-charset", "utf-8");
+    ipp_put_string(w, IPP_TAG_LANGUAGE, "attributes-natural-language", "en");
+}
+
+static void ipp_response_send(ipp_conn_t *conn, ipp_writer_t *w) {
+    ipp_put_tag(w, IPP_TAG_END);
+    if (w->overflow) {
+        ESP_LOGE(TAG, "Response doesn't fit in %d bytes", IPP_SERVER_RESPONSE_SIZE);
+        ipp_conn_send(conn, "500 Internal Server Error", "text/plain", NULL, 0);
+        return;
+    }
+    ipp_conn_send(conn, "200 OK", "application/ipp", w->buf, w->len);
+}
+
+static void ipp_send_status(ipp_conn_t *conn, uint16_t status, uint32_t request_id) {
+    uint8_t buf[IPP_SERVER_RESPONSE_SIZE];
+    ipp_writer_t w;
+    ipp_response_begin(&w, buf, status, request_id);
+    ipp_response_send(conn, &w);
+}
+
+static void ipp_copy_value(char *dst, size_t size, const uint8_t *value, uint16_t value_len) {
+    size_t len = value_len < size - 1 ? value_len : size - 1;
+    memcpy(dst, value, len);
+    dst[len] = '\0';
+}
+
+static void ipp_request_attr(void *arg, uint8_t group, uint8_t value_tag, const char *name,
+                             const uint8_t *value, uint16_t value_len) {
+    ipp_request_attrs_t *attrs = (ipp_request_attrs_t *)arg;
+    if (group != IPP_TAG_OPERATION) {
+        return;
+    }
+    if (strcmp(name, "job-name") == 0) {
+        ipp_copy_value(attrs->job_name, sizeof(attrs->job_name), value, value_len);
+    } else if (strcmp(name, "requesting-user-name") == 0) {
+        ipp_copy_value(attrs->user, sizeof(attrs->user), value, value_len);
+    } else if (strcmp(name, "document-format") == 0) {
+        ipp_copy_value(attrs->format, sizeof(attrs->format), value, value_len);
+    } else if (strcmp(name, "compression") == 0) {
+        ipp_copy_value(attrs->compression, sizeof(attrs->compression), value, value_len);
+    }
+}
+
+// Maps the compression attribute to the inflate stage, false if it isn't supported
+static bool ipp_compression_format(const ipp_request_attrs_t *attrs, inflate_format_t *format) {
+    if (attrs->compression[0] == '\0' || strcmp(attrs->compression, "none") == 0) {
+        *format = INFLATE_FORMAT_NONE;
+    } else if (strcmp(attrs->compression, "deflate") == 0) {
+        *format = INFLATE_FORMAT_DEFLATE;
+    } else if (strcmp(attrs->compression, "gzip") == 0) {
+        *format = INFLATE_FORMAT_GZIP;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Host for URIs, from the request's Host header or else the address the connection came in on
+static void ipp_conn_set_host(ipp_conn_t *conn, const char *head, size_t head_len) {
+    if (http_get_header(head, head_len, "Host", conn->host, sizeof(conn->host)) && conn->host[0] != '\0') {
+        return;
+    }
+    struct sockaddr_in addr = {0};
+    socklen_t addr_len = sizeof(addr);
+    char ip[INET_ADDRSTRLEN] = "0.0.0.0";
+    if (getsockname(conn->sock, (struct sockaddr *)&addr, &addr_len) == 0) {
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    }
+    snprintf(conn->host, sizeof(conn->host), "%s:%d", ip, ntohs(addr.sin_port));
+}
+
+static void ipp_printer_uri(const ipp_conn_t *conn, const char *printer_id, char *uri, size_t size) {
+    snprintf(uri, size, "ipp://%s%s%s%s", conn->host, IPP_SERVER_PRINT_PATH,
+             printer_id != NULL ? "/" : "", printer_id != NULL ? printer_id : "");
+}
+
+// Describes the printer at printer_id, the first printer if NULL
+static void ipp_get_printer_attributes(ipp_conn_t *conn, const char *printer_id, uint32_t request_id) {
+    printer_info_t printers[PRINTER_MAX_COUNT];
+    int num_printers = printer_handler_list(printers, PRINTER_MAX_COUNT);
+    const printer_info_t *printer = num_printers > 0 && printer_id == NULL ? &printers[0] : NULL;
+    for (int i = 0; i < num_printers && printer_id != NULL; i++) {
+        if (strcmp(printers[i].id, printer_id) == 0) {
+            printer = &printers[i];
+        }
+    }
+    if (printer_id != NULL && printer == NULL) {
+        ipp_send_status(conn, IPP_STATUS_CLIENT_ERROR_NOT_FOUND, request_id);
+        return;
+    }
+    char uri[IPP_SERVER_URI_SIZE];
+    ipp_printer_uri(conn, printer_id, uri, sizeof(uri));
+
+    uint8_t buf[IPP_SERVER_RESPONSE_SIZE];
+    ipp_writer_t w;
+    ipp_response_begin(&w, buf, IPP_STATUS_OK, request_id);
+    ipp_put_tag(&w, IPP_TAG_PRINTER);
+    // One value each, the security and authentication lists run parallel to the URIs
+    ipp_put_string(&w, IPP_TAG_URI, "printer-uri-supported", uri);
+    ipp_put_string(&w, IPP_TAG_KEYWORD, "uri-security-supported", "none");
+    ipp_put_string(&w, IPP_TAG_KEYWORD, "uri-authentication-supported", "none");
+    ipp_put_string(&w, IPP_TAG_NAME, "printer-name", printer != NULL ? printer->id : "PrinterBridge");
+    ipp_put_integer(&w, IPP_TAG_ENUM, "printer-state",
+                    printer != NULL ? IPP_PRINTER_STATE_IDLE : IPP_PRINTER_STATE_STOPPED);
+    ipp_put_string(&w, IPP_TAG_KEYWORD, "printer-state-reasons", "none");
+    ipp_put_boolean(&w, "printer-is-accepting-jobs", printer != NULL);
+    // Jobs go straight to the printer's queue, none wait on the server
+    ipp_put_integer(&w, IPP_TAG_INTEGER, "queued-job-count", 0);
+    ipp_put_integer(&w, IPP_TAG_INTEGER, "printer-up-time", (int32_t)(esp_timer_get_time() / 1000000) + 1);
+    ipp_put_integer(&w, IPP_TAG_ENUM, "operations-supported", IPP_OP_PRINT_JOB);
+    ipp_put_integer(&w, IPP_TAG_ENUM, "", IPP_OP_VALIDATE_JOB);
+    ipp_put_integer(&w, IPP_TAG_ENUM, "", IPP_OP_GET_PRINTER_ATTRIBUTES);
+    ipp_put_string(&w, IPP_TAG_KEYWORD, "ipp-versions-supported", "1.1");
+    ipp_put_string(&w, IPP_TAG_CHARSET, "charset-configured", "utf-8");
+    ipp_put_string(&w, IPP_TAG_CHARSET, "charset-supported", "utf-8");
+    ipp_put_string(&w, IPP_TAG_LANGUAGE, "natural-language-configured", "en");
+    ipp_put_string(&w, IPP_TAG_LANGUAGE, "generated-natural-language-supported", "en");
+    ipp_put_string(&w, IPP_TAG_MIME_TYPE, "document-format-supported", "application/octet-stream");
+    ipp_put_string(&w, IPP_TAG_MIME_TYPE, "document-format-default", "application/octet-stream");
+    ipp_put_string(&w, IPP_TAG_KEYWORD, "pdl-override-supported", "not-attempted");
+    ipp_put_string(&w, IPP_TAG_KEYWORD, "compression-supported", "none");
+    ipp_put_string(&w, IPP_TAG_KEYWORD, "", "deflate");
+    ipp_put_string(&w, IPP_TAG_KEYWORD, "", "gzip");
+    ipp_response_send(conn, &w);
+}
+
+// Starts a job fed from the request body
+static esp_err_t ipp_job_start(ipp_conn_t *conn, net_job_t *job, const char *printer_id, inflate_format_t format) {
+    esp_err_t ret = net_job_start(job, printer_id);
+    if (ret == ESP_OK && net_job_set_compression(job, format) != ESP_OK) {
+        net_job_finish(job, false);
+        net_job_free(job, TAG, conn->peer);
+        ret = ESP_ERR_NO_MEM;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Job from %s refused: %s", conn->peer, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+// Writes the rest of the request body into a job, data/len is the part already received
+// Returns false if the connection broke before the body was whole
+static bool ipp_conn_stream_body(ipp_conn_t *conn, net_job_t *job, uint8_t *data, size_t len) {
+    // A full stream blocks the write, the socket isn't read and TCP throttles the client
+    while (1) {
+        if (len > 0 && net_job_write(job, data, len) != ESP_OK) {
+            // The printer gave up, the rest of the body can't be skipped in reasonable time
+            conn->keep_alive = false;
+            return true;
+        }
+        if (conn->body_done) {
+            return true;
+        }
+        if (!conn->chunked && conn->pos == conn->len && job->inflate == NULL) {
+            // A plain body with nothing buffered is received straight into the job
+            int recv_len;
+            if (net_job_recv(job, conn->sock, conn->remaining, &recv_len) != ESP_OK) {
+                conn->keep_alive = false;
+                return true;
+            }
+            if (recv_len <= 0) {
+                ESP_LOGE(TAG, "Body from %s cut short", conn->peer);
+                conn->keep_alive = false;
+                return false;
+            }
+            conn->remaining -= recv_len;
+            conn->body_done = conn->remaining == 0;
+            len = 0;
+            continue;
+        }
+        if (ipp_conn_read_body(conn, &data, &len) != ESP_OK) {
+            ESP_LOGE(TAG, "Body from %s cut short", conn->peer);
+            conn->keep_alive = false;
+            return false;
+        }
+    }
+}
+
+// Streams the document that follows the attributes, data/len is the part already received
+static void ipp_print_job(ipp_conn_t *conn, const char *printer_id, const ipp_parser_t *parser,
+                          const ipp_request_attrs_t *attrs, uint8_t *data, size_t len) {
+    inflate_format_t format;
+    if (!ipp_compression_format(attrs, &format)) {
+        ipp_conn_drain_body(conn);
+        ipp_send_status(conn, IPP_STATUS_CLIENT_ERROR_COMPRESSION_NOT_SUPPORTED, parser->request_id);
+        return;
+    }
+
+    net_job_t job;
+    esp_err_t ret = ipp_job_start(conn, &job, printer_id, format);
+    if (ret != ESP_OK) {
+        ipp_conn_drain_body(conn);
+        // A full job queue or spool budget is temporary, busy makes the client retry
+        uint16_t status = ret == ESP_ERR_NOT_FOUND && printer_id != NULL ? IPP_STATUS_CLIENT_ERROR_NOT_FOUND
+                          : ret == ESP_ERR_NO_MEM ? IPP_STATUS_SERVER_ERROR_BUSY
+                          : IPP_STATUS_SERVER_ERROR_SERVICE_UNAVAILABLE;
+        ipp_send_status(conn, status, parser->request_id);
+        return;
+    }
+    uint32_t job_id = ipp_next_job_id();
+    int64_t overhead_us = esp_timer_get_time() - conn->request_us;
+
+    bool complete = ipp_conn_stream_body(conn, &job, data, len);
+    ret = net_job_finish(&job, complete);
+    net_job_free(&job, TAG, conn->peer);
+    ESP_LOGI(TAG, "Job %" PRIu32 " \"%s\" from %s (%s, %s), %s: %" PRId64 " us from request to document",
+             job_id, attrs->job_name, attrs->user[0] ? attrs->user : conn->peer,
+             attrs->format[0] ? attrs->format : "no format", attrs->compression[0] ? attrs->compression : "none",
+             esp_err_to_name(ret), overhead_us);
+    if (!complete) {
+        return;
+    }
+
+    uint8_t buf[IPP_SERVER_RESPONSE_SIZE];
+    ipp_writer_t w;
+    ipp_response_begin(&w, buf, ret == ESP_OK ? IPP_STATUS_OK : IPP_STATUS_SERVER_ERROR_INTERNAL, parser->request_id);
+    char uri[IPP_SERVER_URI_SIZE];
+    snprintf(uri, sizeof(uri), "ipp://%s%s/%" PRIu32, conn->host, IPP_SERVER_JOB_PATH, job_id);
+    ipp_put_tag(&w, IPP_TAG_JOB);
+    ipp_put_string(&w, IPP_TAG_URI, "job-uri", uri);
+    ipp_put_integer(&w, IPP_TAG_INTEGER, "job-id", job_id);
+    ipp_put_integer(&w, IPP_TAG_ENUM, "job-state", ret == ESP_OK ? IPP_JOB_STATE_COMPLETED : IPP_JOB_STATE_ABORTED);
+    ipp_put_string(&w, IPP_TAG_KEYWORD, "job-state-reasons", ret == ESP_OK ? "job-completed-successfully"
+                   : "aborted-by-system");
+    ipp_response_send(conn, &w);
+}
+
+// Returns the printer ID in prefix/<id>, NULL for any other path
+static const char *ipp_path_printer(const char *path, const char *prefix) {
+    size_t len = strlen(prefix);
+    if (strncmp(path, prefix, len) == 0 && path[len] == '/' && path[len + 1] != '\0') {
+        return &path[len + 1];
+    }
+    return NULL;
+}
+
+static void ipp_handle_request(ipp_conn_t *conn, const char *path) {
+    const char *printer_id = ipp_path_printer(path, IPP_SERVER_PRINT_PATH);
+
+    // Only the attributes go through the parser, it stops where the document starts
+    ipp_parser_t parser;
+    ipp_request_attrs_t attrs = {0};
+    ipp_parser_init(&parser, ipp_request_attr, &attrs);
+    uint8_t *data = NULL;
+    size_t len = 0;
+    size_t consumed = 0;
+    while (!parser.done) {
+        esp_err_t ret = ipp_conn_read_body(conn, &data, &len);
+        if (ret != ESP_OK) {
+            conn->keep_alive = false;
+            return;
+        }
+        if (len == 0 || ipp_parser_feed(&parser, data, len, &consumed) != ESP_OK) {
+            ESP_LOGW(TAG, "Malformed request from %s", conn->peer);
+            conn->keep_alive = false;
+            ipp_send_status(conn, IPP_STATUS_CLIENT_ERROR_BAD_REQUEST, parser.request_id);
+            return;
+        }
+    }
+    data += consumed;
+    len -= consumed;
+
+    switch (parser.op_or_status) {
+    case IPP_OP_PRINT_JOB:
+        ipp_print_job(conn, printer_id, &parser, &attrs, data, len);
+        break;
+    case IPP_OP_VALIDATE_JOB: {
+        printer_info_t printers[PRINTER_MAX_COUNT];
+        int num_printers = printer_handler_list(printers, PRINTER_MAX_COUNT);
+        inflate_format_t format;
+        uint16_t status = IPP_STATUS_OK;
+        if (!ipp_compression_format(&attrs, &format)) {
+            status = IPP_STATUS_CLIENT_ERROR_COMPRESSION_NOT_SUPPORTED;
+        } else if (num_printers == 0) {
+            status = IPP_STATUS_SERVER_ERROR_SERVICE_UNAVAILABLE;
+        }
+        ipp_conn_drain_body(conn);
+        ipp_send_status(conn, status, parser.request_id);
+        break;
+    }
+    case IPP_OP_GET_PRINTER_ATTRIBUTES:
+        ipp_conn_drain_body(conn);
+        ipp_get_printer_attributes(conn, printer_id, parser.request_id);
+        break;
+    default:
+        ipp_conn_drain_body(conn);
+        ipp_send_status(conn, IPP_STATUS_SERVER_ERROR_OP_NOT_SUPPORTED, parser.request_id);
+        break;
+    }
+}
+
+// Plain upload for scripts, the body is the document and the reply describes the job in JSON
+static void ipp_handle_print(ipp_conn_t *conn, const char *path, const char *head, size_t head_len) {
+    char value[16];
+    inflate_format_t format = INFLATE_FORMAT_NONE;
+    if (http_get_header(head, head_len, "Content-Encoding", value, sizeof(value))
+        && strcasecmp(value, "identity") != 0) {
+        if (strcasecmp(value, "gzip") != 0) {
+            conn->keep_alive = conn->keep_alive && conn->body_done;
+            ipp_conn_send(conn, "415 Unsupported Media Type", "text/plain", NULL, 0);
+            return;
+        }
+        format = INFLATE_FORMAT_GZIP;
+    }
+    if (conn->body_done) {
+        ipp_conn_send(conn, "400 Bad Request", "text/plain", NULL, 0);
+        return;
+    }
+
+    const char *printer_id = ipp_path_printer(path, IPP_SERVER_UPLOAD_PATH);
+    net_job_t job;
+    esp_err_t ret = ipp_job_start(conn, &job, printer_id, format);
+    if (ret != ESP_OK) {
+        ipp_conn_drain_body(conn);
+        ipp_conn_send(conn, ret == ESP_ERR_NOT_FOUND && printer_id != NULL ? "404 Not Found"
+                      : "503 Service Unavailable", "text/plain", NULL, 0);
+        return;
+    }
+    uint32_t job_id = ipp_next_job_id();
+
+    bool complete = ipp_conn_stream_body(conn, &job, NULL, 0);
+    ret = net_job_finish(&job, complete);
+    print_stream_stats_t stats;
+    net_job_get_stats(&job, &stats);
+    size_t received = job.received;
+    int64_t start_us = job.start_us;
+    net_job_free(&job, TAG, conn->peer);
+    if (!complete) {
+        return;
+    }
+
+    char body[192];
+    int len = snprintf(body, sizeof(body),
+                       "{\"job_id\":%" PRIu32 ",\"result\":\"%s\",\"received\":%zu,\"delivered\":%zu,"
+                       "\"first_byte_ms\":%" PRId64 ",\"total_ms\":%" PRId64 "}\n",
+                       job_id, esp_err_to_name(ret), received, stats.acked,
+                       stats.first_byte_us ? (stats.first_byte_us - start_us) / 1000 : -1,
+                       (esp_timer_get_time() - start_us) / 1000);
+    ipp_conn_send(conn, ret == ESP_OK ? "200 OK" : "502 Bad Gateway", "application/json", body, len);
+}
+
+static void ipp_handle_descriptors(ipp_conn_t *conn) {
+    char *text = malloc(IPP_SERVER_TEXT_SIZE);
+    if (text == NULL) {
+        ipp_conn_send(conn, "503 Service Unavailable", "text/plain", NULL, 0);
+        return;
+    }
+    size_t len = descriptor_log_format(text, IPP_SERVER_TEXT_SIZE);
+    ipp_conn_send(conn, "200 OK", "text/plain", text, len);
+    free(text);
+}
+
+// Serves the requests of one connection until it closes or breaks
+static void ipp_server_handle(ipp_conn_t *conn) {
+    conn->keep_alive = true;
+    while (conn->keep_alive) {
+        size_t head_len;
+        esp_err_t ret = ipp_conn_read_head(conn, &head_len);
+        if (ret == ESP_ERR_INVALID_SIZE) {
+            conn->keep_alive = false;
+            ipp_conn_send(conn, "431 Request Header Fields Too Large", "text/plain", NULL, 0);
+        }
+        if (ret != ESP_OK) {
+            return;
+        }
+
+        const char *head = (const char *)conn->buf;
+        char method[8] = "";
+        char path[64] = "";
+        char version[12] = "";
+        char line[96];
+        const char *line_end = memchr(head, '\r', head_len);
+        size_t line_len = line_end != NULL ? (size_t)(line_end - head) : 0;
+        if (line_len >= sizeof(line)) {
+            line_len = sizeof(line) - 1;
+        }
+        memcpy(line, head, line_len);
+        line[line_len] = '\0';
+        sscanf(line, "%7s %63s %11s", method, path, version);
+
+        char value[32];
+        conn->keep_alive = strcmp(version, "HTTP/1.1") == 0;
+        if (http_get_header(head, head_len, "Connection", value, sizeof(value))) {
+            conn->keep_alive = strcasecmp(value, "close") != 0;
+        }
+        conn->chunked = http_get_header(head, head_len, "Transfer-Encoding", value, sizeof(value))
+                        && strcasecmp(value, "chunked") == 0;
+        conn->remaining = 0;
+        if (!conn->chunked && http_get_header(head, head_len, "Content-Length", value, sizeof(value))) {
+            conn->remaining = strtoul(value, NULL, 10);
+        }
+        conn->body_done = !conn->chunked && conn->remaining == 0;
+        http_chunked_init(&conn->chunk);
+        ipp_conn_set_host(conn, head, head_len);
+        if (http_get_header(head, head_len, "Expect", value, sizeof(value))
+            && strcasecmp(value, "100-continue") == 0) {
+            static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            send(conn->sock, cont, sizeof(cont) - 1, 0);
+        }
+
+        if (strcmp(method, "POST") == 0 && (strcmp(path, IPP_SERVER_UPLOAD_PATH) == 0
+                                            || ipp_path_printer(path, IPP_SERVER_UPLOAD_PATH) != NULL)) {
+            ipp_handle_print(conn, path, head, head_len);
+        } else if (strcmp(method, "POST") == 0 && http_get_header(head, head_len, "Content-Type", value, sizeof(value))
+            && strcasecmp(value, "application/ipp") == 0) {
+            ipp_handle_request(conn, path);
+        } else if (strcmp(method, "GET") == 0 && strcmp(path, "/descriptors") == 0) {
+            ipp_conn_drain_body(conn);
+            ipp_handle_descriptors(conn);
+        } else {
+            // An unread body would be taken for the next request
+            conn->keep_alive = conn->keep_alive && conn->body_done;
+            ipp_conn_send(conn, "404 Not Found", "text/plain", NULL, 0);
+        }
+    }
+}
+
+// Serves one connection, jobs of concurrent clients queue on the printer
+static void ipp_client_task(void *arg) {
+    ipp_conn_t *conn = (ipp_conn_t *)arg;
+    ipp_server_handle(conn);
+    shutdown(conn->sock, SHUT_RDWR);
+    close(conn->sock);
+    net_admission_release(IPP_CONN_COST, TAG, conn->peer);
+    free(conn);
+    vTaskDelete(NULL);
+}
+
+static void ipp_server_task(void *arg) {
+    uint16_t port = (uint16_t)(uintptr_t)arg;
+    int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (listen_sock < 0) {
+        ESP_LOGE(TAG, "Unable to start the server");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    int opt = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || listen(listen_sock, NET_ADMISSION_BACKLOG) != 0) {
+        ESP_LOGE(TAG, "Unable to listen on port %d: errno %d", port, errno);
+        close(listen_sock);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG, "Listening on port %d", port);
+
+    while (1) {
+        struct sockaddr_in peer_addr;
+        bool busy;
+        int sock = net_admission_accept(listen_sock, IPP_CONN_COST, &peer_addr, &busy);
+        if (sock < 0) {
+            ESP_LOGE(TAG, "Accept failed: errno %d", errno);
+            continue;
+        }
+        if (busy) {
+            static const char reply[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 30\r\n"
+                                        "Content-Length: 0\r\nConnection: close\r\n\r\n";
+            send(sock, reply, sizeof(reply) - 1, 0);
+            shutdown(sock, SHUT_RDWR);
+            close(sock);
+            continue;
+        }
+        ipp_conn_t *conn = malloc(sizeof(ipp_conn_t));
+        if (conn == NULL) {
+            close(sock);
+            net_admission_release(IPP_CONN_COST, TAG, "unknown");
+            continue;
+        }
+        struct timeval timeout = {
+            .tv_sec = IPP_SERVER_IDLE_TIMEOUT_S,
+        };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        conn->sock = sock;
+        conn->pos = 0;
+        conn->len = 0;
+        inet_ntop(AF_INET, &peer_addr.sin_addr, conn->peer, sizeof(conn->peer));
+
+        if (xTaskCreate(ipp_client_task, "ipp_client", IPP_SERVER_TASK_STACK, conn,
+                        IPP_SERVER_TASK_PRIORITY, NULL) != pdTRUE) {
+            close(sock);
+            net_admission_release(IPP_CONN_COST, TAG, conn->peer);
+            free(conn);
+        }
+    }
+}
+
+esp_err_t ipp_server_start(uint16_t port) {
+    BaseType_t task_created = xTaskCreate(ipp_server_task, "ipp_server", IPP_SERVER_TASK_STACK,
+                                          (void *)(uintptr_t)port, IPP_SERVER_TASK_PRIORITY, NULL);
+    return task_created == pdTRUE ? ESP_OK : ESP_ERR_NO_MEM;
+}
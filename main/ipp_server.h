@@ -0,0 +1,24 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// IPP/1.1 print server over HTTP
+// Print-Job documents are streamed to the printer while the request is still arriving,
+// the attributes in front of them are parsed on the fly. The path /ipp/print/<id> picks
+// a printer by its registry ID, any other path uses the first printer. GET /descriptors
+// returns the descriptor log as text.
+// POST /print (or /print/<id>) takes the document itself as the body, plain, chunked or
+// gzip encoded, and answers with the job ID, the bytes the printer acknowledged on USB
+// and timings as JSON.
+// Connections are served concurrently within the spool budget, a client that waited too
+// long in the backlog gets 503 with Retry-After.
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Starts the server task listening on port
+esp_err_t ipp_server_start(uint16_t port);
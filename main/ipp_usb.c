@@ -0,0 +1,615 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// IPP over USB transport
+// Channel I/O blocks on transfer completion and must never run in the class driver
+// task. Interfaces are therefore claimed and released by the transport's own task,
+// which runs the queued jobs. printer-state is polled by a second task, so during a job
+// the poll takes another channel from the pool.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+
+#include "ipp_usb.h"
+#include "ipp.h"
+#include "http_util.h"
+#include "bulk_pipe.h"
+#include "printer_handler.h"
+
+void class_driver_device_released(usb_device_handle_t dev_hdl);
+
+static const char *TAG = "IPP-USB";
+
+#define USB_CLASS_PRINTER               0x07
+#define USB_PRINTER_PROTOCOL_IPP_USB    0x04
+
+#define IPP_USB_BUF_SIZE                2048
+#define IPP_USB_HEAD_SIZE               512
+#define IPP_USB_MAX_ALT_SETTINGS        8
+#define IPP_USB_TASK_STACK              4096
+#define IPP_USB_TASK_PRIORITY           3
+#define IPP_USB_STATUS_PERIOD           pdMS_TO_TICKS(10000)
+#define IPP_USB_IO_TIMEOUT              pdMS_TO_TICKS(5000)
+#define IPP_USB_PRINTER_URI             "ipp://localhost/ipp/print"
+#define IPP_USB_JOB_QUEUE_LEN           4
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    printer_job_done_cb_t done;
+    void *done_arg;
+} ipp_usb_job_t;
+
+struct ipp_usb_channel {
+    ipp_usb_t *ipp;
+    bool usable;                            // Claimed and pipe set up
+    bool busy;
+    uint8_t interface_number;
+    uint8_t alternate_setting;
+    uint8_t bulk_out_ep;
+    uint8_t bulk_in_ep;
+    uint16_t bulk_in_mps;
+    bulk_pipe_t pipe;
+    uint8_t tx[IPP_USB_BUF_SIZE];           // Chunk framing scratch
+    char head[IPP_USB_HEAD_SIZE];           // Response header, then receive scratch
+};
+
+struct ipp_usb {
+    usb_device_handle_t dev_hdl;
+    usb_host_client_handle_t client_hdl;
+    int num_channels;
+    ipp_usb_channel_t channels[IPP_USB_MAX_CHANNELS];
+    SemaphoreHandle_t free_channels;        // Counts channels that are usable and not busy
+    SemaphoreHandle_t lock;
+    QueueHandle_t job_queue;                // Documents queued with ipp_usb_queue_job()
+    TaskHandle_t task;
+    bool task_running;
+    TaskHandle_t status_task;
+    bool status_running;                    // Cleared by the status task right before it exits
+    bool closing;
+    int users;                              // Channels handed out
+    uint32_t next_request_id;
+    int printer_state;
+};
+
+static bool ipp_usb_find_interfaces(ipp_usb_t *ipp) {
+    const usb_config_desc_t *config_desc;
+    if (usb_host_get_active_config_descriptor(ipp->dev_hdl, &config_desc) != ESP_OK) {
+        return false;
+    }
+
+    for (int i = 0; i < config_desc->bNumInterfaces && ipp->num_channels < IPP_USB_MAX_CHANNELS; i++) {
+        for (int alt = 0; alt < IPP_USB_MAX_ALT_SETTINGS; alt++) {
+            int offset = 0;
+            const usb_intf_desc_t *intf_desc = usb_parse_interface_descriptor(config_desc, i, alt, &offset);
+            if (intf_desc == NULL) {
+                break;
+            }
+            if (intf_desc->bInterfaceClass != USB_CLASS_PRINTER
+                || intf_desc->bInterfaceProtocol != USB_PRINTER_PROTOCOL_IPP_USB) {
+                continue;
+            }
+
+            ipp_usb_channel_t *channel = &ipp->channels[ipp->num_channels];
+            channel->bulk_out_ep = 0;
+            channel->bulk_in_ep = 0;
+            int ep_offset = 0;
+            for (int ep = 0; ep < intf_desc->bNumEndpoints; ep++) {
+                const usb_ep_desc_t *ep_desc = usb_parse_endpoint_descriptor_by_index(
+                    intf_desc, ep, config_desc->wTotalLength, &ep_offset);
+                if (ep_desc == NULL
+                    || (ep_desc->bmAttributes & USB_BM_ATTRIBUTES_XFERTYPE_MASK) != USB_BM_ATTRIBUTES_XFER_BULK) {
+                    continue;
+                }
+                if (ep_desc->bEndpointAddress & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK) {
+                    channel->bulk_in_ep = ep_desc->bEndpointAddress;
+                    channel->bulk_in_mps = USB_EP_DESC_GET_MPS(ep_desc);
+                } else {
+                    channel->bulk_out_ep = ep_desc->bEndpointAddress;
+                }
+            }
+            if (channel->bulk_out_ep == 0 || channel->bulk_in_ep == 0) {
+                continue;
+            }
+
+            channel->ipp = ipp;
+            channel->interface_number = i;
+            channel->alternate_setting = alt;
+            ipp->num_channels++;
+            ESP_LOGI(TAG, "Interface %d alt %d: IPP-USB channel (OUT 0x%02x, IN 0x%02x)",
+                     i, alt, channel->bulk_out_ep, channel->bulk_in_ep);
+            break;
+        }
+    }
+    return ipp->num_channels > 0;
+}
+
+static esp_err_t ipp_usb_channel_send(ipp_usb_channel_t *channel, const uint8_t *data, size_t len, TickType_t timeout) {
+    if (channel->ipp->closing) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return bulk_pipe_write(&channel->pipe, data, len, timeout);
+}
+
+static esp_err_t ipp_usb_channel_recv(ipp_usb_channel_t *channel, uint8_t *data, size_t max_len,
+                                      size_t *actual_len, TickType_t timeout) {
+    if (channel->ipp->closing) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return bulk_pipe_read(&channel->pipe, data, max_len, actual_len, timeout);
+}
+
+esp_err_t ipp_usb_channel_acquire(ipp_usb_t *ipp, TickType_t timeout, ipp_usb_channel_t **channel_ret) {
+    if (ipp->closing) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xSemaphoreTake(ipp->free_channels, timeout) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    ipp_usb_channel_t *channel = NULL;
+    xSemaphoreTake(ipp->lock, portMAX_DELAY);
+    for (int i = 0; i < ipp->num_channels; i++) {
+        if (ipp->channels[i].usable && !ipp->channels[i].busy) {
+            channel = &ipp->channels[i];
+            channel->busy = true;
+            ipp->users++;
+            break;
+        }
+    }
+    xSemaphoreGive(ipp->lock);
+
+    if (channel == NULL) {
+        xSemaphoreGive(ipp->free_channels);
+        return ESP_ERR_INVALID_STATE;
+    }
+    *channel_ret = channel;
+    return ESP_OK;
+}
+
+void ipp_usb_channel_release(ipp_usb_channel_t *channel) {
+    ipp_usb_t *ipp = channel->ipp;
+    xSemaphoreTake(ipp->lock, portMAX_DELAY);
+    channel->busy = false;
+    ipp->users--;
+    xSemaphoreGive(ipp->lock);
+    xSemaphoreGive(ipp->free_channels);
+}
+
+esp_err_t ipp_usb_post_begin(ipp_usb_channel_t *channel, TickType_t timeout) {
+    static const char head[] =
+        "POST /ipp/print HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Content-Type: application/ipp\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n";
+    return ipp_usb_channel_send(channel, (const uint8_t *)head, sizeof(head) - 1, timeout);
+}
+
+esp_err_t ipp_usb_post_write(ipp_usb_channel_t *channel, const uint8_t *data, size_t len, TickType_t timeout) {
+    // Chunk header and trailing CRLF go out in the same transfer as the data
+    const size_t framing = 12;
+    while (len > 0) {
+        size_t n = len < IPP_USB_BUF_SIZE - framing ? len : IPP_USB_BUF_SIZE - framing;
+        int pos = snprintf((char *)channel->tx, framing, "%x\r\n", (unsigned)n);
+        memcpy(&channel->tx[pos], data, n);
+        pos += n;
+        channel->tx[pos++] = '\r';
+        channel->tx[pos++] = '\n';
+
+        esp_err_t ret = ipp_usb_channel_send(channel, channel->tx, pos, timeout);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        data += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+// Appends body bytes to the caller's response buffer, dropping what doesn't fit
+static void ipp_usb_append(uint8_t *response, size_t response_size, size_t *response_len,
+                           const uint8_t *data, size_t len) {
+    size_t room = response_size - *response_len;
+    size_t n = len < room ? len : room;
+    memcpy(&response[*response_len], data, n);
+    *response_len += n;
+}
+
+esp_err_t ipp_usb_post_finish(ipp_usb_channel_t *channel, uint8_t *response, size_t response_size,
+                              size_t *response_len, TickType_t timeout) {
+    static const uint8_t last_chunk[] = "0\r\n\r\n";
+    esp_err_t ret = ipp_usb_channel_send(channel, last_chunk, sizeof(last_chunk) - 1, timeout);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Read the response header
+    size_t head_len = 0;
+    size_t header_end = 0;
+    while ((header_end = http_header_end(channel->head, head_len)) == 0) {
+        if (head_len == IPP_USB_HEAD_SIZE) {
+            ESP_LOGE(TAG, "Response header too large");
+            return ESP_ERR_INVALID_SIZE;
+        }
+        size_t n;
+        ret = ipp_usb_channel_recv(channel, (uint8_t *)&channel->head[head_len], IPP_USB_HEAD_SIZE - head_len, &n, timeout);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        head_len += n;
+    }
+
+    const char *status_start = memchr(channel->head, ' ', header_end);
+    int http_status = status_start != NULL ? atoi(status_start + 1) : 0;
+
+    char value[32];
+    bool chunked = http_get_header(channel->head, header_end, "Transfer-Encoding", value, sizeof(value))
+                   && strcasecmp(value, "chunked") == 0;
+    size_t content_length = 0;
+    if (!chunked && http_get_header(channel->head, header_end, "Content-Length", value, sizeof(value))) {
+        content_length = strtoul(value, NULL, 10);
+    }
+
+    // Read the body, the channel must be drained completely to stay in sync
+    http_chunked_decoder_t dec;
+    http_chunked_init(&dec);
+    *response_len = 0;
+    uint8_t *buf = (uint8_t *)&channel->head[header_end];
+    size_t len = head_len - header_end;
+    while (1) {
+        if (chunked) {
+            size_t consumed, payload;
+            ret = http_chunked_decode(&dec, buf, len, &consumed, &payload);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            ipp_usb_append(response, response_size, response_len, buf, payload);
+            if (dec.done) {
+                break;
+            }
+        } else {
+            size_t n = len < content_length ? len : content_length;
+            ipp_usb_append(response, response_size, response_len, buf, n);
+            content_length -= n;
+            if (content_length == 0) {
+                break;
+            }
+        }
+
+        buf = (uint8_t *)channel->head;
+        ret = ipp_usb_channel_recv(channel, buf, IPP_USB_HEAD_SIZE, &len, timeout);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    if (http_status != 200) {
+        ESP_LOGE(TAG, "HTTP status %d", http_status);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ipp_usb_request(ipp_usb_t *ipp, const uint8_t *request, size_t request_len,
+                          uint8_t *response, size_t response_size, size_t *response_len, TickType_t timeout) {
+    ipp_usb_channel_t *channel;
+    esp_err_t ret = ipp_usb_channel_acquire(ipp, timeout, &channel);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = ipp_usb_post_begin(channel, timeout);
+    if (ret == ESP_OK) {
+        ret = ipp_usb_post_write(channel, request, request_len, timeout);
+    }
+    if (ret == ESP_OK) {
+        ret = ipp_usb_post_finish(channel, response, response_size, response_len, timeout);
+    }
+
+    ipp_usb_channel_release(channel);
+    return ret;
+}
+
+static uint32_t ipp_usb_next_request_id(ipp_usb_t *ipp) {
+    xSemaphoreTake(ipp->lock, portMAX_DELAY);
+    uint32_t request_id = ++ipp->next_request_id;
+    xSemaphoreGive(ipp->lock);
+    return request_id;
+}
+
+static void ipp_usb_put_operation_attributes(ipp_writer_t *w) {
+    ipp_put_tag(w, IPP_TAG_OPERATION);
+    ipp_put_string(w, IPP_TAG_CHARSET, "attributes-charset", "utf-8");
+    ipp_put_string(w, IPP_TAG_LANGUAGE, "attributes-natural-language", "en");
+    ipp_put_string(w, IPP_TAG_URI, "printer-uri", IPP_USB_PRINTER_URI);
+}
+
+static esp_err_t ipp_usb_check_status(const uint8_t *response, size_t len) {
+    if (len < IPP_HEADER_SIZE) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    uint16_t status = (response[2] << 8) | response[3];
+    if (status > 0x00FF) {
+        ESP_LOGE(TAG, "IPP status 0x%04x", status);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ipp_usb_print_job(ipp_usb_t *ipp, const uint8_t *data, size_t size, TickType_t timeout) {
+    uint8_t request[256];
+    ipp_writer_t w;
+    ipp_writer_init(&w, request, sizeof(request));
+    ipp_put_header(&w, IPP_OP_PRINT_JOB, ipp_usb_next_request_id(ipp));
+    ipp_usb_put_operation_attributes(&w);
+    ipp_put_string(&w, IPP_TAG_NAME, "requesting-user-name", "PrinterBridge");
+    ipp_put_string(&w, IPP_TAG_NAME, "job-name", "PrinterBridge job");
+    ipp_put_string(&w, IPP_TAG_MIME_TYPE, "document-format", "application/octet-stream");
+    ipp_put_tag(&w, IPP_TAG_END);
+    if (w.overflow) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ipp_usb_channel_t *channel;
+    esp_err_t ret = ipp_usb_channel_acquire(ipp, timeout, &channel);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ESP_LOGI(TAG, "Print-Job on interface %d (%zu bytes)", channel->interface_number, size);
+
+    uint8_t response[64];
+    size_t response_len = 0;
+    ret = ipp_usb_post_begin(channel, timeout);
+    if (ret == ESP_OK) {
+        ret = ipp_usb_post_write(channel, request, w.len, timeout);
+    }
+    if (ret == ESP_OK) {
+        ret = ipp_usb_post_write(channel, data, size, timeout);
+    }
+    if (ret == ESP_OK) {
+        ret = ipp_usb_post_finish(channel, response, sizeof(response), &response_len, timeout);
+    }
+    ipp_usb_channel_release(channel);
+
+    if (ret == ESP_OK) {
+        ret = ipp_usb_check_status(response, response_len);
+    }
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Print-Job completed");
+    } else {
+        ESP_LOGE(TAG, "Print-Job failed: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t ipp_usb_queue_job(ipp_usb_t *ipp, const uint8_t *data, size_t size,
+                            printer_job_done_cb_t done, void *done_arg) {
+    if (ipp->closing) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ipp_usb_job_t job = {
+        .data = data,
+        .size = size,
+        .done = done,
+        .done_arg = done_arg,
+    };
+    if (xQueueSend(ipp->job_queue, &job, 0) != pdTRUE) {
+        return ESP_ERR_NO_MEM;
+    }
+    xTaskNotifyGive(ipp->task);
+    return ESP_OK;
+}
+
+static void ipp_usb_poll_printer_state(ipp_usb_t *ipp) {
+    uint8_t request[192];
+    ipp_writer_t w;
+    ipp_writer_init(&w, request, sizeof(request));
+    ipp_put_header(&w, IPP_OP_GET_PRINTER_ATTRIBUTES, ipp_usb_next_request_id(ipp));
+    ipp_usb_put_operation_attributes(&w);
+    ipp_put_string(&w, IPP_TAG_KEYWORD, "requested-attributes", "printer-state");
+    ipp_put_tag(&w, IPP_TAG_END);
+
+    uint8_t response[256];
+    size_t response_len = 0;
+    if (ipp_usb_request(ipp, request, w.len, response, sizeof(response), &response_len, IPP_USB_IO_TIMEOUT) != ESP_OK
+        || ipp_usb_check_status(response, response_len) != ESP_OK) {
+        return;
+    }
+
+    uint8_t tag;
+    uint16_t len;
+    const uint8_t *value = ipp_find_attribute(response, response_len, "printer-state", &tag, &len);
+    if (value != NULL && tag == IPP_TAG_ENUM && len == 4) {
+        int state = (value[0] << 24) | (value[1] << 16) | (value[2] << 8) | value[3];
+        if (state != ipp->printer_state) {
+            ESP_LOGI(TAG, "printer-state: %s", state == IPP_PRINTER_STATE_IDLE ? "idle"
+                     : state == IPP_PRINTER_STATE_PROCESSING ? "processing"
+                     : state == IPP_PRINTER_STATE_STOPPED ? "stopped" : "unknown");
+        }
+        ipp->printer_state = state;
+    }
+}
+
+// Polls printer-state alongside the jobs of the transport's task
+static void ipp_usb_status_task(void *arg) {
+    ipp_usb_t *ipp = (ipp_usb_t *)arg;
+    while (!ipp->closing) {
+        ipp_usb_poll_printer_state(ipp);
+        // Woken early by the transport's task when closing
+        ulTaskNotifyTake(pdTRUE, IPP_USB_STATUS_PERIOD);
+    }
+    xSemaphoreTake(ipp->lock, portMAX_DELAY);
+    ipp->status_running = false;
+    xSemaphoreGive(ipp->lock);
+    vTaskDelete(NULL);
+}
+
+static void ipp_usb_task(void *arg) {
+    ipp_usb_t *ipp = (ipp_usb_t *)arg;
+
+    for (int i = 0; i < ipp->num_channels && !ipp->closing; i++) {
+        ipp_usb_channel_t *channel = &ipp->channels[i];
+        esp_err_t ret = printer_claim_interface(ipp->client_hdl, ipp->dev_hdl,
+                                                channel->interface_number, channel->alternate_setting);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to claim interface %d: %s", channel->interface_number, esp_err_to_name(ret));
+            continue;
+        }
+        ret = bulk_pipe_init(&channel->pipe, ipp->dev_hdl, channel->bulk_out_ep, channel->bulk_in_ep,
+                             channel->bulk_in_mps, IPP_USB_BUF_SIZE);
+        if (ret != ESP_OK) {
+            usb_host_interface_release(ipp->client_hdl, ipp->dev_hdl, channel->interface_number);
+            continue;
+        }
+        channel->usable = true;
+        xSemaphoreGive(ipp->free_channels);
+    }
+
+    ipp->status_running = !ipp->closing;
+    if (ipp->status_running && xTaskCreate(ipp_usb_status_task, "ipp_usb_status", IPP_USB_TASK_STACK, ipp,
+                                           IPP_USB_TASK_PRIORITY, &ipp->status_task) != pdTRUE) {
+        ESP_LOGW(TAG, "No status task, printer-state won't be polled");
+        ipp->status_running = false;
+    }
+
+    while (!ipp->closing) {
+        ipp_usb_job_t job;
+        if (xQueueReceive(ipp->job_queue, &job, 0) == pdTRUE) {
+            esp_err_t ret = ipp_usb_print_job(ipp, job.data, job.size, IPP_USB_IO_TIMEOUT);
+            if (job.done != NULL) {
+                job.done(job.done_arg, ret);
+            }
+            continue;
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+
+    // Wait for the status task and the other users to notice, their transfers were
+    // cancelled by ipp_usb_close()
+    xSemaphoreTake(ipp->lock, portMAX_DELAY);
+    if (ipp->status_running) {
+        // Still before its exit, which clears the flag under the lock
+        xTaskNotifyGive(ipp->status_task);
+    }
+    xSemaphoreGive(ipp->lock);
+    while (1) {
+        xSemaphoreTake(ipp->lock, portMAX_DELAY);
+        bool busy = ipp->users > 0 || ipp->status_running;
+        xSemaphoreGive(ipp->lock);
+        if (!busy) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    // Jobs that never started still belong to their submitters
+    ipp_usb_job_t job;
+    while (xQueueReceive(ipp->job_queue, &job, 0) == pdTRUE) {
+        if (job.done != NULL) {
+            job.done(job.done_arg, ESP_ERR_INVALID_STATE);
+        }
+    }
+
+    for (int i = 0; i < ipp->num_channels; i++) {
+        ipp_usb_channel_t *channel = &ipp->channels[i];
+        if (channel->usable) {
+            bulk_pipe_deinit(&channel->pipe);
+        }
+    }
+
+    xSemaphoreTake(ipp->lock, portMAX_DELAY);
+    ipp->task_running = false;
+    xSemaphoreGive(ipp->lock);
+    class_driver_device_released(ipp->dev_hdl);
+    vTaskDelete(NULL);
+}
+
+esp_err_t ipp_usb_open(usb_device_handle_t dev_hdl, usb_host_client_handle_t client_hdl, ipp_usb_t **ipp_ret) {
+    ipp_usb_t *ipp = calloc(1, sizeof(ipp_usb_t));
+    if (ipp == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ipp->dev_hdl = dev_hdl;
+    ipp->client_hdl = client_hdl;
+
+    if (!ipp_usb_find_interfaces(ipp)) {
+        free(ipp);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ipp->free_channels = xSemaphoreCreateCounting(IPP_USB_MAX_CHANNELS, 0);
+    ipp->lock = xSemaphoreCreateMutex();
+    ipp->job_queue = xQueueCreate(IPP_USB_JOB_QUEUE_LEN, sizeof(ipp_usb_job_t));
+    if (ipp->free_channels == NULL || ipp->lock == NULL || ipp->job_queue == NULL) {
+        goto err;
+    }
+
+    ipp->task_running = true;
+    if (xTaskCreatePinnedToCore(ipp_usb_task, "ipp_usb", IPP_USB_TASK_STACK, ipp,
+                                IPP_USB_TASK_PRIORITY, &ipp->task, 0) != pdTRUE) {
+        goto err;
+    }
+
+    ESP_LOGI(TAG, "IPP-USB transport started with %d channels", ipp->num_channels);
+    *ipp_ret = ipp;
+    return ESP_OK;
+
+err:
+    if (ipp->free_channels) {
+        vSemaphoreDelete(ipp->free_channels);
+    }
+    if (ipp->lock) {
+        vSemaphoreDelete(ipp->lock);
+    }
+    if (ipp->job_queue) {
+        vQueueDelete(ipp->job_queue);
+    }
+    free(ipp);
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t ipp_usb_close(ipp_usb_t *ipp) {
+    xSemaphoreTake(ipp->lock, portMAX_DELAY);
+    if (!ipp->closing) {
+        ipp->closing = true;
+        // Make blocked channel I/O return
+        for (int i = 0; i < ipp->num_channels; i++) {
+            if (ipp->channels[i].usable && ipp->channels[i].busy) {
+                bulk_pipe_cancel(&ipp->channels[i].pipe);
+            }
+        }
+        xTaskNotifyGive(ipp->task);
+    }
+    bool running = ipp->task_running;
+    xSemaphoreGive(ipp->lock);
+    if (running) {
+        return ESP_ERR_NOT_FINISHED;
+    }
+
+    for (int i = 0; i < ipp->num_channels; i++) {
+        if (ipp->channels[i].usable) {
+            usb_host_interface_release(ipp->client_hdl, ipp->dev_hdl, ipp->channels[i].interface_number);
+        }
+    }
+    vSemaphoreDelete(ipp->free_channels);
+    vSemaphoreDelete(ipp->lock);
+    vQueueDelete(ipp->job_queue);
+    free(ipp);
+    ESP_LOGI(TAG, "IPP-USB transport stopped");
+    return ESP_OK;
+}
+
+int ipp_usb_printer_state(const ipp_usb_t *ipp) {
+    return ipp->printer_state;
+}
@@ -0,0 +1,59 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// IPP over USB transport (class 7/1/4)
+// Every IPP-USB interface carries one HTTP/1.1 connection. The transport claims all of
+// them and hands them out as a pool, so status queries run alongside a print job.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "usb/usb_host.h"
+#include "printer_handler.h"
+
+#define IPP_USB_MAX_CHANNELS        4
+
+typedef struct ipp_usb ipp_usb_t;
+typedef struct ipp_usb_channel ipp_usb_channel_t;
+
+// Starts the transport on every IPP-USB interface of the device
+// Interfaces are claimed by the transport's own task, so this never blocks
+// Returns ESP_ERR_NOT_FOUND if the device has no IPP-USB interface
+esp_err_t ipp_usb_open(usb_device_handle_t dev_hdl, usb_host_client_handle_t client_hdl, ipp_usb_t **ipp_ret);
+
+// Stops the transport. Returns ESP_ERR_NOT_FINISHED while channels are still busy,
+// class_driver_device_released() is called once they are idle and the call must be repeated
+esp_err_t ipp_usb_close(ipp_usb_t *ipp);
+
+// Exclusive use of one HTTP connection, waits for a free one
+esp_err_t ipp_usb_channel_acquire(ipp_usb_t *ipp, TickType_t timeout, ipp_usb_channel_t **channel_ret);
+void ipp_usb_channel_release(ipp_usb_channel_t *channel);
+
+// POST /ipp/print with a chunked application/ipp body written piece by piece
+esp_err_t ipp_usb_post_begin(ipp_usb_channel_t *channel, TickType_t timeout);
+esp_err_t ipp_usb_post_write(ipp_usb_channel_t *channel, const uint8_t *data, size_t len, TickType_t timeout);
+// Ends the body and reads the response body (truncated to response_size, the rest is drained)
+esp_err_t ipp_usb_post_finish(ipp_usb_channel_t *channel, uint8_t *response, size_t response_size,
+                              size_t *response_len, TickType_t timeout);
+
+// Complete IPP request/response on any free channel
+esp_err_t ipp_usb_request(ipp_usb_t *ipp, const uint8_t *request, size_t request_len,
+                          uint8_t *response, size_t response_size, size_t *response_len, TickType_t timeout);
+
+// Sends a document with Print-Job on one channel
+esp_err_t ipp_usb_print_job(ipp_usb_t *ipp, const uint8_t *data, size_t size, TickType_t timeout);
+
+// Queues a document for the transport's task, data must stay valid until it is printed
+// done (optional) is called from the transport's task with the result
+esp_err_t ipp_usb_queue_job(ipp_usb_t *ipp, const uint8_t *data, size_t size,
+                            printer_job_done_cb_t done, void *done_arg);
+
+// Last printer-state seen by the status task (IPP_PRINTER_STATE_*), 0 if unknown
+// The status task polls on its own channel, also while a job prints on another one
+int ipp_usb_printer_state(const ipp_usb_t *ipp);
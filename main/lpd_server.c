@@ -0,0 +1,437 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "lpd_server.h"
+#include "net_job.h"
+#include "net_admission.h"
+#include "printer_handler.h"
+
+#define LPD_SERVER_TASK_STACK       4096
+#define LPD_SERVER_TASK_PRIORITY    2
+#define LPD_RECV_SIZE               2048
+#define LPD_LINE_MAX                256
+#define LPD_CONTROL_MAX             1024    // Control files are a few lines, larger ones are refused
+#define LPD_IDLE_TIMEOUT_S          60
+#define LPD_JOB_HISTORY             8
+
+// Daemon commands and receive job subcommands
+#define LPD_CMD_PRINT_WAITING       0x01
+#define LPD_CMD_RECEIVE_JOB         0x02
+#define LPD_CMD_QUEUE_SHORT         0x03
+#define LPD_CMD_QUEUE_LONG          0x04
+#define LPD_CMD_REMOVE_JOBS         0x05
+#define LPD_SUB_ABORT               0x01
+#define LPD_SUB_CONTROL_FILE        0x02
+#define LPD_SUB_DATA_FILE           0x03
+
+#define LPD_ACK                     0x00
+#define LPD_NACK                    0x01
+
+static const char *TAG = "LPD server";
+
+typedef enum {
+    LPD_JOB_RECEIVING,
+    LPD_JOB_PRINTING,
+    LPD_JOB_DONE,
+    LPD_JOB_FAILED,
+} lpd_job_state_t;
+
+typedef struct {
+    bool in_use;
+    uint32_t id;
+    lpd_job_state_t state;
+    char owner[32];
+    char host[32];
+    char name[64];
+    size_t size;
+} lpd_job_info_t;
+
+typedef struct {
+    int sock;
+    char peer[INET_ADDRSTRLEN];
+    size_t len;
+    size_t pos;
+    uint8_t buf[LPD_RECV_SIZE];
+} lpd_conn_t;
+
+// Spool budget of a connection: a job's stream, the connection and its task
+#define LPD_CONN_COST               (NET_JOB_STREAM_SIZE + sizeof(lpd_conn_t) + LPD_SERVER_TASK_STACK)
+
+static lpd_job_info_t jobs[LPD_JOB_HISTORY];   // Ring of recent jobs, oldest is replaced
+static uint32_t next_job_id = 1;
+static SemaphoreHandle_t jobs_lock;
+
+// Buffered socket reads, the command lines and file data share one buffer
+
+static int lpd_fill(lpd_conn_t *conn) {
+    if (conn->pos < conn->len) {
+        return conn->len - conn->pos;
+    }
+    int len = recv(conn->sock, conn->buf, sizeof(conn->buf), 0);
+    if (len <= 0) {
+        return len;
+    }
+    conn->len = len;
+    conn->pos = 0;
+    return len;
+}
+
+// Reads a line up to LF, returns false on EOF or if the line doesn't fit
+static bool lpd_read_line(lpd_conn_t *conn, char *line, size_t size) {
+    size_t len = 0;
+    while (1) {
+        if (lpd_fill(conn) <= 0) {
+            return false;
+        }
+        char c = conn->buf[conn->pos++];
+        if (c == '\n') {
+            line[len] = '\0';
+            return true;
+        }
+        if (len == size - 1) {
+            return false;
+        }
+        line[len++] = c;
+    }
+}
+
+static bool lpd_read_bytes(lpd_conn_t *conn, uint8_t *data, size_t len) {
+    while (len > 0) {
+        int avail = lpd_fill(conn);
+        if (avail <= 0) {
+            return false;
+        }
+        size_t n = (size_t)avail < len ? (size_t)avail : len;
+        memcpy(data, &conn->buf[conn->pos], n);
+        conn->pos += n;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void lpd_reply(lpd_conn_t *conn, uint8_t code) {
+    send(conn->sock, &code, 1, 0);
+}
+
+// Job table
+
+static lpd_job_info_t *lpd_job_new(const char *host) {
+    xSemaphoreTake(jobs_lock, portMAX_DELAY);
+    lpd_job_info_t *info = &jobs[next_job_id % LPD_JOB_HISTORY];
+    memset(info, 0, sizeof(lpd_job_info_t));
+    info->in_use = true;
+    info->id = next_job_id++;
+    info->state = LPD_JOB_RECEIVING;
+    strlcpy(info->host, host, sizeof(info->host));
+    xSemaphoreGive(jobs_lock);
+    return info;
+}
+
+static void lpd_job_set_state(lpd_job_info_t *info, uint32_t id, lpd_job_state_t state, size_t size) {
+    xSemaphoreTake(jobs_lock, portMAX_DELAY);
+    // The slot may have been reused by a newer job in the meantime
+    if (info->id == id) {
+        info->state = state;
+        info->size = size;
+    }
+    xSemaphoreGive(jobs_lock);
+}
+
+// Picks owner, host and job name out of a control file
+static void lpd_job_parse_control(lpd_job_info_t *info, uint32_t id, char *control) {
+    xSemaphoreTake(jobs_lock, portMAX_DELAY);
+    for (char *line = strtok(control, "\n"); line != NULL && info->id == id; line = strtok(NULL, "\n")) {
+        switch (line[0]) {
+        case 'P':
+            strlcpy(info->owner, &line[1], sizeof(info->owner));
+            break;
+        case 'H':
+            strlcpy(info->host, &line[1], sizeof(info->host));
+            break;
+        case 'J':
+            strlcpy(info->name, &line[1], sizeof(info->name));
+            break;
+        case 'N':
+            if (info->name[0] == '\0') {
+                strlcpy(info->name, &line[1], sizeof(info->name));
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    xSemaphoreGive(jobs_lock);
+}
+
+static void lpd_send_queue_state(lpd_conn_t *conn, bool long_format) {
+    static const char *const state_names[] = {"receiving", "printing", "done", "failed"};
+    char line[160];
+    int count = 0;
+
+    xSemaphoreTake(jobs_lock, portMAX_DELAY);
+    lpd_job_info_t snapshot[LPD_JOB_HISTORY];
+    memcpy(snapshot, jobs, sizeof(snapshot));
+    xSemaphoreGive(jobs_lock);
+
+    // Oldest first
+    for (int n = 0; n < LPD_JOB_HISTORY; n++) {
+        const lpd_job_info_t *info = &snapshot[(next_job_id + n) % LPD_JOB_HISTORY];
+        if (!info->in_use) {
+            continue;
+        }
+        int len;
+        if (long_format) {
+            len = snprintf(line, sizeof(line), "%s: %s [job %03" PRIu32 " %s]\n\t%s %zu bytes\n",
+                           info->owner[0] ? info->owner : "-", state_names[info->state], info->id, info->host,
+                           info->name[0] ? info->name : "-", info->size);
+        } else {
+            len = snprintf(line, sizeof(line), "%-10s %-10s %-6" PRIu32 " %-24s %zu bytes\n",
+                           state_names[info->state], info->owner[0] ? info->owner : "-", info->id,
+                           info->name[0] ? info->name : "-", info->size);
+        }
+        send(conn->sock, line, len, 0);
+        count++;
+    }
+    if (count == 0) {
+        send(conn->sock, "no entries\n", 11, 0);
+    }
+}
+
+// Streams a data file of size bytes (0 = until the client closes) into a print job
+static bool lpd_receive_data_file(lpd_conn_t *conn, const char *printer_id, size_t size,
+                                  lpd_job_info_t *info, uint32_t id) {
+    net_job_t job;
+    esp_err_t ret = net_job_start(&job, printer_id);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Job from %s refused: %s", conn->peer, esp_err_to_name(ret));
+        lpd_reply(conn, LPD_NACK);
+        return false;
+    }
+    lpd_reply(conn, LPD_ACK);
+    lpd_job_set_state(info, id, LPD_JOB_PRINTING, 0);
+
+    size_t remaining = size;
+    bool complete = true;
+    while (size == 0 || remaining > 0) {
+        size_t want = size == 0 ? SIZE_MAX : remaining;
+        size_t n;
+        if (conn->pos < conn->len) {
+            // Whatever came in with the command lines is copied out of the line buffer
+            n = conn->len - conn->pos < want ? conn->len - conn->pos : want;
+            if (net_job_write(&job, &conn->buf[conn->pos], n) != ESP_OK) {
+                break;
+            }
+            conn->pos += n;
+        } else {
+            // The rest is received straight into the job, never past the end of the file
+            int len;
+            if (net_job_recv(&job, conn->sock, want, &len) != ESP_OK) {
+                break;
+            }
+            if (len <= 0) {
+                // End of a data file of unknown size, anything else is a broken transfer
+                complete = size == 0 && len == 0;
+                break;
+            }
+            n = len;
+        }
+        remaining -= size ? n : 0;
+    }
+
+    // The file is followed by a zero byte
+    uint8_t end = 0xFF;
+    if (complete && size != 0 && (!lpd_read_bytes(conn, &end, 1) || end != 0)) {
+        complete = false;
+    }
+    ret = net_job_finish(&job, complete);
+    lpd_job_set_state(info, id, ret == ESP_OK ? LPD_JOB_DONE : LPD_JOB_FAILED, job.received);
+    net_job_free(&job, TAG, conn->peer);
+    if (size != 0) {
+        lpd_reply(conn, ret == ESP_OK ? LPD_ACK : LPD_NACK);
+    }
+    return ret == ESP_OK && size != 0;
+}
+
+// Handles the subcommands of a receive job command
+static void lpd_receive_job(lpd_conn_t *conn, const char *queue) {
+    // Queue names that match a printer ID pick that printer
+    printer_info_t printers[PRINTER_MAX_COUNT];
+    int num_printers = printer_handler_list(printers, PRINTER_MAX_COUNT);
+    const char *printer_id = NULL;
+    for (int i = 0; i < num_printers; i++) {
+        if (strcmp(printers[i].id, queue) == 0) {
+            printer_id = queue;
+        }
+    }
+    if (num_printers == 0) {
+        lpd_reply(conn, LPD_NACK);
+        return;
+    }
+    lpd_reply(conn, LPD_ACK);
+
+    lpd_job_info_t *info = lpd_job_new(conn->peer);
+    uint32_t id = info->id;
+    char line[LPD_LINE_MAX];
+    while (lpd_read_line(conn, line, sizeof(line))) {
+        char *name = NULL;
+        unsigned long size = strtoul(&line[1], &name, 10);
+        if (line[0] == LPD_SUB_ABORT) {
+            break;
+        } else if (line[0] == LPD_SUB_CONTROL_FILE) {
+            if (size == 0 || size > LPD_CONTROL_MAX) {
+                lpd_reply(conn, LPD_NACK);
+                continue;
+            }
+            char *control = malloc(size + 1);
+            if (control == NULL) {
+                lpd_reply(conn, LPD_NACK);
+                continue;
+            }
+            lpd_reply(conn, LPD_ACK);
+            bool ok = lpd_read_bytes(conn, (uint8_t *)control, size + 1) && control[size] == '\0';
+            if (ok) {
+                lpd_job_parse_control(info, id, control);
+            }
+            free(control);
+            lpd_reply(conn, ok ? LPD_ACK : LPD_NACK);
+            if (!ok) {
+                break;
+            }
+        } else if (line[0] == LPD_SUB_DATA_FILE) {
+            if (!lpd_receive_data_file(conn, printer_id, size, info, id)) {
+                break;
+            }
+        } else {
+            ESP_LOGW(TAG, "Unknown subcommand 0x%02x from %s", line[0], conn->peer);
+            lpd_reply(conn, LPD_NACK);
+        }
+    }
+}
+
+static void lpd_client_task(void *arg) {
+    lpd_conn_t *conn = (lpd_conn_t *)arg;
+    char line[LPD_LINE_MAX];
+
+    if (lpd_read_line(conn, line, sizeof(line))) {
+        // Queue name runs up to the first space, any operands follow it
+        char *queue = &line[1];
+        queue[strcspn(queue, " \t")] = '\0';
+        switch (line[0]) {
+        case LPD_CMD_PRINT_WAITING:
+            // Jobs print as soon as they arrive
+            break;
+        case LPD_CMD_RECEIVE_JOB:
+            lpd_receive_job(conn, queue);
+            break;
+        case LPD_CMD_QUEUE_SHORT:
+        case LPD_CMD_QUEUE_LONG:
+            lpd_send_queue_state(conn, line[0] == LPD_CMD_QUEUE_LONG);
+            break;
+        case LPD_CMD_REMOVE_JOBS:
+            // Jobs are streamed straight to the printer, there is nothing left to remove
+            ESP_LOGI(TAG, "Ignoring remove jobs request from %s", conn->peer);
+            break;
+        default:
+            ESP_LOGW(TAG, "Unknown command 0x%02x from %s", line[0], conn->peer);
+            break;
+        }
+    }
+
+    shutdown(conn->sock, SHUT_RDWR);
+    close(conn->sock);
+    net_admission_release(LPD_CONN_COST, TAG, conn->peer);
+    free(conn);
+    vTaskDelete(NULL);
+}
+
+static void lpd_server_task(void *arg) {
+    uint16_t port = (uint16_t)(uintptr_t)arg;
+    int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (listen_sock < 0) {
+        ESP_LOGE(TAG, "Unable to start the server");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    int opt = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || listen(listen_sock, NET_ADMISSION_BACKLOG) != 0) {
+        ESP_LOGE(TAG, "Unable to listen on port %d: errno %d", port, errno);
+        close(listen_sock);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG, "Listening on port %d", port);
+
+    while (1) {
+        // Further clients wait in the backlog until the spool has room
+        struct sockaddr_in peer_addr;
+        bool busy;
+        int sock = net_admission_accept(listen_sock, LPD_CONN_COST, &peer_addr, &busy);
+        if (sock < 0) {
+            ESP_LOGE(TAG, "Accept failed: errno %d", errno);
+            continue;
+        }
+        if (busy) {
+            // A negative acknowledgement makes lpr keep the job and retry later
+            uint8_t nack = LPD_NACK;
+            send(sock, &nack, 1, 0);
+            close(sock);
+            continue;
+        }
+        lpd_conn_t *conn = calloc(1, sizeof(lpd_conn_t));
+        if (conn == NULL) {
+            close(sock);
+            net_admission_release(LPD_CONN_COST, TAG, "unknown");
+            continue;
+        }
+        struct timeval timeout = {
+            .tv_sec = LPD_IDLE_TIMEOUT_S,
+        };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        conn->sock = sock;
+        inet_ntop(AF_INET, &peer_addr.sin_addr, conn->peer, sizeof(conn->peer));
+
+        if (xTaskCreate(lpd_client_task, "lpd_client", LPD_SERVER_TASK_STACK, conn,
+                        LPD_SERVER_TASK_PRIORITY, NULL) != pdTRUE) {
+            close(sock);
+            net_admission_release(LPD_CONN_COST, TAG, conn->peer);
+            free(conn);
+        }
+    }
+}
+
+esp_err_t lpd_server_start(uint16_t port) {
+    jobs_lock = xSemaphoreCreateMutex();
+    if (jobs_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    BaseType_t task_created = xTaskCreate(lpd_server_task, "lpd_server", LPD_SERVER_TASK_STACK,
+                                          (void *)(uintptr_t)port, LPD_SERVER_TASK_PRIORITY, NULL);
+    return task_created == pdTRUE ? ESP_OK : ESP_ERR_NO_MEM;
+}
@@ -0,0 +1,20 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// LPD print server (RFC 1179)
+// Data files are streamed to the printer as they arrive. The queue name picks the
+// printer by its registry ID, any other name goes to the first printer. Queue state
+// requests are answered from the recent jobs kept in RAM. Connections are served
+// concurrently within the spool budget, a client that waited too long in the backlog
+// gets a negative acknowledgement and retries later.
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Starts the server task listening on port
+esp_err_t lpd_server_start(uint16_t port);
@@ -9,12 +9,25 @@
 #include "esp_log.h"
 #include "esp_intr_alloc.h"
 #include "usb/usb_host.h"
+#include "driver/gpio.h"
+
+#include "descriptor_log.h"
+#include "port_recovery.h"
+#include "network.h"
+#include "net_admission.h"
+#include "raw_server.h"
+#include "lpd_server.h"
+#include "ipp_server.h"
+#include "usbip_server.h"
 
 #define HOST_LIB_TASK_PRIORITY    2
 #define CLASS_TASK_PRIORITY     3
+#define DUMP_DESCRIPTORS_GPIO   GPIO_NUM_0  // BOOT button
 
 extern void class_driver_task(void *arg);
 extern void usb_host_lib_task(void *arg);
+extern void class_driver_print_stats(void);
+extern void class_driver_storm_task(void *arg);
 
 static const char *TAG = "PrinterBridge";
 
@@ -47,4 +60,53 @@ void app_main(void)
                                            &class_driver_task_hdl,
                                            0);
     assert(task_created == pdTRUE);
+
+#ifdef CONFIG_PRINTER_BRIDGE_HOTPLUG_STORM
+    // Hotplug stress run, it runs above the class driver so events pile up like a real storm
+    task_created = xTaskCreatePinnedToCore(class_driver_storm_task,
+                                           "storm",
+                                           3 * 1024,
+                                           NULL,
+                                           CLASS_TASK_PRIORITY + 1,
+                                           NULL,
+                                           tskNO_AFFINITY);
+    assert(task_created == pdTRUE);
+#endif
+
+    // Network print servers, the station connects in the background
+    if (network_init() == ESP_OK) {
+        ESP_ERROR_CHECK(net_admission_init());
+        if (CONFIG_PRINTER_BRIDGE_RAW_PORT != 0) {
+            ESP_ERROR_CHECK(raw_server_start(CONFIG_PRINTER_BRIDGE_RAW_PORT));
+        }
+        if (CONFIG_PRINTER_BRIDGE_LPD_PORT != 0) {
+            ESP_ERROR_CHECK(lpd_server_start(CONFIG_PRINTER_BRIDGE_LPD_PORT));
+        }
+        if (CONFIG_PRINTER_BRIDGE_IPP_PORT != 0) {
+            ESP_ERROR_CHECK(ipp_server_start(CONFIG_PRINTER_BRIDGE_IPP_PORT));
+        }
+        if (CONFIG_PRINTER_BRIDGE_USBIP_PORT != 0) {
+            ESP_ERROR_CHECK(usbip_server_start(CONFIG_PRINTER_BRIDGE_USBIP_PORT));
+        }
+    }
+
+    // Pressing BOOT prints the descriptors of recently attached devices and the hotplug and recovery stats
+    const gpio_config_t input_pin = {
+        .pin_bit_mask = BIT64(DUMP_DESCRIPTORS_GPIO),
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+    };
+    ESP_ERROR_CHECK(gpio_config(&input_pin));
+    while (1) {
+        if (gpio_get_level(DUMP_DESCRIPTORS_GPIO) == 0) {
+            descriptor_log_print();
+            class_driver_print_stats();
+            port_recovery_print_stats();
+            // Wait for release
+            while (gpio_get_level(DUMP_DESCRIPTORS_GPIO) == 0) {
+                vTaskDelay(pdMS_TO_TICKS(50));
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(50));
+    }
 }
@@ -0,0 +1,144 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+#include "net_admission.h"
+
+#define NET_ADMISSION_BUDGET        (CONFIG_PRINTER_BRIDGE_SPOOL_BUDGET_KB * 1024)
+#define NET_ADMISSION_MAX_CONNS     CONFIG_PRINTER_BRIDGE_MAX_NET_JOBS
+#define NET_ADMISSION_DEFER_US      (30 * 1000 * 1000)  // Backlog wait before a client is answered busy
+#define NET_ADMISSION_HEAP_RESERVE  (32 * 1024)         // Left free for Wi-Fi and USB whatever the budget says
+#define NET_ADMISSION_POLL          pdMS_TO_TICKS(100)  // Waiting servers recheck the budget this often
+
+static const char *TAG = "Admission";
+
+static portMUX_TYPE admission_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t space_sem;         // Given when a reservation is returned
+static size_t spool_bytes;                  // Budget reserved by open connections
+static size_t spool_peak;
+static uint32_t open_conns;
+// Stats
+static uint32_t accepted;
+static uint32_t deferred;
+static uint32_t rejected;
+
+esp_err_t net_admission_init(void) {
+    space_sem = xSemaphoreCreateBinary();
+    return space_sem != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+// Takes bytes of budget, and a connection slot if conn is set
+static bool net_admission_take(size_t bytes, bool conn) {
+    // The heap check is a snapshot, the reserve absorbs what other tasks allocate meanwhile
+    if (heap_caps_get_free_size(MALLOC_CAP_8BIT) < bytes + NET_ADMISSION_HEAP_RESERVE) {
+        return false;
+    }
+    bool ok = false;
+    portENTER_CRITICAL(&admission_lock);
+    if (spool_bytes + bytes <= NET_ADMISSION_BUDGET && (!conn || open_conns < NET_ADMISSION_MAX_CONNS)) {
+        spool_bytes += bytes;
+        if (spool_bytes > spool_peak) {
+            spool_peak = spool_bytes;
+        }
+        if (conn) {
+            open_conns++;
+            accepted++;
+        }
+        ok = true;
+    }
+    portEXIT_CRITICAL(&admission_lock);
+    return ok;
+}
+
+int net_admission_accept(int listen_sock, size_t cost, struct sockaddr_in *peer_addr, bool *busy) {
+    socklen_t peer_len = sizeof(*peer_addr);
+    int64_t deadline_us = 0;
+    *busy = false;
+
+    while (1) {
+        // Only decide once a client is actually waiting
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(listen_sock, &fds);
+        if (select(listen_sock + 1, &fds, NULL, NULL, NULL) < 0) {
+            return -1;
+        }
+
+        if (net_admission_take(cost, true)) {
+            int sock = accept(listen_sock, (struct sockaddr *)peer_addr, &peer_len);
+            if (sock < 0) {
+                portENTER_CRITICAL(&admission_lock);
+                spool_bytes -= cost;
+                open_conns--;
+                accepted--;
+                portEXIT_CRITICAL(&admission_lock);
+                xSemaphoreGive(space_sem);
+            }
+            return sock;
+        }
+
+        int64_t now = esp_timer_get_time();
+        if (deadline_us == 0) {
+            deadline_us = now + NET_ADMISSION_DEFER_US;
+            portENTER_CRITICAL(&admission_lock);
+            deferred++;
+            portEXIT_CRITICAL(&admission_lock);
+            ESP_LOGI(TAG, "Spool full (%zu of %d bytes, %" PRIu32 " connections), client held in the backlog",
+                     spool_bytes, NET_ADMISSION_BUDGET, open_conns);
+        } else if (now >= deadline_us) {
+            int sock = accept(listen_sock, (struct sockaddr *)peer_addr, &peer_len);
+            if (sock >= 0) {
+                *busy = true;
+                portENTER_CRITICAL(&admission_lock);
+                rejected++;
+                portEXIT_CRITICAL(&admission_lock);
+                ESP_LOGW(TAG, "Client waited too long, answering busy: %" PRIu32 " accepted, %" PRIu32
+                         " deferred, %" PRIu32 " rejected", accepted, deferred, rejected);
+            }
+            return sock;
+        }
+        xSemaphoreTake(space_sem, NET_ADMISSION_POLL);
+    }
+}
+
+void net_admission_release(size_t cost, const char *tag, const char *peer) {
+    portENTER_CRITICAL(&admission_lock);
+    spool_bytes -= cost;
+    open_conns--;
+    size_t bytes = spool_bytes;
+    size_t peak = spool_peak;
+    uint32_t conns = open_conns;
+    uint32_t n_accepted = accepted;
+    uint32_t n_deferred = deferred;
+    uint32_t n_rejected = rejected;
+    portEXIT_CRITICAL(&admission_lock);
+    xSemaphoreGive(space_sem);
+
+    ESP_LOGI(tag, "Connection from %s closed: %" PRIu32 " accepted, %" PRIu32 " deferred, %" PRIu32
+             " rejected, %" PRIu32 " open, %zu KB spooled (peak %zu KB)", peer, n_accepted, n_deferred,
+             n_rejected, conns, bytes / 1024, peak / 1024);
+}
+
+esp_err_t net_admission_reserve(size_t bytes) {
+    return net_admission_take(bytes, false) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void net_admission_unreserve(size_t bytes) {
+    portENTER_CRITICAL(&admission_lock);
+    spool_bytes -= bytes;
+    portEXIT_CRITICAL(&admission_lock);
+    xSemaphoreGive(space_sem);
+}
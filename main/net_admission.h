@@ -0,0 +1,38 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Admission control shared by the network print servers
+// Each connection that may carry a job reserves its share of the spool budget (stream
+// ring, buffers and task stack) before it is accepted, and the number of open connections
+// is capped. While either limit is reached, new connections wait in the listen backlog,
+// where they cost the bridge nothing. If one waits longer than the defer timeout, it is
+// accepted without a reservation and its server answers it busy.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include "esp_err.h"
+
+#define NET_ADMISSION_BACKLOG       4       // listen() backlog of the servers, deferred clients wait here
+
+// Creates the shared state, call before starting the servers
+esp_err_t net_admission_init(void);
+
+// Waits for a connection on listen_sock and accepts it once cost bytes of budget are free
+// Returns the socket or -1 if accept failed. busy is set if the connection timed out in
+// the backlog, nothing is reserved then and the server answers busy and closes it.
+int net_admission_accept(int listen_sock, size_t cost, struct sockaddr_in *peer_addr, bool *busy);
+
+// Ends an admitted connection and returns its reservation, tag and peer are for the log
+void net_admission_release(size_t cost, const char *tag, const char *peer);
+
+// Reserves more budget for an admitted connection without waiting, e.g. a decompressor
+// Returns ESP_ERR_NO_MEM if the budget or the heap can't take it.
+esp_err_t net_admission_reserve(size_t bytes);
+void net_admission_unreserve(size_t bytes);
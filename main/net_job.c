@@ -0,0 +1,130 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "net_job.h"
+#include "printer_handler.h"
+#include "net_admission.h"
+
+static void net_job_done(void *arg, esp_err_t result) {
+    net_job_t *job = (net_job_t *)arg;
+    job->result = result;
+    xSemaphoreGive(job->done_sem);
+}
+
+esp_err_t net_job_start(net_job_t *job, const char *printer_id) {
+    memset(job, 0, sizeof(net_job_t));
+    job->start_us = esp_timer_get_time();
+    job->stream = print_stream_create(NET_JOB_STREAM_SIZE, NET_JOB_LOW_WATERMARK);
+    job->done_sem = xSemaphoreCreateBinary();
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    if (job->stream != NULL && job->done_sem != NULL) {
+        ret = printer_handler_submit_stream(printer_id, job->stream, net_job_done, job);
+    }
+    if (ret != ESP_OK) {
+        if (job->stream != NULL) {
+            print_stream_delete(job->stream);
+        }
+        if (job->done_sem != NULL) {
+            vSemaphoreDelete(job->done_sem);
+        }
+        memset(job, 0, sizeof(net_job_t));
+    }
+    return ret;
+}
+
+esp_err_t net_job_set_compression(net_job_t *job, inflate_format_t format) {
+    if (format == INFLATE_FORMAT_NONE) {
+        return ESP_OK;
+    }
+    if (net_admission_reserve(inflate_stream_size()) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+    job->inflate = inflate_stream_create(format);
+    if (job->inflate == NULL) {
+        net_admission_unreserve(inflate_stream_size());
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t net_job_write(net_job_t *job, const uint8_t *data, size_t len) {
+    job->received += len;
+    if (job->inflate != NULL) {
+        return inflate_stream_write(job->inflate, data, len, job->stream);
+    }
+    return print_stream_write(job->stream, data, len);
+}
+
+esp_err_t net_job_recv(net_job_t *job, int sock, size_t max_len, int *len) {
+    if (job->inflate != NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    // lwIP copies out of its packet buffers either way, this way it is the only copy before USB
+    uint8_t *buf;
+    size_t space;
+    esp_err_t ret = print_stream_write_begin(job->stream, &buf, &space);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    *len = recv(sock, buf, space < max_len ? space : max_len, 0);
+    if (*len > 0) {
+        print_stream_write_commit(job->stream, *len);
+        job->received += *len;
+    }
+    return ESP_OK;
+}
+
+esp_err_t net_job_finish(net_job_t *job, bool complete) {
+    // Compressed data that stops short of its end is a truncated document
+    if (job->inflate != NULL && !inflate_stream_done(job->inflate)) {
+        complete = false;
+    }
+    print_stream_finish(job->stream, complete);
+    xSemaphoreTake(job->done_sem, portMAX_DELAY);
+    return job->result;
+}
+
+void net_job_get_stats(net_job_t *job, print_stream_stats_t *stats) {
+    print_stream_get_stats(job->stream, stats);
+}
+
+void net_job_free(net_job_t *job, const char *tag, const char *peer) {
+    print_stream_stats_t stats;
+    print_stream_get_stats(job->stream, &stats);
+    print_stream_delete(job->stream);
+    vSemaphoreDelete(job->done_sem);
+
+    if (job->inflate != NULL) {
+        inflate_stream_stats_t inflate_stats;
+        inflate_stream_get_stats(job->inflate, &inflate_stats);
+        inflate_stream_delete(job->inflate);
+        net_admission_unreserve(inflate_stream_size());
+        uint32_t ratio = inflate_stats.in_bytes > 0 ? (uint32_t)((uint64_t)inflate_stats.out_bytes * 100 / inflate_stats.in_bytes) : 0;
+        int64_t cpu_per_mb = inflate_stats.out_bytes > 0 ? inflate_stats.cpu_us * (1024 * 1024) / (int64_t)inflate_stats.out_bytes : 0;
+        ESP_LOGI(tag, "Job from %s: inflated %zu to %zu bytes, ratio %" PRIu32 ".%02" PRIu32 ", %" PRId64 " ms CPU per MB",
+                 peer, inflate_stats.in_bytes, inflate_stats.out_bytes, ratio / 100, ratio % 100, cpu_per_mb / 1000);
+    }
+
+    if (job->result != ESP_OK) {
+        ESP_LOGE(tag, "Job from %s failed after %zu of %zu bytes: %s", peer, stats.bytes, job->received,
+                 esp_err_to_name(job->result));
+        return;
+    }
+    int64_t duration_us = stats.end_us - job->start_us;
+    uint32_t rate = duration_us > 0 ? (uint32_t)((uint64_t)stats.bytes * 100 / duration_us) : 0;
+    ESP_LOGI(tag, "Job from %s: %zu bytes in %" PRId64 " ms, %" PRIu32 ".%02" PRIu32 " MB/s, first USB byte after %" PRId64
+             " ms, %zu bytes received in place, %zu copied", peer, stats.bytes, duration_us / 1000, rate / 100, rate % 100,
+             stats.first_byte_us ? (stats.first_byte_us - job->start_us) / 1000 : 0, stats.forwarded, stats.copied);
+    // However large the job, the bridge never held more than the ring for it
+    ESP_LOGI(tag, "Job from %s: paused %" PRIu32 " times for %" PRId64 " ms, at most %zu of %d bytes buffered",
+             peer, stats.pauses, stats.paused_us / 1000, stats.peak_count, NET_JOB_STREAM_SIZE);
+}
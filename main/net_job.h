@@ -0,0 +1,60 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Print job fed from a network connection
+// Shared by the network servers: submits a streamed job, lets the server write into it
+// and waits for the printer at the end. Throughput is logged the same way for every
+// protocol, so the servers can be compared.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "print_stream.h"
+#include "inflate_stream.h"
+
+#define NET_JOB_STREAM_SIZE         8192    // Ring between the socket and the printer
+#define NET_JOB_LOW_WATERMARK       (NET_JOB_STREAM_SIZE / 2)   // A full ring takes data again from here
+
+typedef struct {
+    print_stream_t *stream;
+    SemaphoreHandle_t done_sem;
+    esp_err_t result;
+    int64_t start_us;                       // Job accepted, time to first USB byte starts here
+    size_t received;                        // Bytes written by the server
+    inflate_stream_t *inflate;              // Set for compressed documents, its memory is reserved from the spool budget
+} net_job_t;
+
+// Creates the stream and queues the job on printer_id (NULL for the first printer)
+esp_err_t net_job_start(net_job_t *job, const char *printer_id);
+
+// Inflates the job data on its way to the printer, call before the first write
+// Returns ESP_ERR_NO_MEM if the spool budget has no room for the decompressor
+esp_err_t net_job_set_compression(net_job_t *job, inflate_format_t format);
+
+// Writes job data, blocks while the printer is behind. Fails once the printer gave up.
+esp_err_t net_job_write(net_job_t *job, const uint8_t *data, size_t len);
+
+// Receives up to max_len bytes from sock straight into the job's stream, without
+// compression only. len is the recv() result, 0 at EOF and -1 on error with errno set.
+// Fails once the printer gave up.
+esp_err_t net_job_recv(net_job_t *job, int sock, size_t max_len, int *len);
+
+// Ends the job and waits for the printer, returns the job result
+// complete is false if the connection broke before the job was whole
+esp_err_t net_job_finish(net_job_t *job, bool complete);
+
+// Stream stats of a finished job, bytes is what reached the printer
+void net_job_get_stats(net_job_t *job, print_stream_stats_t *stats);
+
+// Logs the job's throughput, time to first USB byte and bytes received in place against
+// bytes copied, then frees it. Back-pressure shows as pauses, time paused and peak fill.
+// Compressed jobs also log the compression ratio and the inflate CPU time per MB
+void net_job_free(net_job_t *job, const char *tag, const char *peer);
@@ -0,0 +1,93 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "nvs_flash.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+#include "network.h"
+
+#define NETWORK_CONNECTED_BIT       (1 << 0)
+
+static const char *TAG = "Network";
+
+static EventGroupHandle_t network_events;
+
+static void network_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        esp_wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        if (xEventGroupGetBits(network_events) & NETWORK_CONNECTED_BIT) {
+            ESP_LOGW(TAG, "Disconnected, reconnecting");
+        }
+        xEventGroupClearBits(network_events, NETWORK_CONNECTED_BIT);
+        // A missing AP takes a full scan per attempt, so this doesn't spin
+        esp_wifi_connect();
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        const ip_event_got_ip_t *event = (const ip_event_got_ip_t *)event_data;
+        ESP_LOGI(TAG, "Got IP " IPSTR, IP2STR(&event->ip_info.ip));
+        xEventGroupSetBits(network_events, NETWORK_CONNECTED_BIT);
+    }
+}
+
+esp_err_t network_init(void) {
+    if (strlen(CONFIG_PRINTER_BRIDGE_WIFI_SSID) == 0) {
+        ESP_LOGW(TAG, "No Wi-Fi SSID configured, network servers are off");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // Wi-Fi keeps its calibration data in NVS
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to init NVS: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    network_events = xEventGroupCreate();
+    if (network_events == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t init_config = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&init_config));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, network_event_handler,
+                                                        NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, network_event_handler,
+                                                        NULL, NULL));
+
+    wifi_config_t wifi_config = {0};
+    strlcpy((char *)wifi_config.sta.ssid, CONFIG_PRINTER_BRIDGE_WIFI_SSID, sizeof(wifi_config.sta.ssid));
+    strlcpy((char *)wifi_config.sta.password, CONFIG_PRINTER_BRIDGE_WIFI_PASSWORD, sizeof(wifi_config.sta.password));
+    wifi_config.sta.threshold.authmode = strlen(CONFIG_PRINTER_BRIDGE_WIFI_PASSWORD) ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    ESP_ERROR_CHECK(esp_wifi_start());
+
+    // Modem sleep adds tens of ms to every received segment, print jobs are bulk traffic
+    esp_wifi_set_ps(WIFI_PS_NONE);
+
+    ESP_LOGI(TAG, "Connecting to %s", CONFIG_PRINTER_BRIDGE_WIFI_SSID);
+    return ESP_OK;
+}
+
+bool network_wait_connected(TickType_t timeout) {
+    if (network_events == NULL) {
+        return false;
+    }
+    return xEventGroupWaitBits(network_events, NETWORK_CONNECTED_BIT, pdFALSE, pdTRUE, timeout) & NETWORK_CONNECTED_BIT;
+}
@@ -0,0 +1,21 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Wi-Fi station bring-up for the network print servers
+// Credentials come from menuconfig (PrinterBridge menu). The station reconnects on its
+// own, so servers can keep their listening sockets across drops.
+
+#pragma once
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// Starts the station, returns ESP_ERR_NOT_SUPPORTED if no SSID is configured
+esp_err_t network_init(void);
+
+// Waits until the station has an IP address
+bool network_wait_connected(TickType_t timeout);
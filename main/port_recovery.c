@@ -0,0 +1,154 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include "port_recovery.h"
+
+static const char *TAG = "Port recovery";
+
+typedef struct {
+    uint32_t hangs_reported;
+    uint32_t power_cycles;
+    uint32_t recoveries;
+    int64_t total_recovery_us;              // From the hang report to the printer being back
+    int64_t worst_recovery_us;
+} port_recovery_stats_t;
+
+static struct {
+    int64_t hang_time_us;                   // Unrecovered hang reported at, 0 if none
+    int64_t next_attempt_us;                // Earliest time for the next power cycle, unless recovered by then
+    int64_t power_on_time_us;               // Port is off until then, 0 if powered
+    int64_t last_recovery_us;
+    uint32_t attempts;                      // Power cycles since the backoff was last reset
+    port_recovery_stats_t stats;
+} recovery;
+static portMUX_TYPE recovery_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void port_recovery_report_hung(usb_device_handle_t dev_hdl) {
+    int64_t now = esp_timer_get_time();
+    bool new_hang = false;
+
+    portENTER_CRITICAL(&recovery_lock);
+    if (recovery.hang_time_us == 0) {
+        new_hang = true;
+        recovery.hang_time_us = now;
+        recovery.stats.hangs_reported++;
+        if (recovery.last_recovery_us == 0 || now - recovery.last_recovery_us > PORT_RECOVERY_STABLE_MS * 1000LL) {
+            // First hang in a while, recover right away
+            recovery.attempts = 0;
+            recovery.next_attempt_us = now;
+        }
+    }
+    portEXIT_CRITICAL(&recovery_lock);
+
+    if (new_hang) {
+        ESP_LOGW(TAG, "Device %p stopped responding, scheduling port power cycle", dev_hdl);
+        usb_host_lib_unblock();
+    }
+}
+
+void port_recovery_note_attach(void) {
+    int64_t now = esp_timer_get_time();
+    int64_t recovery_us = 0;
+
+    portENTER_CRITICAL(&recovery_lock);
+    // Only counts once the port was actually cycled, a printer plugged in elsewhere doesn't
+    if (recovery.hang_time_us != 0 && recovery.attempts > 0 && recovery.power_on_time_us == 0) {
+        recovery_us = now - recovery.hang_time_us;
+        recovery.hang_time_us = 0;
+        recovery.last_recovery_us = now;
+        recovery.stats.recoveries++;
+        recovery.stats.total_recovery_us += recovery_us;
+        if (recovery_us > recovery.stats.worst_recovery_us) {
+            recovery.stats.worst_recovery_us = recovery_us;
+        }
+    }
+    portEXIT_CRITICAL(&recovery_lock);
+
+    if (recovery_us != 0) {
+        ESP_LOGI(TAG, "Printer back %" PRId64 " ms after the hang", recovery_us / 1000);
+    }
+}
+
+TickType_t port_recovery_run(void) {
+    int64_t now = esp_timer_get_time();
+    int64_t wait_us = -1;
+    bool power_off = false;
+    bool power_on = false;
+    bool give_up = false;
+
+    portENTER_CRITICAL(&recovery_lock);
+    if (recovery.power_on_time_us != 0) {
+        if (now >= recovery.power_on_time_us) {
+            recovery.power_on_time_us = 0;
+            power_on = true;
+        } else {
+            wait_us = recovery.power_on_time_us - now;
+        }
+    } else if (recovery.hang_time_us != 0 && recovery.attempts >= PORT_RECOVERY_MAX_ATTEMPTS
+               && now >= recovery.next_attempt_us) {
+        recovery.hang_time_us = 0;
+        recovery.last_recovery_us = now;    // Backoff only restarts after a quiet period
+        give_up = true;
+    } else if (recovery.hang_time_us != 0) {
+        if (now >= recovery.next_attempt_us) {
+            int64_t backoff_ms = (int64_t)PORT_RECOVERY_BACKOFF_MIN_MS << recovery.attempts;
+            if (backoff_ms > PORT_RECOVERY_BACKOFF_MAX_MS) {
+                backoff_ms = PORT_RECOVERY_BACKOFF_MAX_MS;
+            }
+            recovery.attempts++;
+            recovery.stats.power_cycles++;
+            recovery.power_on_time_us = now + PORT_RECOVERY_POWER_OFF_MS * 1000LL;
+            recovery.next_attempt_us = now + backoff_ms * 1000LL;
+            wait_us = PORT_RECOVERY_POWER_OFF_MS * 1000LL;
+            power_off = true;
+        } else {
+            wait_us = recovery.next_attempt_us - now;
+        }
+    }
+    uint32_t attempts = recovery.attempts;
+    portEXIT_CRITICAL(&recovery_lock);
+
+    if (give_up) {
+        ESP_LOGE(TAG, "Giving up after %d power cycles", PORT_RECOVERY_MAX_ATTEMPTS);
+    }
+    if (power_off) {
+        // All devices on the port go away, their jobs get parked
+        ESP_LOGW(TAG, "Power cycling root port (attempt %" PRIu32 ")", attempts);
+        esp_err_t ret = usb_host_lib_set_root_port_power(false);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to power off root port: %s", esp_err_to_name(ret));
+        }
+    }
+    if (power_on) {
+        esp_err_t ret = usb_host_lib_set_root_port_power(true);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to power on root port: %s", esp_err_to_name(ret));
+        }
+    }
+
+    if (wait_us < 0) {
+        return portMAX_DELAY;
+    }
+    return pdMS_TO_TICKS(wait_us / 1000) + 1;
+}
+
+void port_recovery_print_stats(void) {
+    portENTER_CRITICAL(&recovery_lock);
+    port_recovery_stats_t stats = recovery.stats;
+    portEXIT_CRITICAL(&recovery_lock);
+
+    ESP_LOGI(TAG, "Recovery stats:");
+    ESP_LOGI(TAG, "\tHangs: %" PRIu32 ", power cycles: %" PRIu32 ", recovered: %" PRIu32,
+             stats.hangs_reported, stats.power_cycles, stats.recoveries);
+    ESP_LOGI(TAG, "\tMean time to recover %" PRId64 " ms, worst %" PRId64 " ms",
+             stats.recoveries ? stats.total_recovery_us / stats.recoveries / 1000 : 0,
+             stats.worst_recovery_us / 1000);
+}
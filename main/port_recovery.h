@@ -0,0 +1,35 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Recovery of printers that stopped responding
+// Printer workers report a device whose control and bulk transfers time out. The USB host
+// library task then power cycles the root port, the only bus reset the host library offers
+// to its users, with exponential backoff between attempts. The printer re-enumerates and
+// its parked jobs resume.
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "usb/usb_host.h"
+
+#define PORT_RECOVERY_POWER_OFF_MS      500     // Long enough for bus powered hubs to drop out
+#define PORT_RECOVERY_BACKOFF_MIN_MS    5000    // Time the printer gets to come back, doubles every attempt
+#define PORT_RECOVERY_BACKOFF_MAX_MS    80000
+#define PORT_RECOVERY_MAX_ATTEMPTS      5       // Then the device is given up on until it hangs again after a quiet period
+#define PORT_RECOVERY_STABLE_MS         300000  // A hang after this much quiet time starts a new backoff
+
+// Reports an unresponsive device, called from printer workers
+// Repeated reports while a recovery is under way are ignored
+void port_recovery_report_hung(usb_device_handle_t dev_hdl);
+
+// Called when a printer registers, ends a recovery that is under way
+void port_recovery_note_attach(void);
+
+// Runs the power cycle steps that are due, called from the USB host library task
+// Returns how long the task may block before the next step is due
+TickType_t port_recovery_run(void);
+
+void port_recovery_print_stats(void);
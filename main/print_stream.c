@@ -0,0 +1,238 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "print_stream.h"
+
+#define PRINT_STREAM_WRITE_POLL     pdMS_TO_TICKS(100)  // Writer rechecks for an abort this often
+
+struct print_stream {
+    uint8_t *buf;
+    size_t size;
+    size_t head;                            // Next byte to read
+    size_t count;                           // Bytes in the ring
+    size_t low_watermark;                   // A full ring takes writes again once drained to this
+    bool paused;                            // Ring filled up, writer waits for the low watermark
+    bool finished;
+    bool complete;
+    bool aborted;
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t data_sem;             // Given when data arrives or the writer finishes
+    SemaphoreHandle_t space_sem;            // Given at the low watermark or when the reader aborts
+    print_stream_stats_t stats;
+};
+
+print_stream_t *print_stream_create(size_t buf_size, size_t low_watermark) {
+    print_stream_t *stream = calloc(1, sizeof(print_stream_t));
+    if (stream == NULL) {
+        return NULL;
+    }
+    stream->buf = malloc(buf_size);
+    stream->size = buf_size;
+    stream->low_watermark = low_watermark < buf_size ? low_watermark : buf_size - 1;
+    stream->lock = xSemaphoreCreateMutex();
+    stream->data_sem = xSemaphoreCreateBinary();
+    stream->space_sem = xSemaphoreCreateBinary();
+    if (stream->buf == NULL || stream->lock == NULL || stream->data_sem == NULL || stream->space_sem == NULL) {
+        print_stream_delete(stream);
+        return NULL;
+    }
+    stream->stats.start_us = esp_timer_get_time();
+    return stream;
+}
+
+void print_stream_delete(print_stream_t *stream) {
+    if (stream->lock != NULL) {
+        vSemaphoreDelete(stream->lock);
+    }
+    if (stream->data_sem != NULL) {
+        vSemaphoreDelete(stream->data_sem);
+    }
+    if (stream->space_sem != NULL) {
+        vSemaphoreDelete(stream->space_sem);
+    }
+    free(stream->buf);
+    free(stream);
+}
+
+// Free space the writer may fill, none while paused. Called with the lock held.
+static size_t print_stream_space(const print_stream_t *stream) {
+    return stream->paused ? 0 : stream->size - stream->count;
+}
+
+// Accounts n bytes the writer added, called with the lock held
+static void print_stream_added(print_stream_t *stream, size_t n) {
+    stream->count += n;
+    if (stream->count > stream->stats.peak_count) {
+        stream->stats.peak_count = stream->count;
+    }
+    // The high watermark is the full ring, the writer stays off until the reader made room
+    // for a large receive instead of trickling in whatever each transfer frees. Writes that
+    // find it paused add nothing and don't count as another pause.
+    if (stream->count == stream->size && !stream->paused) {
+        stream->paused = true;
+        stream->stats.pauses++;
+    }
+}
+
+// Waits for the printer to catch up, the time is accounted as paused
+static void print_stream_wait_space(print_stream_t *stream) {
+    int64_t start_us = esp_timer_get_time();
+    xSemaphoreTake(stream->space_sem, PRINT_STREAM_WRITE_POLL);
+    int64_t waited_us = esp_timer_get_time() - start_us;
+    xSemaphoreTake(stream->lock, portMAX_DELAY);
+    stream->stats.paused_us += waited_us;
+    xSemaphoreGive(stream->lock);
+}
+
+esp_err_t print_stream_write(print_stream_t *stream, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        xSemaphoreTake(stream->lock, portMAX_DELAY);
+        if (stream->aborted) {
+            xSemaphoreGive(stream->lock);
+            return ESP_ERR_INVALID_STATE;
+        }
+        // Copy into the free part of the ring, in up to two pieces
+        size_t n = print_stream_space(stream);
+        if (n > len) {
+            n = len;
+        }
+        size_t tail = (stream->head + stream->count) % stream->size;
+        for (size_t copied = 0; copied < n;) {
+            size_t piece = stream->size - tail;
+            if (piece > n - copied) {
+                piece = n - copied;
+            }
+            memcpy(&stream->buf[tail], &data[copied], piece);
+            tail = (tail + piece) % stream->size;
+            copied += piece;
+        }
+        print_stream_added(stream, n);
+        stream->stats.copied += n;
+        xSemaphoreGive(stream->lock);
+
+        if (n > 0) {
+            xSemaphoreGive(stream->data_sem);
+            data += n;
+            len -= n;
+        } else {
+            print_stream_wait_space(stream);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t print_stream_write_begin(print_stream_t *stream, uint8_t **buf, size_t *len) {
+    while (1) {
+        xSemaphoreTake(stream->lock, portMAX_DELAY);
+        if (stream->aborted) {
+            xSemaphoreGive(stream->lock);
+            return ESP_ERR_INVALID_STATE;
+        }
+        // The reader only moves the head, so the free part stays put until the commit
+        size_t tail = (stream->head + stream->count) % stream->size;
+        size_t free_len = print_stream_space(stream);
+        *buf = &stream->buf[tail];
+        *len = stream->size - tail < free_len ? stream->size - tail : free_len;
+        xSemaphoreGive(stream->lock);
+
+        if (*len > 0) {
+            return ESP_OK;
+        }
+        print_stream_wait_space(stream);
+    }
+}
+
+void print_stream_write_commit(print_stream_t *stream, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    xSemaphoreTake(stream->lock, portMAX_DELAY);
+    print_stream_added(stream, len);
+    stream->stats.forwarded += len;
+    xSemaphoreGive(stream->lock);
+    xSemaphoreGive(stream->data_sem);
+}
+
+void print_stream_finish(print_stream_t *stream, bool complete) {
+    xSemaphoreTake(stream->lock, portMAX_DELAY);
+    stream->finished = true;
+    stream->complete = complete;
+    xSemaphoreGive(stream->lock);
+    xSemaphoreGive(stream->data_sem);
+}
+
+esp_err_t print_stream_read(print_stream_t *stream, uint8_t *buf, size_t max_len, size_t *len, TickType_t timeout) {
+    *len = 0;
+    while (1) {
+        xSemaphoreTake(stream->lock, portMAX_DELAY);
+        if (stream->count > 0) {
+            break;
+        }
+        bool finished = stream->finished;
+        bool complete = stream->complete;
+        xSemaphoreGive(stream->lock);
+        if (finished) {
+            return complete ? ESP_OK : ESP_ERR_INVALID_STATE;
+        }
+        if (xSemaphoreTake(stream->data_sem, timeout) != pdTRUE) {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+
+    // Lock held, copy out in up to two pieces
+    size_t n = stream->count < max_len ? stream->count : max_len;
+    while (*len < n) {
+        size_t piece = stream->size - stream->head;
+        if (piece > n - *len) {
+            piece = n - *len;
+        }
+        memcpy(&buf[*len], &stream->buf[stream->head], piece);
+        stream->head = (stream->head + piece) % stream->size;
+        stream->count -= piece;
+        *len += piece;
+    }
+    int64_t now = esp_timer_get_time();
+    if (stream->stats.first_byte_us == 0) {
+        stream->stats.first_byte_us = now;
+    }
+    stream->stats.end_us = now;
+    stream->stats.bytes += n;
+    bool resume = stream->paused && stream->count <= stream->low_watermark;
+    if (resume) {
+        stream->paused = false;
+    }
+    xSemaphoreGive(stream->lock);
+
+    if (resume) {
+        xSemaphoreGive(stream->space_sem);
+    }
+    return ESP_OK;
+}
+
+void print_stream_abort(print_stream_t *stream) {
+    xSemaphoreTake(stream->lock, portMAX_DELAY);
+    stream->aborted = true;
+    xSemaphoreGive(stream->lock);
+    xSemaphoreGive(stream->space_sem);
+}
+
+void print_stream_set_acked(print_stream_t *stream, size_t acked) {
+    xSemaphoreTake(stream->lock, portMAX_DELAY);
+    stream->stats.acked = acked;
+    xSemaphoreGive(stream->lock);
+}
+
+void print_stream_get_stats(print_stream_t *stream, print_stream_stats_t *stats) {
+    xSemaphoreTake(stream->lock, portMAX_DELAY);
+    *stats = stream->stats;
+    xSemaphoreGive(stream->lock);
+}
@@ -0,0 +1,69 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Print job whose data arrives while it prints
+// A network server writes into a bounded ring, the printer worker reads from it straight
+// into its bulk OUT transfers. A full ring blocks the writer, which stops reading the
+// socket, so a slow printer pushes back through the TCP window instead of buffering a job.
+// The writer only resumes once the ring drained to its low watermark, so the socket is
+// read in large pieces rather than a transfer's worth at a time.
+// Writers can also receive straight into the ring, which saves a copy per byte.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef struct print_stream print_stream_t;
+
+typedef struct {
+    int64_t start_us;                       // Stream created
+    int64_t first_byte_us;                  // First byte handed to the printer, 0 if none yet
+    int64_t end_us;                         // Last byte handed to the printer
+    size_t bytes;                           // Bytes handed to the printer
+    size_t acked;                           // Bytes the printer acknowledged on USB, set once the job is over
+    size_t copied;                          // Bytes the writer copied into the ring
+    size_t forwarded;                       // Bytes received straight into the ring
+    size_t peak_count;                      // Most bytes the ring held
+    uint32_t pauses;                        // Times the ring filled up and the writer had to wait
+    int64_t paused_us;                      // Time the writer waited
+} print_stream_stats_t;
+
+// Creates a stream with a ring of buf_size bytes
+// Once the ring is full, writes block until the reader drained it to low_watermark bytes.
+print_stream_t *print_stream_create(size_t buf_size, size_t low_watermark);
+void print_stream_delete(print_stream_t *stream);
+
+// Writer side
+// Blocks while the ring is full or draining. Returns ESP_ERR_INVALID_STATE once the reader gave up.
+esp_err_t print_stream_write(print_stream_t *stream, const uint8_t *data, size_t len);
+
+// Lends the largest contiguous free part of the ring so the writer can receive straight
+// into it, blocks while the ring is full or draining. Returns ESP_ERR_INVALID_STATE once the reader gave up.
+esp_err_t print_stream_write_begin(print_stream_t *stream, uint8_t **buf, size_t *len);
+
+// Hands len bytes written into the lent space to the reader
+void print_stream_write_commit(print_stream_t *stream, size_t len);
+
+// Ends the job, complete is false if the writer lost its source halfway
+void print_stream_finish(print_stream_t *stream, bool complete);
+
+// Reader side
+// Returns up to max_len bytes, waiting up to timeout for the first one
+// ESP_OK with *len == 0 means the job is complete, ESP_ERR_TIMEOUT that nothing arrived yet
+// and ESP_ERR_INVALID_STATE that the writer aborted.
+esp_err_t print_stream_read(print_stream_t *stream, uint8_t *buf, size_t max_len, size_t *len, TickType_t timeout);
+
+// Reader gives up, the writer's next write fails
+void print_stream_abort(print_stream_t *stream);
+
+// Reader reports how much of the stream the printer acknowledged, before it ends the job
+void print_stream_set_acked(print_stream_t *stream, size_t acked);
+
+void print_stream_get_stats(print_stream_t *stream, print_stream_stats_t *stats);
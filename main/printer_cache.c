@@ -0,0 +1,148 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "printer_cache.h"
+
+typedef struct {
+    bool valid;
+    uint32_t last_used;
+    printer_cap_t cap;
+} printer_cache_entry_t;
+
+typedef struct {
+    uint16_t vid;
+    uint16_t pid;
+    uint16_t bcd_device;
+} printer_cache_reject_t;
+
+static printer_cache_entry_t cache[PRINTER_CACHE_SIZE];
+static uint32_t cache_clock;
+static printer_cache_reject_t rejects[PRINTER_CACHE_REJECT_SIZE];    // Ring, oldest entry is overwritten
+static int num_rejects;
+static int next_reject;
+static portMUX_TYPE cache_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t printer_cache_key_from_device(usb_device_handle_t dev_hdl, printer_cache_key_t *key) {
+    const usb_device_desc_t *dev_desc;
+    esp_err_t ret = usb_host_get_device_descriptor(dev_hdl, &dev_desc);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    usb_device_info_t dev_info;
+    ret = usb_host_device_info(dev_hdl, &dev_info);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    memset(key, 0, sizeof(printer_cache_key_t));
+    key->vid = dev_desc->idVendor;
+    key->pid = dev_desc->idProduct;
+    key->bcd_device = dev_desc->bcdDevice;
+
+    // Serial number string descriptor is UTF-16LE, keep the ASCII part
+    const usb_str_desc_t *serial = dev_info.str_desc_serial_num;
+    if (serial != NULL) {
+        int num_chars = (serial->bLength - 2) / 2;
+        int len = 0;
+        for (int i = 0; i < num_chars && len < PRINTER_CACHE_SERIAL_LEN - 1; i++) {
+            uint16_t c = serial->wData[i];
+            key->serial[len++] = (c >= 0x20 && c < 0x7F) ? (char)c : '?';
+        }
+    }
+    return ESP_OK;
+}
+
+static bool printer_cache_key_equal(const printer_cache_key_t *a, const printer_cache_key_t *b) {
+    return a->vid == b->vid && a->pid == b->pid && a->bcd_device == b->bcd_device
+           && strcmp(a->serial, b->serial) == 0;
+}
+
+// Called with cache_lock held
+static printer_cache_entry_t *printer_cache_find(const printer_cache_key_t *key) {
+    for (int i = 0; i < PRINTER_CACHE_SIZE; i++) {
+        if (cache[i].valid && printer_cache_key_equal(&cache[i].cap.key, key)) {
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+bool printer_cache_lookup(const printer_cache_key_t *key, printer_cap_t *cap) {
+    portENTER_CRITICAL(&cache_lock);
+    printer_cache_entry_t *entry = printer_cache_find(key);
+    if (entry != NULL) {
+        entry->last_used = ++cache_clock;
+        *cap = entry->cap;
+    }
+    portEXIT_CRITICAL(&cache_lock);
+    return entry != NULL;
+}
+
+bool printer_cache_contains(const printer_cache_key_t *key) {
+    portENTER_CRITICAL(&cache_lock);
+    bool found = printer_cache_find(key) != NULL;
+    portEXIT_CRITICAL(&cache_lock);
+    return found;
+}
+
+void printer_cache_store(const printer_cap_t *cap) {
+    portENTER_CRITICAL(&cache_lock);
+    printer_cache_entry_t *entry = printer_cache_find(&cap->key);
+    if (entry == NULL) {
+        // Take a free entry, or evict the least recently used one
+        entry = &cache[0];
+        for (int i = 0; i < PRINTER_CACHE_SIZE; i++) {
+            if (!cache[i].valid) {
+                entry = &cache[i];
+                break;
+            }
+            if (cache[i].last_used < entry->last_used) {
+                entry = &cache[i];
+            }
+        }
+    }
+    entry->valid = true;
+    entry->last_used = ++cache_clock;
+    entry->cap = *cap;
+    portEXIT_CRITICAL(&cache_lock);
+}
+
+void printer_cache_set_device_id(const printer_cache_key_t *key, const char *device_id) {
+    portENTER_CRITICAL(&cache_lock);
+    printer_cache_entry_t *entry = printer_cache_find(key);
+    if (entry != NULL) {
+        strlcpy(entry->cap.device_id, device_id, sizeof(entry->cap.device_id));
+    }
+    portEXIT_CRITICAL(&cache_lock);
+}
+
+void printer_cache_mark_not_printer(uint16_t vid, uint16_t pid, uint16_t bcd_device) {
+    if (printer_cache_is_not_printer(vid, pid, bcd_device)) {
+        return;
+    }
+    portENTER_CRITICAL(&cache_lock);
+    rejects[next_reject].vid = vid;
+    rejects[next_reject].pid = pid;
+    rejects[next_reject].bcd_device = bcd_device;
+    next_reject = (next_reject + 1) % PRINTER_CACHE_REJECT_SIZE;
+    if (num_rejects < PRINTER_CACHE_REJECT_SIZE) {
+        num_rejects++;
+    }
+    portEXIT_CRITICAL(&cache_lock);
+}
+
+bool printer_cache_is_not_printer(uint16_t vid, uint16_t pid, uint16_t bcd_device) {
+    bool found = false;
+    portENTER_CRITICAL(&cache_lock);
+    for (int i = 0; i < num_rejects && !found; i++) {
+        found = rejects[i].vid == vid && rejects[i].pid == pid && rejects[i].bcd_device == bcd_device;
+    }
+    portEXIT_CRITICAL(&cache_lock);
+    return found;
+}
@@ -0,0 +1,68 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// RAM cache of parsed printer capabilities
+// A printer that was seen before (same VID/PID/bcdDevice/serial) skips the descriptor
+// dump and the config descriptor walk on reconnect and goes straight to ready.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "usb/usb_host.h"
+#include "printer_handler.h"
+
+#define PRINTER_CACHE_SIZE          8
+#define PRINTER_CACHE_SERIAL_LEN    33
+#define PRINTER_DEVICE_ID_LEN       256
+#define PRINTER_CACHE_REJECT_SIZE   16
+
+// What a printer record needs to know about one printer interface
+typedef struct {
+    uint8_t interface_number;
+    uint8_t alternate_setting;
+    uint8_t protocol;
+    uint8_t bulk_out_ep;
+    uint8_t bulk_in_ep;                     // 0xFF if unidirectional
+    uint16_t bulk_out_mps;
+    uint16_t bulk_in_mps;
+    uint16_t quirks;                        // PRINTER_QUIRK_*
+    uint16_t transfer_size;                 // Tuned bulk OUT chunk size
+} printer_intf_cap_t;
+
+typedef struct {
+    uint16_t vid;
+    uint16_t pid;
+    uint16_t bcd_device;
+    char serial[PRINTER_CACHE_SERIAL_LEN];  // Empty if the device has no serial number
+} printer_cache_key_t;
+
+typedef struct {
+    printer_cache_key_t key;
+    uint8_t num_interfaces;
+    printer_intf_cap_t intf[PRINTER_MAX_COUNT];
+    bool has_ipp_usb;
+    char device_id[PRINTER_DEVICE_ID_LEN];  // IEEE 1284 Device ID, empty until read
+} printer_cap_t;
+
+// Builds the cache key of an open device from its cached descriptors (no bus traffic)
+esp_err_t printer_cache_key_from_device(usb_device_handle_t dev_hdl, printer_cache_key_t *key);
+
+// Copies the cached capabilities of a printer, returns false if it isn't cached
+bool printer_cache_lookup(const printer_cache_key_t *key, printer_cap_t *cap);
+bool printer_cache_contains(const printer_cache_key_t *key);
+
+// Adds or replaces an entry, the least recently used one is evicted when full
+void printer_cache_store(const printer_cap_t *cap);
+
+// Records the IEEE 1284 Device ID of a cached printer
+void printer_cache_set_device_id(const printer_cache_key_t *key, const char *device_id);
+
+// Devices that were checked and have no printer interface, so the enumeration filter can
+// skip them next time. Keyed by VID/PID/bcdDevice, all the filter gets to see.
+void printer_cache_mark_not_printer(uint16_t vid, uint16_t pid, uint16_t bcd_device);
+bool printer_cache_is_not_printer(uint16_t vid, uint16_t pid, uint16_t bcd_device);
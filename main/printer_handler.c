@@ -4,18 +4,39 @@
  * SPDX-License-Identifier: Apache-2.0
 */
 
-// TODO: Handle more than 1 printer interfaces
 // TODO: Implement bi-directional communication
 
+// Every printer interface gets its own record with a transfer pool, a job queue and a
+// worker task, so several printer interfaces print independently of each other.
+// The class driver task only queues jobs and flips state; everything that waits on a
+// transfer (SET_INTERFACE, DOT4, streaming a job) runs in the worker, because transfer
+// callbacks are delivered by the class driver task and would never arrive while it waits.
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
 #include "esp_intr_alloc.h"
 #include "usb/usb_host.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "freertos/semphr.h"
 
+#include "printer_handler.h"
+#include "bulk_pipe.h"
+#include "dot4.h"
+#include "ipp_usb.h"
+#include "printer_quirks.h"
+#include "printer_cache.h"
+#include "port_recovery.h"
+#include "print_stream.h"
 #include "test/test_page_small.h"
 
+void class_driver_device_released(usb_device_handle_t dev_hdl);
+
 static const char *TAG = "Printer handler";
 
 // Definitions taken from https://www.usb.org/sites/default/files/usbprint11a021811.pdf
@@ -23,63 +44,262 @@ static const char *TAG = "Printer handler";
 #define USB_PRINTER_PROTOCOL_UNI    0x01
 #define USB_PRINTER_PROTOCOL_BI     0x02
 #define USB_PRINTER_PROTOCOL_1284   0x03
+#define USB_PRINTER_PROTOCOL_IPP_USB 0x04   // IPP over USB specification
+#define USB_PRINTER_REQ_GET_DEVICE_ID 0x00
+#define USB_PRINTER_REQ_GET_PORT_STATUS 0x01
+#define PRINTER_PORT_STATUS_PAPER_EMPTY (1 << 5)
+#define PRINTER_PORT_STATUS_NOT_ERROR   (1 << 3)
+
+#define PRINTER_MAX_ALT_SETTINGS    8
+#define PRINTER_TRANSFER_POOL_SIZE  4       // Transfers kept in flight per printer interface
+#define PRINTER_TRANSFER_SIZE       4096
+#define PRINTER_JOB_QUEUE_LEN       4
+#define PRINTER_WORKER_STACK        4096
+#define PRINTER_WORKER_PRIORITY     2
+#define PRINTER_PARKED_MAX          4       // Jobs kept for printers that were unplugged mid-job
+#define PRINTER_PARK_TIMEOUT_US     (10 * 60 * 1000000LL)
+#define PRINTER_FORM_FEED           0x0C
+#define PRINTER_STALL_TIMEOUT       pdMS_TO_TICKS(30000)    // No bulk progress for this long, check the printer
+#define PRINTER_STREAM_WAIT         pdMS_TO_TICKS(1000)     // Idle wait for streamed data, closing is checked in between
+#define PRINTER_COALESCE_US         5000    // A partly filled transfer goes out this long after its first byte
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;                          // Where to start, non-zero when resuming a parked job
+    print_stream_t *stream;                 // Data arrives while printing, data and size are unused
+    printer_job_done_cb_t done;             // Optional, called once the job is over
+    void *done_arg;
+} print_job_t;
 
 typedef struct {
+    bool in_use;
+    bool claimed;                           // Interface claimed, stays claimed until the device goes away
+    bool closing;                           // Device is going away, nothing new gets submitted
     usb_device_handle_t dev_hdl;
     usb_host_client_handle_t client_hdl;
     uint8_t interface_number;
+    uint8_t alternate_setting;
+    uint8_t protocol;                       // USB_PRINTER_PROTOCOL_*
     uint8_t bulk_out_ep;
     uint8_t bulk_in_ep;                     // NULL if unidirectional
-    SemaphoreHandle_t transfer_done_sem;    // Semaphore for transfer syncronization
+    uint16_t bulk_out_mps;
+    uint16_t bulk_in_mps;
+    uint16_t quirks;                        // PRINTER_QUIRK_*
+    size_t transfer_size;                   // Bulk OUT transfer size, may be lowered by a quirk
+
+    usb_transfer_t *drain_transfer;         // Keeps bulk IN read for PRINTER_QUIRK_DRAIN_BACKCHANNEL
+    bool draining;                          // drain_transfer is in flight
+    printer_cache_key_t cache_key;          // Capability cache entry of the device
+    bool fetch_device_id;                   // Worker reads the 1284 Device ID into the cache
+    int64_t attach_time_us;                 // Attach event time until the first byte went out, then 0
+    usb_transfer_t *transfer_pool[PRINTER_TRANSFER_POOL_SIZE];
+    QueueHandle_t done_transfers;           // Transfers handed back by the callback, read by the worker
+    QueueHandle_t job_queue;                // Jobs waiting for this interface
+
+    TaskHandle_t worker;
+    bool worker_running;                    // Cleared by the worker right before it exits
+    bool job_active;                        // Worker took a job off the queue and hasn't finished it, under registry_lock
+    bulk_pipe_t *dot4_pipe;                 // Pipe of the DOT4 job in progress, NULL otherwise, under registry_lock
 } printer_device_t;
 
-static printer_device_t saved_printer;
+static printer_device_t printers[PRINTER_MAX_COUNT];
+
+// Registry of attached printers, one entry per device
+// IPP-USB interfaces are driven per device by the IPP-USB transport, not by printer records
+typedef struct {
+    bool in_use;
+    usb_device_handle_t dev_hdl;
+    usb_host_client_handle_t client_hdl;
+    char id[PRINTER_ID_LEN];                // Stable across reattach, see printer_make_id()
+    uint16_t vid;
+    uint16_t pid;
+    ipp_usb_t *ipp;
+    bool exported;                          // A remote driver owns the device, see printer_handler_export_begin()
+    bool export_gone;                       // Unplugged while exported, released once the export ends
+    printer_export_gone_cb_t export_gone_cb;
+    void *export_gone_arg;
+#ifdef CONFIG_PRINTER_BRIDGE_HOTPLUG_STORM
+    bool stand_in;                          // Hotplug storm device, see printer_handler_storm_attach()
+#endif
+} printer_entry_t;
+
+#ifdef CONFIG_PRINTER_BRIDGE_HOTPLUG_STORM
+#define PRINTER_ENTRY_STAND_IN(entry)   ((entry)->stand_in)
+#else
+#define PRINTER_ENTRY_STAND_IN(entry)   false
+#endif
+
+// Job of a printer that went away mid-job, resumed when the same printer comes back
+typedef struct {
+    bool in_use;
+    char printer_id[PRINTER_ID_LEN];
+    uint16_t vid;
+    uint16_t pid;
+    char device_id[PRINTER_DEVICE_ID_LEN];  // Matches serial-less printers plugged into another port
+    print_job_t job;                        // job.offset is the resume point
+    int64_t park_time_us;
+} parked_job_t;
+
+static printer_entry_t registry[PRINTER_MAX_COUNT];
+static parked_job_t parked_jobs[PRINTER_PARKED_MAX];
+static SemaphoreHandle_t registry_lock;     // Protects registry, parked_jobs and the in_use/closing state of printers
 
-static void save_printer_endpoint_details(usb_device_handle_t dev_hdl, usb_host_client_handle_t client_hdl,
-                                            uint8_t interface_num, const usb_intf_desc_t *intf_desc,
-                                            const usb_config_desc_t *config_desc);
+static printer_device_t *save_printer_endpoint_details(usb_device_handle_t dev_hdl, usb_host_client_handle_t client_hdl,
+                                                       const printer_cap_t *cap, const printer_intf_cap_t *intf_cap,
+                                                       int64_t attach_time_us);
 static void print_transfer_callback(usb_transfer_t *transfer);
+static void drain_transfer_callback(usb_transfer_t *transfer);
+static esp_err_t send_print_job_dot4(printer_device_t *printer, const print_job_t *job);
+static void printer_worker_task(void *arg);
+static printer_entry_t *printer_entry_get(usb_device_handle_t dev_hdl);
+static esp_err_t printer_queue_job(printer_device_t *printer, const print_job_t *job);
+static void printer_resume_parked_jobs(printer_entry_t *entry, const char *device_id);
 
-// Function that checks whether a USB device has printer interfaces
-// Returns the printer device if successfull, else NULL
-bool check_device_for_printer_interfaces(usb_device_handle_t dev_hdl, usb_host_client_handle_t client_hdl) {
-    if (dev_hdl == NULL) {
-        ESP_LOGI(TAG, "Device handle is NULL");
-        return false;
+// Ranks printer interface modes, higher is better. 1284.4 sits below plain
+// bidirectional because it needs a DOT4 handshake before any data moves.
+static int printer_protocol_rank(uint8_t protocol) {
+    switch (protocol) {
+    case USB_PRINTER_PROTOCOL_IPP_USB:
+        return 4;
+    case USB_PRINTER_PROTOCOL_BI:
+        return 3;
+    case USB_PRINTER_PROTOCOL_1284:
+        return 2;
+    case USB_PRINTER_PROTOCOL_UNI:
+        return 1;
+    default:
+        return 0;   // Vendor specific, we don't know how to talk to it
     }
-    if (client_hdl == NULL) {
-        ESP_LOGI(TAG, "Device handle is NULL");
+}
+
+// Checks whether an alternate setting has the bulk OUT endpoint we need to print
+static bool printer_alt_has_bulk_out(const usb_intf_desc_t *intf_desc, const usb_config_desc_t *config_desc) {
+    int ep_offset = 0;
+    for (int ep = 0; ep < intf_desc->bNumEndpoints; ep++) {
+        const usb_ep_desc_t *ep_desc = usb_parse_endpoint_descriptor_by_index(
+            intf_desc, ep, config_desc->wTotalLength, &ep_offset);
+        if (ep_desc != NULL
+            && (ep_desc->bmAttributes & USB_BM_ATTRIBUTES_XFERTYPE_MASK) == USB_BM_ATTRIBUTES_XFER_BULK
+            && !(ep_desc->bEndpointAddress & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Fills the capability of one printer interface from its descriptors
+// Returns false if the interface has no bulk OUT endpoint
+static bool parse_printer_interface(const usb_intf_desc_t *intf_desc, const usb_config_desc_t *config_desc,
+                                    const usb_device_desc_t *dev_desc, printer_intf_cap_t *cap) {
+    memset(cap, 0, sizeof(printer_intf_cap_t));
+    cap->interface_number = intf_desc->bInterfaceNumber;
+    cap->alternate_setting = intf_desc->bAlternateSetting;
+    cap->protocol = intf_desc->bInterfaceProtocol;
+    cap->bulk_out_ep = 0xFF;
+    cap->bulk_in_ep = 0xFF;
+
+    // Parse endpoints
+    int ep_offset = 0;
+    for (int ep = 0; ep < intf_desc->bNumEndpoints; ep++) {
+        const usb_ep_desc_t *ep_desc = usb_parse_endpoint_descriptor_by_index(
+            intf_desc, ep, config_desc->wTotalLength, &ep_offset);
+        if (ep_desc == NULL) {
+            ESP_LOGW(TAG, "Failed to parse endpoint %d", ep);
+            continue;
+        }
+
+        // Check if it's a bulk endpoint
+        if ((ep_desc->bmAttributes & USB_BM_ATTRIBUTES_XFERTYPE_MASK) == USB_BM_ATTRIBUTES_XFER_BULK) {
+            if (ep_desc->bEndpointAddress & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK) {
+                // Bulk IN endpoint (for status)
+                cap->bulk_in_ep = ep_desc->bEndpointAddress;
+                cap->bulk_in_mps = USB_EP_DESC_GET_MPS(ep_desc);
+                ESP_LOGI(TAG, "Found bulk IN endpoint: 0x%02x", cap->bulk_in_ep);
+            } else {
+                // Bulk OUT endpoint (for print data)
+                cap->bulk_out_ep = ep_desc->bEndpointAddress;
+                cap->bulk_out_mps = USB_EP_DESC_GET_MPS(ep_desc);
+                ESP_LOGI(TAG, "Found bulk OUT endpoint: 0x%02x", cap->bulk_out_ep);
+            }
+        }
+    }
+
+    // Verify we found the required OUT endpoint
+    if (cap->bulk_out_ep == 0xFF) {
+        ESP_LOGE(TAG, "No bulk OUT endpoint found for printer interface %d", cap->interface_number);
         return false;
     }
 
-    ESP_LOGI(TAG, "Checking device for printer interfaces...");
+    // Apply per-model quirks
+    cap->transfer_size = PRINTER_TRANSFER_SIZE;
+    const printer_quirk_t *quirk = printer_quirks_lookup(dev_desc->idVendor, dev_desc->idProduct);
+    if (quirk != NULL) {
+        cap->quirks = quirk->flags;
+        if (quirk->max_transfer != 0 && quirk->max_transfer < cap->transfer_size) {
+            cap->transfer_size = quirk->max_transfer;
+        }
+        ESP_LOGI(TAG, "Quirks for %04x:%04x: flags 0x%02x, max transfer %d", dev_desc->idVendor,
+                 dev_desc->idProduct, cap->quirks, cap->transfer_size);
+    }
+    if (cap->bulk_in_ep == 0xFF || cap->protocol == USB_PRINTER_PROTOCOL_1284) {
+        // Nothing to drain, or DOT4 reads the backchannel itself
+        cap->quirks &= ~PRINTER_QUIRK_DRAIN_BACKCHANNEL;
+    }
+    return true;
+}
 
-    // Get config descriptor
+// Walks the config descriptor and fills in the printer capabilities of the device
+// Returns true if at least one printer interface was found
+static bool parse_printer_capabilities(usb_device_handle_t dev_hdl, printer_cap_t *cap) {
+    // Get device and config descriptor
+    const usb_device_desc_t *dev_desc;
     const usb_config_desc_t *config_desc;
-    esp_err_t ret = usb_host_get_active_config_descriptor(dev_hdl, &config_desc);
+    esp_err_t ret = usb_host_get_device_descriptor(dev_hdl, &dev_desc);
+    if (ret == ESP_OK) {
+        ret = usb_host_get_active_config_descriptor(dev_hdl, &config_desc);
+    }
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to get config descriptor: %s", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "Failed to get descriptors: %s", esp_err_to_name(ret));
         return false;
     }
 
-    uint8_t is_printer = false;
+    bool is_printer = false;
     int offset = 0;
     const usb_intf_desc_t *intf_desc = NULL;
 
-    // Go through all interfaces (TODO: Handle more than 1 printer interfaces)
+    // Go through all interfaces, every printer interface gets its own record
     for (int i = 0; i < config_desc->bNumInterfaces; i++) {
-        intf_desc = usb_parse_interface_descriptor(config_desc, i, 0, &offset);
-        if (intf_desc == NULL) {
-            ESP_LOGW(TAG, "Failed to parse interface %d", i);
-            continue;
-        }
+        // Printers often expose their bidirectional or 1284.4 mode only on a non-zero
+        // alternate setting, so walk all of them and keep the best printer mode
+        const usb_intf_desc_t *best_desc = NULL;
+        int best_rank = 0;
+        for (int alt = 0; alt < PRINTER_MAX_ALT_SETTINGS; alt++) {
+            intf_desc = usb_parse_interface_descriptor(config_desc, i, alt, &offset);
+            if (intf_desc == NULL) {
+                if (alt == 0) {
+                    ESP_LOGW(TAG, "Failed to parse interface %d", i);
+                }
+                break;
+            }
 
-        ESP_LOGI(TAG, "Interface %d: Class=0x%02x, SubClass=0x%02x, Protocol=0x%02x",
-                 i, intf_desc->bInterfaceClass, intf_desc->bInterfaceSubClass, intf_desc->bInterfaceProtocol);
+            ESP_LOGI(TAG, "Interface %d alt %d: Class=0x%02x, SubClass=0x%02x, Protocol=0x%02x",
+                     i, alt, intf_desc->bInterfaceClass, intf_desc->bInterfaceSubClass, intf_desc->bInterfaceProtocol);
+
+            if (intf_desc->bInterfaceClass != USB_CLASS_PRINTER) {
+                continue;
+            }
+            int rank = printer_protocol_rank(intf_desc->bInterfaceProtocol);
+            if (rank > best_rank && printer_alt_has_bulk_out(intf_desc, config_desc)) {
+                best_desc = intf_desc;
+                best_rank = rank;
+            }
+        }
 
         // Check if interface is a printer
-        if (intf_desc->bInterfaceClass == USB_CLASS_PRINTER) {
-            ESP_LOGI(TAG, "*** This is a PRINTER device! Interface %d ***", i);
+        if (best_desc != NULL) {
+            intf_desc = best_desc;
+            ESP_LOGI(TAG, "*** This is a PRINTER device! Interface %d, alt %d ***", i, intf_desc->bAlternateSetting);
             printf("Found Printer Interface!\n");
             printf("  Interface Class: 0x%02x (Printer)\n", intf_desc->bInterfaceClass);
             printf("  Interface SubClass: 0x%02x\n", intf_desc->bInterfaceSubClass);
@@ -89,171 +309,1376 @@ bool check_device_for_printer_interfaces(usb_device_handle_t dev_hdl, usb_host_c
             // Handle bi-directional communication (TODO)
             if (intf_desc->bInterfaceProtocol == USB_PRINTER_PROTOCOL_BI) {
                 ESP_LOGI(TAG, "Printer supports bi-directional communication (TODO)");
+            } else if (intf_desc->bInterfaceProtocol == USB_PRINTER_PROTOCOL_1284) {
+                ESP_LOGI(TAG, "Printer uses IEEE 1284.4, print data goes over DOT4");
+            } else if (intf_desc->bInterfaceProtocol == USB_PRINTER_PROTOCOL_IPP_USB) {
+                // IPP-USB interfaces carry HTTP, raw print data must not be sent to them
+                ESP_LOGI(TAG, "Printer supports IPP over USB, interface goes to the IPP-USB transport");
+                cap->has_ipp_usb = true;
+                continue;
             }
 
-            // Save the printer device's details
-            save_printer_endpoint_details(dev_hdl, client_hdl, i, intf_desc, config_desc);
-
-            if (saved_printer.bulk_out_ep != 0xFF) {
-                ESP_LOGI(TAG, "Printer saved successfully and ready for use");
+            if (cap->num_interfaces == PRINTER_MAX_COUNT) {
+                ESP_LOGW(TAG, "Too many printer interfaces, ignoring interface %d", i);
+                continue;
+            }
+            if (parse_printer_interface(intf_desc, config_desc, dev_desc, &cap->intf[cap->num_interfaces])) {
+                cap->num_interfaces++;
             }
         } else {
             ESP_LOGI(TAG, "This is NOT a printer device. Ignoring...");
         }
     }
 
+    if (!is_printer && dev_desc->bNumConfigurations > 1) {
+        // Another configuration may have it, the quirks table can pick that one
+        ESP_LOGW(TAG, "No printer interface in configuration %d of %d", config_desc->bConfigurationValue,
+                 dev_desc->bNumConfigurations);
+    } else if (!is_printer) {
+        // Not worth enumerating again
+        printer_cache_mark_not_printer(dev_desc->idVendor, dev_desc->idProduct, dev_desc->bcdDevice);
+    }
     return is_printer;
 }
 
-// Helper function that saves a printer's details to our struct
-static void save_printer_endpoint_details(usb_device_handle_t dev_hdl, usb_host_client_handle_t client_hdl,
-                                            uint8_t interface_num, const usb_intf_desc_t *intf_desc,
-                                            const usb_config_desc_t *config_desc) {
+// Builds a printer ID that survives unplugging: VID/PID plus the serial number, or the
+// hub port path for printers without one. Same-model printers without a serial number
+// are told apart by where they are plugged in.
+static void printer_make_id(usb_device_handle_t dev_hdl, const printer_cache_key_t *key, char *id) {
+    int len = snprintf(id, PRINTER_ID_LEN, "%04x-%04x-", key->vid, key->pid);
+    if (key->serial[0] != '\0') {
+        snprintf(&id[len], PRINTER_ID_LEN - len, "%s", key->serial);
+        return;
+    }
+
+    // Port numbers from the root port down
+    uint8_t ports[8];
+    int depth = 0;
+    usb_device_handle_t hdl = dev_hdl;
+    while (hdl != NULL && depth < (int)sizeof(ports)) {
+        usb_device_info_t dev_info;
+        if (usb_host_device_info(hdl, &dev_info) != ESP_OK) {
+            break;
+        }
+        ports[depth++] = dev_info.parent.port_num;
+        hdl = dev_info.parent.dev_hdl;
+    }
+    len += snprintf(&id[len], PRINTER_ID_LEN - len, "port");
+    while (depth > 0 && len < PRINTER_ID_LEN) {
+        len += snprintf(&id[len], PRINTER_ID_LEN - len, "-%d", ports[--depth]);
+    }
+}
+
+void printer_handler_init(void) {
+    registry_lock = xSemaphoreCreateMutex();
+    assert(registry_lock != NULL);
+}
+
+// Function that checks whether a device was seen before as a printer
+bool printer_handler_is_known(usb_device_handle_t dev_hdl) {
+    printer_cache_key_t key;
+    return printer_cache_key_from_device(dev_hdl, &key) == ESP_OK && printer_cache_contains(&key);
+}
+
+// Takes a free registry entry for a device, NULL if the registry is full
+// The ID stays empty until the printer is set up, lookups by ID and the printer list skip
+// the entry meanwhile.
+static printer_entry_t *printer_entry_reserve(usb_device_handle_t dev_hdl, usb_host_client_handle_t client_hdl,
+                                              uint16_t vid, uint16_t pid) {
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    printer_entry_t *entry = NULL;
+    for (int i = 0; i < PRINTER_MAX_COUNT && entry == NULL; i++) {
+        if (!registry[i].in_use) {
+            entry = &registry[i];
+        }
+    }
+    if (entry != NULL) {
+        memset(entry, 0, sizeof(printer_entry_t));
+        entry->in_use = true;
+        entry->dev_hdl = dev_hdl;
+        entry->client_hdl = client_hdl;
+        entry->vid = vid;
+        entry->pid = pid;
+    }
+    xSemaphoreGive(registry_lock);
+    return entry;
+}
+
+// Function that checks whether a USB device has printer interfaces
+// Returns true if at least one printer interface was found
+bool check_device_for_printer_interfaces(usb_device_handle_t dev_hdl, usb_host_client_handle_t client_hdl,
+                                         int64_t attach_time_us) {
+    if (dev_hdl == NULL) {
+        ESP_LOGI(TAG, "Device handle is NULL");
+        return false;
+    }
+    if (client_hdl == NULL) {
+        ESP_LOGI(TAG, "Device handle is NULL");
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Checking device for printer interfaces...");
+
+    // Known printers skip the descriptor walk
+    printer_cap_t cap = {0};
+    bool have_key = printer_cache_key_from_device(dev_hdl, &cap.key) == ESP_OK;
+    if (have_key && printer_cache_lookup(&cap.key, &cap)) {
+        ESP_LOGI(TAG, "Known printer %04x:%04x, using cached capabilities", cap.key.vid, cap.key.pid);
+        if (cap.device_id[0] != '\0') {
+            ESP_LOGI(TAG, "Device ID: %s", cap.device_id);
+        }
+    } else {
+        if (!parse_printer_capabilities(dev_hdl, &cap)) {
+            return false;
+        }
+        if (have_key) {
+            printer_cache_store(&cap);
+        }
+    }
+
+    // Reserve the registry entry before anything is started, so a full registry leaves
+    // the device alone
+    printer_entry_t *entry = printer_entry_reserve(dev_hdl, client_hdl, cap.key.vid, cap.key.pid);
+    if (entry == NULL) {
+        ESP_LOGE(TAG, "Printer registry full (max %d), ignoring %04x:%04x", PRINTER_MAX_COUNT,
+                 cap.key.vid, cap.key.pid);
+        return false;
+    }
+
+    for (int i = 0; i < cap.num_interfaces; i++) {
+        if (cap.intf[i].quirks & PRINTER_QUIRK_NEEDS_FIRMWARE) {
+            ESP_LOGW(TAG, "Printer needs a firmware upload before it prints, which is not supported");
+        }
+        // Save the printer device's details
+        if (save_printer_endpoint_details(dev_hdl, client_hdl, &cap, &cap.intf[i], attach_time_us) != NULL) {
+            ESP_LOGI(TAG, "Printer saved successfully and ready for use, %" PRId64 " us after attach",
+                     esp_timer_get_time() - attach_time_us);
+        }
+    }
+
+    ipp_usb_t *ipp = NULL;
+    if (cap.has_ipp_usb) {
+        esp_err_t ret = ipp_usb_open(dev_hdl, client_hdl, &ipp);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start IPP-USB transport: %s", esp_err_to_name(ret));
+        }
+    }
+
+    // Publish the printer under its stable ID
+    // Whatever was started is torn down by printer_handler_release_device() through the entry
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    entry->ipp = ipp;
+    printer_make_id(dev_hdl, &cap.key, entry->id);
+    ESP_LOGI(TAG, "Printer registered as %s", entry->id);
+    port_recovery_note_attach();
+    printer_resume_parked_jobs(entry, cap.key.serial[0] == '\0' ? cap.device_id : NULL);
+    xSemaphoreGive(registry_lock);
+
+    return true;
+}
+
+// Parked jobs whose printer never came back are failed, called with registry_lock held
+// The callbacks run later from printer_parked_jobs_finish(), they may submit new jobs
+static int printer_parked_jobs_expire(print_job_t *expired, int max_count) {
+    int count = 0;
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < PRINTER_PARKED_MAX && count < max_count; i++) {
+        if (parked_jobs[i].in_use && now - parked_jobs[i].park_time_us > PRINTER_PARK_TIMEOUT_US) {
+            ESP_LOGW(TAG, "Dropping parked job of %s, printer did not come back", parked_jobs[i].printer_id);
+            expired[count++] = parked_jobs[i].job;
+            parked_jobs[i].in_use = false;
+        }
+    }
+    return count;
+}
+
+static void printer_parked_jobs_finish(const print_job_t *jobs, int count, esp_err_t result) {
+    for (int i = 0; i < count; i++) {
+        if (jobs[i].done != NULL) {
+            jobs[i].done(jobs[i].done_arg, result);
+        }
+    }
+}
+
+// Requeues the parked jobs of a printer that just came back, called with registry_lock held
+// Printers are matched by ID, or by Device ID (device_id != NULL) when they have no serial number.
+static void printer_resume_parked_jobs(printer_entry_t *entry, const char *device_id) {
+    printer_device_t *printer = NULL;
+    for (int i = 0; i < PRINTER_MAX_COUNT && printer == NULL; i++) {
+        if (printers[i].in_use && printers[i].dev_hdl == entry->dev_hdl) {
+            printer = &printers[i];
+        }
+    }
+    if (printer == NULL) {
+        return;
+    }
+
+    // Oldest first, so jobs keep their order
+    while (1) {
+        parked_job_t *parked = NULL;
+        for (int i = 0; i < PRINTER_PARKED_MAX; i++) {
+            parked_job_t *p = &parked_jobs[i];
+            bool match = p->in_use && (strcmp(p->printer_id, entry->id) == 0
+                         || (device_id != NULL && device_id[0] != '\0' && p->vid == entry->vid
+                             && p->pid == entry->pid && strcmp(p->device_id, device_id) == 0));
+            if (match && (parked == NULL || p->park_time_us < parked->park_time_us)) {
+                parked = p;
+            }
+        }
+        if (parked == NULL || printer_queue_job(printer, &parked->job) != ESP_OK) {
+            return;
+        }
+        ESP_LOGI(TAG, "Resuming parked job on %s at byte %zu of %zu", entry->id,
+                 parked->job.offset, parked->job.size);
+        parked->in_use = false;
+    }
+}
+
+// Keeps a job of a printer that is going away, fails it if there is no room
+static void printer_park_job(printer_device_t *printer, const print_job_t *job) {
+    printer_cap_t *cap = malloc(sizeof(printer_cap_t));
+    bool have_cap = cap != NULL && printer_cache_lookup(&printer->cache_key, cap);
+    print_job_t expired[PRINTER_PARKED_MAX];
+    bool parked = false;
+
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    int num_expired = printer_parked_jobs_expire(expired, PRINTER_PARKED_MAX);
+    printer_entry_t *entry = printer_entry_get(printer->dev_hdl);
+    for (int i = 0; i < PRINTER_PARKED_MAX && entry != NULL && !parked; i++) {
+        parked_job_t *p = &parked_jobs[i];
+        if (p->in_use) {
+            continue;
+        }
+        p->in_use = true;
+        memcpy(p->printer_id, entry->id, sizeof(p->printer_id));
+        p->vid = entry->vid;
+        p->pid = entry->pid;
+        p->device_id[0] = '\0';
+        if (have_cap) {
+            memcpy(p->device_id, cap->device_id, sizeof(p->device_id));
+        }
+        p->job = *job;
+        p->park_time_us = esp_timer_get_time();
+        parked = true;
+        ESP_LOGI(TAG, "Parked job of %s at byte %zu of %zu", entry->id, job->offset, job->size);
+    }
+    xSemaphoreGive(registry_lock);
+    free(cap);
+
+    printer_parked_jobs_finish(expired, num_expired, ESP_ERR_TIMEOUT);
+    if (!parked) {
+        ESP_LOGW(TAG, "No room to park the job, dropping it");
+        printer_parked_jobs_finish(job, 1, ESP_ERR_INVALID_STATE);
+    }
+}
+
+// Where an interrupted job can safely restart. Printers with PRINTER_QUIRK_RESUME_PAGE
+// pick up after the last form feed that made it out, everything else starts over.
+static size_t printer_resume_offset(const printer_device_t *printer, const print_job_t *job, size_t acked) {
+    if (!(printer->quirks & PRINTER_QUIRK_RESUME_PAGE)) {
+        return 0;
+    }
+    while (acked > job->offset && job->data[acked - 1] != PRINTER_FORM_FEED) {
+        acked--;
+    }
+    return acked > job->offset ? acked : job->offset;
+}
+
+// Called with registry_lock held
+static printer_entry_t *printer_entry_get(usb_device_handle_t dev_hdl) {
+    for (int i = 0; i < PRINTER_MAX_COUNT; i++) {
+        if (registry[i].in_use && registry[i].dev_hdl == dev_hdl) {
+            return &registry[i];
+        }
+    }
+    return NULL;
+}
+
+// Finds a free printer record, or the one already registered for this interface
+static printer_device_t *printer_record_get(usb_device_handle_t dev_hdl, uint8_t interface_num) {
+    printer_device_t *free_record = NULL;
+    for (int i = 0; i < PRINTER_MAX_COUNT; i++) {
+        if (printers[i].in_use) {
+            if (printers[i].dev_hdl == dev_hdl && printers[i].interface_number == interface_num) {
+                return &printers[i];
+            }
+        } else if (free_record == NULL) {
+            free_record = &printers[i];
+        }
+    }
+    return free_record;
+}
+
+// Frees the transfer pool and job queue of a printer record and marks it unused
+static void printer_record_free(printer_device_t *printer) {
+    for (int i = 0; i < PRINTER_TRANSFER_POOL_SIZE; i++) {
+        if (printer->transfer_pool[i] != NULL) {
+            usb_host_transfer_free(printer->transfer_pool[i]);
+        }
+    }
+    if (printer->drain_transfer != NULL) {
+        usb_host_transfer_free(printer->drain_transfer);
+    }
+    if (printer->job_queue != NULL) {
+        vQueueDelete(printer->job_queue);
+    }
+    if (printer->done_transfers != NULL) {
+        vQueueDelete(printer->done_transfers);
+    }
+    memset(printer, 0, sizeof(printer_device_t));
+}
+
+// Helper function that saves a printer's details to a free printer record
+// Returns the record, or NULL if the interface can't be used
+static printer_device_t *save_printer_endpoint_details(usb_device_handle_t dev_hdl, usb_host_client_handle_t client_hdl,
+                                                       const printer_cap_t *cap, const printer_intf_cap_t *intf_cap,
+                                                       int64_t attach_time_us) {
+    printer_device_t *record = printer_record_get(dev_hdl, intf_cap->interface_number);
+    if (record == NULL) {
+        ESP_LOGE(TAG, "No free printer record for interface %d (max %d)", intf_cap->interface_number, PRINTER_MAX_COUNT);
+        return NULL;
+    }
+    if (record->in_use) {
+        return record;
+    }
+
     printer_device_t printer = {0};
 
     // Save basic device info
     printer.dev_hdl = dev_hdl;
     printer.client_hdl = client_hdl;
-    printer.interface_number = interface_num;
-    printer.bulk_out_ep = 0xFF;
-    printer.bulk_in_ep = 0xFF;
+    printer.interface_number = intf_cap->interface_number;
+    printer.alternate_setting = intf_cap->alternate_setting;
+    printer.protocol = intf_cap->protocol;
+    printer.bulk_out_ep = intf_cap->bulk_out_ep;
+    printer.bulk_in_ep = intf_cap->bulk_in_ep;
+    printer.bulk_out_mps = intf_cap->bulk_out_mps;
+    printer.bulk_in_mps = intf_cap->bulk_in_mps;
+    printer.quirks = intf_cap->quirks;
+    printer.transfer_size = intf_cap->transfer_size;
+    printer.cache_key = cap->key;
+    printer.attach_time_us = attach_time_us;
+    // One Device ID per device is enough
+    printer.fetch_device_id = intf_cap == &cap->intf[0] && cap->device_id[0] == '\0';
 
-    // Parse endpoints
-    int ep_offset = 0;
-    for (int ep = 0; ep < intf_desc->bNumEndpoints; ep++) {
-        const usb_ep_desc_t *ep_desc = usb_parse_endpoint_descriptor_by_index(
-            intf_desc, ep, config_desc->wTotalLength, &ep_offset);
-        if (ep_desc == NULL) {
-            ESP_LOGW(TAG, "Failed to parse endpoint %d", ep);
-            continue;
+    // Save to the printer record, then give it its own job queue, transfer pool and worker
+    *record = printer;
+    record->in_use = true;
+
+    record->job_queue = xQueueCreate(PRINTER_JOB_QUEUE_LEN, sizeof(print_job_t));
+    record->done_transfers = xQueueCreate(PRINTER_TRANSFER_POOL_SIZE, sizeof(usb_transfer_t *));
+    if (record->job_queue == NULL || record->done_transfers == NULL) {
+        ESP_LOGE(TAG, "Failed to create queues");
+        printer_record_free(record);
+        return NULL;
+    }
+    for (int i = 0; i < PRINTER_TRANSFER_POOL_SIZE; i++) {
+        esp_err_t ret = usb_host_transfer_alloc(record->transfer_size, 0, &record->transfer_pool[i]);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to allocate transfer: %s", esp_err_to_name(ret));
+            printer_record_free(record);
+            return NULL;
         }
+        usb_transfer_t *transfer = record->transfer_pool[i];
+        transfer->device_handle = dev_hdl;
+        transfer->bEndpointAddress = record->bulk_out_ep;
+        transfer->callback = print_transfer_callback;
+        transfer->context = record;
+    }
 
-        // Check if it's a bulk endpoint
-        if ((ep_desc->bmAttributes & USB_BM_ATTRIBUTES_XFERTYPE_MASK) == USB_BM_ATTRIBUTES_XFER_BULK) {
-            if (ep_desc->bEndpointAddress & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK) {
-                // Bulk IN endpoint (for status)
-                printer.bulk_in_ep = ep_desc->bEndpointAddress;
-                ESP_LOGI(TAG, "Found bulk IN endpoint: 0x%02x", printer.bulk_in_ep);
+    if (record->quirks & PRINTER_QUIRK_DRAIN_BACKCHANNEL) {
+        if (usb_host_transfer_alloc(record->bulk_in_mps, 0, &record->drain_transfer) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to allocate drain transfer");
+            printer_record_free(record);
+            return NULL;
+        }
+        record->drain_transfer->device_handle = dev_hdl;
+        record->drain_transfer->bEndpointAddress = record->bulk_in_ep;
+        record->drain_transfer->num_bytes = record->bulk_in_mps;
+        record->drain_transfer->callback = drain_transfer_callback;
+        record->drain_transfer->context = record;
+    }
+
+    record->worker_running = true;
+    if (xTaskCreatePinnedToCore(printer_worker_task, "printer", PRINTER_WORKER_STACK, record,
+                                PRINTER_WORKER_PRIORITY, &record->worker, 0) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to create printer worker");
+        printer_record_free(record);
+        return NULL;
+    }
+
+    ESP_LOGI(TAG, "Printer saved successfully:");
+    ESP_LOGI(TAG, "  Interface: %d (alt %d)", record->interface_number, record->alternate_setting);
+    ESP_LOGI(TAG, "  Bulk OUT: 0x%02x", record->bulk_out_ep);
+    if (record->bulk_in_ep != 0xFF) {
+        ESP_LOGI(TAG, "  Bulk IN:  0x%02x", record->bulk_in_ep);
+    }
+    return record;
+}
+
+// Completion callback for transfers that a task waits on synchronously
+// The semaphore to give is passed in the transfer's context
+static void sync_transfer_callback(usb_transfer_t *transfer) {
+    xSemaphoreGive((SemaphoreHandle_t)transfer->context);
+}
+
+// Runs a control transfer with a data stage of setup->wLength bytes and waits for it
+// On success the completed transfer is returned, the caller reads the data and frees it
+static esp_err_t printer_control_sync(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                      const usb_setup_packet_t *setup, usb_transfer_t **transfer_ret) {
+    SemaphoreHandle_t done_sem = xSemaphoreCreateBinary();
+    if (done_sem == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    usb_transfer_t *transfer = NULL;
+    esp_err_t ret = usb_host_transfer_alloc(USB_SETUP_PACKET_SIZE + setup->wLength, 0, &transfer);
+    if (ret != ESP_OK) {
+        vSemaphoreDelete(done_sem);
+        return ret;
+    }
+
+    memcpy(transfer->data_buffer, setup, USB_SETUP_PACKET_SIZE);
+    transfer->num_bytes = USB_SETUP_PACKET_SIZE + setup->wLength;
+    transfer->device_handle = dev_hdl;
+    transfer->bEndpointAddress = 0;
+    transfer->callback = sync_transfer_callback;
+    transfer->context = done_sem;
+
+    ret = usb_host_transfer_submit_control(client_hdl, transfer);
+    if (ret == ESP_OK) {
+        if (xSemaphoreTake(done_sem, pdMS_TO_TICKS(5000)) != pdTRUE) {
+            // The host library still owns the transfer, so it can't be freed here
+            ESP_LOGE(TAG, "Control transfer 0x%02x timeout", setup->bRequest);
+            return ESP_ERR_TIMEOUT;
+        }
+        if (transfer->status != USB_TRANSFER_STATUS_COMPLETED) {
+            ESP_LOGE(TAG, "Control transfer 0x%02x failed with status: %d", setup->bRequest, transfer->status);
+            ret = ESP_FAIL;
+        }
+    }
+    vSemaphoreDelete(done_sem);
+
+    if (ret != ESP_OK) {
+        usb_host_transfer_free(transfer);
+        return ret;
+    }
+    *transfer_ret = transfer;
+    return ESP_OK;
+}
+
+// Sends a standard SET_INTERFACE request to select an alternate setting
+static esp_err_t printer_set_interface(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                       uint8_t interface_num, uint8_t alt_setting) {
+    usb_setup_packet_t setup;
+    USB_SETUP_PACKET_INIT_SET_INTERFACE(&setup, interface_num, alt_setting);
+    usb_transfer_t *transfer;
+    esp_err_t ret = printer_control_sync(client_hdl, dev_hdl, &setup, &transfer);
+    if (ret == ESP_OK) {
+        usb_host_transfer_free(transfer);
+    }
+    return ret;
+}
+
+// Reads the IEEE 1284 Device ID with the printer class GET_DEVICE_ID request
+// The reply starts with its length as a big-endian 16 bit value, which includes those two bytes
+static esp_err_t printer_get_device_id(printer_device_t *printer, char *device_id, size_t size) {
+    usb_setup_packet_t setup = {
+        .bmRequestType = USB_BM_REQUEST_TYPE_DIR_IN | USB_BM_REQUEST_TYPE_TYPE_CLASS | USB_BM_REQUEST_TYPE_RECIP_INTERFACE,
+        .bRequest = USB_PRINTER_REQ_GET_DEVICE_ID,
+        .wValue = 0,
+        .wIndex = (printer->interface_number << 8) | printer->alternate_setting,
+        .wLength = size + 1,
+    };
+    usb_transfer_t *transfer;
+    esp_err_t ret = printer_control_sync(printer->client_hdl, printer->dev_hdl, &setup, &transfer);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    const uint8_t *data = transfer->data_buffer + USB_SETUP_PACKET_SIZE;
+    int actual = transfer->actual_num_bytes - USB_SETUP_PACKET_SIZE;
+    int len = actual >= 2 ? ((data[0] << 8) | data[1]) - 2 : 0;
+    if (len > actual - 2) {
+        len = actual - 2;
+    }
+    if (len < 0) {
+        len = 0;
+    }
+    if ((size_t)len > size - 1) {
+        len = size - 1;
+    }
+    memcpy(device_id, &data[2], len);
+    device_id[len] = '\0';
+    usb_host_transfer_free(transfer);
+    return len > 0 ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+}
+
+// Reads the printer class port status byte (PRINTER_PORT_STATUS_*)
+static esp_err_t printer_get_port_status(printer_device_t *printer, uint8_t *status) {
+    usb_setup_packet_t setup = {
+        .bmRequestType = USB_BM_REQUEST_TYPE_DIR_IN | USB_BM_REQUEST_TYPE_TYPE_CLASS | USB_BM_REQUEST_TYPE_RECIP_INTERFACE,
+        .bRequest = USB_PRINTER_REQ_GET_PORT_STATUS,
+        .wValue = 0,
+        .wIndex = printer->interface_number,
+        .wLength = 1,
+    };
+    usb_transfer_t *transfer;
+    esp_err_t ret = printer_control_sync(printer->client_hdl, printer->dev_hdl, &setup, &transfer);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = ESP_ERR_INVALID_RESPONSE;
+    if (transfer->actual_num_bytes > USB_SETUP_PACKET_SIZE) {
+        *status = transfer->data_buffer[USB_SETUP_PACKET_SIZE];
+        ret = ESP_OK;
+    }
+    usb_host_transfer_free(transfer);
+    return ret;
+}
+
+// Called when a job made no progress for PRINTER_STALL_TIMEOUT. A printer that still answers
+// control requests is busy or needs attention, one that doesn't gets its port power cycled.
+static void printer_check_stalled(printer_device_t *printer) {
+    uint8_t status;
+    esp_err_t ret = printer_get_port_status(printer, &status);
+    if (ret == ESP_ERR_TIMEOUT) {
+        port_recovery_report_hung(printer->dev_hdl);
+    } else if (ret == ESP_OK) {
+        ESP_LOGW(TAG, "Interface %d stalled, port status 0x%02x%s%s", printer->interface_number, status,
+                 (status & PRINTER_PORT_STATUS_PAPER_EMPTY) ? ", paper empty" : "",
+                 (status & PRINTER_PORT_STATUS_NOT_ERROR) ? "" : ", error");
+    }
+}
+
+// Function that claims an interface and switches it to the given alternate setting
+esp_err_t printer_claim_interface(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                  uint8_t interface_num, uint8_t alt_setting) {
+    esp_err_t ret = usb_host_interface_claim(client_hdl, dev_hdl, interface_num, alt_setting);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Alt 0 is already active after SET_CONFIGURATION, and some printers stall a redundant SET_INTERFACE
+    if (alt_setting != 0) {
+        ret = printer_set_interface(client_hdl, dev_hdl, interface_num, alt_setting);
+        if (ret != ESP_OK) {
+            usb_host_interface_release(client_hdl, dev_hdl, interface_num);
+            return ret;
+        }
+        ESP_LOGI(TAG, "Interface %d: selected alternate setting %d", interface_num, alt_setting);
+    }
+    return ESP_OK;
+}
+
+// Claims the printer interface and switches it to the selected alternate setting
+static esp_err_t claim_printer_interface(printer_device_t *printer) {
+    if (printer->claimed) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = printer_claim_interface(printer->client_hdl, printer->dev_hdl,
+                                            printer->interface_number, printer->alternate_setting);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    printer->claimed = true;
+
+    // Printers with this quirk stall their OUT endpoint once unread status piles up
+    if (printer->drain_transfer != NULL && !printer->closing) {
+        printer->draining = true;
+        ret = usb_host_transfer_submit(printer->drain_transfer);
+        if (ret != ESP_OK) {
+            printer->draining = false;
+            ESP_LOGW(TAG, "Failed to start backchannel drain: %s", esp_err_to_name(ret));
+        }
+    }
+    return ESP_OK;
+}
+
+// Reports attach-to-first-byte latency once per attach
+static void printer_note_first_byte(printer_device_t *printer) {
+    if (printer->attach_time_us != 0) {
+        ESP_LOGI(TAG, "Interface %d: first byte accepted %" PRId64 " us after attach",
+                 printer->interface_number, esp_timer_get_time() - printer->attach_time_us);
+        printer->attach_time_us = 0;
+    }
+}
+
+// Streams a job through the transfer pool and waits until every transfer has come back
+// Fills buf with the next chunk of a job, *end is set once the job has no more data
+// Streamed jobs wait up to timeout for data, ESP_ERR_TIMEOUT if none came
+static esp_err_t printer_job_next_chunk(const print_job_t *job, size_t offset, uint8_t *buf, size_t max_len,
+                                        size_t *len, bool *end, TickType_t timeout) {
+    if (job->stream != NULL) {
+        esp_err_t ret = print_stream_read(job->stream, buf, max_len, len, timeout);
+        *end = ret == ESP_OK && *len == 0;
+        return ret;
+    }
+    *len = job->size - offset < max_len ? job->size - offset : max_len;
+    memcpy(buf, &job->data[offset], *len);
+    *end = offset + *len == job->size;
+    return ESP_OK;
+}
+
+// acked is set to the offset up to which the printer took the data, transfers on
+// one endpoint complete in order
+static esp_err_t send_print_job_raw(printer_device_t *printer, const print_job_t *job, size_t *acked) {
+    usb_transfer_t *idle[PRINTER_TRANSFER_POOL_SIZE];
+    int num_idle = PRINTER_TRANSFER_POOL_SIZE;
+    memcpy(idle, printer->transfer_pool, sizeof(idle));
+    int in_flight = 0;
+    size_t submitted = job->offset;
+    size_t completed = 0;
+    size_t last_chunk = 0;
+    bool end = job->stream == NULL && submitted == job->size;
+    bool failed = false;
+    // Small network writes are packed into full transfers, which are whole packets so none
+    // ends early. The transfer being filled goes out when full, at the end of the job or
+    // PRINTER_COALESCE_US after its first byte, whichever comes first.
+    size_t fill_size = printer->transfer_size;
+    if (fill_size >= printer->bulk_out_mps && printer->bulk_out_mps > 0) {
+        fill_size -= fill_size % printer->bulk_out_mps;
+    }
+    usb_transfer_t *fill = NULL;            // Transfer being filled, out of the idle list
+    size_t filled = 0;
+    int64_t fill_start_us = 0;
+    uint32_t num_transfers = 0;
+    uint32_t num_flushed = 0;               // Transfers sent partly filled on the deadline
+
+    while (in_flight > 0 || (!end && !failed)) {
+        if (printer->closing) {
+            failed = true;
+        }
+        TickType_t flush_wait = portMAX_DELAY;
+        if (filled > 0) {
+            int64_t left_us = fill_start_us + PRINTER_COALESCE_US - esp_timer_get_time();
+            flush_wait = left_us > 0 ? pdMS_TO_TICKS((left_us + 999) / 1000) : 0;
+            if (left_us > 0 && flush_wait == 0) {
+                flush_wait = 1;
+            }
+        }
+
+        // Fill an idle transfer with the next chunk of the job
+        if ((fill != NULL || num_idle > 0) && !end && !failed) {
+            if (fill == NULL) {
+                fill = idle[--num_idle];
+            }
+            usb_transfer_t *transfer = fill;
+            size_t chunk;
+            // Streamed data doesn't hold up the completions of transfers already out
+            TickType_t wait = in_flight > 0 ? 0 : PRINTER_STREAM_WAIT;
+            esp_err_t ret = printer_job_next_chunk(job, submitted + filled, transfer->data_buffer + filled,
+                                                   fill_size - filled, &chunk, &end,
+                                                   wait < flush_wait ? wait : flush_wait);
+            if (ret == ESP_ERR_INVALID_STATE) {
+                ESP_LOGE(TAG, "Job source went away");
+                failed = true;
+                continue;
+            }
+            if (chunk > 0 && filled == 0) {
+                fill_start_us = esp_timer_get_time();
+            }
+            filled += chunk;
+            bool due = filled > 0 && esp_timer_get_time() - fill_start_us >= PRINTER_COALESCE_US;
+            if (!end && filled < fill_size && !due) {
+                if (chunk > 0 || in_flight == 0) {
+                    // Keep filling, or nothing to wait for but the job source
+                    continue;
+                }
             } else {
-                // Bulk OUT endpoint (for print data)
-                printer.bulk_out_ep = ep_desc->bEndpointAddress;
-                ESP_LOGI(TAG, "Found bulk OUT endpoint: 0x%02x", printer.bulk_out_ep);
+                // A job ending exactly on a packet boundary needs a ZLP on some printers. A streamed
+                // job only knows it ended after its last chunk went out, so that one gets a ZLP of its own.
+                chunk = filled;
+                size_t final_chunk = chunk > 0 ? chunk : last_chunk;
+                bool zlp = (printer->quirks & PRINTER_QUIRK_ZLP) && end && final_chunk > 0
+                           && final_chunk % printer->bulk_out_mps == 0;
+                if (chunk > 0 || zlp) {
+                    transfer->num_bytes = chunk;
+                    transfer->flags = zlp && chunk > 0 ? USB_TRANSFER_FLAG_ZERO_PACK : 0;
+                    ret = usb_host_transfer_submit(transfer);
+                    if (ret != ESP_OK) {
+                        ESP_LOGE(TAG, "Failed to submit transfer: %s", esp_err_to_name(ret));
+                        failed = true;
+                        continue;
+                    }
+                    fill = NULL;
+                    in_flight++;
+                    submitted += chunk;
+                    last_chunk = chunk;
+                    num_transfers++;
+                    num_flushed += !end && chunk < fill_size ? 1 : 0;
+                    filled = 0;
+                    continue;
+                }
+                if (in_flight == 0) {
+                    continue;
+                }
             }
         }
+
+        // Pool exhausted or no data yet, wait for a transfer to come back, or until the
+        // transfer being filled is due
+        usb_transfer_t *transfer;
+        TickType_t done_wait = flush_wait < PRINTER_STALL_TIMEOUT ? flush_wait : PRINTER_STALL_TIMEOUT;
+        if (xQueueReceive(printer->done_transfers, &transfer, done_wait) != pdTRUE) {
+            if (done_wait == PRINTER_STALL_TIMEOUT) {
+                printer_check_stalled(printer);
+            }
+            continue;
+        }
+        idle[num_idle++] = transfer;
+        in_flight--;
+        if (transfer->status == USB_TRANSFER_STATUS_COMPLETED) {
+            completed += transfer->actual_num_bytes;
+            printer_note_first_byte(printer);
+        } else {
+            if (!printer->closing) {
+                ESP_LOGE(TAG, "Print transfer failed with status: %d", transfer->status);
+            }
+            failed = true;
+        }
     }
 
-    // Verify we found the required OUT endpoint
-    if (printer.bulk_out_ep == 0xFF) {
-        ESP_LOGE(TAG, "No bulk OUT endpoint found for printer interface %d", interface_num);
-        return;
+    *acked = job->offset + completed;
+    if (failed) {
+        ESP_LOGE(TAG, "Print job failed on interface %d after %zu bytes", printer->interface_number, completed);
+        return ESP_FAIL;
     }
+    ESP_LOGI(TAG, "Print job completed! Sent %zu bytes to interface %d in %" PRIu32 " transfers, %" PRIu32
+             " flushed early", completed, printer->interface_number, num_transfers, num_flushed);
+    return ESP_OK;
+}
+
+// Marks the worker's current job as over, exports may take the printer from here
+static void printer_job_finished(printer_device_t *printer) {
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    printer->job_active = false;
+    xSemaphoreGive(registry_lock);
+}
+
+// Takes the next job off the queue, false if there is none
+// Taken under the registry lock so an export never sees a job between queue and worker
+static bool printer_job_take(printer_device_t *printer, print_job_t *job) {
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    printer->job_active = xQueueReceive(printer->job_queue, job, 0) == pdTRUE;
+    xSemaphoreGive(registry_lock);
+    return printer->job_active;
+}
 
-    // Create semaphore for transfer synchronization
-    printer.transfer_done_sem = xSemaphoreCreateBinary();
-    if (printer.transfer_done_sem == NULL) {
-        ESP_LOGE(TAG, "Failed to create transfer semaphore");
+// Ends the worker's current job, acked is how far the printer took it
+static void printer_job_end(printer_device_t *printer, print_job_t *job, esp_err_t ret, size_t acked) {
+    if (ret != ESP_OK && printer->closing && job->stream == NULL) {
+        // Unplugged mid-job, the job continues when the printer comes back
+        job->offset = printer_resume_offset(printer, job, acked);
+        printer_park_job(printer, job);
+        printer_job_finished(printer);
         return;
     }
+    if (job->stream != NULL) {
+        print_stream_set_acked(job->stream, acked);
+    }
+    if (ret != ESP_OK && job->stream != NULL) {
+        // Streamed data is gone once printed, the sender has to try again
+        print_stream_abort(job->stream);
+    }
+    if (job->done != NULL) {
+        job->done(job->done_arg, ret);
+    }
+    printer_job_finished(printer);
+}
 
-    // Save to static array
-    saved_printer = printer;
+// Hands back what is left on the queue of a closing printer and ends its worker
+static void printer_worker_exit(printer_device_t *printer) {
+    // Jobs that never started wait for the printer as well, except streamed ones
+    print_job_t job;
+    while (xQueueReceive(printer->job_queue, &job, 0) == pdTRUE) {
+        if (job.stream == NULL) {
+            printer_park_job(printer, &job);
+            continue;
+        }
+        print_stream_abort(job.stream);
+        if (job.done != NULL) {
+            job.done(job.done_arg, ESP_ERR_INVALID_STATE);
+        }
+    }
 
-    ESP_LOGI(TAG, "Printer saved successfully:");
-    ESP_LOGI(TAG, "  Interface: %d", printer.interface_number);
-    ESP_LOGI(TAG, "  Bulk OUT: 0x%02x", printer.bulk_out_ep);
-    if (printer.bulk_in_ep != 0xFF) {
-        ESP_LOGI(TAG, "  Bulk IN:  0x%02x", printer.bulk_in_ep);
+    usb_device_handle_t dev_hdl = printer->dev_hdl;
+    printer->worker_running = false;
+    class_driver_device_released(dev_hdl);
+    vTaskDelete(NULL);
+}
+
+// Runs the jobs of one printer interface until the device goes away
+static void printer_worker_task(void *arg) {
+    printer_device_t *printer = (printer_device_t *)arg;
+
+    // Claim right away so the printer is ready before the first job arrives
+    esp_err_t ret = claim_printer_interface(printer);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to claim printer interface: %s, retrying with the first job", esp_err_to_name(ret));
+        if (ret == ESP_ERR_TIMEOUT) {
+            port_recovery_report_hung(printer->dev_hdl);
+        }
+    } else if (printer->fetch_device_id) {
+        char device_id[PRINTER_DEVICE_ID_LEN];
+        if (printer_get_device_id(printer, device_id, sizeof(device_id)) == ESP_OK) {
+            ESP_LOGI(TAG, "Device ID: %s", device_id);
+            printer_cache_set_device_id(&printer->cache_key, device_id);
+        }
     }
+
+    while (!printer->closing) {
+        print_job_t job;
+        if (!printer_job_take(printer, &job)) {
+            // Woken by send_print_job() and printer_handler_release_device()
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        ESP_LOGI(TAG, "Starting print job...");
+        ESP_LOGI(TAG, "Printer details:");
+        ESP_LOGI(TAG, "  Interface: %d", printer->interface_number);
+        ESP_LOGI(TAG, "  Bulk OUT EP: 0x%02x", printer->bulk_out_ep);
+        if (job.stream != NULL) {
+            ESP_LOGI(TAG, "  Data size: streamed");
+        } else {
+            ESP_LOGI(TAG, "  Data size: %zu bytes", job.size);
+        }
+
+        // Claim the printer interface
+        size_t acked = job.offset;
+        ret = claim_printer_interface(printer);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to claim printer interface: %s", esp_err_to_name(ret));
+            if (ret == ESP_ERR_TIMEOUT) {
+                port_recovery_report_hung(printer->dev_hdl);
+            }
+        } else if (printer->protocol == USB_PRINTER_PROTOCOL_1284) {
+            // 1284.4 printers only accept data wrapped in DOT4 packets
+            // A DOT4 session can't be picked up halfway, so acked stays put
+            ret = send_print_job_dot4(printer, &job);
+            if (ret == ESP_ERR_TIMEOUT && !printer->closing) {
+                printer_check_stalled(printer);
+            }
+            if (ret == ESP_OK && job.stream != NULL) {
+                // Only a whole session counts, then everything read went out
+                print_stream_stats_t stats;
+                print_stream_get_stats(job.stream, &stats);
+                acked = stats.bytes;
+            }
+        } else {
+            ret = send_print_job_raw(printer, &job, &acked);
+        }
+        printer_job_end(printer, &job, ret, acked);
+    }
+    printer_worker_exit(printer);
 }
 
-// Function that sends a print job to the saved printer
-esp_err_t send_print_job(void) {
-    if (saved_printer.dev_hdl == NULL) {
-        ESP_LOGE(TAG, "No printer device available");
+// Queues a job on one printer interface, called with registry_lock held
+static esp_err_t printer_queue_job(printer_device_t *printer, const print_job_t *job) {
+    if (printer->closing) {
         return ESP_ERR_INVALID_STATE;
     }
-    if (saved_printer.bulk_out_ep == 0xFF) {
-        ESP_LOGE(TAG, "No valid bulk OUT endpoint");
-        return ESP_ERR_INVALID_STATE;
-    }    
-
-    ESP_LOGI(TAG, "Starting print job...");
-    ESP_LOGI(TAG, "Printer details:");
-    ESP_LOGI(TAG, "  Interface: %d", saved_printer.interface_number);
-    ESP_LOGI(TAG, "  Bulk OUT EP: 0x%02x", saved_printer.bulk_out_ep);
-    ESP_LOGI(TAG, "  Data size: %d bytes", test_print_data_size);
-
-    // Claim the printer interface
-    esp_err_t ret = usb_host_interface_claim(saved_printer.client_hdl, 
-                                           saved_printer.dev_hdl, 
-                                           saved_printer.interface_number, 
-                                           0);
+    if (xQueueSend(printer->job_queue, job, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Job queue of interface %d is full", printer->interface_number);
+        return ESP_ERR_NO_MEM;
+    }
+    xTaskNotifyGive(printer->worker);
+    return ESP_OK;
+}
+
+// Function that queues the test page on every printer interface of a device
+esp_err_t send_print_job(usb_device_handle_t dev_hdl) {
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+    print_job_t job = {
+        .data = test_print_data,
+        .size = test_print_data_size,
+    };
+
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    for (int i = 0; i < PRINTER_MAX_COUNT; i++) {
+        printer_device_t *printer = &printers[i];
+        if (printer->in_use && printer->dev_hdl == dev_hdl && printer_queue_job(printer, &job) == ESP_OK) {
+            ret = ESP_OK;
+        }
+    }
+
+    // Printers without a raw printer interface get the page over IPP-USB
+    printer_entry_t *entry = printer_entry_get(dev_hdl);
+    if (ret != ESP_OK && entry != NULL && entry->ipp != NULL) {
+        ret = ipp_usb_queue_job(entry->ipp, test_print_data, test_print_data_size, NULL, NULL);
+    }
+    xSemaphoreGive(registry_lock);
+
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to claim printer interface: %s", esp_err_to_name(ret));
-        return ret;
+        ESP_LOGE(TAG, "No printer device available");
     }
+    return ret;
+}
 
-    ESP_LOGI(TAG, "Successfully claimed printer interface");
+// Queues a job on the printer with the given ID, or the first one
+static esp_err_t printer_submit(const char *printer_id, const print_job_t *job) {
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    bool exported = false;
 
-    // Allocate transfer for sending print data
-    usb_transfer_t *transfer = NULL;
-    ret = usb_host_transfer_alloc(test_print_data_size, 0, &transfer);
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    for (int i = 0; i < PRINTER_MAX_COUNT && ret == ESP_ERR_NOT_FOUND; i++) {
+        printer_entry_t *entry = &registry[i];
+        if (!entry->in_use || (printer_id != NULL ? strcmp(entry->id, printer_id) != 0 : PRINTER_ENTRY_STAND_IN(entry))) {
+            continue;
+        }
+        if (entry->exported) {
+            exported = true;
+            continue;
+        }
+        // Any raw interface of the printer will do, IPP-USB only if there is none
+        for (int p = 0; p < PRINTER_MAX_COUNT; p++) {
+            if (printers[p].in_use && printers[p].dev_hdl == entry->dev_hdl) {
+                ret = printer_queue_job(&printers[p], job);
+                break;
+            }
+        }
+        if (ret == ESP_ERR_NOT_FOUND && entry->ipp != NULL) {
+            ret = job->stream != NULL ? ESP_ERR_NOT_SUPPORTED
+                  : ipp_usb_queue_job(entry->ipp, job->data, job->size, job->done, job->done_arg);
+        }
+    }
+    xSemaphoreGive(registry_lock);
+    return ret == ESP_ERR_NOT_FOUND && exported ? ESP_ERR_INVALID_STATE : ret;
+}
+
+// Function that queues a job on a printer by its stable ID
+esp_err_t printer_handler_submit(const char *printer_id, const uint8_t *data, size_t size,
+                                 printer_job_done_cb_t done, void *done_arg) {
+    print_job_t job = {
+        .data = data,
+        .size = size,
+        .done = done,
+        .done_arg = done_arg,
+    };
+    return printer_submit(printer_id, &job);
+}
+
+// Function that queues a job whose data is still arriving
+esp_err_t printer_handler_submit_stream(const char *printer_id, print_stream_t *stream,
+                                        printer_job_done_cb_t done, void *done_arg) {
+    print_job_t job = {
+        .stream = stream,
+        .done = done,
+        .done_arg = done_arg,
+    };
+    return printer_submit(printer_id, &job);
+}
+
+// Function that lists the attached printers
+int printer_handler_list(printer_info_t *list, int max_count) {
+    int count = 0;
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    for (int i = 0; i < PRINTER_MAX_COUNT && count < max_count; i++) {
+        printer_entry_t *entry = &registry[i];
+        if (!entry->in_use || entry->id[0] == '\0' || PRINTER_ENTRY_STAND_IN(entry)) {
+            continue;
+        }
+        printer_info_t *info = &list[count++];
+        memcpy(info->id, entry->id, sizeof(info->id));
+        info->vid = entry->vid;
+        info->pid = entry->pid;
+        info->ipp_usb = entry->ipp != NULL;
+        info->num_interfaces = 0;
+        for (int p = 0; p < PRINTER_MAX_COUNT; p++) {
+            if (printers[p].in_use && printers[p].dev_hdl == entry->dev_hdl) {
+                info->num_interfaces++;
+            }
+        }
+    }
+    xSemaphoreGive(registry_lock);
+    return count;
+}
+
+// True once the worker has exited and no transfer of the printer is in flight
+static bool printer_idle(const printer_device_t *printer) {
+    return !printer->worker_running && !printer->draining;
+}
+
+// Hands a completed transfer back to the worker
+static void print_transfer_callback(usb_transfer_t *transfer) {
+    printer_device_t *printer = (printer_device_t *)transfer->context;
+    xQueueSend(printer->done_transfers, &transfer, 0);
+}
+
+// Discards backchannel data and reads on until the device goes away
+static void drain_transfer_callback(usb_transfer_t *transfer) {
+    printer_device_t *printer = (printer_device_t *)transfer->context;
+
+    if (!printer->closing && transfer->status == USB_TRANSFER_STATUS_COMPLETED
+        && usb_host_transfer_submit(transfer) == ESP_OK) {
+        return;
+    }
+    printer->draining = false;
+    if (printer->closing && printer_idle(printer)) {
+        class_driver_device_released(printer->dev_hdl);
+    }
+}
+
+// Function that gives short access to a printer's device handle
+esp_err_t printer_handler_with_device(const char *id, void (*fn)(usb_device_handle_t dev_hdl, void *arg), void *arg) {
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    for (int i = 0; i < PRINTER_MAX_COUNT && ret == ESP_ERR_NOT_FOUND; i++) {
+        if (registry[i].in_use && strcmp(registry[i].id, id) == 0) {
+            fn(registry[i].dev_hdl, arg);
+            ret = ESP_OK;
+        }
+    }
+    xSemaphoreGive(registry_lock);
+    return ret;
+}
+
+// Function that hands a printer over to a remote driver
+esp_err_t printer_handler_export_begin(const char *id, printer_export_gone_cb_t gone, void *gone_arg,
+                                       usb_device_handle_t *dev_hdl, usb_host_client_handle_t *client_hdl) {
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    for (int i = 0; i < PRINTER_MAX_COUNT && ret == ESP_ERR_NOT_FOUND; i++) {
+        printer_entry_t *entry = &registry[i];
+        if (!entry->in_use || strcmp(entry->id, id) != 0) {
+            continue;
+        }
+        ret = entry->exported ? ESP_ERR_INVALID_STATE : ESP_OK;
+        // Workers stay around between jobs, only a job taken or queued keeps the printer busy.
+        // Neither can change while the lock is held.
+        for (int p = 0; p < PRINTER_MAX_COUNT; p++) {
+            printer_device_t *printer = &printers[p];
+            if (printer->in_use && printer->dev_hdl == entry->dev_hdl
+                && (printer->job_active || printer->closing || uxQueueMessagesWaiting(printer->job_queue) > 0)) {
+                ret = ESP_ERR_INVALID_STATE;
+            }
+        }
+        if (ret == ESP_OK) {
+            entry->exported = true;
+            entry->export_gone = false;
+            entry->export_gone_cb = gone;
+            entry->export_gone_arg = gone_arg;
+            *dev_hdl = entry->dev_hdl;
+            *client_hdl = entry->client_hdl;
+        }
+    }
+    xSemaphoreGive(registry_lock);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to allocate transfer: %s", esp_err_to_name(ret));
-        usb_host_interface_release(saved_printer.client_hdl, saved_printer.dev_hdl, saved_printer.interface_number);
         return ret;
     }
-    
-    // Set up the transfer
-    transfer->device_handle = saved_printer.dev_hdl;
-    transfer->bEndpointAddress = saved_printer.bulk_out_ep;
-    transfer->callback = print_transfer_callback;
-    transfer->context = NULL;
-    transfer->num_bytes = test_print_data_size;
 
-    // Copy print data to transfer buffer
-    memcpy(transfer->data_buffer, test_print_data, test_print_data_size);
+    // The backchannel drain would eat the remote driver's bulk IN data
+    for (int p = 0; p < PRINTER_MAX_COUNT; p++) {
+        printer_device_t *printer = &printers[p];
+        if (!printer->in_use || printer->dev_hdl != *dev_hdl || !printer->draining) {
+            continue;
+        }
+        usb_host_endpoint_halt(printer->dev_hdl, printer->bulk_in_ep);
+        usb_host_endpoint_flush(printer->dev_hdl, printer->bulk_in_ep);
+        for (int wait = 0; wait < 100 && printer->draining; wait++) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        usb_host_endpoint_clear(printer->dev_hdl, printer->bulk_in_ep);
+    }
+    return ESP_OK;
+}
+
+// Function that gives an exported printer back to the printer handler
+void printer_handler_export_end(const char *id) {
+    usb_device_handle_t gone_dev = NULL;
+
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    for (int i = 0; i < PRINTER_MAX_COUNT; i++) {
+        printer_entry_t *entry = &registry[i];
+        if (!entry->in_use || !entry->exported || strcmp(entry->id, id) != 0) {
+            continue;
+        }
+        entry->exported = false;
+        if (entry->export_gone) {
+            gone_dev = entry->dev_hdl;
+            break;
+        }
+        for (int p = 0; p < PRINTER_MAX_COUNT; p++) {
+            printer_device_t *printer = &printers[p];
+            if (printer->in_use && printer->dev_hdl == entry->dev_hdl && printer->claimed
+                && printer->drain_transfer != NULL && !printer->draining && !printer->closing) {
+                printer->draining = usb_host_transfer_submit(printer->drain_transfer) == ESP_OK;
+            }
+        }
+    }
+    xSemaphoreGive(registry_lock);
+
+    // Unplugged meanwhile, the release was put off until now
+    if (gone_dev != NULL) {
+        class_driver_device_released(gone_dev);
+    }
+}
+
+// Function that stops and frees all printer records of a device
+esp_err_t printer_handler_release_device(usb_device_handle_t dev_hdl) {
+    bool pending = false;
+
+    // A remote driver still owns the device, printer_handler_export_end() brings us back here
+    printer_export_gone_cb_t gone = NULL;
+    void *gone_arg = NULL;
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    printer_entry_t *exported = printer_entry_get(dev_hdl);
+    if (exported != NULL && !exported->exported) {
+        exported = NULL;
+    }
+    if (exported != NULL && !exported->export_gone) {
+        exported->export_gone = true;
+        gone = exported->export_gone_cb;
+        gone_arg = exported->export_gone_arg;
+    }
+    xSemaphoreGive(registry_lock);
+    if (gone != NULL) {
+        gone(gone_arg);
+    }
+    if (exported != NULL) {
+        return ESP_ERR_NOT_FINISHED;
+    }
+
+    for (int i = 0; i < PRINTER_MAX_COUNT; i++) {
+        printer_device_t *printer = &printers[i];
+        if (!printer->in_use || printer->dev_hdl != dev_hdl) {
+            continue;
+        }
+
+        if (!printer->closing) {
+            // Under the registry lock so no job gets queued after the worker has drained its queue
+            // The worker publishes and clears its DOT4 pipe under the lock, so the pipe can't
+            // be torn down while it is cancelled. The cancel doesn't wait for callbacks.
+            xSemaphoreTake(registry_lock, portMAX_DELAY);
+            printer->closing = true;
+            if (printer->dot4_pipe != NULL) {
+                bulk_pipe_cancel(printer->dot4_pipe);
+            }
+            xSemaphoreGive(registry_lock);
+            // Cancel whatever is still in flight, the transfers come back through the callback
+            // and the worker exits once it has them all
+            if (printer->claimed) {
+                usb_host_endpoint_halt(dev_hdl, printer->bulk_out_ep);
+                usb_host_endpoint_flush(dev_hdl, printer->bulk_out_ep);
+            }
+            xTaskNotifyGive(printer->worker);
+            if (printer->draining) {
+                usb_host_endpoint_halt(dev_hdl, printer->bulk_in_ep);
+                usb_host_endpoint_flush(dev_hdl, printer->bulk_in_ep);
+            }
+        }
+        if (!printer_idle(printer)) {
+            pending = true;
+            continue;
+        }
+
+        if (printer->claimed) {
+            usb_host_endpoint_clear(dev_hdl, printer->bulk_out_ep);
+            if (printer->drain_transfer != NULL || printer->protocol == USB_PRINTER_PROTOCOL_1284) {
+                usb_host_endpoint_clear(dev_hdl, printer->bulk_in_ep);
+            }
+            usb_host_interface_release(printer->client_hdl, dev_hdl, printer->interface_number);
+        }
+        ESP_LOGI(TAG, "Printer interface %d released", printer->interface_number);
+        xSemaphoreTake(registry_lock, portMAX_DELAY);
+        printer_record_free(printer);
+        xSemaphoreGive(registry_lock);
+    }
+
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    printer_entry_t *entry = printer_entry_get(dev_hdl);
+    if (entry != NULL && entry->ipp != NULL) {
+        // ipp_usb_close() refuses new jobs right away and only needs the lock for that
+        if (ipp_usb_close(entry->ipp) == ESP_ERR_NOT_FINISHED) {
+            pending = true;
+        } else {
+            entry->ipp = NULL;
+        }
+    }
+    if (entry != NULL && !pending) {
+        ESP_LOGI(TAG, "Printer %s unregistered", entry->id);
+        entry->in_use = false;
+    }
+    xSemaphoreGive(registry_lock);
+
+    return pending ? ESP_ERR_NOT_FINISHED : ESP_OK;
+}
 
-    ESP_LOGI(TAG, "Sending print data to endpoint 0x%02x...", saved_printer.bulk_out_ep);
+// DOT4 runs over a blocking bulk pipe on the printer's IN/OUT pair
+#define PRINTER_LINK_BUF_SIZE       1024
 
-    // Submit the transfer
-    ret = usb_host_transfer_submit(transfer);
+static esp_err_t printer_link_write(void *ctx, const uint8_t *data, size_t len, TickType_t timeout) {
+    return bulk_pipe_write((bulk_pipe_t *)ctx, data, len, timeout);
+}
+
+static esp_err_t printer_link_read(void *ctx, uint8_t *data, size_t max_len, size_t *actual_len, TickType_t timeout) {
+    return bulk_pipe_read((bulk_pipe_t *)ctx, data, max_len, actual_len, timeout);
+}
+
+// Sends a print job over the DOT4 print channel
+// Blocks until the whole job has been accepted by the printer
+static esp_err_t send_print_job_dot4(printer_device_t *printer, const print_job_t *job) {
+    if (printer->bulk_in_ep == 0xFF || printer->bulk_in_mps == 0) {
+        ESP_LOGE(TAG, "1284.4 printer has no bulk IN endpoint");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ESP_LOGI(TAG, "Starting DOT4 print job...");
+
+    bulk_pipe_t pipe;
+    esp_err_t ret = bulk_pipe_init(&pipe, printer->dev_hdl, printer->bulk_out_ep,
+                                   printer->bulk_in_ep, printer->bulk_in_mps, PRINTER_LINK_BUF_SIZE);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to submit transfer: %s", esp_err_to_name(ret));
-        usb_host_transfer_free(transfer);
-        usb_host_interface_release(saved_printer.client_hdl, saved_printer.dev_hdl, saved_printer.interface_number);
+        ESP_LOGE(TAG, "Failed to set up bulk link: %s", esp_err_to_name(ret));
         return ret;
     }
 
-    ESP_LOGI(TAG, "Print job sent successfully!");
+    // A close that came first has nothing to cancel, so the job ends here
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    bool closing = printer->closing;
+    if (!closing) {
+        printer->dot4_pipe = &pipe;
+    }
+    xSemaphoreGive(registry_lock);
+    if (closing) {
+        bulk_pipe_deinit(&pipe);
+        return ESP_ERR_INVALID_STATE;
+    }
+    dot4_link_t link = {
+        .write = printer_link_write,
+        .read = printer_link_read,
+        .ctx = &pipe,
+    };
+    dot4_t *dot4 = NULL;
+    dot4_channel_t *print_channel = NULL;
 
-    // Wait for transfer to complete (with timeout)
-    if (xSemaphoreTake(saved_printer.transfer_done_sem, pdMS_TO_TICKS(5000)) != pdTRUE) {
-        ESP_LOGE(TAG, "Transfer timeout");
-        usb_host_transfer_free(transfer);
-        usb_host_interface_release(saved_printer.client_hdl, saved_printer.dev_hdl, saved_printer.interface_number);
-        return ESP_ERR_TIMEOUT;
+    ret = dot4_open(&link, &dot4);
+    if (ret == ESP_OK) {
+        uint8_t socket_id;
+        if (dot4_get_socket(dot4, "PRINT", &socket_id) != ESP_OK) {
+            socket_id = DOT4_PRINT_SOCKET_DEFAULT;
+        }
+        ret = dot4_channel_open(dot4, socket_id, &print_channel);
     }
+    if (ret == ESP_OK && job->stream == NULL) {
+        ret = dot4_channel_write(print_channel, &job->data[job->offset], job->size - job->offset,
+                                 pdMS_TO_TICKS(30000));
+        if (ret == ESP_OK) {
+            printer_note_first_byte(printer);
+        }
+    }
+    if (ret == ESP_OK && job->stream != NULL) {
+        // Streamed jobs go out in link buffer sized pieces as they arrive
+        uint8_t *chunk = malloc(PRINTER_LINK_BUF_SIZE);
+        size_t len;
+        bool end = false;
+        if (chunk == NULL) {
+            ret = ESP_ERR_NO_MEM;
+        }
+        while (ret == ESP_OK && !end && !printer->closing) {
+            ret = printer_job_next_chunk(job, 0, chunk, PRINTER_LINK_BUF_SIZE, &len, &end, PRINTER_STREAM_WAIT);
+            if (ret == ESP_ERR_TIMEOUT) {
+                ret = ESP_OK;
+            } else if (ret == ESP_OK && len > 0) {
+                ret = dot4_channel_write(print_channel, chunk, len, pdMS_TO_TICKS(30000));
+                printer_note_first_byte(printer);
+            }
+        }
+        if (ret == ESP_OK && !end) {
+            ret = ESP_ERR_INVALID_STATE;
+        }
+        free(chunk);
+    }
+    if (print_channel != NULL) {
+        dot4_channel_close(print_channel);
+    }
+    dot4_close(dot4);
 
-    // Clean up transfer and release the interface after waiting for the semaphore
-    usb_host_transfer_free(transfer);
-    usb_host_interface_release(saved_printer.client_hdl, saved_printer.dev_hdl, saved_printer.interface_number);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "DOT4 print job completed!");
+    } else {
+        ESP_LOGE(TAG, "DOT4 print job failed: %s", esp_err_to_name(ret));
+    }
 
-    return ESP_OK;
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    printer->dot4_pipe = NULL;
+    xSemaphoreGive(registry_lock);
+    bulk_pipe_deinit(&pipe);
+    return ret;
 }
 
-static void print_transfer_callback(usb_transfer_t *transfer) {
-    if (transfer->status == USB_TRANSFER_STATUS_COMPLETED) {
-        ESP_LOGI(TAG, "Print transfer completed successfully!");
-        ESP_LOGI(TAG, "Sent %d bytes to printer", transfer->actual_num_bytes);
+#ifdef CONFIG_PRINTER_BRIDGE_HOTPLUG_STORM
+#define PRINTER_STORM_HOLD_MAX_MS   20      // A stand-in holds each job up to this long
+
+// Worker of a stand-in printer, goes through the same job states as printer_worker_task()
+static void printer_storm_worker_task(void *arg) {
+    printer_device_t *printer = (printer_device_t *)arg;
+
+    while (!printer->closing) {
+        print_job_t job;
+        if (!printer_job_take(printer, &job)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        // In flight until the hold is over, unplugging ends it early like a cancelled transfer
+        int64_t end_us = esp_timer_get_time() + (1 + esp_random() % PRINTER_STORM_HOLD_MAX_MS) * 1000LL;
+        while (!printer->closing && esp_timer_get_time() < end_us) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1));
+        }
+        printer_job_end(printer, &job, printer->closing ? ESP_ERR_INVALID_STATE : ESP_OK, job.offset);
+    }
+    printer_worker_exit(printer);
+}
+
+// Function that registers a stand-in printer for a hotplug storm device
+bool printer_handler_storm_attach(usb_device_handle_t dev_hdl, usb_host_client_handle_t client_hdl, const char *id) {
+    printer_entry_t *entry = printer_entry_reserve(dev_hdl, client_hdl, 0, 0);
+    if (entry == NULL) {
+        return false;
+    }
+    // No interface to claim and no transfers, release_device() only has the worker to stop
+    printer_device_t *record = printer_record_get(dev_hdl, 0);
+    if (record != NULL && !record->in_use) {
+        record->in_use = true;
+        record->dev_hdl = dev_hdl;
+        record->client_hdl = client_hdl;
+        record->job_queue = xQueueCreate(PRINTER_JOB_QUEUE_LEN, sizeof(print_job_t));
+        record->worker_running = true;
+        if (record->job_queue == NULL
+            || xTaskCreate(printer_storm_worker_task, "storm_printer", PRINTER_WORKER_STACK, record,
+                           PRINTER_WORKER_PRIORITY, &record->worker) != pdTRUE) {
+            printer_record_free(record);
+            record = NULL;
+        }
     } else {
-        ESP_LOGE(TAG, "Print transfer failed with status: %d", transfer->status);
+        record = NULL;
     }
 
-    // Signal that transfer is done
-    if (saved_printer.transfer_done_sem != NULL) {
-        xSemaphoreGive(saved_printer.transfer_done_sem);
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    if (record == NULL) {
+        entry->in_use = false;
+    } else {
+        entry->stand_in = true;
+        strlcpy(entry->id, id, sizeof(entry->id));
+        printer_resume_parked_jobs(entry, NULL);
     }
+    xSemaphoreGive(registry_lock);
+    return record != NULL;
+}
 
-    ESP_LOGI(TAG, "Print job completed!");
-}
\ No newline at end of file
+// Function that counts the parked jobs
+int printer_handler_parked_count(void) {
+    int count = 0;
+    xSemaphoreTake(registry_lock, portMAX_DELAY);
+    for (int i = 0; i < PRINTER_PARKED_MAX; i++) {
+        if (parked_jobs[i].in_use) {
+            count++;
+        }
+    }
+    xSemaphoreGive(registry_lock);
+    return count;
+}
+#endif
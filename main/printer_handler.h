@@ -0,0 +1,95 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "usb/usb_host.h"
+#include "print_stream.h"
+
+#define PRINTER_MAX_COUNT           4       // Printer interfaces handled at the same time
+#define PRINTER_ID_LEN              48      // Stable printer ID, "vid-pid-serial" or "vid-pid-port-1-2"
+
+// Called from the printer's worker task once a submitted job is over
+typedef void (*printer_job_done_cb_t)(void *arg, esp_err_t result);
+
+// Called from the class driver task when an exported printer is unplugged
+typedef void (*printer_export_gone_cb_t)(void *arg);
+
+typedef struct {
+    char id[PRINTER_ID_LEN];
+    uint16_t vid;
+    uint16_t pid;
+    int num_interfaces;                     // Raw printer interfaces, each with its own queue and worker
+    bool ipp_usb;
+} printer_info_t;
+
+// Sets up the printer registry, called once before the first device is checked
+void printer_handler_init(void);
+
+// Checks whether a USB device has printer interfaces
+// A printer record is created for every printer interface found
+// attach_time_us (esp_timer time of the attach event) is used to report attach-to-first-byte latency
+bool check_device_for_printer_interfaces(usb_device_handle_t dev_hdl, usb_host_client_handle_t client_hdl,
+                                         int64_t attach_time_us);
+
+// True if the device is a printer whose capabilities are cached from an earlier attach
+// Such devices can skip the descriptor dump and go straight to check_device_for_printer_interfaces()
+bool printer_handler_is_known(usb_device_handle_t dev_hdl);
+
+// Queues the test page on every printer interface of the device
+esp_err_t send_print_job(usb_device_handle_t dev_hdl);
+
+// Queues a job on the printer with the given ID (NULL picks the first printer)
+// data must stay valid until done is called. Printers print in parallel, jobs for
+// the same printer in order. Returns ESP_ERR_NOT_FOUND if no such printer is attached,
+// ESP_ERR_INVALID_STATE while it is exported.
+// Jobs of a printer unplugged mid-job are parked and resume when it comes back.
+esp_err_t printer_handler_submit(const char *printer_id, const uint8_t *data, size_t size,
+                                 printer_job_done_cb_t done, void *done_arg);
+
+// Queues a job that is read from stream while it prints, for network servers
+// The stream must stay valid until done is called. Streamed jobs are not parked on unplug,
+// the stream is aborted instead. IPP-USB only printers return ESP_ERR_NOT_SUPPORTED.
+esp_err_t printer_handler_submit_stream(const char *printer_id, print_stream_t *stream,
+                                        printer_job_done_cb_t done, void *done_arg);
+
+// Fills list with up to max_count attached printers, returns how many
+int printer_handler_list(printer_info_t *list, int max_count);
+
+// Runs fn with the printer's device handle while the device can't go away
+// fn runs under the registry lock, it must not block or call back into the printer handler
+esp_err_t printer_handler_with_device(const char *id, void (*fn)(usb_device_handle_t dev_hdl, void *arg), void *arg);
+
+// Hands the printer over to a remote driver for exclusive use (USB/IP)
+// Refused with ESP_ERR_INVALID_STATE while a job prints. Jobs are refused the same way until
+// printer_handler_export_end(). If the printer is unplugged meanwhile gone is called once,
+// the device stays open until the export ends.
+esp_err_t printer_handler_export_begin(const char *id, printer_export_gone_cb_t gone, void *gone_arg,
+                                       usb_device_handle_t *dev_hdl, usb_host_client_handle_t *client_hdl);
+void printer_handler_export_end(const char *id);
+
+// Stops all printer interfaces of the device and frees their records
+// Returns ESP_ERR_NOT_FINISHED while transfers are still in flight,
+// class_driver_device_released() is called once they have all come back
+esp_err_t printer_handler_release_device(usb_device_handle_t dev_hdl);
+
+#ifdef CONFIG_PRINTER_BRIDGE_HOTPLUG_STORM
+// Registers a stand-in printer for a hotplug storm device, which has no USB device behind it
+// Jobs submitted under id are held for a few ms each as if printing. Unplugging it parks
+// them like a real printer's, attaching again under the same id resumes them. Stand-ins are
+// not listed and never picked for jobs without a printer ID.
+bool printer_handler_storm_attach(usb_device_handle_t dev_hdl, usb_host_client_handle_t client_hdl, const char *id);
+
+// Number of parked jobs, for leak checks
+int printer_handler_parked_count(void);
+#endif
+
+// Claims an interface and selects alt_setting with SET_INTERFACE when it is not the default
+esp_err_t printer_claim_interface(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                  uint8_t interface_num, uint8_t alt_setting);
@@ -0,0 +1,27 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+
+#include "printer_quirks.h"
+#include "printer_quirks_table.h"
+
+static int printer_quirk_compare(const void *key, const void *elem) {
+    const printer_quirk_t *a = (const printer_quirk_t *)key;
+    const printer_quirk_t *b = (const printer_quirk_t *)elem;
+    uint32_t id_a = ((uint32_t)a->vid << 16) | a->pid;
+    uint32_t id_b = ((uint32_t)b->vid << 16) | b->pid;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+const printer_quirk_t *printer_quirks_lookup(uint16_t vid, uint16_t pid) {
+    const printer_quirk_t key = {
+        .vid = vid,
+        .pid = pid,
+    };
+    return bsearch(&key, printer_quirks_table, sizeof(printer_quirks_table) / sizeof(printer_quirks_table[0]),
+                   sizeof(printer_quirk_t), printer_quirk_compare);
+}
@@ -0,0 +1,28 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Per-model printer quirks
+// The table is generated at build time from quirks/printer_quirks.csv
+
+#pragma once
+
+#include <stdint.h>
+
+#define PRINTER_QUIRK_ZLP                   (1 << 0)    // Needs a ZLP after a job ending on a packet boundary
+#define PRINTER_QUIRK_NEEDS_FIRMWARE        (1 << 1)    // Needs a firmware upload before printing
+#define PRINTER_QUIRK_DRAIN_BACKCHANNEL     (1 << 2)    // Bulk IN must be read continuously
+#define PRINTER_QUIRK_RESUME_PAGE           (1 << 3)    // Interrupted jobs resume at a page boundary, not the start
+
+typedef struct {
+    uint16_t vid;
+    uint16_t pid;
+    uint16_t max_transfer;                  // Largest bulk OUT transfer, 0 = no limit
+    uint16_t flags;                         // PRINTER_QUIRK_*
+    uint8_t config;                         // Configuration to enumerate with, 0 = first one
+} printer_quirk_t;
+
+// Returns the quirks for a VID/PID, or NULL if the printer needs none
+const printer_quirk_t *printer_quirks_lookup(uint16_t vid, uint16_t pid);
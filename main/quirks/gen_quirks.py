@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+#
+# SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Turns printer_quirks.csv into a C table sorted by VID/PID for binary search
+
+import csv
+import sys
+
+FLAGS = (
+    ('zlp', 'PRINTER_QUIRK_ZLP'),
+    ('firmware', 'PRINTER_QUIRK_NEEDS_FIRMWARE'),
+    ('drain_backchannel', 'PRINTER_QUIRK_DRAIN_BACKCHANNEL'),
+    ('resume_page', 'PRINTER_QUIRK_RESUME_PAGE'),
+)
+COLUMNS = ['vid', 'pid', 'config', 'max_transfer'] + [name for name, _ in FLAGS] + ['name']
+
+
+def parse(path):
+    entries = {}
+    with open(path, newline='') as f:
+        lines = (line for line in f if line.strip() and not line.lstrip().startswith('#'))
+        for lineno, row in enumerate(csv.reader(lines), 1):
+            if len(row) != len(COLUMNS):
+                sys.exit(f'{path}: entry {lineno}: expected {len(COLUMNS)} columns, got {len(row)}')
+            entry = dict(zip(COLUMNS, (field.strip() for field in row)))
+            vid = int(entry['vid'], 0)
+            pid = int(entry['pid'], 0)
+            config = int(entry['config'], 0)
+            max_transfer = int(entry['max_transfer'], 0)
+            if not (0 <= vid <= 0xFFFF and 0 <= pid <= 0xFFFF and 0 <= config <= 0xFF and 0 <= max_transfer <= 0xFFFF):
+                sys.exit(f'{path}: entry {lineno}: value out of range')
+            if (vid, pid) in entries:
+                sys.exit(f'{path}: entry {lineno}: duplicate {vid:04x}:{pid:04x}')
+            flags = [macro for name, macro in FLAGS if int(entry[name], 0)]
+            entries[(vid, pid)] = (config, max_transfer, flags, entry['name'].replace('"', "'"))
+    return entries
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: gen_quirks.py <printer_quirks.csv> <printer_quirks_table.h>')
+    entries = parse(sys.argv[1])
+
+    out = ['// Generated by gen_quirks.py from printer_quirks.csv, do not edit', '',
+           '#pragma once', '',
+           'static const printer_quirk_t printer_quirks_table[] = {']
+    for (vid, pid), (config, max_transfer, flags, name) in sorted(entries.items()):
+        out.append(f'    {{ 0x{vid:04x}, 0x{pid:04x}, {max_transfer}, {" | ".join(flags) or "0"}, {config} }},    // {name}')
+    out.append('};')
+    out.append('')
+
+    with open(sys.argv[2], 'w') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,147 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "raw_server.h"
+#include "net_job.h"
+#include "net_admission.h"
+
+#define RAW_SERVER_TASK_STACK       4096
+#define RAW_SERVER_TASK_PRIORITY    2
+#define RAW_SERVER_IDLE_TIMEOUT_S   300     // A silent client ends its job after this long
+
+static const char *TAG = "RAW server";
+
+typedef struct {
+    int sock;
+    char peer[INET_ADDRSTRLEN];
+} raw_conn_t;
+
+// Spool budget of a connection: its job's stream, the connection and its task
+#define RAW_CONN_COST               (NET_JOB_STREAM_SIZE + sizeof(raw_conn_t) + RAW_SERVER_TASK_STACK)
+
+// Streams one connection into a print job
+static void raw_server_handle(int sock, const char *peer) {
+    net_job_t job;
+    esp_err_t ret = net_job_start(&job, NULL);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Job from %s refused: %s", peer, esp_err_to_name(ret));
+        return;
+    }
+
+    // Data is received straight into the stream. While it is full the socket isn't read
+    // and TCP throttles the client.
+    bool complete = true;
+    while (1) {
+        int len;
+        if (net_job_recv(&job, sock, SIZE_MAX, &len) != ESP_OK) {
+            // The printer gave up, the job result says why
+            break;
+        }
+        if (len == 0) {
+            break;
+        }
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                ESP_LOGW(TAG, "Client %s idle, ending its job", peer);
+            } else {
+                ESP_LOGE(TAG, "Receive from %s failed: errno %d", peer, errno);
+                complete = false;
+            }
+            break;
+        }
+    }
+    net_job_finish(&job, complete);
+    net_job_free(&job, TAG, peer);
+}
+
+// Serves one connection, jobs of concurrent clients queue on the printer
+static void raw_client_task(void *arg) {
+    raw_conn_t *conn = (raw_conn_t *)arg;
+    raw_server_handle(conn->sock, conn->peer);
+    shutdown(conn->sock, SHUT_RDWR);
+    close(conn->sock);
+    net_admission_release(RAW_CONN_COST, TAG, conn->peer);
+    free(conn);
+    vTaskDelete(NULL);
+}
+
+static void raw_server_task(void *arg) {
+    uint16_t port = (uint16_t)(uintptr_t)arg;
+    int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (listen_sock < 0) {
+        ESP_LOGE(TAG, "Unable to start the server");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    int opt = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || listen(listen_sock, NET_ADMISSION_BACKLOG) != 0) {
+        ESP_LOGE(TAG, "Unable to listen on port %d: errno %d", port, errno);
+        close(listen_sock);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG, "Listening on port %d", port);
+
+    while (1) {
+        struct sockaddr_in peer_addr;
+        bool busy;
+        int sock = net_admission_accept(listen_sock, RAW_CONN_COST, &peer_addr, &busy);
+        if (sock < 0) {
+            ESP_LOGE(TAG, "Accept failed: errno %d", errno);
+            continue;
+        }
+        if (busy) {
+            // The protocol has no way to say busy, a closed connection makes the client retry
+            close(sock);
+            continue;
+        }
+        raw_conn_t *conn = malloc(sizeof(raw_conn_t));
+        if (conn == NULL) {
+            close(sock);
+            net_admission_release(RAW_CONN_COST, TAG, "unknown");
+            continue;
+        }
+        struct timeval timeout = {
+            .tv_sec = RAW_SERVER_IDLE_TIMEOUT_S,
+        };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        conn->sock = sock;
+        inet_ntop(AF_INET, &peer_addr.sin_addr, conn->peer, sizeof(conn->peer));
+
+        if (xTaskCreate(raw_client_task, "raw_client", RAW_SERVER_TASK_STACK, conn,
+                        RAW_SERVER_TASK_PRIORITY, NULL) != pdTRUE) {
+            close(sock);
+            net_admission_release(RAW_CONN_COST, TAG, conn->peer);
+            free(conn);
+        }
+    }
+}
+
+esp_err_t raw_server_start(uint16_t port) {
+    BaseType_t task_created = xTaskCreate(raw_server_task, "raw_server", RAW_SERVER_TASK_STACK,
+                                          (void *)(uintptr_t)port, RAW_SERVER_TASK_PRIORITY, NULL);
+    return task_created == pdTRUE ? ESP_OK : ESP_ERR_NO_MEM;
+}
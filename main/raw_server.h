@@ -0,0 +1,19 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// RAW / JetDirect print server
+// Every connection is one job for the first attached printer, it ends when the client
+// closes. Data is streamed to the printer as it arrives, nothing is buffered per job.
+// Clients are served concurrently within the spool budget and their jobs queue on the
+// printer, further clients wait in the listen backlog like on a JetDirect box.
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Starts the server task listening on port
+esp_err_t raw_server_start(uint16_t port);
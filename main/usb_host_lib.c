@@ -7,6 +7,9 @@
 #include "esp_log.h"
 #include "esp_intr_alloc.h"
 #include "usb/usb_host.h"
+#include "printer_quirks.h"
+#include "printer_cache.h"
+#include "port_recovery.h"
 
 #ifdef CONFIG_USB_HOST_ENABLE_ENUM_FILTER_CALLBACK
 #define ENABLE_ENUM_FILTER_CALLBACK
@@ -18,6 +21,8 @@ static const char *TAG = "USB host lib";
  * @brief Set configuration callback
  *
  * Set the USB device configuration during the enumeration process, must be enabled in the menuconfig
+ * Devices that can't be printers are not enumerated at all, which saves the descriptor reads
+ * and the host memory they would take. Hubs always pass, printers may sit behind them.
 
  * @note bConfigurationValue starts at index 1
  *
@@ -31,11 +36,32 @@ static const char *TAG = "USB host lib";
 #ifdef ENABLE_ENUM_FILTER_CALLBACK
 static bool set_config_cb(const usb_device_desc_t *dev_desc, uint8_t *bConfigurationValue)
 {
-    // If the USB device has more than one configuration, set the second configuration
-    if (dev_desc->bNumConfigurations > 1) {
-        *bConfigurationValue = 2;
-    } else {
+    switch (dev_desc->bDeviceClass) {
+    case USB_CLASS_PER_INTERFACE:   // Printers normally declare their class per interface
+    case USB_CLASS_PRINTER:
+    case USB_CLASS_MISC:            // Composite devices with IADs, e.g. multifunction printers
+    case USB_CLASS_VENDOR_SPEC:     // Vendor specific bridges and GDI printers
+        break;
+    case USB_CLASS_HUB:
         *bConfigurationValue = 1;
+        return true;
+    default:
+        ESP_LOGI(TAG, "Skipping %04x:%04x, device class 0x%02x",
+                 dev_desc->idVendor, dev_desc->idProduct, dev_desc->bDeviceClass);
+        return false;
+    }
+
+    // Checked on an earlier attach and had no printer interface
+    if (printer_cache_is_not_printer(dev_desc->idVendor, dev_desc->idProduct, dev_desc->bcdDevice)) {
+        ESP_LOGI(TAG, "Skipping %04x:%04x, not a printer", dev_desc->idVendor, dev_desc->idProduct);
+        return false;
+    }
+
+    // The printer interface is in the first configuration unless a quirk says otherwise
+    *bConfigurationValue = 1;
+    const printer_quirk_t *quirk = printer_quirks_lookup(dev_desc->idVendor, dev_desc->idProduct);
+    if (quirk != NULL && quirk->config != 0 && quirk->config <= dev_desc->bNumConfigurations) {
+        *bConfigurationValue = quirk->config;
     }
 
     // Return true to enumerate the USB device
@@ -67,7 +93,12 @@ void usb_host_lib_task(void *arg)
     bool has_devices = false;
     while (has_clients) {
         uint32_t event_flags;
-        ESP_ERROR_CHECK(usb_host_lib_handle_events(portMAX_DELAY, &event_flags));
+        // Power cycles of hung printers run here, the timeout brings us back for the next step
+        esp_err_t ret = usb_host_lib_handle_events(port_recovery_run(), &event_flags);
+        if (ret == ESP_ERR_TIMEOUT) {
+            continue;
+        }
+        ESP_ERROR_CHECK(ret);
         if (event_flags & USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS) {
             ESP_LOGI(TAG, "Get FLAGS_NO_CLIENTS");
             if (ESP_OK == usb_host_device_free_all()) {
@@ -0,0 +1,809 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "usb/usb_host.h"
+
+#include "usbip_server.h"
+#include "printer_handler.h"
+#include "net_admission.h"
+
+#define USBIP_SERVER_TASK_STACK     4096
+#define USBIP_SERVER_TASK_PRIORITY  2
+#define USBIP_REPLY_TASK_STACK      3072
+#define USBIP_MAX_URBS              8       // URBs in flight per session
+#define USBIP_MAX_URB_SIZE          16384   // Larger URBs are failed, printer drivers stay well below
+#define USBIP_MAX_INTERFACES        8
+#define USBIP_OP_TIMEOUT_S          10      // Request phase, before a device is imported
+#define USBIP_POLL_TIMEOUT_S        1       // Receive timeout while imported, to notice an unplug
+#define USBIP_CANCEL_TIMEOUT        pdMS_TO_TICKS(5000)
+#define USBIP_BUSNUM                1
+#define USBIP_BUSID_LEN             32
+#define USBIP_STOP                  0xFF    // Ends the reply task
+
+// Protocol, all fields big-endian
+#define USBIP_VERSION               0x0111
+#define USBIP_OP_HEADER_SIZE        8
+#define USBIP_OP_REQ_DEVLIST        0x8005
+#define USBIP_OP_REP_DEVLIST        0x0005
+#define USBIP_OP_REQ_IMPORT         0x8003
+#define USBIP_OP_REP_IMPORT         0x0003
+#define USBIP_DEVICE_SIZE           312     // path, busid, busnum ... bNumInterfaces
+#define USBIP_INTERFACE_SIZE        4
+#define USBIP_HEADER_SIZE           48
+#define USBIP_CMD_SUBMIT            1
+#define USBIP_CMD_UNLINK            2
+#define USBIP_RET_SUBMIT            3
+#define USBIP_RET_UNLINK            4
+#define USBIP_DIR_IN                1
+
+// URB status is a negative Linux errno, the remote kernel's numbering not ours
+#define USBIP_ENOMEM                12
+#define USBIP_ENODEV                19
+#define USBIP_EINVAL                22
+#define USBIP_EPIPE                 32
+#define USBIP_EPROTO                71
+#define USBIP_EOVERFLOW             75
+#define USBIP_ECONNRESET            104
+#define USBIP_ETIMEDOUT             110
+
+static const char *TAG = "USB/IP server";
+
+typedef struct {
+    int sock;
+    char peer[INET_ADDRSTRLEN];
+} usbip_conn_t;
+
+typedef struct usbip_session usbip_session_t;
+
+typedef struct {
+    usbip_session_t *session;
+    bool in_use;
+    bool local;                             // Answered without the device, status holds the result
+    bool unlinked;                          // Unlinked or cancelled, completes without a reply
+    int32_t status;
+    uint32_t seqnum;
+    uint8_t ep;                             // Endpoint address, 0x00/0x80 for control
+    uint32_t length;                        // Requested transfer_buffer_length
+    usb_transfer_t *transfer;               // Kept between URBs, grown when too small
+} usbip_urb_t;
+
+struct usbip_session {
+    int sock;
+    char peer[INET_ADDRSTRLEN];
+    char printer_id[PRINTER_ID_LEN];
+    usb_device_handle_t dev_hdl;
+    usb_host_client_handle_t client_hdl;
+    const usb_config_desc_t *config;
+    uint32_t claimed;                       // Interfaces claimed by the session, bit per interface number
+    uint8_t alt[USBIP_MAX_INTERFACES];
+    usbip_urb_t urbs[USBIP_MAX_URBS];
+    QueueHandle_t done_urbs;                // URB indexes handed back by the transfer callback
+    SemaphoreHandle_t free_urbs;            // Counts free URB slots, the receive side waits on it
+    SemaphoreHandle_t lock;                 // Protects urbs and the stats
+    SemaphoreHandle_t send_lock;            // Replies come from both tasks
+    TaskHandle_t receive_task;
+    volatile bool gone;                     // Printer unplugged
+    // Stats
+    uint32_t submitted;
+    uint32_t unlinked;
+    uint32_t in_flight;
+    uint32_t max_in_flight;
+    uint64_t bytes_out;
+    uint64_t bytes_in;
+};
+
+// Budget of a connection: the connection, its task and an imported session with its reply task
+// URB buffers are allocated as the host asks for them and not reserved
+#define USBIP_CONN_COST             (sizeof(usbip_conn_t) + USBIP_SERVER_TASK_STACK + sizeof(usbip_session_t) \
+                                     + USBIP_REPLY_TASK_STACK)
+
+static void usbip_put_u16(uint8_t *p, uint16_t val) {
+    p[0] = val >> 8;
+    p[1] = val & 0xFF;
+}
+
+static void usbip_put_u32(uint8_t *p, uint32_t val) {
+    p[0] = val >> 24;
+    p[1] = (val >> 16) & 0xFF;
+    p[2] = (val >> 8) & 0xFF;
+    p[3] = val & 0xFF;
+}
+
+static uint32_t usbip_get_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// Reads exactly len bytes. Receive timeouts are waited out unless gone is NULL or set.
+static bool usbip_recv_all(int sock, void *buf, size_t len, const volatile bool *gone) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        int n = recv(sock, p, len, 0);
+        if (n > 0) {
+            p += n;
+            len -= n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && gone != NULL && !*gone) {
+            continue;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fills the device part of the devlist and import replies
+static esp_err_t usbip_describe(usb_device_handle_t dev_hdl, const char *busid, uint8_t *out,
+                                const usb_config_desc_t **config_ret) {
+    usb_device_info_t info;
+    const usb_device_desc_t *dev_desc;
+    const usb_config_desc_t *config;
+    if (usb_host_device_info(dev_hdl, &info) != ESP_OK || usb_host_get_device_descriptor(dev_hdl, &dev_desc) != ESP_OK
+        || usb_host_get_active_config_descriptor(dev_hdl, &config) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    memset(out, 0, USBIP_DEVICE_SIZE);
+    snprintf((char *)out, 256, "/sys/devices/platform/printerbridge/usb%d/%s", USBIP_BUSNUM, busid);
+    strlcpy((char *)&out[256], busid, USBIP_BUSID_LEN);
+    usbip_put_u32(&out[288], USBIP_BUSNUM);
+    usbip_put_u32(&out[292], info.dev_addr);
+    usbip_put_u32(&out[296], info.speed + 1);  // Linux counts from USB_SPEED_UNKNOWN
+    usbip_put_u16(&out[300], dev_desc->idVendor);
+    usbip_put_u16(&out[302], dev_desc->idProduct);
+    usbip_put_u16(&out[304], dev_desc->bcdDevice);
+    out[306] = dev_desc->bDeviceClass;
+    out[307] = dev_desc->bDeviceSubClass;
+    out[308] = dev_desc->bDeviceProtocol;
+    out[309] = config->bConfigurationValue;
+    out[310] = dev_desc->bNumConfigurations;
+    out[311] = config->bNumInterfaces;
+    if (config_ret != NULL) {
+        *config_ret = config;
+    }
+    return ESP_OK;
+}
+
+typedef struct {
+    const char *busid;
+    uint8_t *buf;
+    size_t len;
+    bool added;
+} usbip_devlist_t;
+
+// Adds a device and its interfaces to the devlist reply, runs under the printer registry lock
+static void usbip_devlist_add(usb_device_handle_t dev_hdl, void *arg) {
+    usbip_devlist_t *list = (usbip_devlist_t *)arg;
+    const usb_config_desc_t *config;
+    if (usbip_describe(dev_hdl, list->busid, &list->buf[list->len], &config) != ESP_OK) {
+        return;
+    }
+    list->len += USBIP_DEVICE_SIZE;
+    for (uint8_t intf = 0; intf < config->bNumInterfaces; intf++) {
+        int offset = 0;
+        const usb_intf_desc_t *intf_desc = usb_parse_interface_descriptor(config, intf, 0, &offset);
+        uint8_t *out = &list->buf[list->len];
+        memset(out, 0, USBIP_INTERFACE_SIZE);
+        if (intf_desc != NULL) {
+            out[0] = intf_desc->bInterfaceClass;
+            out[1] = intf_desc->bInterfaceSubClass;
+            out[2] = intf_desc->bInterfaceProtocol;
+        }
+        list->len += USBIP_INTERFACE_SIZE;
+    }
+    list->added = true;
+}
+
+static void usbip_send_devlist(int sock) {
+    printer_info_t printers[PRINTER_MAX_COUNT];
+    int num_printers = printer_handler_list(printers, PRINTER_MAX_COUNT);
+    size_t size = USBIP_OP_HEADER_SIZE + 4 + num_printers * (USBIP_DEVICE_SIZE + 32 * USBIP_INTERFACE_SIZE);
+    uint8_t *buf = calloc(1, size);
+    if (buf == NULL) {
+        return;
+    }
+
+    usbip_devlist_t list = {
+        .buf = buf,
+        .len = USBIP_OP_HEADER_SIZE + 4,
+    };
+    uint32_t count = 0;
+    for (int i = 0; i < num_printers; i++) {
+        char busid[USBIP_BUSID_LEN];
+        strlcpy(busid, printers[i].id, sizeof(busid));
+        list.busid = busid;
+        list.added = false;
+        printer_handler_with_device(printers[i].id, usbip_devlist_add, &list);
+        count += list.added ? 1 : 0;
+    }
+    usbip_put_u16(&buf[0], USBIP_VERSION);
+    usbip_put_u16(&buf[2], USBIP_OP_REP_DEVLIST);
+    usbip_put_u32(&buf[8], count);
+    send(sock, buf, list.len, 0);
+    free(buf);
+}
+
+// Transfers complete on the class driver task, the reply task takes it from here
+static void usbip_transfer_callback(usb_transfer_t *transfer) {
+    usbip_urb_t *urb = (usbip_urb_t *)transfer->context;
+    uint8_t index = urb - urb->session->urbs;
+    xQueueSend(urb->session->done_urbs, &index, 0);
+}
+
+static void usbip_session_gone(void *arg) {
+    usbip_session_t *s = (usbip_session_t *)arg;
+    s->gone = true;
+}
+
+static int32_t usbip_transfer_status(usb_transfer_status_t status) {
+    switch (status) {
+    case USB_TRANSFER_STATUS_COMPLETED:
+        return 0;
+    case USB_TRANSFER_STATUS_STALL:
+        return -USBIP_EPIPE;
+    case USB_TRANSFER_STATUS_NO_DEVICE:
+        return -USBIP_ENODEV;
+    case USB_TRANSFER_STATUS_CANCELED:
+        return -USBIP_ECONNRESET;
+    case USB_TRANSFER_STATUS_TIMED_OUT:
+        return -USBIP_ETIMEDOUT;
+    case USB_TRANSFER_STATUS_OVERFLOW:
+        return -USBIP_EOVERFLOW;
+    default:
+        return -USBIP_EPROTO;
+    }
+}
+
+// Claims an interface for the session in its current alternate setting
+// Interfaces the printer handler has claimed already are shared, it doesn't use them while exported
+static void usbip_claim(usbip_session_t *s, uint8_t intf) {
+    if (intf >= USBIP_MAX_INTERFACES || (s->claimed & (1 << intf))) {
+        return;
+    }
+    if (usb_host_interface_claim(s->client_hdl, s->dev_hdl, intf, s->alt[intf]) == ESP_OK) {
+        s->claimed |= 1 << intf;
+    }
+}
+
+// Finds the interface of an endpoint and claims it, returns the endpoint's MPS or 0 if there is none
+static uint16_t usbip_prepare_endpoint(usbip_session_t *s, uint8_t ep) {
+    for (uint8_t intf = 0; intf < s->config->bNumInterfaces && intf < USBIP_MAX_INTERFACES; intf++) {
+        int offset = 0;
+        const usb_intf_desc_t *intf_desc = usb_parse_interface_descriptor(s->config, intf, s->alt[intf], &offset);
+        if (intf_desc == NULL) {
+            continue;
+        }
+        for (int i = 0; i < intf_desc->bNumEndpoints; i++) {
+            int ep_offset = offset;
+            const usb_ep_desc_t *ep_desc = usb_parse_endpoint_descriptor_by_index(intf_desc, i, s->config->wTotalLength,
+                                                                                  &ep_offset);
+            if (ep_desc != NULL && ep_desc->bEndpointAddress == ep) {
+                usbip_claim(s, intf);
+                return USB_EP_DESC_GET_MPS(ep_desc);
+            }
+        }
+    }
+    return 0;
+}
+
+// Handles the standard requests the host library owns, returns false if the request goes to the device
+static bool usbip_intercept_control(usbip_session_t *s, const usb_setup_packet_t *setup, int32_t *status) {
+    if (setup->bmRequestType == (USB_BM_REQUEST_TYPE_DIR_OUT | USB_BM_REQUEST_TYPE_RECIP_DEVICE)
+        && setup->bRequest == USB_B_REQUEST_SET_CONFIGURATION) {
+        // The configuration can't change under the host library, selecting the active one is fine
+        *status = setup->wValue == s->config->bConfigurationValue ? 0 : -USBIP_EPIPE;
+        return true;
+    }
+    if (setup->bmRequestType == (USB_BM_REQUEST_TYPE_DIR_OUT | USB_BM_REQUEST_TYPE_RECIP_INTERFACE)
+        && setup->bRequest == USB_B_REQUEST_SET_INTERFACE && setup->wIndex < USBIP_MAX_INTERFACES) {
+        // The endpoints of the new alternate setting only exist once it is claimed
+        uint8_t intf = setup->wIndex;
+        if (s->claimed & (1 << intf)) {
+            usb_host_interface_release(s->client_hdl, s->dev_hdl, intf);
+            s->claimed &= ~(1 << intf);
+        }
+        s->alt[intf] = setup->wValue;
+        usbip_claim(s, intf);
+    }
+    return false;
+}
+
+static void usbip_complete_local(usbip_session_t *s, uint8_t index, int32_t status) {
+    s->urbs[index].local = true;
+    s->urbs[index].status = status;
+    xQueueSend(s->done_urbs, &index, 0);
+}
+
+// Handles CMD_SUBMIT, returns false once the connection is broken
+static bool usbip_submit(usbip_session_t *s, const uint8_t *hdr) {
+    bool in = usbip_get_u32(&hdr[12]) == USBIP_DIR_IN;
+    uint8_t ep = (usbip_get_u32(&hdr[16]) & 0x0F) | (in ? 0x80 : 0x00);
+    uint32_t length = usbip_get_u32(&hdr[24]);
+    uint32_t packets = usbip_get_u32(&hdr[32]);
+    bool control = (ep & 0x0F) == 0;
+
+    // Waiting for a free slot stops reading the socket, which throttles the host
+    xSemaphoreTake(s->free_urbs, portMAX_DELAY);
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    uint8_t index = 0;
+    while (s->urbs[index].in_use) {
+        index++;
+    }
+    usbip_urb_t *urb = &s->urbs[index];
+    urb->in_use = true;
+    urb->local = false;
+    urb->unlinked = false;
+    urb->seqnum = usbip_get_u32(&hdr[4]);
+    urb->ep = ep;
+    urb->length = length;
+    s->submitted++;
+    s->in_flight++;
+    if (s->in_flight > s->max_in_flight) {
+        s->max_in_flight = s->in_flight;
+    }
+    xSemaphoreGive(s->lock);
+
+    int32_t status = 0;
+    size_t size = length;
+    if (control) {
+        size += USB_SETUP_PACKET_SIZE;
+    } else {
+        uint16_t mps = usbip_prepare_endpoint(s, ep);
+        if (mps == 0) {
+            status = -USBIP_EPIPE;
+        } else if (in) {
+            size = (length + mps - 1) / mps * mps;  // IN transfers must be whole packets
+        }
+    }
+    if (packets != 0 && packets != UINT32_MAX) {
+        status = -USBIP_EINVAL;     // Isochronous, no printer needs it
+    } else if (length > USBIP_MAX_URB_SIZE) {
+        status = -USBIP_EOVERFLOW;
+    }
+    if (status == 0 && (urb->transfer == NULL || urb->transfer->data_buffer_size < size)) {
+        if (urb->transfer != NULL) {
+            usb_host_transfer_free(urb->transfer);
+            urb->transfer = NULL;
+        }
+        if (usb_host_transfer_alloc(size, 0, &urb->transfer) != ESP_OK) {
+            status = -USBIP_ENOMEM;
+        }
+    }
+
+    // OUT data follows the header and is read even for a failed URB, to stay in step
+    if (!in && length > 0) {
+        if (status == 0) {
+            uint8_t *dst = &urb->transfer->data_buffer[control ? USB_SETUP_PACKET_SIZE : 0];
+            if (!usbip_recv_all(s->sock, dst, length, &s->gone)) {
+                usbip_complete_local(s, index, -USBIP_ECONNRESET);
+                return false;
+            }
+        } else {
+            uint8_t discard[64];
+            for (uint32_t left = length; left > 0;) {
+                uint32_t n = left < sizeof(discard) ? left : sizeof(discard);
+                if (!usbip_recv_all(s->sock, discard, n, &s->gone)) {
+                    usbip_complete_local(s, index, status);
+                    return false;
+                }
+                left -= n;
+            }
+        }
+    }
+    if (status != 0) {
+        usbip_complete_local(s, index, status);
+        return true;
+    }
+
+    usb_transfer_t *transfer = urb->transfer;
+    transfer->num_bytes = size;
+    transfer->device_handle = s->dev_hdl;
+    transfer->bEndpointAddress = ep;
+    transfer->callback = usbip_transfer_callback;
+    transfer->context = urb;
+    transfer->timeout_ms = 0;
+    esp_err_t ret;
+    if (control) {
+        memcpy(transfer->data_buffer, &hdr[40], USB_SETUP_PACKET_SIZE);
+        if (usbip_intercept_control(s, (const usb_setup_packet_t *)transfer->data_buffer, &status)) {
+            usbip_complete_local(s, index, status);
+            return true;
+        }
+        ret = usb_host_transfer_submit_control(s->client_hdl, transfer);
+    } else {
+        ret = usb_host_transfer_submit(transfer);
+    }
+    if (ret != ESP_OK) {
+        usbip_complete_local(s, index, s->gone ? -USBIP_ENODEV : -USBIP_EPIPE);
+    } else if (!in) {
+        s->bytes_out += length;
+    }
+    return true;
+}
+
+// Handles CMD_UNLINK
+// Transfers can't be cancelled one by one, so the whole endpoint is flushed. Hosts unlink all
+// URBs of an endpoint together anyway. Control transfers run to completion, unreported.
+static void usbip_unlink(usbip_session_t *s, uint32_t seqnum, uint32_t target) {
+    int32_t status = 0;
+    uint8_t ep = 0;
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    for (int i = 0; i < USBIP_MAX_URBS; i++) {
+        usbip_urb_t *urb = &s->urbs[i];
+        if (urb->in_use && !urb->unlinked && urb->seqnum == target) {
+            urb->unlinked = true;
+            ep = urb->ep;
+            status = -USBIP_ECONNRESET;
+            s->unlinked++;
+        }
+    }
+    xSemaphoreGive(s->lock);
+    if (status != 0 && (ep & 0x0F) != 0) {
+        usb_host_endpoint_halt(s->dev_hdl, ep);
+        usb_host_endpoint_flush(s->dev_hdl, ep);
+        usb_host_endpoint_clear(s->dev_hdl, ep);
+    }
+
+    uint8_t hdr[USBIP_HEADER_SIZE] = {0};
+    usbip_put_u32(&hdr[0], USBIP_RET_UNLINK);
+    usbip_put_u32(&hdr[4], seqnum);
+    usbip_put_u32(&hdr[20], status);
+    xSemaphoreTake(s->send_lock, portMAX_DELAY);
+    send(s->sock, hdr, sizeof(hdr), 0);
+    xSemaphoreGive(s->send_lock);
+}
+
+// Sends RET_SUBMIT for every completed URB and frees its slot
+static void usbip_reply_task(void *arg) {
+    usbip_session_t *s = (usbip_session_t *)arg;
+    uint8_t index;
+
+    while (xQueueReceive(s->done_urbs, &index, portMAX_DELAY) == pdTRUE && index != USBIP_STOP) {
+        usbip_urb_t *urb = &s->urbs[index];
+        usb_transfer_t *transfer = urb->transfer;
+        bool control = (urb->ep & 0x0F) == 0;
+        bool in = (urb->ep & 0x80) != 0;
+        int32_t status = urb->status;
+        const uint8_t *data = NULL;
+        size_t actual = 0;
+        if (!urb->local) {
+            status = usbip_transfer_status(transfer->status);
+            data = &transfer->data_buffer[control ? USB_SETUP_PACKET_SIZE : 0];
+            actual = transfer->actual_num_bytes;
+            if (control) {
+                actual = actual > USB_SETUP_PACKET_SIZE ? actual - USB_SETUP_PACKET_SIZE : 0;
+            }
+            if (actual > urb->length) {
+                actual = urb->length;
+            }
+            // A halt the device cleared has to be cleared in the host library as well
+            const usb_setup_packet_t *setup = (const usb_setup_packet_t *)transfer->data_buffer;
+            if (control && status == 0 && setup->bmRequestType == USB_BM_REQUEST_TYPE_RECIP_ENDPOINT
+                && setup->bRequest == USB_B_REQUEST_CLEAR_FEATURE && setup->wValue == USB_W_VALUE_FEATURE_ENDPOINT_HALT) {
+                usb_host_endpoint_clear(s->dev_hdl, setup->wIndex & 0xFF);
+            }
+        }
+
+        xSemaphoreTake(s->lock, portMAX_DELAY);
+        bool unlinked = urb->unlinked;
+        if (in) {
+            s->bytes_in += actual;
+        }
+        xSemaphoreGive(s->lock);
+
+        if (!unlinked) {
+            uint8_t hdr[USBIP_HEADER_SIZE] = {0};
+            size_t data_len = in ? actual : 0;
+            usbip_put_u32(&hdr[0], USBIP_RET_SUBMIT);
+            usbip_put_u32(&hdr[4], urb->seqnum);
+            usbip_put_u32(&hdr[20], status);
+            usbip_put_u32(&hdr[24], actual);
+            xSemaphoreTake(s->send_lock, portMAX_DELAY);
+            send(s->sock, hdr, sizeof(hdr), data_len > 0 ? MSG_MORE : 0);
+            if (data_len > 0) {
+                send(s->sock, data, data_len, 0);
+            }
+            xSemaphoreGive(s->send_lock);
+        }
+
+        // The slot is only reused once the reply is out of its buffer
+        xSemaphoreTake(s->lock, portMAX_DELAY);
+        urb->in_use = false;
+        s->in_flight--;
+        xSemaphoreGive(s->lock);
+        xSemaphoreGive(s->free_urbs);
+    }
+
+    xTaskNotifyGive(s->receive_task);
+    vTaskDelete(NULL);
+}
+
+// Cancels what is still in flight and gives the printer back
+static void usbip_session_end(usbip_session_t *s) {
+    uint8_t eps[USBIP_MAX_URBS];
+    int num_eps = 0;
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    for (int i = 0; i < USBIP_MAX_URBS; i++) {
+        usbip_urb_t *urb = &s->urbs[i];
+        if (!urb->in_use) {
+            continue;
+        }
+        urb->unlinked = true;
+        bool listed = (urb->ep & 0x0F) == 0;
+        for (int e = 0; e < num_eps && !listed; e++) {
+            listed = eps[e] == urb->ep;
+        }
+        if (!listed) {
+            eps[num_eps++] = urb->ep;
+        }
+    }
+    xSemaphoreGive(s->lock);
+    for (int e = 0; e < num_eps; e++) {
+        usb_host_endpoint_halt(s->dev_hdl, eps[e]);
+        usb_host_endpoint_flush(s->dev_hdl, eps[e]);
+    }
+
+    // Every slot comes back through the reply task, control transfers finish on their own
+    bool returned = true;
+    for (int i = 0; i < USBIP_MAX_URBS && returned; i++) {
+        returned = xSemaphoreTake(s->free_urbs, USBIP_CANCEL_TIMEOUT) == pdTRUE;
+    }
+    for (int e = 0; e < num_eps; e++) {
+        usb_host_endpoint_clear(s->dev_hdl, eps[e]);
+    }
+    for (uint8_t intf = 0; intf < USBIP_MAX_INTERFACES; intf++) {
+        if (s->claimed & (1 << intf)) {
+            usb_host_interface_release(s->client_hdl, s->dev_hdl, intf);
+        }
+    }
+    printer_handler_export_end(s->printer_id);
+
+    ESP_LOGI(TAG, "%s released by %s: %" PRIu32 " URBs (%" PRIu32 " unlinked), %" PRIu64 " bytes out, %" PRIu64
+             " bytes in, up to %" PRIu32 " in flight", s->printer_id, s->peer, s->submitted, s->unlinked,
+             s->bytes_out, s->bytes_in, s->max_in_flight);
+
+    if (!returned) {
+        // The host library still owns a transfer whose callback uses the session, so it stays allocated
+        ESP_LOGE(TAG, "URBs of %s did not come back, leaking the session", s->printer_id);
+        return;
+    }
+    uint8_t stop = USBIP_STOP;
+    xQueueSend(s->done_urbs, &stop, portMAX_DELAY);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    for (int i = 0; i < USBIP_MAX_URBS; i++) {
+        if (s->urbs[i].transfer != NULL) {
+            usb_host_transfer_free(s->urbs[i].transfer);
+        }
+    }
+    vQueueDelete(s->done_urbs);
+    vSemaphoreDelete(s->free_urbs);
+    vSemaphoreDelete(s->lock);
+    vSemaphoreDelete(s->send_lock);
+    free(s);
+}
+
+static usbip_session_t *usbip_session_create(int sock, const char *peer) {
+    usbip_session_t *s = calloc(1, sizeof(usbip_session_t));
+    if (s == NULL) {
+        return NULL;
+    }
+    s->sock = sock;
+    strlcpy(s->peer, peer, sizeof(s->peer));
+    s->receive_task = xTaskGetCurrentTaskHandle();
+    s->done_urbs = xQueueCreate(USBIP_MAX_URBS + 1, sizeof(uint8_t));
+    s->free_urbs = xSemaphoreCreateCounting(USBIP_MAX_URBS, USBIP_MAX_URBS);
+    s->lock = xSemaphoreCreateMutex();
+    s->send_lock = xSemaphoreCreateMutex();
+    for (int i = 0; i < USBIP_MAX_URBS; i++) {
+        s->urbs[i].session = s;
+    }
+    if (s->done_urbs == NULL || s->free_urbs == NULL || s->lock == NULL || s->send_lock == NULL) {
+        if (s->done_urbs != NULL) {
+            vQueueDelete(s->done_urbs);
+        }
+        if (s->free_urbs != NULL) {
+            vSemaphoreDelete(s->free_urbs);
+        }
+        if (s->lock != NULL) {
+            vSemaphoreDelete(s->lock);
+        }
+        if (s->send_lock != NULL) {
+            vSemaphoreDelete(s->send_lock);
+        }
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+// Imports a printer and runs its URB stream until the host detaches or the printer goes away
+static void usbip_handle_import(int sock, const char *peer) {
+    char busid[USBIP_BUSID_LEN];
+    if (!usbip_recv_all(sock, busid, sizeof(busid), NULL)) {
+        return;
+    }
+    busid[sizeof(busid) - 1] = '\0';
+
+    printer_info_t printers[PRINTER_MAX_COUNT];
+    int num_printers = printer_handler_list(printers, PRINTER_MAX_COUNT);
+    const char *printer_id = NULL;
+    for (int i = 0; i < num_printers && printer_id == NULL; i++) {
+        if (strncmp(printers[i].id, busid, USBIP_BUSID_LEN - 1) == 0) {
+            printer_id = printers[i].id;
+        }
+    }
+
+    usbip_session_t *s = printer_id != NULL ? usbip_session_create(sock, peer) : NULL;
+    esp_err_t ret = s != NULL ? ESP_OK : ESP_ERR_NOT_FOUND;
+    if (s != NULL) {
+        strlcpy(s->printer_id, printer_id, sizeof(s->printer_id));
+        ret = printer_handler_export_begin(printer_id, usbip_session_gone, s, &s->dev_hdl, &s->client_hdl);
+    }
+    uint8_t reply[USBIP_OP_HEADER_SIZE + USBIP_DEVICE_SIZE] = {0};
+    usbip_put_u16(&reply[0], USBIP_VERSION);
+    usbip_put_u16(&reply[2], USBIP_OP_REP_IMPORT);
+    if (ret == ESP_OK && usbip_describe(s->dev_hdl, busid, &reply[USBIP_OP_HEADER_SIZE], &s->config) != ESP_OK) {
+        printer_handler_export_end(s->printer_id);
+        ret = ESP_FAIL;
+    }
+    if (ret == ESP_OK && xTaskCreate(usbip_reply_task, "usbip_reply", USBIP_REPLY_TASK_STACK, s,
+                                     USBIP_SERVER_TASK_PRIORITY, NULL) != pdTRUE) {
+        printer_handler_export_end(s->printer_id);
+        ret = ESP_ERR_NO_MEM;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Import of %s by %s refused: %s", busid, peer, esp_err_to_name(ret));
+        usbip_put_u32(&reply[4], 1);
+        send(sock, reply, USBIP_OP_HEADER_SIZE, 0);
+        if (s != NULL) {
+            vQueueDelete(s->done_urbs);
+            vSemaphoreDelete(s->free_urbs);
+            vSemaphoreDelete(s->lock);
+            vSemaphoreDelete(s->send_lock);
+            free(s);
+        }
+        return;
+    }
+    send(sock, reply, sizeof(reply), 0);
+    ESP_LOGI(TAG, "%s imported by %s", s->printer_id, peer);
+
+    // From here on the connection carries URBs
+    struct timeval timeout = {
+        .tv_sec = USBIP_POLL_TIMEOUT_S,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    uint8_t hdr[USBIP_HEADER_SIZE];
+    while (!s->gone && usbip_recv_all(sock, hdr, sizeof(hdr), &s->gone)) {
+        uint32_t command = usbip_get_u32(&hdr[0]);
+        if (command == USBIP_CMD_SUBMIT) {
+            if (!usbip_submit(s, hdr)) {
+                break;
+            }
+        } else if (command == USBIP_CMD_UNLINK) {
+            usbip_unlink(s, usbip_get_u32(&hdr[4]), usbip_get_u32(&hdr[20]));
+        } else {
+            ESP_LOGW(TAG, "Unknown command %" PRIu32 " from %s", command, peer);
+            break;
+        }
+    }
+    if (s->gone) {
+        ESP_LOGW(TAG, "%s unplugged while imported by %s", s->printer_id, peer);
+    }
+    usbip_session_end(s);
+}
+
+// Serves one connection: a device list, or an imported printer for as long as the host keeps it
+static void usbip_client_task(void *arg) {
+    usbip_conn_t *conn = (usbip_conn_t *)arg;
+    uint8_t op[USBIP_OP_HEADER_SIZE];
+    if (usbip_recv_all(conn->sock, op, sizeof(op), NULL)) {
+        uint16_t code = (op[2] << 8) | op[3];
+        if (code == USBIP_OP_REQ_DEVLIST) {
+            usbip_send_devlist(conn->sock);
+        } else if (code == USBIP_OP_REQ_IMPORT) {
+            usbip_handle_import(conn->sock, conn->peer);
+        } else {
+            ESP_LOGW(TAG, "Unknown request 0x%04x from %s", code, conn->peer);
+        }
+    }
+    shutdown(conn->sock, SHUT_RDWR);
+    close(conn->sock);
+    net_admission_release(USBIP_CONN_COST, TAG, conn->peer);
+    free(conn);
+    vTaskDelete(NULL);
+}
+
+static void usbip_server_task(void *arg) {
+    uint16_t port = (uint16_t)(uintptr_t)arg;
+    int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (listen_sock < 0) {
+        ESP_LOGE(TAG, "Unable to start the server");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    int opt = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || listen(listen_sock, NET_ADMISSION_BACKLOG) != 0) {
+        ESP_LOGE(TAG, "Unable to listen on port %d: errno %d", port, errno);
+        close(listen_sock);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG, "Listening on port %d", port);
+
+    while (1) {
+        struct sockaddr_in peer_addr;
+        bool busy;
+        int sock = net_admission_accept(listen_sock, USBIP_CONN_COST, &peer_addr, &busy);
+        if (sock < 0) {
+            ESP_LOGE(TAG, "Accept failed: errno %d", errno);
+            continue;
+        }
+        if (busy) {
+            // usbip reports a closed connection as an error and the user tries again
+            close(sock);
+            continue;
+        }
+        usbip_conn_t *conn = malloc(sizeof(usbip_conn_t));
+        if (conn == NULL) {
+            close(sock);
+            net_admission_release(USBIP_CONN_COST, TAG, "unknown");
+            continue;
+        }
+        struct timeval timeout = {
+            .tv_sec = USBIP_OP_TIMEOUT_S,
+        };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        // URBs are small and latency bound, and a vanished host must not hold the printer forever
+        int keepalive_idle = 30;
+        int keepalive_interval = 5;
+        int keepalive_count = 3;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &opt, sizeof(opt));
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &keepalive_idle, sizeof(keepalive_idle));
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepalive_interval, sizeof(keepalive_interval));
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepalive_count, sizeof(keepalive_count));
+
+        conn->sock = sock;
+        inet_ntop(AF_INET, &peer_addr.sin_addr, conn->peer, sizeof(conn->peer));
+
+        // An imported printer keeps its connection for as long as the host uses it, so every
+        // connection runs on its own task and the next host is served meanwhile
+        if (xTaskCreate(usbip_client_task, "usbip_client", USBIP_SERVER_TASK_STACK, conn,
+                        USBIP_SERVER_TASK_PRIORITY, NULL) != pdTRUE) {
+            close(sock);
+            net_admission_release(USBIP_CONN_COST, TAG, conn->peer);
+            free(conn);
+        }
+    }
+}
+
+esp_err_t usbip_server_start(uint16_t port) {
+    BaseType_t task_created = xTaskCreate(usbip_server_task, "usbip_server", USBIP_SERVER_TASK_STACK,
+                                          (void *)(uintptr_t)port, USBIP_SERVER_TASK_PRIORITY, NULL);
+    return task_created == pdTRUE ? ESP_OK : ESP_ERR_NO_MEM;
+}
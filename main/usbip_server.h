@@ -0,0 +1,19 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Ilias Dimopoulos
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// USB/IP server, exports attached printers to remote hosts (usbip attach -r <bridge> -b <busid>)
+// The bus ID is the printer's registry ID cut to 31 characters. While a host has a printer
+// imported, its URBs run on the printer's endpoints with several in flight to hide the
+// network round trip, and local print jobs for it are refused. Each printer can be
+// imported by one host at a time, hosts importing different printers are served in parallel.
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Starts the server task listening on port
+esp_err_t usbip_server_start(uint16_t port);